@@ -244,6 +244,73 @@ document.addEventListener('DOMContentLoaded', () => {
         });
     }
 
+    // Console output that grows as chunks arrive. Appended text is batched
+    // into one DOM update per frame, and only the last CONSOLE_MAX_CHARS are
+    // kept, so a program that prints a lot doesn't freeze the page.
+    const CONSOLE_MAX_CHARS = 1000000;
+
+    class ConsoleStream {
+        constructor(element) {
+            this.element = element;
+            this.element.textContent = '';
+            this.pending = '';
+            this.length = 0;
+            this.empty = true;
+            this.frame = null;
+        }
+
+        append(text) {
+            if (!text) return;
+            this.empty = false;
+            this.pending += text;
+            if (this.frame === null) this.frame = requestAnimationFrame(() => this.flush());
+        }
+
+        flush() {
+            this.frame = null;
+            if (!this.pending) return;
+            this.element.appendChild(document.createTextNode(this.pending));
+            this.length += this.pending.length;
+            this.pending = '';
+            if (this.length > CONSOLE_MAX_CHARS) {
+                const kept = this.element.textContent.slice(-CONSOLE_MAX_CHARS / 2);
+                this.element.textContent = '... (earlier output trimmed)\n' + kept;
+                this.length = this.element.textContent.length;
+            }
+            this.element.scrollTop = this.element.scrollHeight;
+        }
+
+        finish(banner, placeholder) {
+            if (this.empty) this.append(placeholder);
+            this.append('\n' + banner + '\n');
+            if (this.frame !== null) cancelAnimationFrame(this.frame);
+            this.flush();
+        }
+    }
+
+    // Parse a text/event-stream body, calling onEvent(name, data) per event
+    async function readEvents(body, onEvent) {
+        const reader = body.pipeThrough(new TextDecoderStream()).getReader();
+        let buffer = '';
+        for (;;) {
+            const { value, done } = await reader.read();
+            if (done) break;
+            buffer += value;
+            let end;
+            while ((end = buffer.indexOf('\n\n')) !== -1) {
+                const block = buffer.slice(0, end);
+                buffer = buffer.slice(end + 2);
+                let event = 'message';
+                let data = '';
+                for (const line of block.split('\n')) {
+                    if (line.startsWith('event: ')) event = line.slice(7);
+                    else if (line.startsWith('data: ')) data += line.slice(6);
+                }
+                onEvent(event, data ? JSON.parse(data) : {});
+            }
+        }
+    }
+
     // Run Code
     btnRun.addEventListener('click', async () => {
         if (isRunning) return;
@@ -275,27 +342,32 @@ document.addEventListener('DOMContentLoaded', () => {
         statusMessage.textContent = 'Running...';
 
         try {
-            const response = await fetch('/api/run', {
+            // Output is shown as the program prints it (Server-Sent Events)
+            const response = await fetch('/api/run/stream', {
                 method: 'POST',
                 headers: { 'Content-Type': 'application/json' },
                 body: JSON.stringify({ code, inputs: userInputs })
             });
+            if (!response.ok || !response.body) throw new Error(`HTTP ${response.status}`);
+
+            const output = new ConsoleStream(consoleOutput);
+            let exitCode = null;
+            await readEvents(response.body, (event, data) => {
+                if (event === 'stdout' || event === 'stderr') {
+                    output.append(data.text);
+                } else if (event === 'exit') {
+                    exitCode = data.exit_code;
+                }
+            });
 
-            const data = await response.json();
-            let output = '';
-
-            if (data.exit_code === 0) {
-                output += '=== SUCCESS ===\n';
-                output += data.stdout || 'Program executed successfully';
+            if (exitCode === 0) {
+                output.finish('=== SUCCESS ===', 'Program executed successfully');
                 statusMessage.textContent = 'Execution complete';
             } else {
-                output += '=== ERROR ===\n';
-                output += data.stderr || 'Unknown error';
-                if (data.stdout) output += '\n\n=== OUTPUT ===\n' + data.stdout;
-                statusMessage.textContent = 'Compilation error';
+                output.finish(exitCode === null ? '=== ERROR (connection lost) ===' : `=== ERROR (exit code ${exitCode}) ===`,
+                              'Unknown error');
+                statusMessage.textContent = exitCode === null ? 'Server error' : 'Execution failed';
             }
-
-            consoleOutput.textContent = output;
         } catch (error) {
             consoleOutput.textContent = 'Error: Cannot connect to server\n' + error.message;
             statusMessage.textContent = 'Server error';
@@ -10,6 +10,13 @@ import subprocess
 import os
 import json
 import tempfile
+import urllib.request
+import urllib.error
+import hashlib
+import threading
+import time
+import queue
+import codecs
 
 import cgi
 import shutil
@@ -22,9 +29,275 @@ KOTHA_BIN = os.path.abspath(os.path.join(os.path.dirname(__file__), "../kotha/ko
 # Path to example Kotha files
 KOTHA_EXAMPLES = os.path.abspath(os.path.join(os.path.dirname(__file__), "../kotha"))
 
+# Optional 'kotha serve' daemon (e.g. http://127.0.0.1:8090); when set,
+# /api/run is forwarded to it and runs on the VM without a C compile
+KOTHA_SERVE_URL = os.environ.get("KOTHA_SERVE_URL", "")
+
+# Build cache: compiled programs by hash of source, compiler and flags
+KOTHA_CACHE_DIR = os.environ.get("KOTHA_CACHE_DIR", os.path.join(os.path.expanduser("~"), ".cache", "kotha-ide"))
+KOTHA_CACHE_MAX_MB = int(os.environ.get("KOTHA_CACHE_MAX_MB", "256"))
+
 # Change to server directory
 os.chdir(os.path.dirname(os.path.abspath(__file__)))
 
+def run_on_daemon(post_data):
+    """Forward a run request to the daemon; None if it is unreachable"""
+    try:
+        request = urllib.request.Request(
+            KOTHA_SERVE_URL.rstrip('/') + "/run",
+            data=post_data,
+            headers={'Content-Type': 'application/json'}
+        )
+        with urllib.request.urlopen(request, timeout=15) as reply:
+            return json.loads(reply.read().decode('utf-8'))
+    except urllib.error.HTTPError as error:
+        if error.code == 504:
+            # The run overran its time limit; running it again here would too
+            return {"stdout": "", "stderr": "Time limit exceeded\n", "exit_code": 1,
+                    "status": "limit exceeded"}
+        return None
+    except Exception:
+        return None
+
+class BuildCache:
+    """Content-addressed cache of Kotha -> C -> executable builds.
+
+    Entries live in <dir>/<key>/ (program.kotha, program.c, program and
+    result.json) and are keyed by a hash of the source, the compiler and
+    runtime files, the gcc version and the gcc command line, so a new
+    compiler build never reuses old entries. Compile errors are cached too.
+    Identical builds requested at the same time run once; the others wait
+    for it. Least recently used entries are evicted past the size limit.
+    """
+
+    VERSION = "2"
+    EVICT_GRACE_S = 60  # Entries used this recently are kept (they may be running)
+
+    def __init__(self, directory, max_bytes):
+        self.directory = directory
+        self.max_bytes = max_bytes
+        self.lock = threading.Lock()
+        self.building = {}  # key -> threading.Event, while a build runs
+        self.gcc_version = None
+        self.hits = 0
+        self.misses = 0
+        os.makedirs(directory, exist_ok=True)
+
+    def _runtime(self):
+        """Header and library of the C runtime (make builds them with kotha)"""
+        kotha_dir = os.path.dirname(KOTHA_BIN)
+        return [os.path.join(kotha_dir, name) for name in ('kotha_rt.h', 'libkotha_rt.a')]
+
+    def _gcc_command(self, c_file, exe):
+        header, library = self._runtime()
+        return ['gcc', c_file, '-I', os.path.dirname(header), '-o', exe, library, '-lm']
+
+    def _fingerprint(self):
+        if self.gcc_version is None:
+            try:
+                self.gcc_version = subprocess.run(['gcc', '--version'], capture_output=True,
+                                                  text=True, timeout=10).stdout.split('\n')[0]
+            except Exception:
+                self.gcc_version = ""
+        parts = [self.VERSION, self.gcc_version]
+        for path in [KOTHA_BIN] + self._runtime():
+            try:
+                info = os.stat(path)
+            except OSError:
+                continue  # The build will report it
+            parts.append(f"{path}:{info.st_size}:{info.st_mtime_ns}")
+        return '\0'.join(parts)
+
+    def key(self, code):
+        flags = ' '.join(self._gcc_command('program.c', 'program'))
+        digest = hashlib.sha256()
+        for part in (self._fingerprint(), flags, code):
+            digest.update(part.encode('utf-8'))
+            digest.update(b'\0')
+        return digest.hexdigest()
+
+    def _load(self, key):
+        entry = os.path.join(self.directory, key)
+        try:
+            with open(os.path.join(entry, 'result.json')) as f:
+                result = json.load(f)
+        except (OSError, ValueError):
+            return None
+        os.utime(entry)  # Recently used
+        if result.get('exit_code') == 0:
+            result['exe'] = os.path.join(entry, 'program')
+        return result
+
+    def _build(self, key, code):
+        """Compile into a private directory, then publish it by renaming"""
+        work = tempfile.mkdtemp(prefix='build-', dir=self.directory)
+        try:
+            source = os.path.join(work, 'program.kotha')
+            with open(source, 'w') as f:
+                f.write(code)
+
+            # Step 1: Compile Kotha to C
+            result = subprocess.run([KOTHA_BIN, source], capture_output=True, text=True, timeout=10)
+            if result.returncode != 0:
+                outcome = {"exit_code": result.returncode,
+                           "stderr": result.stderr or "Compilation failed"}
+            else:
+                # Step 2: Save C code to file
+                c_file = os.path.join(work, 'program.c')
+                with open(c_file, 'w') as f:
+                    f.write(result.stdout)
+
+                # Step 3: Compile C to executable against the Kotha runtime
+                compile_cmd = self._gcc_command(c_file, os.path.join(work, 'program'))
+                compile_result = subprocess.run(compile_cmd, capture_output=True, text=True, timeout=10)
+                if compile_result.returncode != 0:
+                    outcome = {"exit_code": compile_result.returncode,
+                               "stderr": f"C compilation error:\n{compile_result.stderr}"}
+                else:
+                    outcome = {"exit_code": 0, "stderr": ""}
+
+            with open(os.path.join(work, 'result.json'), 'w') as f:
+                json.dump(outcome, f)
+            try:
+                os.rename(work, os.path.join(self.directory, key))
+            except OSError:
+                pass  # Another server process published it first
+        finally:
+            if os.path.isdir(work):
+                shutil.rmtree(work, ignore_errors=True)
+
+    def get(self, code):
+        """Build result for 'code': {"exit_code", "stderr", "exe" if it built}"""
+        key = self.key(code)
+        while True:
+            result = self._load(key)
+            if result is not None:
+                with self.lock:
+                    self.hits += 1
+                return result
+
+            with self.lock:
+                pending = self.building.get(key)
+                if pending is None:
+                    pending = self.building[key] = threading.Event()
+                    owner = True
+                else:
+                    owner = False
+
+            if not owner:
+                # Someone is building the same program: use theirs
+                pending.wait()
+                continue
+
+            try:
+                with self.lock:
+                    self.misses += 1
+                self._build(key, code)
+            finally:
+                with self.lock:
+                    del self.building[key]
+                pending.set()
+            self.evict()
+
+            result = self._load(key)
+            if result is None:
+                raise RuntimeError("Build finished without a result")
+            return result
+
+    def evict(self):
+        """Drop least recently used entries until the cache fits"""
+        entries = []
+        total = 0
+        for name in os.listdir(self.directory):
+            path = os.path.join(self.directory, name)
+            if name.startswith('build-') or not os.path.isdir(path):
+                continue
+            size = sum(os.path.getsize(os.path.join(path, f)) for f in os.listdir(path))
+            entries.append((os.path.getmtime(path), size, path))
+            total += size
+
+        now = time.time()
+        for used, size, path in sorted(entries):
+            if total <= self.max_bytes:
+                break
+            if now - used < self.EVICT_GRACE_S:
+                continue
+            shutil.rmtree(path, ignore_errors=True)
+            total -= size
+
+
+BUILD_CACHE = BuildCache(KOTHA_CACHE_DIR, KOTHA_CACHE_MAX_MB * 1024 * 1024)
+
+# Streamed runs: pipe reads of at most STREAM_CHUNK bytes, at most
+# STREAM_QUEUE of them waiting to be sent
+STREAM_CHUNK = 16 * 1024
+STREAM_QUEUE = 64
+
+# Compiled programs print with stdio, which buffers fully into a pipe;
+# stdbuf makes them flush each line so it can be shown right away
+STDBUF = shutil.which('stdbuf')
+
+
+def stream_output(proc, emit, timeout):
+    """Pass proc's stdout and stderr to emit(stream, text) as it is written.
+
+    A reader thread per pipe feeds a bounded queue. When the client reads
+    slower than the program prints, the queue fills, the readers stop
+    reading, the pipes fill, and the program blocks on its next write, so
+    memory stays bounded however much it prints. Returns the exit code, or
+    None if the program was killed at the timeout.
+    """
+    chunks = queue.Queue(maxsize=STREAM_QUEUE)
+    stopped = threading.Event()
+
+    def reader(name, pipe):
+        decoder = codecs.getincrementaldecoder('utf-8')(errors='replace')
+        fd = pipe.fileno()
+        while True:
+            data = os.read(fd, STREAM_CHUNK)
+            text = decoder.decode(data, final=not data)
+            item = (name, text) if data else (name, text, None)
+            while not stopped.is_set():
+                try:
+                    chunks.put(item, timeout=0.1)
+                    break
+                except queue.Full:
+                    pass
+            if not data or stopped.is_set():
+                break
+        pipe.close()
+
+    readers = [threading.Thread(target=reader, args=(name, pipe), daemon=True)
+               for name, pipe in (('stdout', proc.stdout), ('stderr', proc.stderr))]
+    for thread in readers:
+        thread.start()
+
+    deadline = time.monotonic() + timeout
+    open_pipes = len(readers)
+    try:
+        while open_pipes > 0:
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                return None
+            try:
+                item = chunks.get(timeout=remaining)
+            except queue.Empty:
+                return None
+            if item[1]:
+                emit(item[0], item[1])
+            if len(item) == 3:
+                open_pipes -= 1
+        return proc.wait(timeout=max(deadline - time.monotonic(), 0.01))
+    except subprocess.TimeoutExpired:
+        return None
+    finally:
+        # Timed out, finished, or the client went away: make sure it's gone
+        stopped.set()
+        if proc.poll() is None:
+            proc.kill()
+            proc.wait()
+
+
 class KothaHandler(http.server.SimpleHTTPRequestHandler):
     def do_GET(self):
         # Serve example files from examples directory
@@ -236,6 +509,12 @@ class KothaHandler(http.server.SimpleHTTPRequestHandler):
                 self.send_error(500, str(e))
             return
 
+        if self.path == "/api/run/stream":
+            content_length = int(self.headers['Content-Length'])
+            data = json.loads(self.rfile.read(content_length).decode('utf-8'))
+            self.stream_run(data.get('code', ''), data.get('inputs', []))
+            return
+
         if self.path == "/api/run":
             content_length = int(self.headers['Content-Length'])
             post_data = self.rfile.read(content_length)
@@ -243,101 +522,42 @@ class KothaHandler(http.server.SimpleHTTPRequestHandler):
             code = data.get('code', '')
             inputs = data.get('inputs', [])  # Get pre-collected inputs
 
-            # Create temp file for Kotha code
-            with tempfile.NamedTemporaryFile(mode='w', suffix='.kotha', delete=False) as tmp:
-                tmp.write(code)
-                tmp_path = tmp.name
-
-            # Create input file if inputs provided
-            input_file = None
-            if inputs:
-                input_file = tmp_path.replace('.kotha', '.input')
-                with open(input_file, 'w') as f:
-                    f.write('\n'.join(str(inp) for inp in inputs) + '\n')
+            response = run_on_daemon(post_data) if KOTHA_SERVE_URL else None
+            if response is not None:
+                self.send_response(200)
+                self.send_header('Content-type', 'application/json')
+                self.send_header('Access-Control-Allow-Origin', '*')
+                self.end_headers()
+                self.wfile.write(json.dumps(response).encode('utf-8'))
+                return
 
             try:
-                # Step 1: Compile Kotha to C
-                result = subprocess.run(
-                    [KOTHA_BIN, tmp_path],  # Pass file path as argument
-                    capture_output=True,
-                    text=True,
-                    timeout=10
-                )
-                
-                if result.returncode != 0:
-                    # Compilation failed
+                # Steps 1-3 (Kotha -> C -> executable) come from the build cache
+                build = BUILD_CACHE.get(code)
+                if 'exe' not in build:
                     response = {
                         "stdout": "",
-                        "stderr": result.stderr or "Compilation failed",
-                        "exit_code": result.returncode
+                        "stderr": build['stderr'],
+                        "exit_code": build['exit_code']
                     }
                 else:
-                    # Step 2: Save C code to file
-                    c_file = tmp_path.replace('.kotha', '.c')
-                    with open(c_file, 'w') as f:
-                        f.write(result.stdout)
-                    
-                    # Step 3: Compile C to executable
-                    exe_file = tmp_path.replace('.kotha', '.out')
-                    
-                    # Add Kotha standard libraries
-                    kotha_dir = os.path.dirname(KOTHA_BIN)
-                    file_io_o = os.path.join(kotha_dir, 'file_io.o')
-                    string_lib_o = os.path.join(kotha_dir, 'string_lib.o')
-                    
-                    compile_cmd = ['gcc', c_file, '-o', exe_file]
-                    
-                    # Add standard libraries if they exist
-                    if os.path.exists(file_io_o):
-                        compile_cmd.insert(2, file_io_o)
-                    if os.path.exists(string_lib_o):
-                        compile_cmd.insert(2, string_lib_o)
-                    
-                    compile_result = subprocess.run(
-                        compile_cmd,
+                    # Step 4: Run the executable, with the inputs on stdin
+                    stdin_data = '\n'.join(str(inp) for inp in inputs) + '\n' if inputs else None
+                    run_result = subprocess.run(
+                        [build['exe']],
+                        input=stdin_data,
+                        stdin=None if inputs else subprocess.DEVNULL,
                         capture_output=True,
                         text=True,
                         timeout=10
                     )
-                    
-                    if compile_result.returncode != 0:
-                        response = {
-                            "stdout": "",
-                            "stderr": f"C compilation error:\n{compile_result.stderr}",
-                            "exit_code": compile_result.returncode
-                        }
-                    else:
-                        # Step 4: Run the executable
-                        # If we have inputs, redirect stdin from input file
-                        if input_file and os.path.exists(input_file):
-                            with open(input_file, 'r') as stdin_file:
-                                run_result = subprocess.run(
-                                    [exe_file],
-                                    stdin=stdin_file,
-                                    capture_output=True,
-                                    text=True,
-                                    timeout=10
-                                )
-                        else:
-                            run_result = subprocess.run(
-                                [exe_file],
-                                capture_output=True,
-                                text=True,
-                                timeout=10
-                            )
-                        
-                        response = {
-                            "stdout": run_result.stdout,
-                            "stderr": run_result.stderr,
-                            "exit_code": run_result.returncode
-                        }
-                    
-                    # Cleanup C and executable files
-                    if os.path.exists(c_file):
-                        os.unlink(c_file)
-                    if os.path.exists(exe_file):
-                        os.unlink(exe_file)
-                
+
+                    response = {
+                        "stdout": run_result.stdout,
+                        "stderr": run_result.stderr,
+                        "exit_code": run_result.returncode
+                    }
+
             except FileNotFoundError:
                 response = {
                     "stdout": "",
@@ -356,11 +576,6 @@ class KothaHandler(http.server.SimpleHTTPRequestHandler):
                     "stderr": f"ERROR: {str(e)}",
                     "exit_code": 1
                 }
-            finally:
-                if os.path.exists(tmp_path):
-                    os.unlink(tmp_path)
-                if input_file and os.path.exists(input_file):
-                    os.unlink(input_file)
 
             self.send_response(200)
             self.send_header('Content-type', 'application/json')
@@ -370,12 +585,74 @@ class KothaHandler(http.server.SimpleHTTPRequestHandler):
         else:
             self.send_error(404)
 
+    def send_event(self, event, data):
+        """One Server-Sent Event, written straight to the socket"""
+        self.wfile.write(f"event: {event}\ndata: {json.dumps(data)}\n\n".encode('utf-8'))
+
+    def stream_run(self, code, inputs):
+        """/api/run/stream: like /api/run, but the output arrives as Server-Sent
+        Events while the program runs: 'stdout' and 'stderr' events carry
+        {"text"}, and a final 'exit' event carries {"exit_code"}."""
+        self.send_response(200)
+        self.send_header('Content-type', 'text/event-stream; charset=utf-8')
+        self.send_header('Cache-Control', 'no-cache')
+        self.send_header('Access-Control-Allow-Origin', '*')
+        self.end_headers()
+
+        try:
+            # The daemon answers in one piece (its output is capped anyway)
+            response = run_on_daemon(json.dumps({"code": code, "inputs": inputs}).encode('utf-8')) if KOTHA_SERVE_URL else None
+            if response is not None:
+                for stream in ('stdout', 'stderr'):
+                    if response.get(stream):
+                        self.send_event(stream, {"text": response[stream]})
+                self.send_event('exit', {"exit_code": response.get('exit_code', 1)})
+                return
+
+            try:
+                build = BUILD_CACHE.get(code)
+            except FileNotFoundError:
+                build = {"exit_code": 127,
+                         "stderr": f"ERROR: Kotha compiler not found at: {KOTHA_BIN}\n\nPlease run:\n  cd kotha\n  make clean && make\n"}
+            except subprocess.TimeoutExpired:
+                build = {"exit_code": 124, "stderr": "ERROR: Compilation timeout (10 seconds)"}
+            except Exception as e:
+                build = {"exit_code": 1, "stderr": f"ERROR: {str(e)}"}
+
+            if 'exe' not in build:
+                self.send_event('stderr', {"text": build['stderr']})
+                self.send_event('exit', {"exit_code": build['exit_code']})
+                return
+
+            command = [build['exe']]
+            if STDBUF:
+                command = [STDBUF, '-oL', '-eL'] + command
+            proc = subprocess.Popen(command, stdin=subprocess.PIPE,
+                                    stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+            try:
+                if inputs:
+                    proc.stdin.write(('\n'.join(str(inp) for inp in inputs) + '\n').encode('utf-8'))
+                proc.stdin.close()
+            except BrokenPipeError:
+                pass  # It exited without reading
+
+            exit_code = stream_output(proc, lambda stream, text: self.send_event(stream, {"text": text}), 10)
+            if exit_code is None:
+                self.send_event('stderr', {"text": "\nERROR: Execution timeout (10 seconds)"})
+                exit_code = 124
+            self.send_event('exit', {"exit_code": exit_code})
+        except (BrokenPipeError, ConnectionResetError):
+            pass  # The browser stopped listening; stream_output killed the program
+
 print("=" * 60)
 print("🚀 Kotha IDE Server Starting...")
 print("=" * 60)
 print(f"📝 URL: http://localhost:{PORT}")
 print(f"🔧 Compiler: {KOTHA_BIN}")
+if KOTHA_SERVE_URL:
+    print(f"⚡ Runs go to: {KOTHA_SERVE_URL}")
 print(f"📁 Files: {os.getcwd()}")
+print(f"🗄️  Build cache: {KOTHA_CACHE_DIR} ({KOTHA_CACHE_MAX_MB} MB)")
 
 # Check if compiler exists
 if os.path.exists(KOTHA_BIN):
@@ -387,7 +664,11 @@ else:
 print("=" * 60)
 print("")
 
-with socketserver.TCPServer(("", PORT), KothaHandler) as httpd:
+# One thread per request, so a long run doesn't hold up the rest
+socketserver.ThreadingTCPServer.daemon_threads = True
+socketserver.ThreadingTCPServer.allow_reuse_address = True
+
+with socketserver.ThreadingTCPServer(("", PORT), KothaHandler) as httpd:
     try:
         httpd.serve_forever()
     except KeyboardInterrupt:
@@ -4,6 +4,9 @@
 #include <string.h>
 #include <stdio.h>
 
+__thread int ast_current_line = 1;
+__thread int ast_line_offset = 0;
+
 /* Node creation functions */
 ASTNode* create_node(NodeType type) {
     ASTNode *node = (ASTNode*)malloc(sizeof(ASTNode));
@@ -13,6 +16,7 @@ ASTNode* create_node(NodeType type) {
     }
     memset(node, 0, sizeof(ASTNode));
     node->type = type;
+    node->line = ast_current_line;
     return node;
 }
 
@@ -27,7 +27,15 @@ typedef enum {
     NODE_CATCH,
     NODE_THROW,
     NODE_ARRAY_ACCESS,   // NEW: Array element access
-    NODE_ARRAY_DECL      // NEW: Array declaration
+    NODE_ARRAY_DECL,     // NEW: Array declaration
+    NODE_WAIT,           // wait(seconds); yields the fiber in the VM
+    NODE_SPAWN,          // spawn { body } starts a fiber
+    NODE_ISOLATE,        // isolate { body } starts a VM on another thread
+    NODE_PAR_FOR,        // cholbe somantorale; params = jog(...) accumulators
+    NODE_ARRAY_ASSIGN,   // sval[params...] = left
+    NODE_COMPOUND_ASSIGN, // sval op= left
+    NODE_CLEAR,          // porishkar()
+    NODE_INCLUDE         // include "file"; sval is the quoted name
 } NodeType;
 
 typedef struct ASTNode {
@@ -50,8 +58,15 @@ typedef struct ASTNode {
     // For functions
     struct ASTNode *params;
     
+    int line;             // Source line (carried into IR and bytecode)
+    int value_type;       // VarType of a declaration, or of an expression once codegen_c typed it
+    
 } ASTNode;
 
+/* Line of the last token read by the scanner (new nodes get it) */
+extern __thread int ast_current_line;
+extern __thread int ast_line_offset;   // Added to the scanner's line (a region parsed alone)
+
 /* Node creation functions */
 ASTNode* create_node(NodeType type);
 ASTNode* create_int_node(int val);
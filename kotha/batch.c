@@ -0,0 +1,309 @@
+/*
+ * Kotha Batch Runner
+ * Workers claim scripts from a shared list and take each one through the
+ * whole pipeline (parse, IR, bytecode, run). The front end keeps its state
+ * per thread and every VM prints into its own buffer, so scripts run side
+ * by side without interleaving their output.
+ */
+
+#include "batch.h"
+#include "ast.h"
+#include "ir.h"
+#include "vm.h"
+#include "vm_jit.h"
+#include "vm_trace.h"
+#include "vm_isolate.h"
+#include "parser.tab.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define BATCH_MAX_JOBS 256
+
+typedef enum {
+    BATCH_OK,
+    BATCH_OPEN_ERROR,
+    BATCH_PARSE_ERROR,
+    BATCH_COMPILE_ERROR,
+    BATCH_RUNTIME_ERROR
+} BatchStatus;
+
+typedef struct {
+    char *path;
+    BatchStatus status;
+    char *output;            // Everything the script printed, errors included
+    size_t output_size;
+    long long instructions;  // Including its isolates
+    double wall_ms;
+    int done;                // Guarded by the run's lock
+} BatchScript;
+
+typedef struct {
+    const BatchConfig *config;
+    BatchScript *scripts;
+    int count;
+    int next;                // Atomic: first unclaimed script
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+} BatchRun;
+
+static const char* batch_status_name(BatchStatus status) {
+    switch (status) {
+        case BATCH_OK: return "ok";
+        case BATCH_OPEN_ERROR: return "cannot open";
+        case BATCH_PARSE_ERROR: return "parse error";
+        case BATCH_COMPILE_ERROR: return "compile error";
+        case BATCH_RUNTIME_ERROR: return "runtime error";
+    }
+    return "?";
+}
+
+static double batch_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* Script list */
+
+static int batch_add(BatchScript **scripts, int *count, int *capacity, char *path) {
+    if (*count >= *capacity) {
+        int grown = *capacity ? *capacity * 2 : 32;
+        BatchScript *list = (BatchScript*)realloc(*scripts, sizeof(BatchScript) * grown);
+        if (!list) {
+            free(path);
+            return 0;
+        }
+        *scripts = list;
+        *capacity = grown;
+    }
+    memset(&(*scripts)[*count], 0, sizeof(BatchScript));
+    (*scripts)[(*count)++].path = path;
+    return 1;
+}
+
+static int batch_compare(const void *a, const void *b) {
+    return strcmp(((const BatchScript*)a)->path, ((const BatchScript*)b)->path);
+}
+
+static int batch_ends_with(const char *name, const char *suffix) {
+    size_t n = strlen(name), s = strlen(suffix);
+    return n > s && strcmp(name + n - s, suffix) == 0;
+}
+
+/* Returns the number of scripts found, or -1 if 'source' can't be read */
+static int batch_collect(const char *source, BatchScript **scripts) {
+    int count = 0, capacity = 0;
+    struct stat st;
+    *scripts = NULL;
+
+    if (stat(source, &st) == 0 && S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(source);
+        if (!dir) return -1;
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (!batch_ends_with(entry->d_name, ".kotha")) continue;
+            size_t size = strlen(source) + strlen(entry->d_name) + 2;
+            char *path = (char*)malloc(size);
+            if (!path) break;
+            snprintf(path, size, "%s/%s", source, entry->d_name);
+            if (!batch_add(scripts, &count, &capacity, path)) break;
+        }
+        closedir(dir);
+        if (count > 1) qsort(*scripts, count, sizeof(BatchScript), batch_compare);
+        return count;
+    }
+
+    FILE *list = fopen(source, "r");
+    if (!list) return -1;
+    char *line = NULL;
+    size_t line_size = 0;
+    while (getline(&line, &line_size, list) != -1) {
+        char *start = line;
+        while (*start == ' ' || *start == '\t') start++;
+        char *end = start + strlen(start);
+        while (end > start && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t')) end--;
+        *end = '\0';
+        if (*start == '\0' || *start == '#') continue;
+
+        char *path = strdup(start);
+        if (!path || !batch_add(scripts, &count, &capacity, path)) break;
+    }
+    free(line);
+    fclose(list);
+    return count;
+}
+
+/* Running one script */
+
+static BatchStatus batch_execute(BatchScript *script, const BatchConfig *config, FILE *out) {
+    FILE *source = fopen(script->path, "r");
+    if (!source) {
+        fprintf(out, "Error: Cannot open file '%s'\n", script->path);
+        return BATCH_OPEN_ERROR;
+    }
+    int parsed;
+    ASTNode *root = kotha_parse(source, NULL, out, &parsed);
+    fclose(source);
+    if (!parsed) {
+        free_ast(root);
+        return BATCH_PARSE_ERROR;
+    }
+
+    ir_init();
+    ir_generate(root);
+    VM *vm = ir_head ? codegen_vm(ir_head) : NULL;
+    ir_free(ir_head);
+    ir_init();
+    free_ast(root);
+    if (!vm) {
+        fprintf(out, "Error: Bytecode generation failed\n");
+        return BATCH_COMPILE_ERROR;
+    }
+
+    // Scripts get an empty stdin: they all run at once
+    FILE *in = fopen("/dev/null", "r");
+    vm->out = out;
+    vm->err = out;
+    if (in) vm->in = in;
+    vm->gc_max_pause_us = config->gc_max_pause_us;
+    vm->gc_slice_objects = config->gc_slice_objects;
+    vm->gc_threads = config->gc_threads;
+    vm->par_threads = config->par_threads > 0 ? config->par_threads : 1;
+
+    if (config->trace_jit) vm_trace_create(vm);
+    VMJit *jit = config->jit ? vm_jit_compile(vm) : NULL;
+    if (jit) {
+        vm_jit_run(jit, vm);
+    } else {
+        vm_run(vm);
+    }
+
+    // An isolate that failed shuts the group down; the ones still running
+    // after an error are stopped and joined by vm_free
+    vm_jit_free(jit);
+    VMIsolateGroup *group = vm->isolates;
+    script->instructions = vm->instruction_count + (group ? group->instructions : 0);
+    int errors = vm->error_count;
+    if (group && __atomic_load_n(&group->shutdown, __ATOMIC_ACQUIRE)) errors++;
+    vm_free(vm);
+    free(vm);
+    if (in) fclose(in);
+    return errors > 0 ? BATCH_RUNTIME_ERROR : BATCH_OK;
+}
+
+static void* batch_worker(void *arg) {
+    BatchRun *run = (BatchRun*)arg;
+
+    for (;;) {
+        int i = __atomic_fetch_add(&run->next, 1, __ATOMIC_RELAXED);
+        if (i >= run->count) break;
+        BatchScript *script = &run->scripts[i];
+
+        char *output = NULL;
+        size_t output_size = 0;
+        FILE *out = open_memstream(&output, &output_size);
+        double start = batch_now_ms();
+        if (out) {
+            script->status = batch_execute(script, run->config, out);
+            fclose(out);
+        } else {
+            script->status = BATCH_OPEN_ERROR;
+        }
+        script->wall_ms = batch_now_ms() - start;
+
+        pthread_mutex_lock(&run->lock);
+        script->output = output;
+        script->output_size = output_size;
+        script->done = 1;
+        pthread_cond_broadcast(&run->finished);
+        pthread_mutex_unlock(&run->lock);
+    }
+    return NULL;
+}
+
+/* Public API */
+
+int batch_run(const char *source, const BatchConfig *config) {
+    BatchRun run;
+    memset(&run, 0, sizeof(run));
+    run.config = config;
+    run.count = batch_collect(source, &run.scripts);
+    if (run.count < 0) {
+        fprintf(stderr, "Error: Cannot read '%s'\n", source);
+        return 1;
+    }
+    if (run.count == 0) {
+        fprintf(stderr, "Error: No scripts found in '%s'\n", source);
+        free(run.scripts);
+        return 1;
+    }
+
+    int jobs = config->jobs;
+    if (jobs <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = online > 0 ? (int)online : 1;
+    }
+    if (jobs > BATCH_MAX_JOBS) jobs = BATCH_MAX_JOBS;
+    if (jobs > run.count) jobs = run.count;
+
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.finished, NULL);
+
+    double start = batch_now_ms();
+    pthread_t threads[BATCH_MAX_JOBS];
+    int started = 0;
+    for (int i = 0; i < jobs; i++) {
+        if (pthread_create(&threads[i], NULL, batch_worker, &run) != 0) break;
+        started++;
+    }
+    if (started == 0) batch_worker(&run);  // No threads: run them here
+
+    // Print each script's output as soon as it and everything before it is done
+    for (int i = 0; i < run.count; i++) {
+        BatchScript *script = &run.scripts[i];
+        pthread_mutex_lock(&run.lock);
+        while (!script->done) pthread_cond_wait(&run.finished, &run.lock);
+        pthread_mutex_unlock(&run.lock);
+
+        printf("=== %s ===\n", script->path);
+        if (script->output_size > 0) {
+            fwrite(script->output, 1, script->output_size, stdout);
+            if (script->output[script->output_size - 1] != '\n') putchar('\n');
+        }
+        fflush(stdout);
+        free(script->output);
+        script->output = NULL;
+    }
+
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    double wall_ms = batch_now_ms() - start;
+
+    // Summary
+    int failed = 0;
+    double script_ms = 0;
+    long long instructions = 0;
+    printf("\n=== Batch summary (%d scripts, %d jobs) ===\n", run.count, started ? started : 1);
+    printf("%-14s %10s %14s  %s\n", "Status", "Time (ms)", "Instructions", "Script");
+    for (int i = 0; i < run.count; i++) {
+        BatchScript *script = &run.scripts[i];
+        printf("%-14s %10.2f %14lld  %s\n", batch_status_name(script->status),
+               script->wall_ms, script->instructions, script->path);
+        if (script->status != BATCH_OK) failed++;
+        script_ms += script->wall_ms;
+        instructions += script->instructions;
+        free(script->path);
+    }
+    printf("%d passed, %d failed; %lld instructions; %.2f ms wall (%.2f ms summed over scripts)\n",
+           run.count - failed, failed, instructions, wall_ms, script_ms);
+
+    pthread_cond_destroy(&run.finished);
+    pthread_mutex_destroy(&run.lock);
+    free(run.scripts);
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,26 @@
+/*
+ * Kotha Batch Runner Header
+ * kotha batch <dir|listfile> -j N: compile and run many scripts on a pool
+ * of worker threads in one process
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+typedef struct {
+    int jobs;               // Scripts run at once (0 = one per core)
+    int jit;                // Run bytecode as native code
+    int trace_jit;          // Compile hot loops to native traces
+    int gc_max_pause_us;
+    int gc_slice_objects;
+    int gc_threads;
+    int par_threads;        // Threads per somantorale loop (0 = 1: jobs already fill the cores)
+} BatchConfig;
+
+/* Run every *.kotha file in 'source' (a directory, sorted by name) or every
+ * path listed in it (one per line; blank lines and '#' comments skipped).
+ * Each script's output and errors are printed as one block, in order,
+ * followed by a summary. Returns the exit status: 1 if any script failed. */
+int batch_run(const char *source, const BatchConfig *config);
+
+#endif /* BATCH_H */
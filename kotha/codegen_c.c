@@ -0,0 +1,781 @@
+/*
+ * Kotha C Code Generator
+ * Translates the parsed program (globals, kaj functions and main) to C
+ * once the whole file has been parsed, into a growable buffer.
+ *
+ *   1. Each statement's expressions have their integer constants folded
+ *   2. Every expression node is typed once, bottom-up, and the type is
+ *      kept on the node (value_type), so printf formats and string
+ *      concatenation cost one visit per node
+ *   3. Locals are typed through the symbol table with one scope per block,
+ *      parameters included; statements that can never run (after ferot or
+ *      throw, under a constant-false jodi/jotokkhon, an empty cholbe
+ *      range) are left out
+ *
+ * Generated programs include kotha_rt.h and link with libkotha_rt.a;
+ * codegen_c_build runs the C compiler on them (kotha build).
+ */
+
+#include "codegen_c.h"
+#include "symtab.h"
+#include "parser.tab.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <limits.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#define CG_INDENT 4
+
+/* Output buffer */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} CBuf;
+
+typedef struct {
+    CBuf head;               // #include lines
+    CBuf body;
+    int depth;               // Block nesting, for indentation
+} CGen;
+
+static void cbuf_reserve(CBuf *b, size_t extra) {
+    if (b->len + extra < b->cap) return;
+    size_t cap = b->cap ? b->cap : 4096;
+    while (b->len + extra >= cap) cap *= 2;
+    char *grown = (char*)realloc(b->data, cap);
+    if (!grown) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    b->data = grown;
+    b->cap = cap;
+}
+
+static void cbuf_write(CBuf *b, const char *s, size_t n) {
+    cbuf_reserve(b, n);
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+}
+
+static void cbuf_puts(CBuf *b, const char *s) {
+    cbuf_write(b, s, strlen(s));
+}
+
+static void cbuf_printf(CBuf *b, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    cbuf_reserve(b, (size_t)n + 1);
+    va_start(ap, fmt);
+    vsnprintf(b->data + b->len, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    b->len += n;
+}
+
+static void cg_puts(CGen *g, const char *s) {
+    cbuf_puts(&g->body, s);
+}
+
+static void cg_indent(CGen *g) {
+    int spaces = g->depth * CG_INDENT;
+    cbuf_reserve(&g->body, spaces);
+    memset(g->body.data + g->body.len, ' ', spaces);
+    g->body.len += spaces;
+}
+
+/* Constant folding */
+
+static int is_int_literal(ASTNode *node) {
+    return node && node->type == NODE_LITERAL_INT;
+}
+
+// Fold integer operators over literal operands, in place. A result the
+// int range cannot hold, and division by zero, are left for run time.
+static void cg_fold(ASTNode *node) {
+    if (!node) return;
+    switch (node->type) {
+        case NODE_BIN_OP:
+        case NODE_UN_OP:
+            cg_fold(node->left);
+            cg_fold(node->right);
+            break;
+        case NODE_FUNC_CALL:
+            for (ASTNode *arg = node->params; arg; arg = arg->next) cg_fold(arg);
+            return;
+        case NODE_ARRAY_ACCESS:
+            cg_fold(node->left);
+            return;
+        default:
+            return;
+    }
+
+    long long value;
+    if (node->type == NODE_UN_OP) {
+        if (node->op != NOT || !is_int_literal(node->left)) return;
+        value = !node->left->ival;
+    } else {
+        if (!is_int_literal(node->left) || !is_int_literal(node->right)) return;
+        long long a = node->left->ival;
+        long long b = node->right->ival;
+        switch (node->op) {
+            case PLUS: value = a + b; break;
+            case MINUS: value = a - b; break;
+            case MULT: value = a * b; break;
+            case DIV:
+                if (b == 0) return;
+                value = a / b;
+                break;
+            case MOD:
+                if (b == 0) return;
+                value = a % b;
+                break;
+            case GT: value = a > b; break;
+            case LT: value = a < b; break;
+            case GTE: value = a >= b; break;
+            case LTE: value = a <= b; break;
+            case EQ: value = a == b; break;
+            case NEQ: value = a != b; break;
+            case AND: value = a && b; break;
+            case OR: value = a || b; break;
+            default: return;
+        }
+    }
+    if (value < INT_MIN || value > INT_MAX) return;
+
+    free_ast(node->left);
+    free_ast(node->right);
+    node->left = node->right = NULL;
+    node->type = NODE_LITERAL_INT;
+    node->ival = (int)value;
+    node->value_type = TYPE_INT;
+}
+
+/* Typing */
+
+static int is_arithmetic(int op) {
+    return op == PLUS || op == MINUS || op == MULT || op == DIV || op == MOD;
+}
+
+// Type of an expression, worked out once per node and kept in value_type
+static VarType cg_type(ASTNode *node) {
+    if (!node) return TYPE_UNKNOWN;
+    if (node->value_type != TYPE_UNKNOWN) return (VarType)node->value_type;
+
+    VarType type = TYPE_INT;
+    switch (node->type) {
+        case NODE_LITERAL_FLOAT:
+            type = TYPE_FLOAT;
+            break;
+        case NODE_LITERAL_STRING:
+            type = TYPE_STRING;
+            break;
+        case NODE_VAR_REF:
+            // Undeclared names stay unknown (and are looked up again)
+            return get_symbol_type(node->sval);
+        case NODE_BIN_OP: {
+            VarType l = cg_type(node->left);
+            VarType r = cg_type(node->right);
+            if (node->op == PLUS && (l == TYPE_STRING || r == TYPE_STRING)) {
+                type = TYPE_STRING;
+            } else if (is_arithmetic(node->op) && (l == TYPE_FLOAT || r == TYPE_FLOAT)) {
+                type = TYPE_FLOAT;
+            }
+            break;
+        }
+        case NODE_FUNC_CALL:
+            // typeof() and the conversions; other functions return int
+            if (strncmp(node->sval, "kotha_typeof_", 13) == 0 || strstr(node->sval, "_to_bornona")) {
+                type = TYPE_STRING;
+            } else if (strstr(node->sval, "_to_doshomik")) {
+                type = TYPE_FLOAT;
+            }
+            break;
+        default:
+            break;
+    }
+    node->value_type = type;
+    return type;
+}
+
+/* Expressions */
+
+// Binding strength of a C operator; operands that bind less get parentheses
+static int cg_precedence(int op) {
+    switch (op) {
+        case OR: return 1;
+        case AND: return 2;
+        case EQ: case NEQ: return 3;
+        case GT: case LT: case GTE: case LTE: return 4;
+        case PLUS: case MINUS: return 5;
+        default: return 6;   // * / %
+    }
+}
+
+static const char* cg_operator(int op) {
+    switch (op) {
+        case PLUS: return "+";
+        case MINUS: return "-";
+        case MULT: return "*";
+        case DIV: return "/";
+        case MOD: return "%";
+        case GT: return ">";
+        case LT: return "<";
+        case GTE: return ">=";
+        case LTE: return "<=";
+        case EQ: return "==";
+        case NEQ: return "!=";
+        case AND: return "&&";
+        case OR: return "||";
+        default: return "+";
+    }
+}
+
+static void cg_expr(CGen *g, ASTNode *node, int min_prec);
+
+// One operand of a concatenation; a nested concatenation's operands are
+// appended to the same buffer rather than built in it again
+static void cg_concat_parts(CGen *g, ASTNode *node) {
+    if (node->type == NODE_BIN_OP && node->op == PLUS && cg_type(node) == TYPE_STRING) {
+        cg_concat_parts(g, node->left);
+        cg_concat_parts(g, node->right);
+        return;
+    }
+    switch (cg_type(node)) {
+        case TYPE_STRING: cg_puts(g, ", kotha_str_concat_str("); break;
+        case TYPE_FLOAT: cg_puts(g, ", kotha_str_concat_float("); break;
+        default: cg_puts(g, ", kotha_str_concat_int("); break;
+    }
+    cg_expr(g, node, 0);
+    cg_puts(g, ")");
+}
+
+static void cg_expr(CGen *g, ASTNode *node, int min_prec) {
+    if (!node) return;
+    CBuf *b = &g->body;
+
+    switch (node->type) {
+        case NODE_LITERAL_INT:
+            if (node->ival == INT_MIN) cbuf_puts(b, "(-2147483647 - 1)");
+            else cbuf_printf(b, "%d", node->ival);
+            break;
+        case NODE_LITERAL_FLOAT:
+            cbuf_printf(b, "%f", node->fval);
+            break;
+        case NODE_LITERAL_STRING:
+        case NODE_VAR_REF:
+            cbuf_puts(b, node->sval);
+            break;
+        case NODE_ARRAY_ACCESS:
+            cbuf_printf(b, "%s[", node->sval);
+            cg_expr(g, node->left, 0);
+            cbuf_puts(b, "]");
+            break;
+        case NODE_FUNC_CALL:
+            cbuf_printf(b, "%s(", node->sval);
+            for (ASTNode *arg = node->params; arg; arg = arg->next) {
+                cg_expr(g, arg, 0);
+                if (arg->next) cbuf_puts(b, ", ");
+            }
+            cbuf_puts(b, ")");
+            break;
+        case NODE_UN_OP:
+            cbuf_puts(b, "!");
+            cg_expr(g, node->left, 7);
+            break;
+        case NODE_BIN_OP: {
+            if (node->op == PLUS && cg_type(node) == TYPE_STRING) {
+                cbuf_puts(b, "(kotha_str_reset()");
+                cg_concat_parts(g, node);
+                cbuf_puts(b, ")");
+                break;
+            }
+            int prec = cg_precedence(node->op);
+            if (prec < min_prec) cbuf_puts(b, "(");
+            cg_expr(g, node->left, prec);
+            cbuf_printf(b, " %s ", cg_operator(node->op));
+            cg_expr(g, node->right, prec + 1);
+            if (prec < min_prec) cbuf_puts(b, ")");
+            break;
+        }
+        default:
+            cbuf_puts(b, "0");
+            break;
+    }
+}
+
+// Fold and type an expression before it is written
+static VarType cg_prepare(ASTNode *node) {
+    cg_fold(node);
+    return cg_type(node);
+}
+
+/* Statements */
+
+static const char* cg_c_type(VarType type) {
+    return type == TYPE_FLOAT ? "float" : "int";
+}
+
+static void cg_block(CGen *g, ASTNode *block);
+static void cg_list(CGen *g, ASTNode *list);
+
+// A variable or array declaration (local or global)
+static void cg_decl(CGen *g, ASTNode *node) {
+    if (node->type == NODE_ARRAY_DECL) {
+        cg_indent(g);
+        cbuf_printf(&g->body, "int %s", node->sval);
+        for (ASTNode *dim = node->params; dim; dim = dim->next) {
+            cbuf_printf(&g->body, "[%d]", dim->ival);
+        }
+        cg_puts(g, ";\n");
+        insert_symbol_typed(node->sval, SYM_ARRAY, TYPE_ARRAY_INT);
+        return;
+    }
+
+    VarType type = (VarType)node->value_type;
+    if (node->left) cg_prepare(node->left);
+    cg_indent(g);
+    if (node->op == CONST) cg_puts(g, "const ");
+
+    if (type == TYPE_STRING) {
+        cbuf_printf(&g->body, "char %s[256]", node->sval);
+        if (node->left && node->left->type == NODE_LITERAL_STRING) {
+            cbuf_printf(&g->body, " = %s;\n", node->left->sval);
+        } else if (node->left) {
+            cbuf_printf(&g->body, ";\n");
+            cg_indent(g);
+            cbuf_printf(&g->body, "strcpy(%s, ", node->sval);
+            cg_expr(g, node->left, 0);
+            cg_puts(g, ");\n");
+        } else {
+            cg_puts(g, ";\n");
+        }
+    } else {
+        cbuf_printf(&g->body, "%s %s", cg_c_type(type), node->sval);
+        if (node->left) {
+            cg_puts(g, " = ");
+            cg_expr(g, node->left, 0);
+        }
+        cg_puts(g, ";\n");
+    }
+    insert_symbol_typed(node->sval, SYM_VAR, type);
+}
+
+// jodi / noyto / othoba. Branches whose condition folds to false are
+// dropped; one that folds to true ends the chain.
+static void cg_if(CGen *g, ASTNode *node) {
+    int opened = 0;
+    for (ASTNode *branch = node; branch; branch = branch->right) {
+        if (branch->type != NODE_IF) {
+            // The final othoba block
+            if (opened) cg_puts(g, " else ");
+            else cg_indent(g);
+            cg_block(g, branch);
+            opened = 1;
+            break;
+        }
+
+        cg_prepare(branch->cond);
+        if (is_int_literal(branch->cond)) {
+            if (branch->cond->ival == 0) continue;
+            if (opened) cg_puts(g, " else ");
+            else cg_indent(g);
+            cg_block(g, branch->body);
+            opened = 1;
+            break;
+        }
+
+        if (opened) cg_puts(g, " else if (");
+        else {
+            cg_indent(g);
+            cg_puts(g, "if (");
+        }
+        cg_expr(g, branch->cond, 0);
+        cg_puts(g, ") ");
+        cg_block(g, branch->body);
+        opened = 1;
+    }
+    if (opened) cg_puts(g, "\n");
+}
+
+// cholbe / cholbe somantorale; the bound is evaluated each time, as in C
+static void cg_for(CGen *g, ASTNode *node) {
+    cg_prepare(node->left);
+    cg_prepare(node->right);
+    if (is_int_literal(node->left) && is_int_literal(node->right) &&
+        node->left->ival > node->right->ival) {
+        return;   // Never runs
+    }
+
+    if (node->type == NODE_PAR_FOR) {
+        cg_indent(g);
+        cg_puts(g, "#pragma omp parallel for");
+        if (node->params) {
+            cg_puts(g, " reduction(+:");
+            for (ASTNode *r = node->params; r; r = r->next) {
+                cbuf_printf(&g->body, "%s%s", r->sval, r->next ? ", " : "");
+            }
+            cg_puts(g, ")");
+        }
+        cg_puts(g, "\n");
+    }
+
+    enter_scope();
+    insert_symbol_typed(node->sval, SYM_VAR, TYPE_INT);
+    cg_indent(g);
+    cbuf_printf(&g->body, "for (int %s = ", node->sval);
+    cg_expr(g, node->left, 0);
+    cbuf_printf(&g->body, "; %s <= ", node->sval);
+    cg_expr(g, node->right, 0);
+    cbuf_printf(&g->body, "; %s++) ", node->sval);
+    cg_block(g, node->body);
+    cg_puts(g, "\n");
+    exit_scope();
+}
+
+static void cg_print(CGen *g, ASTNode *value) {
+    const char *format;
+    switch (cg_prepare(value)) {
+        case TYPE_STRING: format = "%s"; break;
+        case TYPE_FLOAT: format = "%f"; break;
+        default: format = "%d"; break;
+    }
+    cg_indent(g);
+    cbuf_printf(&g->body, "printf(\"%s\\n\", ", format);
+    cg_expr(g, value, 0);
+    cg_puts(g, ");\n");
+}
+
+static void cg_input(CGen *g, const char *name) {
+    cg_indent(g);
+    switch (get_symbol_type(name)) {
+        case TYPE_FLOAT:
+            cbuf_printf(&g->body, "scanf(\"%%f\", &%s);\n", name);
+            break;
+        case TYPE_STRING:
+            // Arrays need no &
+            cbuf_printf(&g->body, "scanf(\"%%s\", %s);\n", name);
+            break;
+        default:
+            cbuf_printf(&g->body, "scanf(\"%%d\", &%s);\n", name);
+            break;
+    }
+}
+
+// One statement. Returns 1 if control never reaches the next one.
+static int cg_stmt(CGen *g, ASTNode *node) {
+    switch (node->type) {
+        case NODE_VAR_DECL:
+        case NODE_ARRAY_DECL:
+            cg_decl(g, node);
+            break;
+
+        case NODE_ASSIGN:
+            cg_prepare(node->left);
+            cg_indent(g);
+            if (get_symbol_type(node->sval) == TYPE_STRING) {
+                cbuf_printf(&g->body, "strcpy(%s, ", node->sval);
+                cg_expr(g, node->left, 0);
+                cg_puts(g, ");\n");
+            } else {
+                cbuf_printf(&g->body, "%s = ", node->sval);
+                cg_expr(g, node->left, 0);
+                cg_puts(g, ";\n");
+            }
+            break;
+
+        case NODE_COMPOUND_ASSIGN:
+            cg_prepare(node->left);
+            cg_indent(g);
+            cbuf_printf(&g->body, "%s %s= ", node->sval, cg_operator(node->op));
+            cg_expr(g, node->left, 0);
+            cg_puts(g, ";\n");
+            break;
+
+        case NODE_ARRAY_ASSIGN:
+            cg_prepare(node->left);
+            cg_indent(g);
+            cg_puts(g, node->sval);
+            for (ASTNode *index = node->params; index; index = index->next) {
+                cg_prepare(index);
+                cg_puts(g, "[");
+                cg_expr(g, index, 0);
+                cg_puts(g, "]");
+            }
+            cg_puts(g, " = ");
+            cg_expr(g, node->left, 0);
+            cg_puts(g, ";\n");
+            break;
+
+        case NODE_UN_OP:
+            cg_indent(g);
+            cbuf_printf(&g->body, "%s%s;\n", node->sval, node->op == DEC ? "--" : "++");
+            break;
+
+        case NODE_PRINT:
+            cg_print(g, node->left);
+            break;
+
+        case NODE_INPUT:
+            cg_input(g, node->sval);
+            break;
+
+        case NODE_IF:
+            cg_if(g, node);
+            break;
+
+        case NODE_WHILE:
+            cg_prepare(node->cond);
+            if (is_int_literal(node->cond) && node->cond->ival == 0) break;
+            cg_indent(g);
+            cg_puts(g, "while (");
+            cg_expr(g, node->cond, 0);
+            cg_puts(g, ") ");
+            cg_block(g, node->body);
+            cg_puts(g, "\n");
+            break;
+
+        case NODE_FOR:
+        case NODE_PAR_FOR:
+            cg_for(g, node);
+            break;
+
+        case NODE_BLOCK:
+        case NODE_SPAWN:
+        case NODE_ISOLATE:
+            // No scheduler or threads in C: spawn and isolate bodies run in place
+            cg_indent(g);
+            cg_block(g, node->type == NODE_BLOCK ? node : node->body);
+            cg_puts(g, "\n");
+            break;
+
+        case NODE_WAIT:
+            cg_prepare(node->left);
+            cg_indent(g);
+            cg_puts(g, "sleep(");
+            cg_expr(g, node->left, 0);
+            cg_puts(g, ");\n");
+            break;
+
+        case NODE_FUNC_CALL:
+            cg_prepare(node);
+            cg_indent(g);
+            cg_expr(g, node, 0);
+            cg_puts(g, ";\n");
+            break;
+
+        case NODE_RETURN:
+            cg_indent(g);
+            if (node->left) {
+                cg_prepare(node->left);
+                cg_puts(g, "return ");
+                cg_expr(g, node->left, 0);
+                cg_puts(g, ";\n");
+            } else {
+                cg_puts(g, "return;\n");
+            }
+            return 1;
+
+        case NODE_TRY:
+            cg_indent(g);
+            cg_puts(g, "try ");
+            cg_block(g, node->body);
+            cg_puts(g, " catch (...) ");
+            cg_block(g, node->catch_body);
+            if (node->right) {
+                cg_puts(g, " finally ");
+                cg_block(g, node->right);
+            }
+            cg_puts(g, "\n");
+            break;
+
+        case NODE_THROW:
+            cg_prepare(node->left);
+            cg_indent(g);
+            cg_puts(g, "throw ");
+            cg_expr(g, node->left, 0);
+            cg_puts(g, ";\n");
+            return 1;
+
+        case NODE_CLEAR:
+            cg_puts(g, "#ifdef _WIN32\n");
+            cg_indent(g);
+            cg_puts(g, "system(\"cls\");\n#else\n");
+            cg_indent(g);
+            cg_puts(g, "system(\"clear\");\n#endif\n");
+            break;
+
+        case NODE_INCLUDE:
+            cbuf_printf(&g->head, "#include %s\n", node->sval);
+            break;
+
+        default:
+            break;
+    }
+    return 0;
+}
+
+// Statements after one that never falls through are not written
+static void cg_list(CGen *g, ASTNode *list) {
+    for (ASTNode *stmt = list; stmt; stmt = stmt->next) {
+        if (cg_stmt(g, stmt)) break;
+    }
+}
+
+// { statements } in a scope of its own, from the current position
+static void cg_block(CGen *g, ASTNode *block) {
+    cg_puts(g, "{\n");
+    g->depth++;
+    enter_scope();
+    if (block) cg_list(g, block->type == NODE_BLOCK ? block->body : block);
+    exit_scope();
+    g->depth--;
+    cg_indent(g);
+    cg_puts(g, "}");
+}
+
+/* Functions */
+
+static void cg_signature(CGen *g, ASTNode *func) {
+    if (func->op == MAIN) {
+        cg_puts(g, "int main()");
+        return;
+    }
+    cbuf_printf(&g->body, "%s %s(", func->value_type == TYPE_VOID ? "void" : "int", func->sval);
+    for (ASTNode *p = func->params; p; p = p->next) {
+        cbuf_printf(&g->body, "int %s%s", p->sval, p->next ? ", " : "");
+    }
+    if (!func->params) cg_puts(g, "void");
+    cg_puts(g, ")");
+}
+
+static void cg_function(CGen *g, ASTNode *func) {
+    cg_signature(g, func);
+    cg_puts(g, " {\n");
+    g->depth++;
+    enter_scope();
+    for (ASTNode *p = func->params; p; p = p->next) {
+        insert_symbol_typed(p->sval, SYM_VAR, TYPE_INT);
+    }
+
+    int returned = 0;
+    for (ASTNode *stmt = func->body; stmt && !returned; stmt = stmt->next) {
+        returned = cg_stmt(g, stmt);
+    }
+    if (func->op == MAIN && !returned) {
+        cg_indent(g);
+        cg_puts(g, "return 0;\n");
+    }
+
+    exit_scope();
+    g->depth--;
+    cg_puts(g, "}\n\n");
+}
+
+void codegen_c(ASTNode *program, FILE *out) {
+    CGen g;
+    memset(&g, 0, sizeof(g));
+    free_symtab();
+    init_symtab();
+
+    // The helpers are in libkotha_rt.a (see kotha_rt.h)
+    cbuf_puts(&g.head, "#include \"kotha_rt.h\"\n");
+
+    int globals = 0, prototypes = 0;
+    for (ASTNode *node = program; node; node = node->next) {
+        if (node->type == NODE_VAR_DECL || node->type == NODE_ARRAY_DECL) {
+            cg_decl(&g, node);
+            globals++;
+        }
+    }
+    if (globals) cg_puts(&g, "\n");
+
+    // Prototypes, so kaj functions can call each other in any order
+    for (ASTNode *node = program; node; node = node->next) {
+        if (node->type == NODE_FUNC_DECL && node->op != MAIN) {
+            cg_signature(&g, node);
+            cg_puts(&g, ";\n");
+            prototypes++;
+        }
+    }
+    if (prototypes) cg_puts(&g, "\n");
+
+    for (ASTNode *node = program; node; node = node->next) {
+        if (node->type == NODE_FUNC_DECL) cg_function(&g, node);
+    }
+
+    fwrite(g.head.data, 1, g.head.len, out);
+    fputs("\n", out);
+    if (g.body.len) fwrite(g.body.data, 1, g.body.len, out);
+
+    free(g.head.data);
+    free(g.body.data);
+    free_symtab();
+}
+
+/* kotha build */
+
+#ifndef _WIN32
+/* Run a tool and wait for it; returns its exit status */
+static int cg_run_tool(char *const argv[]) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        execvp(argv[0], argv);
+        fprintf(stderr, "Error: Cannot run '%s'\n", argv[0]);
+        _exit(127);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0) return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/* Directory of the running kotha executable, where make leaves kotha_rt.h
+ * and libkotha_rt.a */
+static char* cg_runtime_dir(void) {
+    char path[4096];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (len <= 0) return strdup(".");
+    path[len] = '\0';
+    char *slash = strrchr(path, '/');
+    if (slash) *slash = '\0';
+    return strdup(path);
+}
+#endif
+
+int codegen_c_build(const char *c_file, const char *output) {
+#ifdef _WIN32
+    (void)output;
+    fprintf(stderr, "Error: Compile '%s' with gcc and libkotha_rt.a (see README)\n", c_file);
+    return 1;
+#else
+    char *dir = cg_runtime_dir();
+    char *library = dir ? (char*)malloc(strlen(dir) + sizeof("/libkotha_rt.a")) : NULL;
+    if (!library) {
+        free(dir);
+        return 1;
+    }
+    sprintf(library, "%s/libkotha_rt.a", dir);
+
+    const char *cc = getenv("CC") ? getenv("CC") : "gcc";
+    char *args[] = {(char*)cc, (char*)c_file, "-I", dir, "-o", (char*)output, library, "-lm", NULL};
+    int status = cg_run_tool(args) == 0 ? 0 : 1;
+    if (status) fprintf(stderr, "Error: C compiler failed\n");
+
+    free(library);
+    free(dir);
+    return status;
+#endif
+}
@@ -0,0 +1,21 @@
+/*
+ * Kotha C Code Generator Header
+ * Translates a parsed program to C, after parsing (see kotha_parse)
+ */
+
+#ifndef CODEGEN_C_H
+#define CODEGEN_C_H
+
+#include <stdio.h>
+#include "ast.h"
+
+/* Write 'program' (the globals and functions, main included, chained
+ * through 'next') as C to 'out'. Integer constants are folded and
+ * statements that can never run are left out. Uses the symbol table. */
+void codegen_c(ASTNode *program, FILE *out);
+
+/* Compile generated C to the executable 'output' with $CC (default gcc),
+ * against the runtime next to the kotha executable. Returns 0 on success. */
+int codegen_c_build(const char *c_file, const char *output);
+
+#endif /* CODEGEN_C_H */
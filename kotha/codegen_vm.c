@@ -12,6 +12,7 @@
 
 #define MAX_LABELS 256
 #define MAX_VARS 256
+#define MAX_FIXUPS 1024
 
 /* Label mapping structure */
 typedef struct {
@@ -25,66 +26,372 @@ typedef struct {
     int index;
 } VarEntry;
 
-/* Code generation state */
-static LabelEntry labels[MAX_LABELS];
-static int label_count = 0;
+/* Jump waiting for its label to be placed */
+typedef struct {
+    int pc;
+    const char *label;   // Owned by the IR
+} JumpFixup;
+
+#define MAX_CALL_PARAMS 32
+
+/* Code generation state for one codegen_vm call (nothing is shared, so
+ * several threads can compile at once) */
+typedef struct {
+    LabelEntry labels[MAX_LABELS];
+    int label_count;
+    
+    JumpFixup fixups[MAX_FIXUPS];
+    int fixup_count;
+    
+    VarEntry vars[MAX_VARS];
+    int var_count;
+    
+    // Function tracking
+    int param_count;           // Track parameters for current call
+    const char *pending_params[MAX_CALL_PARAMS];  // Loaded at IR_CALL so temps can't clobber them
+    
+    // Parallel loops: jog(...) variables collected for the next IR_PAR_FOR
+    const char *pending_reductions[PAR_MAX_REDUCTIONS];
+    int reduction_count;
+} CodegenVM;
+
+/* Builtins that compile straight to an opcode (arguments are already pushed) */
+typedef struct {
+    const char *name;
+    OpCode op;
+    int num_args;
+    int has_result;
+} BuiltinEntry;
+
+static const BuiltinEntry builtins[] = {
+    {"kotha_map_new",         OP_MAP_NEW,    0, 1},
+    {"kotha_map_set",         OP_MAP_SET,    3, 0},
+    {"kotha_map_get",         OP_MAP_GET,    2, 1},
+    {"kotha_map_has",         OP_MAP_HAS,    2, 1},
+    {"kotha_map_next",        OP_MAP_NEXT,   2, 1},
+    {"kotha_map_key",         OP_MAP_KEY,    2, 1},
+    {"kotha_map_value",       OP_MAP_VALUE,  2, 1},
+    {"kotha_array_create",    OP_ALLOC,      1, 1},
+    {"kotha_array_get",       OP_LOAD_HEAP,  2, 1},
+    {"kotha_array_set",       OP_STORE_HEAP, 3, 0},
+    {"kotha_channel_new",     OP_CHAN_NEW,   1, 1},
+    {"kotha_channel_send",    OP_CHAN_SEND,  2, 0},
+    {"kotha_channel_receive", OP_CHAN_RECV,  1, 1},
+    {"kotha_channel_close",   OP_CHAN_CLOSE, 1, 0},
+    {NULL, OP_NOP, 0, 0}
+};
 
-static VarEntry vars[MAX_VARS];
-static int var_count = 0;
+static const BuiltinEntry* find_builtin(const char *name) {
+    if (!name) return NULL;
+    
+    for (int i = 0; builtins[i].name; i++) {
+        if (strcmp(builtins[i].name, name) == 0) {
+            return &builtins[i];
+        }
+    }
+    return NULL;
+}
+
+/* Safepoints: instructions that may run the GC, suspend a fiber whose
+ * saved stack is then a root, or copy the locals into an isolate */
+static int is_safepoint(OpCode op) {
+    return op == OP_MAP_NEW || op == OP_ALLOC || op == OP_CALL ||
+           op == OP_WAIT || op == OP_SPAWN || op == OP_INPUT ||
+           op == OP_ISOLATE || op == OP_CHAN_SEND || op == OP_CHAN_RECV;
+}
+
+/* Control-flow successors of the instruction at pc */
+static int instr_successors(VM *vm, int pc, int succ[2]) {
+    Instruction *instr = &vm->code[pc];
+    int count = 0;
+    
+    switch (instr->code) {
+        case OP_HALT:
+        case OP_RETURN:
+        case OP_THROW:
+        case OP_FIBER_EXIT:
+            break;
+        case OP_JMP:
+            succ[count++] = instr->arg;
+            break;
+        case OP_JMP_FALSE:
+        case OP_JMP_TRUE:
+        case OP_TRY:
+        case OP_SPAWN:      // The new fiber starts at arg with the same locals
+        case OP_ISOLATE:    // So does the new isolate (with copies)
+            succ[count++] = instr->arg;
+            succ[count++] = pc + 1;
+            break;
+        case OP_PARALLEL:   // Runs the loop here, or on the pool and resumes at its exit
+            succ[count++] = pc + 1;
+            if (instr->arg >= 0 && instr->arg < vm->par_loop_count) {
+                succ[count++] = vm->par_loops[instr->arg].exit_pc;
+            }
+            break;
+        default:
+            succ[count++] = pc + 1;
+            break;
+    }
+    
+    // Drop edges that leave the code (running off the end halts)
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (succ[i] >= 0 && succ[i] < vm->code_size) succ[kept++] = succ[i];
+    }
+    return kept;
+}
 
-/* Function tracking */
-static int param_count = 0;  // Track parameters for current call
+/* Live locals after pc: union of live-in over its successors */
+static void live_out(VM *vm, const uint32_t *live_in, int words, int pc, uint32_t *out) {
+    int succ[2];
+    int count = instr_successors(vm, pc, succ);
+    
+    memset(out, 0, sizeof(uint32_t) * words);
+    for (int i = 0; i < count; i++) {
+        const uint32_t *in = &live_in[succ[i] * words];
+        for (int w = 0; w < words; w++) out[w] |= in[w];
+    }
+}
 
-/* Initialize code generation state */
-void codegen_vm_init() {
-    label_count = 0;
-    var_count = 0;
-    param_count = 0;
-    memset(labels, 0, sizeof(labels));
-    memset(vars, 0, sizeof(vars));
+/* Backward liveness over the locals, then one stack map per safepoint.
+ * Without maps the GC scans every slot, so dead temps keep objects alive. */
+static void emit_stack_maps(VM *vm) {
+    int words = (vm->local_count + 31) / 32;
+    if (words == 0 || vm->code_size == 0) return;
+    
+    uint32_t *live_in = (uint32_t*)calloc((size_t)vm->code_size * words, sizeof(uint32_t));
+    uint32_t *out = (uint32_t*)malloc(sizeof(uint32_t) * words);
+    if (!live_in || !out) {
+        free(live_in);
+        free(out);
+        return;
+    }
+    
+    // Iterate to a fixed point (reverse order converges in a few passes)
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int pc = vm->code_size - 1; pc >= 0; pc--) {
+            Instruction *instr = &vm->code[pc];
+            live_out(vm, live_in, words, pc, out);
+            
+            int slot = instr->arg;
+            if (slot >= 0 && slot < vm->local_count) {
+                if (instr->code == OP_STORE_LOCAL) {
+                    out[slot / 32] &= ~(1u << (slot % 32));
+                } else if (instr->code == OP_LOAD_LOCAL) {
+                    out[slot / 32] |= 1u << (slot % 32);
+                }
+            }
+            
+            uint32_t *in = &live_in[pc * words];
+            if (memcmp(in, out, sizeof(uint32_t) * words) != 0) {
+                memcpy(in, out, sizeof(uint32_t) * words);
+                changed = 1;
+            }
+        }
+    }
+    
+    // Safepoints touch no locals, so live-out is what the GC must keep
+    for (int pc = 0; pc < vm->code_size; pc++) {
+        if (!is_safepoint(vm->code[pc].code)) continue;
+        live_out(vm, live_in, words, pc, out);
+        vm_add_stack_map(vm, pc, out);
+    }
+    
+    free(live_in);
+    free(out);
 }
 
 /* Get or create variable index */
-static int get_var_index(const char *name) {
+static int get_var_index(CodegenVM *cg, const char *name) {
     if (!name) return -1;
     
     // Check if variable already exists
-    for (int i = 0; i < var_count; i++) {
-        if (vars[i].name && strcmp(vars[i].name, name) == 0) {
-            return vars[i].index;
+    for (int i = 0; i < cg->var_count; i++) {
+        if (cg->vars[i].name && strcmp(cg->vars[i].name, name) == 0) {
+            return cg->vars[i].index;
         }
     }
     
     // Create new variable
-    if (var_count >= MAX_VARS) {
+    if (cg->var_count >= MAX_VARS) {
         fprintf(stderr, "Codegen Error: Too many variables\n");
         return -1;
     }
     
-    vars[var_count].name = strdup(name);
-    vars[var_count].index = var_count;
-    return vars[var_count++].index;
+    cg->vars[cg->var_count].name = strdup(name);
+    cg->vars[cg->var_count].index = cg->var_count;
+    return cg->vars[cg->var_count++].index;
 }
 
 /* Get label address (returns -1 if not found) */
-static int get_label_address(const char *name) {
+static int get_label_address(CodegenVM *cg, const char *name) {
     if (!name) return -1;
     
-    for (int i = 0; i < label_count; i++) {
-        if (labels[i].name && strcmp(labels[i].name, name) == 0) {
-            return labels[i].address;
+    for (int i = 0; i < cg->label_count; i++) {
+        if (cg->labels[i].name && strcmp(cg->labels[i].name, name) == 0) {
+            return cg->labels[i].address;
         }
     }
     return -1;
 }
 
 /* Add label */
-static void add_label(const char *name, int address) {
-    if (!name || label_count >= MAX_LABELS) return;
+static void add_label(CodegenVM *cg, const char *name, int address) {
+    if (!name || cg->label_count >= MAX_LABELS) return;
     
-    labels[label_count].name = strdup(name);
-    labels[label_count].address = address;
-    label_count++;
+    cg->labels[cg->label_count].name = strdup(name);
+    cg->labels[cg->label_count].address = address;
+    cg->label_count++;
+}
+
+/* Place a label at the current address (function labels also set the
+ * function's entry point) */
+static void place_label(CodegenVM *cg, VM *vm, const char *name) {
+    if (!name) return;
+    
+    // The IR may repeat a label; the first placement wins
+    if (get_label_address(cg, name) < 0) {
+        add_label(cg, name, vm->code_size);
+    }
+    
+    if (strncmp(name, "func_", 5) == 0 || strncmp(name, "function_", 9) == 0) {
+        int func_idx = vm_get_function(vm, name);
+        if (func_idx >= 0) {
+            vm->functions[func_idx].address = vm->code_size;
+        } else {
+            // Params will be set during IR_CALL
+            vm_add_function(vm, name, vm->code_size, 0);
+        }
+    }
+}
+
+/* Emit a jump; targets that are not placed yet are patched by patch_jumps */
+static void emit_jump(CodegenVM *cg, VM *vm, OpCode op, const char *label) {
+    int addr = get_label_address(cg, label);
+    
+    if (addr < 0) {
+        if (cg->fixup_count >= MAX_FIXUPS) {
+            fprintf(stderr, "Codegen Error: Too many forward jumps\n");
+        } else {
+            cg->fixups[cg->fixup_count].pc = vm->code_size;
+            cg->fixups[cg->fixup_count].label = label;
+            cg->fixup_count++;
+        }
+    }
+    vm_add_instr(vm, op, addr);
+}
+
+static void patch_jumps(CodegenVM *cg, VM *vm) {
+    for (int i = 0; i < cg->fixup_count; i++) {
+        int addr = get_label_address(cg, cg->fixups[i].label);
+        if (addr < 0) {
+            fprintf(stderr, "Codegen Error: Undefined label '%s'\n", cg->fixups[i].label);
+            continue;
+        }
+        vm->code[cg->fixups[i].pc].arg = addr;
+    }
+    cg->fixup_count = 0;
+}
+
+/* IR_PAR_FOR: describe the loop whose sequential code follows. Its exit
+ * is filled in by the matching IR_PAR_END (loops nest, so that is the
+ * innermost one still open). */
+static int add_par_loop(CodegenVM *cg, VM *vm, IRInstr *instr) {
+    VMParLoop *loops = (VMParLoop*)realloc(vm->par_loops, sizeof(VMParLoop) * (vm->par_loop_count + 1));
+    if (!loops) {
+        fprintf(stderr, "Codegen Error: Out of memory\n");
+        return -1;
+    }
+    vm->par_loops = loops;
+    
+    VMParLoop *loop = &loops[vm->par_loop_count];
+    memset(loop, 0, sizeof(VMParLoop));
+    loop->top_pc = vm->code_size + 1;
+    loop->exit_pc = -1;
+    loop->var_slot = get_var_index(cg, instr->arg1);
+    loop->end_slot = get_var_index(cg, instr->arg2);
+    loop->parallel = 1;
+    
+    if (cg->reduction_count > PAR_MAX_REDUCTIONS) {
+        fprintf(stderr, "Codegen Warning: Line %d: jog takes at most %d variables\n",
+                instr->line, PAR_MAX_REDUCTIONS);
+        loop->parallel = 0;
+    } else {
+        for (int i = 0; i < cg->reduction_count; i++) {
+            loop->reductions[loop->reduction_count++] = get_var_index(cg, cg->pending_reductions[i]);
+        }
+    }
+    cg->reduction_count = 0;
+    
+    return vm->par_loop_count++;
+}
+
+static void close_par_loop(VM *vm) {
+    for (int i = vm->par_loop_count - 1; i >= 0; i--) {
+        if (vm->par_loops[i].exit_pc < 0) {
+            vm->par_loops[i].exit_pc = vm->code_size;
+            return;
+        }
+    }
+}
+
+/* Why a loop body cannot run on worker threads, or NULL if it can. Workers
+ * only get private copies of the locals, so the body must stay inside the
+ * loop and leave the heap, functions and fibers alone. */
+static const char* par_loop_blocker(VM *vm, const VMParLoop *loop) {
+    if (loop->exit_pc < loop->top_pc || loop->var_slot < 0 || loop->end_slot < 0) {
+        return "malformed loop";
+    }
+    
+    int var_stores = 0;
+    for (int pc = loop->top_pc; pc < loop->exit_pc; pc++) {
+        Instruction *instr = &vm->code[pc];
+        switch (instr->code) {
+            case OP_NOP: case OP_PUSH: case OP_POP: case OP_DUP:
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOD: case OP_NEG:
+            case OP_EQ: case OP_NEQ: case OP_LT: case OP_GT: case OP_LTE: case OP_GTE:
+            case OP_AND: case OP_OR: case OP_NOT:
+            case OP_LOAD_LOCAL: case OP_LOAD_CONST: case OP_LOAD_STR:
+            case OP_PRINT: case OP_PRINT_STR: case OP_LINE:
+                break;
+            case OP_STORE_LOCAL:
+                if (instr->arg == loop->end_slot) return "the bound is assigned";
+                if (instr->arg == loop->var_slot && ++var_stores > 1) {
+                    return "the loop variable is assigned";
+                }
+                break;
+            case OP_JMP: case OP_JMP_FALSE: case OP_JMP_TRUE:
+                if (instr->arg < loop->top_pc || instr->arg > loop->exit_pc) {
+                    return "control leaves the loop";
+                }
+                break;
+            case OP_INPUT:
+                return "it reads input";
+            case OP_CALL:
+                return "it calls functions";
+            case OP_WAIT: case OP_SPAWN:
+                return "it uses fibers";
+            case OP_ISOLATE: case OP_CHAN_NEW: case OP_CHAN_SEND:
+            case OP_CHAN_RECV: case OP_CHAN_CLOSE:
+                return "it uses isolates or channels";
+            case OP_PARALLEL:
+                return "it contains a parallel loop";
+            default:
+                return "it uses arrays, maps or exceptions";
+        }
+    }
+    
+    for (int i = 0; i < loop->reduction_count; i++) {
+        if (loop->reductions[i] < 0 || loop->reductions[i] == loop->var_slot) {
+            return "invalid jog variable";
+        }
+        for (int j = 0; j < i; j++) {
+            if (loop->reductions[j] == loop->reductions[i]) return "jog variable listed twice";
+        }
+    }
+    return NULL;
 }
 
 /* Helper to check if string is a number literal */
@@ -122,7 +429,7 @@ static int is_float(const char *s) {
 }
 
 /* Helper to load an operand (literal or variable) */
-static void emit_load(VM *vm, const char *arg) {
+static void emit_load(CodegenVM *cg, VM *vm, const char *arg) {
     if (!arg) {
         // Load NULL/0 if needed, or assume implicit
         vm_add_instr(vm, OP_PUSH, 0); // Default to 0/NULL
@@ -154,11 +461,22 @@ static void emit_load(VM *vm, const char *arg) {
         }
     } else {
         // Variable
-        int idx = get_var_index(arg);
+        int idx = get_var_index(cg, arg);
         vm_add_instr(vm, OP_LOAD_LOCAL, idx);
     }
 }
 
+/* Release what is left of the codegen state */
+static void codegen_free(CodegenVM *cg) {
+    for (int i = 0; i < cg->label_count; i++) {
+        free(cg->labels[i].name);
+    }
+    for (int i = 0; i < cg->var_count; i++) {
+        free(cg->vars[i].name);
+    }
+    free(cg);
+}
+
 /* Generate VM bytecode from IR */
 VM* codegen_vm(IRInstr *ir) {
     if (!ir) return NULL;
@@ -171,96 +489,20 @@ VM* codegen_vm(IRInstr *ir) {
     }
     vm_init(vm);
     
-    // Initialize code generation
-    codegen_vm_init();
-    
-    // First pass: collect labels and estimate size
-    IRInstr *curr = ir;
-    int addr = 0;
-    while (curr) {
-        if (curr->op == IR_LABEL) {
-            add_label(curr->result, addr);
-            
-            // Check if this is a function label (starts with "func_" or "function_")
-            if (curr->result && (strncmp(curr->result, "func_", 5) == 0 || 
-                                  strncmp(curr->result, "function_", 9) == 0)) {
-                // Register function in VM function table
-                // Extract function name (skip "func_" or "function_" prefix)
-                const char *func_name = curr->result;
-                int func_idx = vm_get_function(vm, func_name);
-                if (func_idx >= 0) {
-                    // Update existing function with address
-                    vm->functions[func_idx].address = addr;
-                } else {
-                    // Add new function (params will be set during IR_CALL)
-                    vm_add_function(vm, func_name, addr, 0);
-                }
-            }
-        } else {
-            // Count instructions (estimate is fine for label addresses as long as we maintain consistency)
-            // But VM uses instruction index, not byte offset. 
-            // So we must count exactly how many instructions we will emit.
-            // This requires duplicating the logic of emission or using a more robust 2-pass system.
-            // For now, let's keep the simple mapping:
-            
-            switch (curr->op) {
-                case IR_ADD:
-                case IR_SUB:
-                case IR_MUL:
-                case IR_DIV:
-                case IR_MOD:
-                case IR_EQ:
-                case IR_NEQ:
-                case IR_LT:
-                case IR_GT:
-                case IR_LTE:
-                case IR_GTE:
-                    addr += 4; // LOAD arg1, LOAD arg2, OP, STORE result
-                    break;
-                case IR_ASSIGN:
-                    addr += 2; // LOAD arg1, STORE result
-                    break;
-                case IR_PRINT:
-                    addr += 2; // LOAD arg1, PRINT
-                    break;
-                case IR_INPUT:
-                    addr += 2; // INPUT, STORE result
-                    break;
-                case IR_GOTO:
-                    addr += 1; // JMP
-                    break;
-                case IR_IF_FALSE:
-                    addr += 2; // LOAD arg1, JMP_FALSE
-                    break;
-                case IR_RETURN:
-                    addr += 2; // LOAD return_val (if any), RETURN
-                    break;
-                case IR_PARAM:
-                    addr += 1; // LOAD param
-                    break;
-                case IR_CALL:
-                    addr += 3; // CALL, STORE/POP result
-                    break;
-                case IR_TRY_START:
-                    addr += 1; 
-                    break;
-                case IR_TRY_END:
-                    addr += 1;
-                    break;
-                case IR_THROW:
-                    addr += 1;
-                    break;
-                default:
-                    addr += 1; // NOP or others
-                    break;
-            }
-        }
-        curr = curr->next;
+    CodegenVM *cg = (CodegenVM*)calloc(1, sizeof(CodegenVM));
+    if (!cg) {
+        fprintf(stderr, "Codegen Error: Out of memory\n");
+        vm_free(vm);
+        free(vm);
+        return NULL;
     }
     
-    // Second pass: generate bytecode
-    curr = ir;
+    // Labels get their address when they are reached during emission;
+    // jumps to labels further down are patched at the end
+    IRInstr *curr = ir;
     while (curr) {
+        int first_pc = vm->code_size;
+        
         switch (curr->op) {
             case IR_NOP:
                 // No operation
@@ -268,9 +510,9 @@ VM* codegen_vm(IRInstr *ir) {
                 
             case IR_ASSIGN: {
                 // result = arg1
-                emit_load(vm, curr->arg1);
+                emit_load(cg, vm, curr->arg1);
                 
-                int dst_idx = get_var_index(curr->result);
+                int dst_idx = get_var_index(cg, curr->result);
                 vm_add_instr(vm, OP_STORE_LOCAL, dst_idx); 
                 break;
             }
@@ -281,10 +523,10 @@ VM* codegen_vm(IRInstr *ir) {
             case IR_DIV:
             case IR_MOD: {
                 // result = arg1 OP arg2
-                emit_load(vm, curr->arg1);
-                emit_load(vm, curr->arg2);
+                emit_load(cg, vm, curr->arg1);
+                emit_load(cg, vm, curr->arg2);
                 
-                int result_idx = get_var_index(curr->result);
+                int result_idx = get_var_index(cg, curr->result);
                 
                 switch (curr->op) {
                     case IR_ADD: vm_add_instr(vm, OP_ADD, 0); break;
@@ -306,10 +548,10 @@ VM* codegen_vm(IRInstr *ir) {
             case IR_LTE:
             case IR_GTE: {
                 // result = arg1 CMP arg2
-                emit_load(vm, curr->arg1);
-                emit_load(vm, curr->arg2);
+                emit_load(cg, vm, curr->arg1);
+                emit_load(cg, vm, curr->arg2);
                 
-                int result_idx = get_var_index(curr->result);
+                int result_idx = get_var_index(cg, curr->result);
                 
                 switch (curr->op) {
                     case IR_EQ:  vm_add_instr(vm, OP_EQ, 0); break;
@@ -339,7 +581,7 @@ VM* codegen_vm(IRInstr *ir) {
             
             case IR_PRINT: {
                 // print arg1
-                emit_load(vm, curr->arg1);
+                emit_load(cg, vm, curr->arg1);
                 vm_add_instr(vm, OP_PRINT, 0);
                 break;
             }
@@ -347,52 +589,40 @@ VM* codegen_vm(IRInstr *ir) {
             case IR_INPUT: {
                 // input result
                 vm_add_instr(vm, OP_INPUT, 0);
-                int dst_idx = get_var_index(curr->result);
+                int dst_idx = get_var_index(cg, curr->result);
                 vm_add_instr(vm, OP_STORE_LOCAL, dst_idx);
                 break;
             }
             
             case IR_LABEL:
-                // Labels are already processed in first pass
+                place_label(cg, vm, curr->result);
                 break;
             
             case IR_GOTO: {
                 // goto result
-                int addr = get_label_address(curr->result);
-                if (addr >= 0) {
-                    vm_add_instr(vm, OP_JMP, addr);
-                } else {
-                    fprintf(stderr, "Codegen Error: Undefined label '%s'\n", curr->result);
-                }
+                emit_jump(cg, vm, OP_JMP, curr->result);
                 break;
             }
             
             case IR_IF_FALSE: {
                 // if false arg1 goto result
-                emit_load(vm, curr->arg1);
-                int addr = get_label_address(curr->result);
-                
-                if (addr >= 0) {
-                    vm_add_instr(vm, OP_JMP_FALSE, addr);
-                } else {
-                    fprintf(stderr, "Codegen Error: Undefined label '%s'\n", curr->result);
-                }
+                emit_load(cg, vm, curr->arg1);
+                emit_jump(cg, vm, OP_JMP_FALSE, curr->result);
                 break;
             }
             
             case IR_RETURN:
                 // Push return value if present
                 if (curr->arg1) {
-                    emit_load(vm, curr->arg1);
+                    emit_load(cg, vm, curr->arg1);
                 }
                 vm_add_instr(vm, OP_RETURN, 0);
                 break;
             
             case IR_TRY_START: {
                 // try start (arg1 = catch label)
-                int addr = get_label_address(curr->arg1);
-                if (addr >= 0) {
-                    vm_add_instr(vm, OP_TRY, addr);
+                if (curr->arg1) {
+                    emit_jump(cg, vm, OP_TRY, curr->arg1);
                 }
                 break;
             }
@@ -405,10 +635,54 @@ VM* codegen_vm(IRInstr *ir) {
                 vm_add_instr(vm, OP_THROW, 0);
                 break;
             
+            case IR_WAIT:
+                // wait arg1 (seconds)
+                emit_load(cg, vm, curr->arg1);
+                vm_add_instr(vm, OP_WAIT, 0);
+                break;
+            
+            case IR_SPAWN:
+                // start a fiber at label result
+                emit_jump(cg, vm, OP_SPAWN, curr->result);
+                break;
+            
+            case IR_FIBER_EXIT:
+                vm_add_instr(vm, OP_FIBER_EXIT, 0);
+                break;
+            
+            case IR_ISOLATE:
+                // start an isolate at label result
+                emit_jump(cg, vm, OP_ISOLATE, curr->result);
+                break;
+            
+            case IR_PAR_REDUCE:
+                // Like IR_PARAM, held until the loop it belongs to
+                if (cg->reduction_count < PAR_MAX_REDUCTIONS) {
+                    cg->pending_reductions[cg->reduction_count] = curr->arg1;
+                }
+                cg->reduction_count++;
+                break;
+            
+            case IR_PAR_FOR: {
+                int index = add_par_loop(cg, vm, curr);
+                if (index >= 0) vm_add_instr(vm, OP_PARALLEL, index);
+                break;
+            }
+            
+            case IR_PAR_END:
+                close_par_loop(vm);
+                vm_add_instr(vm, OP_PAR_END, 0);
+                break;
+            
             case IR_PARAM:
-                // Push parameter onto stack for upcoming call
-                emit_load(vm, curr->arg1);
-                param_count++;
+                // Defer the push: later argument temps are stored in
+                // stack slots that would overwrite already-pushed params
+                if (cg->param_count < MAX_CALL_PARAMS) {
+                    cg->pending_params[cg->param_count] = curr->arg1;
+                } else {
+                    fprintf(stderr, "Codegen Error: Too many call arguments\n");
+                }
+                cg->param_count++;
                 break;
             
             case IR_CALL: {
@@ -418,12 +692,37 @@ VM* codegen_vm(IRInstr *ir) {
                     break;
                 }
                 
+                for (int i = 0; i < cg->param_count && i < MAX_CALL_PARAMS; i++) {
+                    emit_load(cg, vm, cg->pending_params[i]);
+                }
+                
+                const BuiltinEntry *builtin = find_builtin(curr->arg1);
+                if (builtin) {
+                    if (cg->param_count != builtin->num_args) {
+                        fprintf(stderr, "Codegen Error: %s expects %d arguments, got %d\n",
+                                builtin->name, builtin->num_args, cg->param_count);
+                    }
+                    vm_add_instr(vm, builtin->op, 0);
+                    
+                    if (!builtin->has_result) {
+                        vm_add_instr(vm, OP_PUSH, 0);
+                    }
+                    if (curr->result) {
+                        vm_add_instr(vm, OP_STORE_LOCAL, get_var_index(cg, curr->result));
+                    } else {
+                        vm_add_instr(vm, OP_POP, 0);
+                    }
+                    
+                    cg->param_count = 0;
+                    break;
+                }
+                
                 // Get or create function index
                 int func_idx = vm_get_function(vm, curr->arg1);
                 if (func_idx < 0) {
                     // Function not yet registered, add placeholder
                     // Address will be updated when function label is found
-                    func_idx = vm_add_function(vm, curr->arg1, -1, param_count);
+                    func_idx = vm_add_function(vm, curr->arg1, -1, cg->param_count);
                 }
                 
                 if (func_idx >= 0) {
@@ -432,7 +731,7 @@ VM* codegen_vm(IRInstr *ir) {
                     
                     // Store return value if result is specified
                     if (curr->result) {
-                        int dst_idx = get_var_index(curr->result);
+                        int dst_idx = get_var_index(cg, curr->result);
                         vm_add_instr(vm, OP_STORE_LOCAL, dst_idx);
                     } else {
                         // Pop unused return value
@@ -440,7 +739,7 @@ VM* codegen_vm(IRInstr *ir) {
                     }
                 }
                 
-                param_count = 0;  // Reset for next call
+                cg->param_count = 0;  // Reset for next call
                 break;
             }
             
@@ -449,33 +748,47 @@ VM* codegen_vm(IRInstr *ir) {
                 break;
         }
         
+        // Line table for error reports and profilers
+        for (int pc = first_pc; pc < vm->code_size; pc++) {
+            if (vm->code[pc].line == 0) vm->code[pc].line = curr->line;
+        }
+        
         curr = curr->next;
     }
     
+    patch_jumps(cg, vm);
+    
+    for (int i = 0; i < vm->par_loop_count; i++) {
+        VMParLoop *loop = &vm->par_loops[i];
+        const char *blocker = loop->parallel ? par_loop_blocker(vm, loop) : NULL;
+        if (blocker) {
+            int line = loop->top_pc < vm->code_size ? vm->code[loop->top_pc].line : 0;
+            fprintf(stderr, "Codegen Warning: Line %d: somantorale loop runs sequentially (%s)\n",
+                    line, blocker);
+            loop->parallel = 0;
+        }
+    }
+    
+    // Literals are referenced from the code itself, so the GC keeps them
+    vm->static_string_count = vm->string_count;
+    
     // Add final HALT if not already present
     if (vm->code_size == 0 || vm->code[vm->code_size - 1].code != OP_HALT) {
         vm_add_instr(vm, OP_HALT, 0);
     }
     
-    return vm;
-}
-
-/* Cleanup function */
-void codegen_vm_cleanup() {
-    for (int i = 0; i < label_count; i++) {
-        if (labels[i].name) {
-            free(labels[i].name);
-            labels[i].name = NULL;
-        }
-    }
+    vm->local_count = cg->var_count;
+    emit_stack_maps(vm);
     
-    for (int i = 0; i < var_count; i++) {
-        if (vars[i].name) {
-            free(vars[i].name);
-            vars[i].name = NULL;
+    // Keep the source names of the locals (the VM owns them from here)
+    vm->local_names = (char**)calloc(cg->var_count + 1, sizeof(char*));
+    if (vm->local_names) {
+        for (int i = 0; i < cg->var_count; i++) {
+            vm->local_names[cg->vars[i].index] = cg->vars[i].name;
+            cg->vars[i].name = NULL;
         }
     }
     
-    label_count = 0;
-    var_count = 0;
+    codegen_free(cg);
+    return vm;
 }
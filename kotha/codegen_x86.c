@@ -0,0 +1,1070 @@
+/*
+ * Kotha Native Code Generator
+ * Lowers the IR (the same 3-address code the VM backend consumes) to
+ * x86-64 assembly for GNU as, then assembles and links it with as/ld
+ * against a small freestanding runtime (no C compiler or libc needed).
+ *
+ * Pipeline:
+ *   1. Number IR variables and infer a static type for each (int or string)
+ *   2. Liveness over the IR control-flow graph gives each variable a live
+ *      interval; linear scan assigns registers, spilling to the stack frame
+ *   3. Each IR instruction becomes a fixed instruction sequence; a compare
+ *      feeding only the next IF_FALSE becomes cmp + jcc
+ *
+ * Supported: integer arithmetic and comparisons, string literals, print,
+ * input, branches and loops. Function calls, maps/arrays, floats and
+ * exceptions are reported as unsupported (build with --vm for those).
+ */
+
+#include "codegen_x86.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+/* Static type of an IR variable */
+typedef enum {
+    X86_UNTYPED = 0,
+    X86_INT = 1,
+    X86_STRING = 2,
+    X86_MIXED = 3
+} X86Type;
+
+typedef enum {
+    LOC_REG,
+    LOC_STACK
+} X86LocKind;
+
+typedef struct {
+    char *name;
+    X86Type type;
+    int start, end;          // Live interval (instruction indices)
+    X86LocKind kind;
+    int where;               // Register index or stack slot
+} X86Var;
+
+typedef struct {
+    IRInstr **code;
+    int count;
+
+    X86Var *vars;
+    int var_count;
+    int var_capacity;
+
+    // Per instruction: variable ids (-1 = literal/none)
+    int *def;
+    int *use1;
+    int *use2;
+    int *target;             // Jump target index (GOTO / IF_FALSE)
+
+    // Liveness bitsets, 'words' per instruction
+    uint64_t *live_in;
+    uint64_t *live_out;
+    int words;
+
+    int spill_count;
+    int string_count;
+    int label_id;
+} X86Gen;
+
+/* Allocatable registers; rax, rcx, rdx and rdi are scratch (the runtime
+ * preserves everything else) */
+static const char *reg32[] = {"%ebx", "%ebp", "%esi", "%r8d", "%r9d", "%r10d", "%r11d",
+                              "%r12d", "%r13d", "%r14d", "%r15d"};
+static const char *reg64[] = {"%rbx", "%rbp", "%rsi", "%r8", "%r9", "%r10", "%r11",
+                              "%r12", "%r13", "%r14", "%r15"};
+#define X86_REG_COUNT ((int)(sizeof(reg32) / sizeof(reg32[0])))
+
+/* Helpers for IR operands */
+static int is_string_literal(const char *s) {
+    return s && s[0] == '"';
+}
+
+static int is_int_literal(const char *s) {
+    if (!s) return 0;
+    if (*s == '-' || *s == '+') s++;
+    if (!*s) return 0;
+    while (*s) {
+        if (!isdigit((unsigned char)*s)) return 0;
+        s++;
+    }
+    return 1;
+}
+
+static int is_float_literal(const char *s) {
+    if (!s || is_int_literal(s)) return 0;
+    if (*s == '-' || *s == '+') s++;
+    int digits = 0, dots = 0;
+    for (; *s; s++) {
+        if (isdigit((unsigned char)*s)) digits++;
+        else if (*s == '.') dots++;
+        else return 0;
+    }
+    return digits > 0 && dots == 1;
+}
+
+static int is_variable(const char *s) {
+    return s && !is_string_literal(s) && !is_int_literal(s) && !is_float_literal(s);
+}
+
+static int var_lookup(X86Gen *g, const char *name) {
+    for (int i = 0; i < g->var_count; i++) {
+        if (strcmp(g->vars[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static int var_index(X86Gen *g, const char *name) {
+    if (!is_variable(name)) return -1;
+
+    int id = var_lookup(g, name);
+    if (id >= 0) return id;
+
+    if (g->var_count >= g->var_capacity) {
+        int capacity = g->var_capacity ? g->var_capacity * 2 : 64;
+        X86Var *vars = (X86Var*)realloc(g->vars, sizeof(X86Var) * capacity);
+        if (!vars) return -1;
+        g->vars = vars;
+        g->var_capacity = capacity;
+    }
+
+    X86Var *v = &g->vars[g->var_count];
+    memset(v, 0, sizeof(*v));
+    v->name = strdup(name);
+    v->start = v->end = -1;
+    return g->var_count++;
+}
+
+static int find_label(X86Gen *g, const char *name) {
+    for (int i = 0; i < g->count; i++) {
+        if (g->code[i]->op == IR_LABEL && g->code[i]->result && strcmp(g->code[i]->result, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static const char* unsupported_reason(IRInstr *instr) {
+    switch (instr->op) {
+        case IR_PARAM:
+        case IR_CALL:
+            return "function calls (including maps and arrays)";
+        case IR_TRY_START:
+        case IR_TRY_END:
+        case IR_CATCH:
+        case IR_THROW:
+            return "exceptions";
+        case IR_SPAWN:
+        case IR_FIBER_EXIT:
+            return "fibers (spawn)";
+        case IR_ISOLATE:
+            return "isolates";
+        default:
+            break;
+    }
+    if (is_float_literal(instr->arg1) || is_float_literal(instr->arg2)) {
+        return "floating-point values";
+    }
+    return NULL;
+}
+
+/* Pass 1: flatten the IR, number variables and resolve jump targets */
+static int x86_collect(X86Gen *g, IRInstr *ir) {
+    for (IRInstr *curr = ir; curr; curr = curr->next) g->count++;
+
+    g->code = (IRInstr**)malloc(sizeof(IRInstr*) * (g->count + 1));
+    g->def = (int*)malloc(sizeof(int) * (g->count + 1));
+    g->use1 = (int*)malloc(sizeof(int) * (g->count + 1));
+    g->use2 = (int*)malloc(sizeof(int) * (g->count + 1));
+    g->target = (int*)malloc(sizeof(int) * (g->count + 1));
+    if (!g->code || !g->def || !g->use1 || !g->use2 || !g->target) {
+        fprintf(stderr, "Native Codegen Error: Out of memory\n");
+        return -1;
+    }
+
+    int i = 0;
+    for (IRInstr *curr = ir; curr; curr = curr->next) g->code[i++] = curr;
+
+    for (i = 0; i < g->count; i++) {
+        IRInstr *instr = g->code[i];
+        const char *reason = unsupported_reason(instr);
+        if (reason) {
+            fprintf(stderr, "Native Codegen Error: %s are not supported yet (use --vm)\n", reason);
+            return -1;
+        }
+
+        g->def[i] = g->use1[i] = g->use2[i] = g->target[i] = -1;
+        switch (instr->op) {
+            case IR_ASSIGN:
+                g->use1[i] = var_index(g, instr->arg1);
+                g->def[i] = var_index(g, instr->result);
+                break;
+            case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD:
+            case IR_EQ: case IR_NEQ: case IR_LT: case IR_GT: case IR_LTE: case IR_GTE:
+                g->use1[i] = var_index(g, instr->arg1);
+                g->use2[i] = var_index(g, instr->arg2);
+                g->def[i] = var_index(g, instr->result);
+                break;
+            case IR_PRINT:
+            case IR_RETURN:
+            case IR_WAIT:
+                g->use1[i] = var_index(g, instr->arg1);
+                break;
+            case IR_INPUT:
+                g->def[i] = var_index(g, instr->result);
+                break;
+            case IR_IF_FALSE:
+                g->use1[i] = var_index(g, instr->arg1);
+                /* fall through */
+            case IR_GOTO:
+                g->target[i] = find_label(g, instr->result);
+                if (g->target[i] < 0) {
+                    fprintf(stderr, "Native Codegen Error: Undefined label '%s'\n", instr->result);
+                    return -1;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return 0;
+}
+
+/* Pass 2: static types. Arithmetic and comparisons always produce
+ * integers (the VM yields 0 for non-numeric operands); a variable that
+ * holds both numbers and strings has no native representation. */
+static int x86_infer_types(X86Gen *g) {
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = 0; i < g->count; i++) {
+            if (g->def[i] < 0) continue;
+
+            IRInstr *instr = g->code[i];
+            X86Type type = X86_INT;
+            if (instr->op == IR_ASSIGN) {
+                if (is_string_literal(instr->arg1)) type = X86_STRING;
+                else if (g->use1[i] >= 0) type = g->vars[g->use1[i]].type;
+            }
+
+            X86Var *v = &g->vars[g->def[i]];
+            if ((v->type | type) != v->type) {
+                v->type |= type;
+                changed = 1;
+            }
+        }
+    }
+
+    for (int i = 0; i < g->var_count; i++) {
+        if (g->vars[i].type == X86_MIXED) {
+            fprintf(stderr, "Native Codegen Error: '%s' holds both numbers and strings (use --vm)\n",
+                    g->vars[i].name);
+            return -1;
+        }
+        if (g->vars[i].type == X86_UNTYPED) g->vars[i].type = X86_INT;
+    }
+    return 0;
+}
+
+#define BIT_SET(set, id)  ((set)[(id) / 64] |= 1ULL << ((id) % 64))
+#define BIT_CLEAR(set, id) ((set)[(id) / 64] &= ~(1ULL << ((id) % 64)))
+#define BIT_TEST(set, id) (((set)[(id) / 64] >> ((id) % 64)) & 1)
+
+/* Pass 3: liveness, then one conservative interval per variable */
+static int x86_liveness(X86Gen *g) {
+    int n = g->count;
+    g->words = (g->var_count + 63) / 64;
+    if (g->words == 0) g->words = 1;
+
+    g->live_in = (uint64_t*)calloc((size_t)(n + 1) * g->words, sizeof(uint64_t));
+    g->live_out = (uint64_t*)calloc((size_t)(n + 1) * g->words, sizeof(uint64_t));
+    if (!g->live_in || !g->live_out) {
+        fprintf(stderr, "Native Codegen Error: Out of memory\n");
+        return -1;
+    }
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = n - 1; i >= 0; i--) {
+            uint64_t *out = &g->live_out[(size_t)i * g->words];
+            uint64_t *in = &g->live_in[(size_t)i * g->words];
+            IROp op = g->code[i]->op;
+
+            int succ[2] = {-1, -1};
+            if (op == IR_GOTO) {
+                succ[0] = g->target[i];
+            } else if (op == IR_IF_FALSE) {
+                succ[0] = i + 1;
+                succ[1] = g->target[i];
+            } else if (op != IR_RETURN) {
+                succ[0] = i + 1;
+            }
+
+            for (int s = 0; s < 2; s++) {
+                if (succ[s] < 0 || succ[s] >= n) continue;
+                uint64_t *next = &g->live_in[(size_t)succ[s] * g->words];
+                for (int w = 0; w < g->words; w++) {
+                    if ((out[w] | next[w]) != out[w]) {
+                        out[w] |= next[w];
+                        changed = 1;
+                    }
+                }
+            }
+
+            for (int w = 0; w < g->words; w++) {
+                uint64_t value = out[w];
+                if (g->def[i] >= 0 && g->def[i] / 64 == w) value &= ~(1ULL << (g->def[i] % 64));
+                if (g->use1[i] >= 0 && g->use1[i] / 64 == w) value |= 1ULL << (g->use1[i] % 64);
+                if (g->use2[i] >= 0 && g->use2[i] / 64 == w) value |= 1ULL << (g->use2[i] % 64);
+                if (value != in[w]) {
+                    in[w] = value;
+                    changed = 1;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        int ids[3] = {g->def[i], g->use1[i], g->use2[i]};
+        for (int v = 0; v < g->var_count; v++) {
+            int touched = BIT_TEST(&g->live_in[(size_t)i * g->words], v) ||
+                          BIT_TEST(&g->live_out[(size_t)i * g->words], v) ||
+                          v == ids[0] || v == ids[1] || v == ids[2];
+            if (!touched) continue;
+            if (g->vars[v].start < 0) g->vars[v].start = i;
+            g->vars[v].end = i;
+        }
+    }
+    return 0;
+}
+
+/* Pass 4: linear scan register allocation (Poletto & Sarkar) */
+static void x86_allocate(X86Gen *g) {
+    int *order = (int*)malloc(sizeof(int) * (g->var_count + 1));
+    int active[X86_REG_COUNT];
+    int active_count = 0;
+    int free_regs[X86_REG_COUNT];
+    int free_count = 0;
+    int count = 0;
+
+    if (!order) {
+        // Everything on the stack still produces correct code
+        for (int v = 0; v < g->var_count; v++) {
+            g->vars[v].kind = LOC_STACK;
+            g->vars[v].where = g->spill_count++;
+        }
+        return;
+    }
+
+    for (int r = X86_REG_COUNT - 1; r >= 0; r--) free_regs[free_count++] = r;
+
+    // Variables in order of interval start (insertion sort; IR order is nearly sorted)
+    for (int v = 0; v < g->var_count; v++) {
+        if (g->vars[v].start < 0) continue;
+        int j = count++;
+        while (j > 0 && g->vars[order[j - 1]].start > g->vars[v].start) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = v;
+    }
+
+    for (int k = 0; k < count; k++) {
+        X86Var *v = &g->vars[order[k]];
+
+        for (int j = 0; j < active_count; ) {
+            X86Var *other = &g->vars[active[j]];
+            if (other->end < v->start) {
+                free_regs[free_count++] = other->where;
+                active[j] = active[--active_count];
+            } else {
+                j++;
+            }
+        }
+
+        if (free_count > 0) {
+            v->kind = LOC_REG;
+            v->where = free_regs[--free_count];
+            active[active_count++] = order[k];
+            continue;
+        }
+
+        int victim = -1;
+        for (int j = 0; j < active_count; j++) {
+            if (victim < 0 || g->vars[active[j]].end > g->vars[active[victim]].end) victim = j;
+        }
+        X86Var *spilled = &g->vars[active[victim]];
+        if (spilled->end > v->end) {
+            v->kind = LOC_REG;
+            v->where = spilled->where;
+            spilled->kind = LOC_STACK;
+            spilled->where = g->spill_count++;
+            active[victim] = order[k];
+        } else {
+            v->kind = LOC_STACK;
+            v->where = g->spill_count++;
+        }
+    }
+
+    free(order);
+}
+
+/* Operand text for a variable or integer literal */
+static const char* x86_operand(X86Gen *g, const char *arg, int wide, char *buf, size_t size) {
+    int id = var_lookup(g, arg ? arg : "");
+    if (!arg || id < 0) {
+        snprintf(buf, size, "$%d", arg && is_int_literal(arg) ? atoi(arg) : 0);
+        return buf;
+    }
+
+    X86Var *v = &g->vars[id];
+    if (v->kind == LOC_REG) return wide ? reg64[v->where] : reg32[v->where];
+    snprintf(buf, size, "%d(%%rsp)", v->where * 8);
+    return buf;
+}
+
+static int x86_in_register(X86Gen *g, const char *arg) {
+    int id = arg ? var_lookup(g, arg) : -1;
+    return id >= 0 && g->vars[id].kind == LOC_REG;
+}
+
+static int x86_same_location(X86Gen *g, const char *a, const char *b) {
+    int x = a ? var_lookup(g, a) : -1;
+    int y = b ? var_lookup(g, b) : -1;
+    return x >= 0 && y >= 0 && g->vars[x].kind == g->vars[y].kind && g->vars[x].where == g->vars[y].where;
+}
+
+static X86Type x86_type_of(X86Gen *g, const char *arg) {
+    if (is_string_literal(arg)) return X86_STRING;
+    int id = arg ? var_lookup(g, arg) : -1;
+    return id >= 0 ? g->vars[id].type : X86_INT;
+}
+
+/* Store eax (or rax for strings) into a variable */
+static void x86_store(X86Gen *g, FILE *out, const char *dst, int wide) {
+    char buf[32];
+    fprintf(out, "    mov%c %s, %s\n", wide ? 'q' : 'l', wide ? "%rax" : "%eax",
+            x86_operand(g, dst, wide, buf, sizeof(buf)));
+}
+
+static void x86_string_literal(X86Gen *g, FILE *out, const char *lit) {
+    // Literal text between the quotes, bytes as-is (matches the VM's pool)
+    size_t len = strlen(lit);
+    size_t start = 1, end = len;
+    if (len >= 2 && lit[len - 1] == '"') end = len - 1;
+
+    fprintf(out, "    .section .rodata\n.Lkotha_str%d:\n    .byte ", g->string_count);
+    for (size_t i = start; i < end; i++) fprintf(out, "%d,", (unsigned char)lit[i]);
+    fprintf(out, "0\n    .text\n");
+    fprintf(out, "    leaq .Lkotha_str%d(%%rip), %%rax\n", g->string_count++);
+}
+
+static const char* condition_suffix(IROp op) {
+    switch (op) {
+        case IR_EQ: return "e";
+        case IR_NEQ: return "ne";
+        case IR_LT: return "l";
+        case IR_GT: return "g";
+        case IR_LTE: return "le";
+        default: return "ge";   // IR_GTE
+    }
+}
+
+static const char* inverse_condition_suffix(IROp op) {
+    switch (op) {
+        case IR_EQ: return "ne";
+        case IR_NEQ: return "e";
+        case IR_LT: return "ge";
+        case IR_GT: return "le";
+        case IR_LTE: return "g";
+        default: return "l";    // IR_GTE
+    }
+}
+
+static int is_compare(IROp op) {
+    return op == IR_EQ || op == IR_NEQ || op == IR_LT || op == IR_GT || op == IR_LTE || op == IR_GTE;
+}
+
+/* A compare whose only use is the IF_FALSE right after it */
+static int fuses_with_next(X86Gen *g, int i) {
+    IRInstr *instr = g->code[i];
+    if (!is_compare(instr->op) || i + 1 >= g->count || g->def[i] < 0) return 0;
+
+    IRInstr *next = g->code[i + 1];
+    if (next->op != IR_IF_FALSE || g->use1[i + 1] != g->def[i]) return 0;
+    return !BIT_TEST(&g->live_out[(size_t)(i + 1) * g->words], g->def[i]);
+}
+
+static void x86_label(FILE *out, const char *name) {
+    fprintf(out, ".Lk_");
+    for (const char *p = name; *p; p++) {
+        fputc(isalnum((unsigned char)*p) ? *p : '_', out);
+    }
+}
+
+/* Pass 5: emit each IR instruction */
+static void x86_emit_instr(X86Gen *g, FILE *out, int i) {
+    IRInstr *instr = g->code[i];
+    char a[32], b[32], d[32];
+
+    switch (instr->op) {
+        case IR_NOP:
+        case IR_CATCH:
+            break;
+
+        case IR_LABEL:
+            x86_label(out, instr->result);
+            fprintf(out, ":\n");
+            break;
+
+        case IR_ASSIGN: {
+            if (g->def[i] < 0) break;
+            int wide = g->vars[g->def[i]].type == X86_STRING;
+            if (is_string_literal(instr->arg1)) {
+                x86_string_literal(g, out, instr->arg1);
+                x86_store(g, out, instr->result, 1);
+            } else if (x86_same_location(g, instr->arg1, instr->result)) {
+                break;
+            } else if (x86_in_register(g, instr->result) || x86_in_register(g, instr->arg1) ||
+                       !is_variable(instr->arg1)) {
+                fprintf(out, "    mov%c %s, %s\n", wide ? 'q' : 'l',
+                        x86_operand(g, instr->arg1, wide, a, sizeof(a)),
+                        x86_operand(g, instr->result, wide, d, sizeof(d)));
+            } else {
+                fprintf(out, "    mov%c %s, %s\n", wide ? 'q' : 'l',
+                        x86_operand(g, instr->arg1, wide, a, sizeof(a)), wide ? "%rax" : "%eax");
+                x86_store(g, out, instr->result, wide);
+            }
+            break;
+        }
+
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL: {
+            // The VM yields 0 when an operand is not a number
+            if (x86_type_of(g, instr->arg1) != X86_INT || x86_type_of(g, instr->arg2) != X86_INT) {
+                fprintf(out, "    movl $0, %s\n", x86_operand(g, instr->result, 0, d, sizeof(d)));
+                break;
+            }
+            const char *mnemonic = instr->op == IR_ADD ? "addl" : instr->op == IR_SUB ? "subl" : "imull";
+            const char *lhs = x86_operand(g, instr->arg1, 0, a, sizeof(a));
+            const char *rhs = x86_operand(g, instr->arg2, 0, b, sizeof(b));
+
+            if (x86_in_register(g, instr->result) && !x86_same_location(g, instr->result, instr->arg2)) {
+                const char *dst = x86_operand(g, instr->result, 0, d, sizeof(d));
+                if (!x86_same_location(g, instr->result, instr->arg1)) {
+                    fprintf(out, "    movl %s, %s\n", lhs, dst);
+                }
+                fprintf(out, "    %s %s, %s\n", mnemonic, rhs, dst);
+            } else {
+                fprintf(out, "    movl %s, %%eax\n", lhs);
+                fprintf(out, "    %s %s, %%eax\n", mnemonic, rhs);
+                x86_store(g, out, instr->result, 0);
+            }
+            break;
+        }
+
+        case IR_DIV:
+        case IR_MOD: {
+            if (x86_type_of(g, instr->arg1) != X86_INT || x86_type_of(g, instr->arg2) != X86_INT) {
+                fprintf(out, "    movl $0, %s\n", x86_operand(g, instr->result, 0, d, sizeof(d)));
+                break;
+            }
+            int id = g->label_id++;
+            fprintf(out, "    movl %s, %%ecx\n", x86_operand(g, instr->arg2, 0, b, sizeof(b)));
+            fprintf(out, "    testl %%ecx, %%ecx\n");
+            fprintf(out, "    jz kotha_rt_div_zero\n");
+            fprintf(out, "    movl %s, %%eax\n", x86_operand(g, instr->arg1, 0, a, sizeof(a)));
+            // x / -1 wraps instead of trapping on INT_MIN
+            fprintf(out, "    cmpl $-1, %%ecx\n");
+            fprintf(out, "    jne .Lkotha_div%d\n", id);
+            fprintf(out, instr->op == IR_DIV ? "    negl %%eax\n" : "    xorl %%eax, %%eax\n");
+            fprintf(out, "    jmp .Lkotha_div%d_done\n", id);
+            fprintf(out, ".Lkotha_div%d:\n", id);
+            fprintf(out, "    cltd\n");
+            fprintf(out, "    idivl %%ecx\n");
+            if (instr->op == IR_MOD) fprintf(out, "    movl %%edx, %%eax\n");
+            fprintf(out, ".Lkotha_div%d_done:\n", id);
+            x86_store(g, out, instr->result, 0);
+            break;
+        }
+
+        case IR_EQ:
+        case IR_NEQ:
+        case IR_LT:
+        case IR_GT:
+        case IR_LTE:
+        case IR_GTE: {
+            if (x86_type_of(g, instr->arg1) != X86_INT || x86_type_of(g, instr->arg2) != X86_INT) {
+                // The VM's comparisons are integer-only; anything else is false
+                if (fuses_with_next(g, i)) {
+                    fprintf(out, "    jmp ");
+                    x86_label(out, g->code[i + 1]->result);
+                    fprintf(out, "\n");
+                } else {
+                    fprintf(out, "    movl $0, %s\n", x86_operand(g, instr->result, 0, d, sizeof(d)));
+                }
+                break;
+            }
+            fprintf(out, "    movl %s, %%eax\n", x86_operand(g, instr->arg1, 0, a, sizeof(a)));
+            fprintf(out, "    cmpl %s, %%eax\n", x86_operand(g, instr->arg2, 0, b, sizeof(b)));
+            if (fuses_with_next(g, i)) {
+                fprintf(out, "    j%s ", inverse_condition_suffix(instr->op));
+                x86_label(out, g->code[i + 1]->result);
+                fprintf(out, "\n");
+                break;
+            }
+            fprintf(out, "    set%s %%al\n", condition_suffix(instr->op));
+            fprintf(out, "    movzbl %%al, %%eax\n");
+            x86_store(g, out, instr->result, 0);
+            break;
+        }
+
+        case IR_IF_FALSE:
+            if (i > 0 && fuses_with_next(g, i - 1)) break;
+            if (x86_type_of(g, instr->arg1) != X86_INT) break;  // Only integer 0 is false
+            if (is_int_literal(instr->arg1)) {
+                if (atoi(instr->arg1) != 0) break;
+                fprintf(out, "    jmp ");
+            } else {
+                fprintf(out, "    cmpl $0, %s\n", x86_operand(g, instr->arg1, 0, a, sizeof(a)));
+                fprintf(out, "    je ");
+            }
+            x86_label(out, instr->result);
+            fprintf(out, "\n");
+            break;
+
+        case IR_GOTO:
+            fprintf(out, "    jmp ");
+            x86_label(out, instr->result);
+            fprintf(out, "\n");
+            break;
+
+        case IR_PRINT:
+            if (!instr->arg1) break;
+            if (is_string_literal(instr->arg1)) {
+                x86_string_literal(g, out, instr->arg1);
+                fprintf(out, "    movq %%rax, %%rdi\n");
+                fprintf(out, "    call kotha_rt_print_str\n");
+            } else if (x86_type_of(g, instr->arg1) == X86_STRING) {
+                fprintf(out, "    movq %s, %%rdi\n", x86_operand(g, instr->arg1, 1, a, sizeof(a)));
+                fprintf(out, "    call kotha_rt_print_str\n");
+            } else {
+                fprintf(out, "    movl %s, %%edi\n", x86_operand(g, instr->arg1, 0, a, sizeof(a)));
+                fprintf(out, "    call kotha_rt_print_int\n");
+            }
+            break;
+
+        case IR_INPUT:
+            fprintf(out, "    call kotha_rt_read_int\n");
+            x86_store(g, out, instr->result, 0);
+            break;
+
+        case IR_WAIT:
+            if (x86_type_of(g, instr->arg1) != X86_INT) break;
+            fprintf(out, "    movl %s, %%edi\n", x86_operand(g, instr->arg1, 0, a, sizeof(a)));
+            fprintf(out, "    call kotha_rt_sleep\n");
+            break;
+
+        case IR_RETURN:
+            fprintf(out, "    jmp .Lkotha_exit\n");
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void x86_free(X86Gen *g) {
+    for (int i = 0; i < g->var_count; i++) free(g->vars[i].name);
+    free(g->vars);
+    free(g->code);
+    free(g->def);
+    free(g->use1);
+    free(g->use2);
+    free(g->target);
+    free(g->live_in);
+    free(g->live_out);
+}
+
+int codegen_x86(IRInstr *ir, FILE *out) {
+    X86Gen g;
+    memset(&g, 0, sizeof(g));
+
+    if (x86_collect(&g, ir) < 0 || x86_infer_types(&g) < 0 || x86_liveness(&g) < 0) {
+        x86_free(&g);
+        return -1;
+    }
+    x86_allocate(&g);
+
+    // Keep rsp 16-byte aligned after the six pushes and the return address
+    int frame = ((g.spill_count * 8 + 8 + 15) & ~15) - 8;
+
+    fprintf(out, "# Generated by the Kotha native backend\n");
+    fprintf(out, "    .text\n");
+    fprintf(out, "    .globl kotha_main\n");
+    fprintf(out, "    .type kotha_main, @function\n");
+    fprintf(out, "kotha_main:\n");
+    fprintf(out, "    pushq %%rbx\n    pushq %%rbp\n    pushq %%r12\n");
+    fprintf(out, "    pushq %%r13\n    pushq %%r14\n    pushq %%r15\n");
+    fprintf(out, "    subq $%d, %%rsp\n", frame);
+
+    // Variables read before any assignment start as 0, like VM locals
+    for (int v = 0; v < g.var_count; v++) {
+        if (g.count > 0 && BIT_TEST(&g.live_in[0], v)) {
+            char buf[32];
+            fprintf(out, "    mov%c $0, %s\n", g.vars[v].type == X86_STRING ? 'q' : 'l',
+                    x86_operand(&g, g.vars[v].name, g.vars[v].type == X86_STRING, buf, sizeof(buf)));
+        }
+    }
+
+    for (int i = 0; i < g.count; i++) {
+        x86_emit_instr(&g, out, i);
+    }
+
+    fprintf(out, ".Lkotha_exit:\n");
+    fprintf(out, "    addq $%d, %%rsp\n", frame);
+    fprintf(out, "    popq %%r15\n    popq %%r14\n    popq %%r13\n");
+    fprintf(out, "    popq %%r12\n    popq %%rbp\n    popq %%rbx\n");
+    fprintf(out, "    xorl %%eax, %%eax\n");
+    fprintf(out, "    ret\n");
+    fprintf(out, "    .size kotha_main, .-kotha_main\n");
+    fprintf(out, "    .section .note.GNU-stack,\"\",@progbits\n");
+
+    x86_free(&g);
+    return 0;
+}
+
+/* Runtime: Linux system calls only. Every kotha_rt_* entry point preserves
+ * all registers except rax, rcx, rdx and rdi. */
+static const char *x86_runtime_source =
+    "# Kotha native runtime\n"
+    "    .bss\n"
+    "    .lcomm kotha_rt_out, 4096\n"
+    "    .lcomm kotha_rt_out_len, 8\n"
+    "    .lcomm kotha_rt_in, 4096\n"
+    "    .lcomm kotha_rt_in_pos, 8\n"
+    "    .lcomm kotha_rt_in_len, 8\n"
+    "\n"
+    "    .section .rodata\n"
+    "kotha_rt_div_msg:\n"
+    "    .ascii \"\\n\xF0\x9F\x90\xAF Kotha Runtime Error\\n\"\n"
+    "    .ascii \"\xE2\x94\x81\xE2\x94\x81\xE2\x94\x81\xE2\x94\x81\xE2\x94\x81\xE2\x94\x81\xE2\x94\x81\xE2\x94\x81\xE2\x94\x81\xE2\x94\x81\xE2\x94\x81\"\n"
+    "    .ascii \"\xE2\x94\x81\xE2\x94\x81\xE2\x94\x81\xE2\x94\x81\xE2\x94\x81\xE2\x94\x81\xE2\x94\x81\xE2\x94\x81\xE2\x94\x81\xE2\x94\x81\xE2\x94\x81\\n\"\n"
+    "    .ascii \"Division by zero\\n\\n\"\n"
+    "kotha_rt_div_msg_end:\n"
+    "\n"
+    "    .text\n"
+    "    .globl _start\n"
+    "_start:\n"
+    "    xorl %ebp, %ebp\n"
+    "    andq $-16, %rsp\n"
+    "    call kotha_main\n"
+    "    movl %eax, %ebx\n"
+    "    call kotha_rt_flush\n"
+    "    movl %ebx, %edi\n"
+    "    movl $60, %eax\n"                 // exit
+    "    syscall\n"
+    "\n"
+    "# Write buffered output (clobbers rax, rcx, rdx, rsi, rdi, r11)\n"
+    "kotha_rt_flush:\n"
+    "    leaq kotha_rt_out(%rip), %rsi\n"
+    "    movq kotha_rt_out_len(%rip), %rdx\n"
+    "1:  testq %rdx, %rdx\n"
+    "    jz 2f\n"
+    "    movl $1, %eax\n"                  // write(1, ...)
+    "    movl $1, %edi\n"
+    "    syscall\n"
+    "    testq %rax, %rax\n"
+    "    jle 2f\n"
+    "    addq %rax, %rsi\n"
+    "    subq %rax, %rdx\n"
+    "    jmp 1b\n"
+    "2:  movq $0, kotha_rt_out_len(%rip)\n"
+    "    ret\n"
+    "\n"
+    "# Append the byte in al (clobbers rax, rcx, rdx, rsi, rdi, r11)\n"
+    "kotha_rt_putc:\n"
+    "    movq kotha_rt_out_len(%rip), %rcx\n"
+    "    cmpq $4096, %rcx\n"
+    "    jb 1f\n"
+    "    pushq %rax\n"
+    "    call kotha_rt_flush\n"
+    "    popq %rax\n"
+    "    xorl %ecx, %ecx\n"
+    "1:  leaq kotha_rt_out(%rip), %rdx\n"
+    "    movb %al, (%rdx,%rcx)\n"
+    "    incq %rcx\n"
+    "    movq %rcx, kotha_rt_out_len(%rip)\n"
+    "    ret\n"
+    "\n"
+    "# Next input byte in eax, -1 at end of input (clobbers rcx, rdx, rsi, rdi, r11)\n"
+    "kotha_rt_getc:\n"
+    "    movq kotha_rt_in_pos(%rip), %rcx\n"
+    "    cmpq kotha_rt_in_len(%rip), %rcx\n"
+    "    jb 1f\n"
+    "    xorl %eax, %eax\n"                // read(0, ...)
+    "    xorl %edi, %edi\n"
+    "    leaq kotha_rt_in(%rip), %rsi\n"
+    "    movl $4096, %edx\n"
+    "    syscall\n"
+    "    testq %rax, %rax\n"
+    "    jle 2f\n"
+    "    movq %rax, kotha_rt_in_len(%rip)\n"
+    "    xorl %ecx, %ecx\n"
+    "1:  leaq kotha_rt_in(%rip), %rdx\n"
+    "    movzbl (%rdx,%rcx), %eax\n"
+    "    incq %rcx\n"
+    "    movq %rcx, kotha_rt_in_pos(%rip)\n"
+    "    ret\n"
+    "2:  movq $0, kotha_rt_in_len(%rip)\n"
+    "    movq $0, kotha_rt_in_pos(%rip)\n"
+    "    movl $-1, %eax\n"
+    "    ret\n"
+    "\n"
+    "    .globl kotha_rt_print_int\n"
+    "kotha_rt_print_int:\n"
+    "    pushq %rsi\n    pushq %r8\n    pushq %r9\n    pushq %r10\n    pushq %r11\n"
+    "    subq $32, %rsp\n"
+    "    leaq 31(%rsp), %r8\n"
+    "    movb $10, (%r8)\n"
+    "    movslq %edi, %rax\n"
+    "    movq %rax, %r9\n"
+    "    testq %rax, %rax\n"
+    "    jns 1f\n"
+    "    negq %rax\n"
+    "1:  movl $10, %ecx\n"
+    "2:  xorl %edx, %edx\n"
+    "    divq %rcx\n"
+    "    addb $48, %dl\n"
+    "    decq %r8\n"
+    "    movb %dl, (%r8)\n"
+    "    testq %rax, %rax\n"
+    "    jnz 2b\n"
+    "    testq %r9, %r9\n"
+    "    jns 3f\n"
+    "    decq %r8\n"
+    "    movb $45, (%r8)\n"
+    "3:  leaq 32(%rsp), %r10\n"
+    "4:  movb (%r8), %al\n"
+    "    call kotha_rt_putc\n"
+    "    incq %r8\n"
+    "    cmpq %r10, %r8\n"
+    "    jb 4b\n"
+    "    addq $32, %rsp\n"
+    "    popq %r11\n    popq %r10\n    popq %r9\n    popq %r8\n    popq %rsi\n"
+    "    ret\n"
+    "\n"
+    "    .globl kotha_rt_print_str\n"
+    "kotha_rt_print_str:\n"
+    "    testq %rdi, %rdi\n"
+    "    jnz 1f\n"
+    "    xorl %edi, %edi\n"                // Never assigned: prints like integer 0
+    "    jmp kotha_rt_print_int\n"
+    "1:  pushq %rsi\n    pushq %r8\n    pushq %r11\n"
+    "    movq %rdi, %r8\n"
+    "2:  movb (%r8), %al\n"
+    "    testb %al, %al\n"
+    "    jz 3f\n"
+    "    call kotha_rt_putc\n"
+    "    incq %r8\n"
+    "    jmp 2b\n"
+    "3:  movb $10, %al\n"
+    "    call kotha_rt_putc\n"
+    "    popq %r11\n    popq %r8\n    popq %rsi\n"
+    "    ret\n"
+    "\n"
+    "# Like scanf(\"%d\"): skip whitespace, optional sign, digits; a bad\n"
+    "# token discards the rest of the line and reads as 0\n"
+    "    .globl kotha_rt_read_int\n"
+    "kotha_rt_read_int:\n"
+    "    pushq %rsi\n    pushq %r8\n    pushq %r9\n    pushq %r11\n"
+    "    call kotha_rt_flush\n"
+    "1:  call kotha_rt_getc\n"
+    "    cmpl $32, %eax\n"
+    "    je 1b\n"
+    "    cmpl $9, %eax\n"
+    "    jl 2f\n"
+    "    cmpl $13, %eax\n"
+    "    jle 1b\n"
+    "2:  xorl %r9d, %r9d\n"
+    "    cmpl $45, %eax\n"
+    "    jne 3f\n"
+    "    movl $1, %r9d\n"
+    "    call kotha_rt_getc\n"
+    "    jmp 4f\n"
+    "3:  cmpl $43, %eax\n"
+    "    jne 4f\n"
+    "    call kotha_rt_getc\n"
+    "4:  subl $48, %eax\n"
+    "    cmpl $9, %eax\n"
+    "    ja 8f\n"
+    "    movl %eax, %r8d\n"
+    "5:  call kotha_rt_getc\n"
+    "    cmpl $-1, %eax\n"
+    "    je 6f\n"
+    "    subl $48, %eax\n"
+    "    cmpl $9, %eax\n"
+    "    ja 7f\n"
+    "    imull $10, %r8d\n"
+    "    addl %eax, %r8d\n"
+    "    jmp 5b\n"
+    "7:  decq kotha_rt_in_pos(%rip)\n"     // Leave the terminator unread
+    "6:  movl %r8d, %eax\n"
+    "    testl %r9d, %r9d\n"
+    "    jz 10f\n"
+    "    negl %eax\n"
+    "    jmp 10f\n"
+    "8:  addl $48, %eax\n"
+    "9:  cmpl $10, %eax\n"
+    "    je 11f\n"
+    "    cmpl $-1, %eax\n"
+    "    je 11f\n"
+    "    call kotha_rt_getc\n"
+    "    jmp 9b\n"
+    "11: xorl %eax, %eax\n"
+    "10: popq %r11\n    popq %r9\n    popq %r8\n    popq %rsi\n"
+    "    ret\n"
+    "\n"
+    "# Flush output, then sleep edi seconds\n"
+    "    .globl kotha_rt_sleep\n"
+    "kotha_rt_sleep:\n"
+    "    pushq %rsi\n    pushq %r11\n"
+    "    testl %edi, %edi\n"
+    "    jle 1f\n"
+    "    pushq %rdi\n"
+    "    call kotha_rt_flush\n"
+    "    popq %rdi\n"
+    "    subq $16, %rsp\n"
+    "    movslq %edi, %rdi\n"
+    "    movq %rdi, (%rsp)\n"              // struct timespec {seconds, 0}
+    "    movq $0, 8(%rsp)\n"
+    "    movq %rsp, %rdi\n"
+    "    xorl %esi, %esi\n"
+    "    movl $35, %eax\n"                 // nanosleep
+    "    syscall\n"
+    "    addq $16, %rsp\n"
+    "1:  popq %r11\n    popq %rsi\n"
+    "    ret\n"
+    "\n"
+    "    .globl kotha_rt_div_zero\n"
+    "kotha_rt_div_zero:\n"
+    "    call kotha_rt_flush\n"
+    "    movl $1, %eax\n"                  // write(2, ...)
+    "    movl $2, %edi\n"
+    "    leaq kotha_rt_div_msg(%rip), %rsi\n"
+    "    movl $(kotha_rt_div_msg_end - kotha_rt_div_msg), %edx\n"
+    "    syscall\n"
+    "    movl $1, %edi\n"
+    "    movl $60, %eax\n"
+    "    syscall\n"
+    "\n"
+    "    .section .note.GNU-stack,\"\",@progbits\n";
+
+void codegen_x86_runtime(FILE *out) {
+    fputs(x86_runtime_source, out);
+}
+
+#ifndef _WIN32
+/* Run a tool and wait for it; returns its exit status */
+static int run_tool(char *const argv[]) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        execvp(argv[0], argv);
+        fprintf(stderr, "Error: Cannot run '%s'\n", argv[0]);
+        _exit(127);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0) return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+#endif
+
+static char* path_with_suffix(const char *base, const char *suffix) {
+    char *path = (char*)malloc(strlen(base) + strlen(suffix) + 1);
+    if (path) {
+        strcpy(path, base);
+        strcat(path, suffix);
+    }
+    return path;
+}
+
+int codegen_x86_build(IRInstr *ir, const char *output, int asm_only, int keep_temps) {
+#ifdef _WIN32
+    (void)ir; (void)output; (void)asm_only; (void)keep_temps;
+    fprintf(stderr, "Error: The native backend targets x86-64 Linux\n");
+    return 1;
+#else
+    char *asm_file = path_with_suffix(output, ".s");
+    char *rt_asm = path_with_suffix(output, ".rt.s");
+    char *obj_file = path_with_suffix(output, ".o");
+    char *rt_obj = path_with_suffix(output, ".rt.o");
+    int status = 1;
+
+    if (!asm_file || !rt_asm || !obj_file || !rt_obj) goto done;
+
+    FILE *out = fopen(asm_file, "w");
+    if (!out) {
+        fprintf(stderr, "Error: Cannot write '%s'\n", asm_file);
+        goto done;
+    }
+    int result = codegen_x86(ir, out);
+    fclose(out);
+    if (result < 0) {
+        remove(asm_file);
+        goto done;
+    }
+    if (asm_only) {
+        status = 0;
+        goto done;
+    }
+
+    out = fopen(rt_asm, "w");
+    if (!out) {
+        fprintf(stderr, "Error: Cannot write '%s'\n", rt_asm);
+        goto done;
+    }
+    codegen_x86_runtime(out);
+    fclose(out);
+
+    const char *as = getenv("AS") ? getenv("AS") : "as";
+    const char *ld = getenv("LD") ? getenv("LD") : "ld";
+    char *as_prog[] = {(char*)as, "--64", "-o", obj_file, asm_file, NULL};
+    char *as_rt[] = {(char*)as, "--64", "-o", rt_obj, rt_asm, NULL};
+    char *ld_args[] = {(char*)ld, "-static", "-o", (char*)output, obj_file, rt_obj, NULL};
+
+    if (run_tool(as_prog) != 0 || run_tool(as_rt) != 0) {
+        fprintf(stderr, "Error: Assembler failed\n");
+    } else if (run_tool(ld_args) != 0) {
+        fprintf(stderr, "Error: Linker failed\n");
+    } else {
+        status = 0;
+    }
+
+    if (!keep_temps) {
+        remove(asm_file);
+        remove(rt_asm);
+    }
+    remove(obj_file);
+    remove(rt_obj);
+
+done:
+    free(asm_file);
+    free(rt_asm);
+    free(obj_file);
+    free(rt_obj);
+    return status;
+#endif
+}
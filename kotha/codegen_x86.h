@@ -0,0 +1,23 @@
+/*
+ * Kotha Native Code Generator Header
+ * Lowers IR to x86-64 assembly (GNU as, Linux) and links with as/ld
+ */
+
+#ifndef CODEGEN_X86_H
+#define CODEGEN_X86_H
+
+#include <stdio.h>
+#include "ir.h"
+
+/* Write the program as assembly. Returns 0 on success, -1 if the IR uses
+ * something the native backend does not support (reported on stderr). */
+int codegen_x86(IRInstr *ir, FILE *out);
+
+/* Write the runtime (entry point, printing, input, errors) as assembly */
+void codegen_x86_runtime(FILE *out);
+
+/* Generate, assemble and link 'output'. With asm_only, stop after
+ * writing output.s. Returns 0 on success. */
+int codegen_x86_build(IRInstr *ir, const char *output, int asm_only, int keep_temps);
+
+#endif /* CODEGEN_X86_H */
@@ -4,15 +4,17 @@
  */
 
 #include "ir.h"
+#include "parser.tab.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
-IRInstr *ir_head = NULL;
-IRInstr *ir_tail = NULL;
+__thread IRInstr *ir_head = NULL;
+__thread IRInstr *ir_tail = NULL;
 
-static int temp_count = 0;
-static int label_count = 0;
+static __thread int temp_count = 0;
+static __thread int label_count = 0;
+static __thread int current_line = 0;   // Line of the statement being lowered
 
 /* Helper: Generate IR for expressions and return result temp/var */
 static char* ir_gen_expr(ASTNode *node);
@@ -22,6 +24,18 @@ void ir_init() {
     ir_tail = NULL;
     temp_count = 0;
     label_count = 0;
+    current_line = 0;
+}
+
+void ir_free(IRInstr *ir) {
+    while (ir) {
+        IRInstr *next = ir->next;
+        free(ir->arg1);
+        free(ir->arg2);
+        free(ir->result);
+        free(ir);
+        ir = next;
+    }
 }
 
 void ir_add(IROp op, const char *a1, const char *a2, const char *res) {
@@ -30,6 +44,7 @@ void ir_add(IROp op, const char *a1, const char *a2, const char *res) {
     instr->arg1 = a1 ? strdup(a1) : NULL;
     instr->arg2 = a2 ? strdup(a2) : NULL;
     instr->result = res ? strdup(res) : NULL;
+    instr->line = current_line;
     instr->next = NULL;
     
     if (!ir_head) {
@@ -94,22 +109,20 @@ static char* ir_gen_expr(ASTNode *node) {
             
             IROp op = IR_NOP;
             
-            /* Operator mapping using correct token values from parser.tab.h:
-             * PLUS=291, MINUS=292, MULT=293, DIV=294, MOD=295
-             * GT=297, LT=298, GTE=299, LTE=300, EQ=301, NEQ=302
+            /* Operator mapping using token values from parser.tab.h
              * Also support ASCII values for basic operators
              */
-            if (node->op == 291 || node->op == '+') op = IR_ADD;
-            else if (node->op == 292 || node->op == '-') op = IR_SUB;
-            else if (node->op == 293 || node->op == '*') op = IR_MUL;
-            else if (node->op == 294 || node->op == '/') op = IR_DIV;
-            else if (node->op == 295 || node->op == '%') op = IR_MOD;
-            else if (node->op == 297 || node->op == '>') op = IR_GT;
-            else if (node->op == 298 || node->op == '<') op = IR_LT;
-            else if (node->op == 299) op = IR_GTE; // >=
-            else if (node->op == 300) op = IR_LTE; // <=
-            else if (node->op == 301) op = IR_EQ;  // ==
-            else if (node->op == 302) op = IR_NEQ; // !=
+            if (node->op == PLUS || node->op == '+') op = IR_ADD;
+            else if (node->op == MINUS || node->op == '-') op = IR_SUB;
+            else if (node->op == MULT || node->op == '*') op = IR_MUL;
+            else if (node->op == DIV || node->op == '/') op = IR_DIV;
+            else if (node->op == MOD || node->op == '%') op = IR_MOD;
+            else if (node->op == GT || node->op == '>') op = IR_GT;
+            else if (node->op == LT || node->op == '<') op = IR_LT;
+            else if (node->op == GTE) op = IR_GTE; // >=
+            else if (node->op == LTE) op = IR_LTE; // <=
+            else if (node->op == EQ) op = IR_EQ;   // ==
+            else if (node->op == NEQ) op = IR_NEQ; // !=
             else {
                 // Default fallback - should not reach here
                 fprintf(stderr, "Warning: Unknown operator %d, defaulting to ADD\n", node->op);
@@ -122,19 +135,23 @@ static char* ir_gen_expr(ASTNode *node) {
         }
         
         case NODE_FUNC_CALL: {
-            // Generate IR_PARAM for each argument
-            ASTNode *arg = node->params;  // Function arguments
+            // Evaluate every argument first, then emit the IR_PARAMs together
+            // right before IR_CALL, so a nested call's params can't interleave
+            int arg_total = 0;
+            for (ASTNode *arg = node->params; arg; arg = arg->next) arg_total++;
+            char **arg_vals = arg_total ? (char**)malloc(sizeof(char*) * arg_total) : NULL;
+
             int arg_count = 0;
-            while (arg) {
+            for (ASTNode *arg = node->params; arg; arg = arg->next) {
                 char *arg_val = ir_gen_expr(arg);
-                if (arg_val) {
-                    ir_add(IR_PARAM, arg_val, NULL, NULL);
-                    free(arg_val);
-                    arg_count++;
-                }
-                arg = arg->next;
+                if (arg_val) arg_vals[arg_count++] = arg_val;
             }
-            
+            for (int i = 0; i < arg_count; i++) {
+                ir_add(IR_PARAM, arg_vals[i], NULL, NULL);
+                free(arg_vals[i]);
+            }
+            free(arg_vals);
+
             // Generate IR_CALL
             char *result = ir_new_temp();
             char arg_count_str[16];
@@ -152,6 +169,10 @@ static char* ir_gen_expr(ASTNode *node) {
 void ir_generate(ASTNode *node) {
     if (!node) return;
     
+    // Loops and ifs are built after their body; the condition has the header's line
+    if (node->cond && node->cond->line > 0) current_line = node->cond->line;
+    else if (node->line > 0) current_line = node->line;
+    
     switch (node->type) {
         case NODE_BLOCK:
             if (node->body) ir_generate(node->body);
@@ -228,6 +249,81 @@ void ir_generate(ASTNode *node) {
             break;
         }
         
+        case NODE_FOR:
+        case NODE_PAR_FOR: {
+            // i = start; t_end = end; L_top: if !(i <= t_end) goto L_exit;
+            // body; i = i + 1; goto L_top. The bound is evaluated once.
+            if (node->left && node->left->line > 0) current_line = node->left->line;
+            int header_line = current_line;
+            char *start = ir_gen_expr(node->left);
+            ir_add(IR_ASSIGN, start, NULL, node->sval);
+            char *end = ir_gen_expr(node->right);
+            char *bound = ir_new_temp();
+            ir_add(IR_ASSIGN, end, NULL, bound);
+            free(start); free(end);
+            
+            char *L_top = ir_new_label();
+            char *L_exit = ir_new_label();
+            
+            if (node->type == NODE_PAR_FOR) {
+                for (ASTNode *r = node->params; r; r = r->next) {
+                    ir_add(IR_PAR_REDUCE, r->sval, NULL, NULL);
+                }
+                ir_add(IR_PAR_FOR, node->sval, bound, L_exit);
+            }
+            
+            ir_add(IR_LABEL, NULL, NULL, L_top);
+            char *cond = ir_new_temp();
+            ir_add(IR_LTE, node->sval, bound, cond);
+            ir_add(IR_IF_FALSE, cond, NULL, L_exit);
+            free(cond);
+            
+            ir_generate(node->body);
+            
+            current_line = header_line;
+            char *next = ir_new_temp();
+            ir_add(IR_ADD, node->sval, "1", next);
+            ir_add(IR_ASSIGN, next, NULL, node->sval);
+            ir_add(IR_GOTO, NULL, NULL, L_top);
+            free(next);
+            
+            ir_add(IR_LABEL, NULL, NULL, L_exit);
+            if (node->type == NODE_PAR_FOR) ir_add(IR_PAR_END, NULL, NULL, NULL);
+            
+            free(bound); free(L_top); free(L_exit);
+            if (node->next) ir_generate(node->next);
+            break;
+        }
+        
+        case NODE_WAIT: {
+            char *val = ir_gen_expr(node->left);
+            ir_add(IR_WAIT, val, NULL, NULL);
+            if (val) free(val);
+            
+            if (node->next) ir_generate(node->next);
+            break;
+        }
+        
+        case NODE_SPAWN:
+        case NODE_ISOLATE: {
+            // The body is laid out inline and skipped by the spawning fiber
+            char *L_body = ir_new_label();
+            char *L_end = ir_new_label();
+            
+            ir_add(node->type == NODE_SPAWN ? IR_SPAWN : IR_ISOLATE, NULL, NULL, L_body);
+            ir_add(IR_GOTO, NULL, NULL, L_end);
+            
+            ir_add(IR_LABEL, NULL, NULL, L_body);
+            ir_generate(node->body);
+            ir_add(IR_FIBER_EXIT, NULL, NULL, NULL);
+            
+            ir_add(IR_LABEL, NULL, NULL, L_end);
+            
+            free(L_body); free(L_end);
+            if (node->next) ir_generate(node->next);
+            break;
+        }
+        
         case NODE_RETURN: {
             char *val = ir_gen_expr(node->left);
             ir_add(IR_RETURN, val, NULL, NULL);
@@ -237,7 +333,7 @@ void ir_generate(ASTNode *node) {
         
         case NODE_UN_OP: {
             // Handle increment (++) and decrement (--)
-            if (node->op == 306) { // INC token value
+            if (node->op == INC) {
                 // i++ becomes: i = i + 1
                 char *temp = ir_new_temp();
                 ir_add(IR_ASSIGN, "1", NULL, temp);
@@ -246,7 +342,7 @@ void ir_generate(ASTNode *node) {
                 ir_add(IR_ASSIGN, result, NULL, node->sval);
                 free(temp);
                 free(result);
-            } else if (node->op == 307) { // DEC token value
+            } else if (node->op == DEC) {
                 // i-- becomes: i = i - 1
                 char *temp = ir_new_temp();
                 ir_add(IR_ASSIGN, "1", NULL, temp);
@@ -348,6 +444,27 @@ void ir_print() {
             case IR_RETURN:
                 printf("RETURN %s\n", instr->arg1);
                 break;
+            case IR_WAIT:
+                printf("WAIT %s\n", instr->arg1);
+                break;
+            case IR_SPAWN:
+                printf("SPAWN %s\n", instr->result);
+                break;
+            case IR_FIBER_EXIT:
+                printf("FIBER_EXIT\n");
+                break;
+            case IR_ISOLATE:
+                printf("ISOLATE %s\n", instr->result);
+                break;
+            case IR_PAR_REDUCE:
+                printf("PAR_REDUCE %s\n", instr->arg1);
+                break;
+            case IR_PAR_FOR:
+                printf("PAR_FOR %s <= %s EXIT %s\n", instr->arg1, instr->arg2, instr->result);
+                break;
+            case IR_PAR_END:
+                printf("PAR_END\n");
+                break;
             default:
                 printf("OP_%d %s, %s, %s\n", instr->op, instr->arg1 ? instr->arg1 : "_", 
                        instr->arg2 ? instr->arg2 : "_", instr->result ? instr->result : "_");
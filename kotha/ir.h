@@ -33,7 +33,14 @@ typedef enum {
     IR_TRY_START,   // try start (arg1 = catch label)
     IR_TRY_END,     // try end
     IR_CATCH,       // catch label
-    IR_THROW        // throw arg1
+    IR_THROW,       // throw arg1
+    IR_WAIT,        // wait arg1 seconds (yields the fiber)
+    IR_SPAWN,       // start a fiber at label result
+    IR_FIBER_EXIT,  // end of a spawned fiber's (or an isolate's) body
+    IR_ISOLATE,     // start an isolate at label result
+    IR_PAR_REDUCE,  // arg1 is a reduction of the next IR_PAR_FOR
+    IR_PAR_FOR,     // loop on arg1 up to arg2 may run in parallel; it exits at label result
+    IR_PAR_END      // exit of a parallel loop
 } IROp;
 
 typedef struct IRInstr {
@@ -41,12 +48,13 @@ typedef struct IRInstr {
     char *arg1;
     char *arg2;
     char *result;
+    int line;           // Source line (0 = unknown)
     struct IRInstr *next;
 } IRInstr;
 
-/* Global list of instructions */
-extern IRInstr *ir_head;
-extern IRInstr *ir_tail;
+/* List of instructions being built (one per thread) */
+extern __thread IRInstr *ir_head;
+extern __thread IRInstr *ir_tail;
 
 /* Functions */
 void ir_init();
@@ -55,5 +63,6 @@ char* ir_new_temp();
 char* ir_new_label();
 void ir_print();
 void ir_generate(ASTNode *node); // Generate IR from AST
+void ir_free(IRInstr *ir);
 
 #endif /* IR_H */
@@ -0,0 +1,219 @@
+/*
+ * libkotha - Embedding API
+ * Source is parsed straight from memory (fmemopen) and the VM's streams
+ * are stdio FILEs backed by the embedder's callbacks (fopencookie), so a
+ * run needs no temporary files or pipes.
+ */
+
+#define _GNU_SOURCE
+#include "kotha.h"
+#include "ast.h"
+#include "ir.h"
+#include "vm.h"
+#include "vm_jit.h"
+#include "vm_isolate.h"
+#include "parser.tab.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define KOTHA_CLOCK_INTERVAL 4096  // Instructions between deadline checks (power of two)
+
+struct KothaVM {
+    VM *vm;                  // NULL if the program did not compile
+    char *diagnostics;
+    size_t diagnostics_size;
+    KothaIO io;
+    FILE *out, *err, *in;    // Callback streams (NULL until kotha_set_io)
+    long long instructions;
+    int ran;
+};
+
+/* Callback streams */
+
+static ssize_t kotha_io_write(void *cookie, const char *buf, size_t size) {
+    KothaVM *k = (KothaVM*)cookie;
+    if (k->io.write) k->io.write(k->io.user, buf, size);
+    return (ssize_t)size;
+}
+
+static ssize_t kotha_io_error(void *cookie, const char *buf, size_t size) {
+    KothaVM *k = (KothaVM*)cookie;
+    if (k->io.error) {
+        k->io.error(k->io.user, buf, size);
+    } else if (k->io.write) {
+        k->io.write(k->io.user, buf, size);
+    }
+    return (ssize_t)size;
+}
+
+static ssize_t kotha_io_read(void *cookie, char *buf, size_t size) {
+    KothaVM *k = (KothaVM*)cookie;
+    return k->io.read ? (ssize_t)k->io.read(k->io.user, buf, size) : 0;
+}
+
+static FILE* kotha_io_open(KothaVM *k, cookie_read_function_t *read, cookie_write_function_t *write) {
+    cookie_io_functions_t functions = {read, write, NULL, NULL};
+    FILE *f = fopencookie(k, read ? "r" : "w", functions);
+    // Hand output over line by line, as a terminal would see it
+    if (f && write) setvbuf(f, NULL, _IOLBF, BUFSIZ);
+    return f;
+}
+
+static void kotha_io_close(KothaVM *k) {
+    if (k->out) fclose(k->out);
+    if (k->err) fclose(k->err);
+    if (k->in) fclose(k->in);
+    k->out = k->err = k->in = NULL;
+}
+
+static double kotha_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* Public API */
+
+KothaVM* kotha_compile(const char *src, size_t len) {
+    KothaVM *k = (KothaVM*)calloc(1, sizeof(KothaVM));
+    if (!k) return NULL;
+    FILE *diag = open_memstream(&k->diagnostics, &k->diagnostics_size);
+    if (!diag) {
+        free(k);
+        return NULL;
+    }
+
+    FILE *source = len > 0 ? fmemopen((void*)src, len, "r") : NULL;
+    if (!source) {
+        fprintf(diag, "Error: Empty program\n");
+        fclose(diag);
+        return k;
+    }
+    int parsed;
+    ASTNode *root = kotha_parse(source, NULL, diag, &parsed);
+    fclose(source);
+
+    if (parsed) {
+        ir_init();
+        ir_generate(root);
+        k->vm = ir_head ? codegen_vm(ir_head) : NULL;
+        ir_free(ir_head);
+        ir_init();
+        if (!k->vm) fprintf(diag, "Error: Bytecode generation failed\n");
+    }
+    free_ast(root);
+    fclose(diag);
+    return k;
+}
+
+const char* kotha_diagnostics(const KothaVM *k) {
+    return k && k->diagnostics ? k->diagnostics : "";
+}
+
+int kotha_set_io(KothaVM *k, const KothaIO *io) {
+    if (!k || !io || k->ran) return 0;
+    kotha_io_close(k);
+    k->io = *io;
+    k->out = kotha_io_open(k, NULL, kotha_io_write);
+    k->err = kotha_io_open(k, NULL, kotha_io_error);
+    k->in = kotha_io_open(k, kotha_io_read, NULL);
+    if (!k->out || !k->err || !k->in) {
+        kotha_io_close(k);
+        return 0;
+    }
+    if (k->vm) {
+        k->vm->out = k->out;
+        k->vm->err = k->err;
+        k->vm->in = k->in;
+    }
+    return 1;
+}
+
+/* vm_run with a budget: the instruction count, the clock and the heap are
+ * checked between instructions, and wait() stops sleeping at the deadline */
+static KothaStatus kotha_run_limited(VM *vm, const KothaLimits *limits) {
+    double deadline = limits->max_time_ms > 0 ? kotha_now_ms() + limits->max_time_ms : 0;
+    long long executed = 0;
+
+    vm_reserve_locals(vm);
+    vm->deadline_us = deadline > 0 ? (long long)(deadline * 1000.0) : 0;  // Same clock as fibers'
+    while (vm->ip < vm->code_size) {
+        if (limits->max_instructions > 0 && executed >= limits->max_instructions) {
+            vm_runtime_error(vm, "Instruction limit exceeded (%lld)", limits->max_instructions);
+            return KOTHA_LIMIT_EXCEEDED;
+        }
+        if (deadline > 0 && (executed & (KOTHA_CLOCK_INTERVAL - 1)) == 0 && kotha_now_ms() >= deadline) {
+            vm_runtime_error(vm, "Time limit exceeded (%lld ms)", limits->max_time_ms);
+            return KOTHA_LIMIT_EXCEEDED;
+        }
+        executed++;
+        int running = vm_execute_instruction(vm);
+        if (vm->deadline_passed) {
+            // Reached inside a wait, which stops sleeping at the deadline
+            vm_runtime_error(vm, "Time limit exceeded (%lld ms)", limits->max_time_ms);
+            return KOTHA_LIMIT_EXCEEDED;
+        }
+        if (!running) break;
+        if (vm->heap_exhausted && vm->heap_limit > 0) {
+            // Out of memory is not fatal to a program, but here it only gets slower
+            return KOTHA_LIMIT_EXCEEDED;
+        }
+    }
+    return KOTHA_OK;
+}
+
+KothaStatus kotha_run(KothaVM *k, const KothaLimits *limits) {
+    if (!k || k->ran) return KOTHA_INVALID;
+    k->ran = 1;
+    if (!k->vm) return KOTHA_COMPILE_ERROR;
+
+    KothaLimits none;
+    memset(&none, 0, sizeof(none));
+    if (!limits) limits = &none;
+
+    VM *vm = k->vm;
+    vm->par_threads = limits->threads;
+    if (limits->max_heap_bytes > 0) {
+        vm->heap_limit = limits->max_heap_bytes < MAX_HEAP ? (int)limits->max_heap_bytes : MAX_HEAP;
+    }
+
+    KothaStatus status = KOTHA_OK;
+    if (limits->max_instructions > 0 || limits->max_time_ms > 0 || limits->max_heap_bytes > 0) {
+        status = kotha_run_limited(vm, limits);
+    } else {
+        VMJit *jit = limits->jit ? vm_jit_compile(vm) : NULL;
+        if (jit) {
+            vm_jit_run(jit, vm);
+            vm_jit_free(jit);
+        } else {
+            vm_run(vm);
+        }
+    }
+
+    VMIsolateGroup *group = vm->isolates;
+    k->instructions = vm->instruction_count + (group ? group->instructions : 0);
+    if (status == KOTHA_OK &&
+        (vm->error_count > 0 || (group && __atomic_load_n(&group->shutdown, __ATOMIC_ACQUIRE)))) {
+        status = KOTHA_RUNTIME_ERROR;
+    }
+    fflush(vm->out);
+    fflush(vm->err);
+    return status;
+}
+
+long long kotha_instructions(const KothaVM *k) {
+    return k ? k->instructions : 0;
+}
+
+void kotha_free(KothaVM *k) {
+    if (!k) return;
+    if (k->vm) {
+        vm_free(k->vm);   // Joins isolates, which may still print
+        free(k->vm);
+    }
+    kotha_io_close(k);
+    free(k->diagnostics);
+    free(k);
+}
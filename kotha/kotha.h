@@ -0,0 +1,74 @@
+/*
+ * libkotha - Embedding API
+ * Compile Kotha source held in memory and run it in-process, with program
+ * output, input and error reports going through caller callbacks.
+ *
+ * Link with libkotha.a (or -lkotha) and -lm -pthread. Separate KothaVMs
+ * may be compiled and run on separate threads at the same time.
+ */
+
+#ifndef KOTHA_H
+#define KOTHA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct KothaVM KothaVM;
+
+typedef enum {
+    KOTHA_OK = 0,
+    KOTHA_COMPILE_ERROR,     // See kotha_diagnostics()
+    KOTHA_RUNTIME_ERROR,     // Reported through the error sink
+    KOTHA_LIMIT_EXCEEDED,    // Stopped by KothaLimits
+    KOTHA_INVALID            // Already run, or out of memory
+} KothaStatus;
+
+/* I/O sinks. Any callback may be NULL: output is then discarded, errors
+ * go to 'write' (or are discarded too) and input is empty. */
+typedef struct {
+    void *user;
+    void (*write)(void *user, const char *data, size_t len);  // dekhaw, one line at a time
+    void (*error)(void *user, const char *data, size_t len);  // Runtime error reports
+    size_t (*read)(void *user, char *buf, size_t len);        // nao; return 0 at end of input
+} KothaIO;
+
+/* Zero means no limit. A limited run uses the bytecode interpreter even
+ * when 'jit' is set, so that it can be stopped, and ends at the first
+ * allocation that fails at max_heap_bytes. Limits cover the VM on the
+ * calling thread, not isolates. */
+typedef struct {
+    long long max_instructions;
+    long long max_time_ms;   // Wall time
+    long long max_heap_bytes; // Old-space and large-object bytes
+    int threads;             // Threads for somantorale loops (0 = one per core)
+    int jit;                 // Compile the bytecode to native code first
+} KothaLimits;
+
+/* Parse and compile 'len' bytes of source. Returns NULL only when out of
+ * memory; a program that failed to compile makes kotha_run return
+ * KOTHA_COMPILE_ERROR. */
+KothaVM* kotha_compile(const char *src, size_t len);
+
+/* Parse and compile errors ("" when there were none) */
+const char* kotha_diagnostics(const KothaVM *vm);
+
+/* Route the program's I/O through 'io' (copied). Without it the program
+ * uses the process's stdin, stdout and stderr. Call before kotha_run. */
+int kotha_set_io(KothaVM *vm, const KothaIO *io);
+
+/* Run the program to the end (once). 'limits' may be NULL. */
+KothaStatus kotha_run(KothaVM *vm, const KothaLimits *limits);
+
+/* Instructions executed by the last run (isolates included) */
+long long kotha_instructions(const KothaVM *vm);
+
+void kotha_free(KothaVM *vm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KOTHA_H */
@@ -0,0 +1,116 @@
+/*
+ * Kotha C Runtime
+ * Helpers that generated C calls (see kotha_rt.h). Built once, with
+ * optimization, into libkotha_rt.a instead of being printed into every
+ * program. All state is per thread.
+ */
+
+#include "kotha_rt.h"
+
+#define RT_STR_INITIAL 256       // First size of the concatenation buffer
+#define RT_SLOTS 8               // Conversion results alive at once
+#define RT_SLOT_SIZE 32
+
+/* String concatenation */
+
+static __thread char *str_buffer;
+static __thread size_t str_len;
+static __thread size_t str_cap;
+static char str_empty[1];        // Returned while no buffer could be allocated
+
+static int str_reserve(size_t extra) {
+    if (str_len + extra < str_cap) return 1;
+    size_t cap = str_cap ? str_cap : RT_STR_INITIAL;
+    while (str_len + extra >= cap) cap *= 2;
+    char *grown = (char*)realloc(str_buffer, cap);
+    if (!grown) return 0;
+    str_buffer = grown;
+    str_cap = cap;
+    return 1;
+}
+
+char* kotha_str_reset(void) {
+    str_len = 0;
+    if (!str_reserve(0)) return str_empty;
+    str_buffer[0] = '\0';
+    return str_buffer;
+}
+
+char* kotha_str_concat_str(const char *s) {
+    if (!str_buffer && !str_reserve(0)) return str_empty;
+    // A nested concatenation (the left operand) has left its result here
+    if (s == str_buffer) return str_buffer;
+    size_t len = strlen(s);
+    if (!str_reserve(len)) return str_buffer;
+    memcpy(str_buffer + str_len, s, len);
+    str_len += len;
+    str_buffer[str_len] = '\0';
+    return str_buffer;
+}
+
+char* kotha_str_concat_int(int val) {
+    char temp[16];
+    snprintf(temp, sizeof(temp), "%d", val);
+    return kotha_str_concat_str(temp);
+}
+
+char* kotha_str_concat_float(float val) {
+    char temp[32];
+    snprintf(temp, sizeof(temp), "%g", val);
+    return kotha_str_concat_str(temp);
+}
+
+/* Type conversions */
+
+static __thread char rt_slots[RT_SLOTS][RT_SLOT_SIZE];
+static __thread int rt_next_slot;
+
+static char* rt_slot(void) {
+    char *slot = rt_slots[rt_next_slot];
+    rt_next_slot = (rt_next_slot + 1) % RT_SLOTS;
+    return slot;
+}
+
+// purno (int) conversions
+float purno_to_doshomik(int val) { return (float)val; }
+
+char* purno_to_bornona(int val) {
+    char *buf = rt_slot();
+    snprintf(buf, RT_SLOT_SIZE, "%d", val);
+    return buf;
+}
+
+int purno_to_sotyo_mittha(int val) { return val != 0; }
+
+// doshomik (float) conversions
+int doshomik_to_purno(float val) { return (int)val; }
+
+char* doshomik_to_bornona(float val) {
+    char *buf = rt_slot();
+    snprintf(buf, RT_SLOT_SIZE, "%g", val);
+    return buf;
+}
+
+int doshomik_to_sotyo_mittha(float val) { return val != 0.0; }
+
+// bornona (string) conversions
+int bornona_to_purno(const char *str) { return atoi(str); }
+float bornona_to_doshomik(const char *str) { return atof(str); }
+int bornona_to_sotyo_mittha(const char *str) { return str[0] != '\0'; }
+
+// sotyo_mittha (bool) conversions
+int sotyo_mittha_to_purno(int val) { return val; }
+float sotyo_mittha_to_doshomik(int val) { return (float)val; }
+
+char* sotyo_mittha_to_bornona(int val) {
+    char *buf = rt_slot();
+    snprintf(buf, RT_SLOT_SIZE, "%s", val ? "sotti" : "mittha");
+    return buf;
+}
+
+/* typeof() */
+
+const char* kotha_typeof_purno(void) { return "purno"; }
+const char* kotha_typeof_doshomik(void) { return "doshomik"; }
+const char* kotha_typeof_bornona(void) { return "bornona"; }
+const char* kotha_typeof_sotyo_mittha(void) { return "sotyo_mittha"; }
@@ -0,0 +1,60 @@
+/*
+ * Kotha C Runtime Header
+ * Included by every C file the compiler generates; the helpers live in
+ * libkotha_rt.a (with the string, math, array and file I/O libraries):
+ *
+ *   gcc program.c -I kotha -o program kotha/libkotha_rt.a -lm
+ */
+
+#ifndef KOTHA_RT_H
+#define KOTHA_RT_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#define sleep(x) Sleep((x)*1000)
+#else
+#include <unistd.h>
+#endif
+
+// The libraries bundled in libkotha_rt.a; generated code calls them directly
+#include "string_lib.h"
+#include "math_lib.h"
+#include "array_lib.h"
+#include "file_io.h"
+
+/* String concatenation: (kotha_str_reset(), kotha_str_concat_*(a), ...)
+ * builds the result in a per-thread buffer, valid until the next reset */
+char* kotha_str_reset(void);
+char* kotha_str_concat_str(const char *s);
+char* kotha_str_concat_int(int val);
+char* kotha_str_concat_float(float val);
+
+/* Type conversions. The strings returned are per thread and stay valid
+ * for the next few conversions, so one expression can use several. */
+float purno_to_doshomik(int val);
+char* purno_to_bornona(int val);
+int purno_to_sotyo_mittha(int val);
+
+int doshomik_to_purno(float val);
+char* doshomik_to_bornona(float val);
+int doshomik_to_sotyo_mittha(float val);
+
+int bornona_to_purno(const char *str);
+float bornona_to_doshomik(const char *str);
+int bornona_to_sotyo_mittha(const char *str);
+
+int sotyo_mittha_to_purno(int val);
+float sotyo_mittha_to_doshomik(int val);
+char* sotyo_mittha_to_bornona(int val);
+
+/* typeof() */
+const char* kotha_typeof_purno(void);
+const char* kotha_typeof_doshomik(void);
+const char* kotha_typeof_bornona(void);
+const char* kotha_typeof_sotyo_mittha(void);
+
+#endif /* KOTHA_RT_H */
@@ -0,0 +1,1190 @@
+/*
+ * Kotha Language Server
+ * A Language Server Protocol server on stdin/stdout for editors and the IDE:
+ * diagnostics (parse and type errors), document symbols and hover.
+ *
+ * A document is cut into top-level regions: the global declarations, then
+ * one region per 'kaj' or 'main function'. Each region is parsed on its own
+ * by the real parser (kotha_parse_region) and the result - diagnostics and
+ * the symbols it declared - is cached under a hash of the region's text and
+ * of the globals it can see. An edit re-scans the document for region
+ * boundaries, which is cheap, and re-parses only the regions whose text
+ * changed; everything else, including regions that merely moved, comes
+ * from the cache. Editing the globals re-parses the functions only if the
+ * set of global symbols changed.
+ */
+
+#define _GNU_SOURCE
+#include "lsp.h"
+#include "ast.h"
+#include "symtab.h"
+#include "parser.tab.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <time.h>
+
+#define LSP_MAX_MESSAGE (64 * 1024 * 1024)
+#define LSP_MAX_DEPTH 64
+
+/* Growable byte buffer */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} LspBuf;
+
+static int buf_reserve(LspBuf *b, size_t extra) {
+    if (b->len + extra + 1 <= b->cap) return 1;
+    size_t cap = b->cap ? b->cap : 256;
+    while (cap < b->len + extra + 1) cap *= 2;
+    char *data = (char*)realloc(b->data, cap);
+    if (!data) return 0;
+    b->data = data;
+    b->cap = cap;
+    return 1;
+}
+
+static void buf_append(LspBuf *b, const char *data, size_t len) {
+    if (!buf_reserve(b, len)) return;
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+}
+
+static void buf_puts(LspBuf *b, const char *s) {
+    buf_append(b, s, strlen(s));
+}
+
+static void buf_printf(LspBuf *b, const char *format, ...) {
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (n > 0) buf_append(b, text, n < (int)sizeof(text) ? (size_t)n : sizeof(text) - 1);
+}
+
+/* Length of the UTF-8 sequence at s (at most n bytes), 0 if it is invalid */
+static int utf8_length(const unsigned char *s, size_t n) {
+    int len = s[0] < 0x80 ? 1 : s[0] >= 0xF0 && s[0] < 0xF5 ? 4 : s[0] >= 0xE0 ? 3 : s[0] >= 0xC2 ? 2 : 0;
+    if (len == 0 || (size_t)len > n) return 0;
+    for (int i = 1; i < len; i++) {
+        if ((s[i] & 0xC0) != 0x80) return 0;
+    }
+    return len;
+}
+
+/* JSON string, quoted and escaped; bytes that aren't UTF-8 become U+FFFD */
+static void buf_json(LspBuf *b, const char *s, size_t len) {
+    buf_append(b, "\"", 1);
+    for (size_t i = 0; i < len; ) {
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 0x80) {
+            int n = utf8_length((const unsigned char*)s + i, len - i);
+            if (n == 0) {
+                buf_append(b, "\\ufffd", 6);
+                i++;
+            } else {
+                buf_append(b, s + i, n);
+                i += n;
+            }
+            continue;
+        }
+        switch (c) {
+            case '"': buf_append(b, "\\\"", 2); break;
+            case '\\': buf_append(b, "\\\\", 2); break;
+            case '\n': buf_append(b, "\\n", 2); break;
+            case '\r': buf_append(b, "\\r", 2); break;
+            case '\t': buf_append(b, "\\t", 2); break;
+            default:
+                if (c < 0x20) {
+                    buf_printf(b, "\\u%04x", c);
+                } else {
+                    buf_append(b, s + i, 1);
+                }
+        }
+        i++;
+    }
+    buf_append(b, "\"", 1);
+}
+
+static void buf_json_str(LspBuf *b, const char *s) {
+    buf_json(b, s, strlen(s));
+}
+
+/* JSON values (requests are small; a tree is simplest) */
+
+typedef enum {
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+} JsonType;
+
+typedef struct Json {
+    JsonType type;
+    char *key;              // Member name inside an object
+    char *text;             // String value, or the number as written
+    size_t text_len;
+    double number;
+    int boolean;
+    struct Json *child;     // First element or member
+    struct Json *next;
+} Json;
+
+static void json_free(Json *j) {
+    while (j) {
+        Json *next = j->next;
+        json_free(j->child);
+        free(j->key);
+        free(j->text);
+        free(j);
+        j = next;
+    }
+}
+
+static const char* json_ws(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    return p;
+}
+
+static void utf8_encode(LspBuf *out, unsigned code) {
+    char bytes[4];
+    int n;
+    if (code < 0x80) {
+        bytes[0] = (char)code; n = 1;
+    } else if (code < 0x800) {
+        bytes[0] = (char)(0xC0 | (code >> 6)); bytes[1] = (char)(0x80 | (code & 0x3F)); n = 2;
+    } else if (code < 0x10000) {
+        bytes[0] = (char)(0xE0 | (code >> 12)); bytes[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+        bytes[2] = (char)(0x80 | (code & 0x3F)); n = 3;
+    } else {
+        bytes[0] = (char)(0xF0 | (code >> 18)); bytes[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+        bytes[2] = (char)(0x80 | ((code >> 6) & 0x3F)); bytes[3] = (char)(0x80 | (code & 0x3F)); n = 4;
+    }
+    buf_append(out, bytes, n);
+}
+
+static int json_hex4(const char *p, const char *end, unsigned *code) {
+    if (end - p < 4) return 0;
+    *code = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 :
+                    c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (digit < 0) return 0;
+        *code = *code * 16 + digit;
+    }
+    return 1;
+}
+
+/* p is just past the opening quote */
+static const char* json_string(const char *p, const char *end, LspBuf *out) {
+    while (p < end && *p != '"') {
+        if (*p != '\\') {
+            buf_append(out, p++, 1);
+            continue;
+        }
+        if (++p >= end) return NULL;
+        switch (*p) {
+            case 'n': buf_append(out, "\n", 1); break;
+            case 't': buf_append(out, "\t", 1); break;
+            case 'r': buf_append(out, "\r", 1); break;
+            case 'b': buf_append(out, "\b", 1); break;
+            case 'f': buf_append(out, "\f", 1); break;
+            case 'u': {
+                unsigned code, low;
+                if (!json_hex4(p + 1, end, &code)) return NULL;
+                p += 4;
+                if (code >= 0xD800 && code < 0xDC00 && end - p > 2 && p[1] == '\\' && p[2] == 'u' &&
+                    json_hex4(p + 3, end, &low) && low >= 0xDC00 && low < 0xE000) {
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                }
+                utf8_encode(out, code);
+                break;
+            }
+            default: buf_append(out, p, 1); break;  // \" \\ \/
+        }
+        p++;
+    }
+    return p < end ? p + 1 : NULL;
+}
+
+static const char* json_value(const char *p, const char *end, Json **result, int depth) {
+    p = json_ws(p, end);
+    if (p >= end || depth > LSP_MAX_DEPTH) return NULL;
+    Json *j = (Json*)calloc(1, sizeof(Json));
+    if (!j) return NULL;
+    *result = j;
+
+    if (*p == '"') {
+        LspBuf text = {0};
+        buf_append(&text, "", 0);
+        p = json_string(p + 1, end, &text);
+        j->type = JSON_STRING;
+        j->text = text.data;
+        j->text_len = text.len;
+        return p;
+    }
+    if (*p == '{' || *p == '[') {
+        int object = *p == '{';
+        char close = object ? '}' : ']';
+        Json **tail = &j->child;
+        j->type = object ? JSON_OBJECT : JSON_ARRAY;
+        p = json_ws(p + 1, end);
+        if (p < end && *p == close) return p + 1;
+        while (p < end) {
+            char *key = NULL;
+            if (object) {
+                LspBuf name = {0};
+                buf_append(&name, "", 0);
+                if (*p != '"' || !(p = json_string(p + 1, end, &name))) {
+                    free(name.data);
+                    return NULL;
+                }
+                key = name.data;
+                p = json_ws(p, end);
+                if (p >= end || *p != ':') {
+                    free(key);
+                    return NULL;
+                }
+                p++;
+            }
+            p = json_value(p, end, tail, depth + 1);
+            if (*tail) (*tail)->key = key; else free(key);
+            if (!p) return NULL;
+            tail = &(*tail)->next;
+            p = json_ws(p, end);
+            if (p < end && *p == ',') {
+                p = json_ws(p + 1, end);
+            } else if (p < end && *p == close) {
+                return p + 1;
+            } else {
+                return NULL;
+            }
+        }
+        return NULL;
+    }
+    if (end - p >= 4 && strncmp(p, "true", 4) == 0) {
+        j->type = JSON_BOOL;
+        j->boolean = 1;
+        return p + 4;
+    }
+    if (end - p >= 5 && strncmp(p, "false", 5) == 0) {
+        j->type = JSON_BOOL;
+        return p + 5;
+    }
+    if (end - p >= 4 && strncmp(p, "null", 4) == 0) {
+        j->type = JSON_NULL;
+        return p + 4;
+    }
+    const char *start = p;
+    while (p < end && (isdigit((unsigned char)*p) || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E')) p++;
+    if (p == start) return NULL;
+    j->type = JSON_NUMBER;
+    j->text = strndup(start, p - start);
+    j->text_len = p - start;
+    j->number = j->text ? strtod(j->text, NULL) : 0;
+    return p;
+}
+
+static Json* json_parse(const char *text, size_t len) {
+    Json *j = NULL;
+    if (!json_value(text, text + len, &j, 0)) {
+        json_free(j);
+        return NULL;
+    }
+    return j;
+}
+
+static Json* json_get(const Json *j, const char *key) {
+    if (!j || j->type != JSON_OBJECT) return NULL;
+    for (Json *m = j->child; m; m = m->next) {
+        if (m->key && strcmp(m->key, key) == 0) return m;
+    }
+    return NULL;
+}
+
+static const char* json_get_string(const Json *j, const char *key) {
+    Json *v = json_get(j, key);
+    return v && v->type == JSON_STRING ? v->text : NULL;
+}
+
+static int json_get_int(const Json *j, const char *key, int fallback) {
+    Json *v = json_get(j, key);
+    return v && v->type == JSON_NUMBER ? (int)v->number : fallback;
+}
+
+/* Documents and their regions */
+
+typedef struct {
+    int line;                // Within the region, from 1
+    char *message;
+} LspDiagnostic;
+
+typedef struct {
+    char *name;
+    SymbolType kind;
+    VarType type;
+    int line;                // Within the region, from 1
+} LspSymbol;
+
+/* What parsing one region found. Shared by every region with the same key. */
+typedef struct LspParse {
+    unsigned long long key;
+    LspDiagnostic *diagnostics;
+    int diagnostic_count;
+    LspSymbol *symbols;
+    int symbol_count;
+    int failed;              // Stopped at a syntax error
+    int used;                // Referenced by the current version
+} LspParse;
+
+typedef struct LspDocument {
+    char *uri;
+    int version;
+    LspBuf text;
+    size_t *lines;           // Byte offset of each line's start
+    int line_count;
+    int line_cap;
+    LspRegion *regions;
+    int region_count;
+    LspParse **cache;        // Parses of the current regions
+    int cache_count;
+    LspParse *scope;         // Globals the functions were parsed against
+    struct LspDocument *next;
+} LspDocument;
+
+typedef struct {
+    const LspConfig *config;
+    LspDocument *documents;
+    int shutdown;
+    // Last update, for the debug log
+    int parsed;
+    int reused;
+} LspServer;
+
+static double lsp_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void lsp_index_lines(LspDocument *doc) {
+    doc->line_count = 0;
+    for (size_t i = 0; ; i++) {
+        if (i == 0 || doc->text.data[i - 1] == '\n') {
+            if (doc->line_count >= doc->line_cap) {
+                int cap = doc->line_cap ? doc->line_cap * 2 : 256;
+                size_t *lines = (size_t*)realloc(doc->lines, sizeof(size_t) * cap);
+                if (!lines) return;
+                doc->lines = lines;
+                doc->line_cap = cap;
+            }
+            doc->lines[doc->line_count++] = i;
+        }
+        if (i >= doc->text.len) break;
+    }
+}
+
+/* End of line 'line' (before its newline) */
+static size_t lsp_line_end(const LspDocument *doc, int line) {
+    size_t end = line + 1 < doc->line_count ? doc->lines[line + 1] : doc->text.len;
+    while (end > doc->lines[line] && (doc->text.data[end - 1] == '\n' || doc->text.data[end - 1] == '\r')) end--;
+    return end;
+}
+
+/* LSP columns count UTF-16 code units */
+static int lsp_utf16_length(const char *s, size_t len) {
+    int units = 0;
+    for (size_t i = 0; i < len; ) {
+        int n = utf8_length((const unsigned char*)s + i, len - i);
+        units += n == 4 ? 2 : 1;
+        i += n ? n : 1;
+    }
+    return units;
+}
+
+/* Byte offset of a line/character position, clamped to the document */
+static size_t lsp_offset(const LspDocument *doc, int line, int character) {
+    if (line < 0) return 0;
+    if (line >= doc->line_count) return doc->text.len;
+    size_t i = doc->lines[line], end = lsp_line_end(doc, line);
+    for (int units = 0; i < end && units < character; ) {
+        int n = utf8_length((const unsigned char*)doc->text.data + i, end - i);
+        units += n == 4 ? 2 : 1;
+        i += n ? n : 1;
+    }
+    return i;
+}
+
+static int lsp_ident_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+static int lsp_word_at(const char *text, size_t len, size_t i, const char *word) {
+    size_t n = strlen(word);
+    return i + n <= len && memcmp(text + i, word, n) == 0 &&
+           (i == 0 || !lsp_ident_char(text[i - 1])) &&
+           (i + n == len || !lsp_ident_char(text[i + n]));
+}
+
+static size_t lsp_skip_space(const char *text, size_t len, size_t i) {
+    while (i < len && isspace((unsigned char)text[i])) i++;
+    return i;
+}
+
+static size_t lsp_ident_end(const char *text, size_t len, size_t i) {
+    while (i < len && lsp_ident_char(text[i])) i++;
+    return i;
+}
+
+/* Name and parameters from a 'kaj name(a, b)' header at i */
+static void lsp_read_header(LspRegion *r, const char *text, size_t len, size_t i) {
+    if (lsp_word_at(text, len, i, "void")) i = lsp_skip_space(text, len, i + 4);
+    i = lsp_skip_space(text, len, i + 3);  // "kaj"
+    size_t name_end = lsp_ident_end(text, len, i);
+    r->name = name_end > i ? strndup(text + i, name_end - i) : strdup("?");
+    i = lsp_skip_space(text, len, name_end);
+    if (i >= len || text[i] != '(') return;
+
+    for (i++; i < len && text[i] != ')' && text[i] != '{'; ) {
+        i = lsp_skip_space(text, len, i);
+        size_t end = lsp_ident_end(text, len, i);
+        if (end > i) {
+            char **params = (char**)realloc(r->params, sizeof(char*) * (r->param_count + 1));
+            if (!params) return;
+            r->params = params;
+            r->params[r->param_count++] = strndup(text + i, end - i);
+            i = end;
+        } else {
+            i++;
+        }
+    }
+}
+
+void lsp_free_regions(LspRegion *regions, int count) {
+    for (int i = 0; i < count; i++) {
+        free(regions[i].name);
+        for (int p = 0; p < regions[i].param_count; p++) free(regions[i].params[p]);
+        free(regions[i].params);
+    }
+    free(regions);
+}
+
+int lsp_split(const char *text, size_t len, LspRegion **result) {
+    int count = 1, cap = 16, depth = 0, line = 0;
+    LspRegion *regions = (LspRegion*)calloc(cap, sizeof(LspRegion));
+    if (!regions) return 0;
+    regions[0].kind = REGION_GLOBALS;
+
+    for (size_t i = 0; i < len; ) {
+        char c = text[i];
+        if (c == '\n') {
+            line++;
+            i++;
+        } else if (c == '"') {
+            for (i++; i < len && text[i] != '"'; i++) {
+                if (text[i] == '\n') line++;
+            }
+            i++;
+        } else if (c == '/' && i + 1 < len && text[i + 1] == '/') {
+            while (i < len && text[i] != '\n') i++;
+        } else if (c == '{') {
+            depth++;
+            i++;
+        } else if (c == '}') {
+            if (depth > 0) depth--;
+            i++;
+        } else if (lsp_ident_char(c)) {
+            int header = 0;
+            RegionKind kind = REGION_FUNCTION;
+            size_t next = lsp_ident_end(text, len, i);
+            if (depth == 0 && (i == 0 || !lsp_ident_char(text[i - 1]))) {
+                if (lsp_word_at(text, len, i, "kaj")) {
+                    header = 1;
+                } else if (lsp_word_at(text, len, i, "void")) {
+                    size_t kaj = lsp_skip_space(text, len, next);
+                    if (lsp_word_at(text, len, kaj, "kaj")) {
+                        header = 1;
+                        next = kaj + 3;
+                    }
+                } else if (lsp_word_at(text, len, i, "main") && i + 13 <= len &&
+                           memcmp(text + i, "main function", 13) == 0 && lsp_word_at(text, len, i + 5, "function")) {
+                    header = 1;
+                    kind = REGION_MAIN;
+                    next = i + 13;
+                }
+            }
+            if (header) {
+                if (count >= cap) {
+                    LspRegion *grown = (LspRegion*)realloc(regions, sizeof(LspRegion) * cap * 2);
+                    if (!grown) break;
+                    regions = grown;
+                    cap *= 2;
+                }
+                LspRegion *r = &regions[count++];
+                memset(r, 0, sizeof(LspRegion));
+                r->kind = kind;
+                r->start = i;
+                r->first_line = line;
+                if (kind == REGION_MAIN) {
+                    r->name = strdup("main function");
+                } else {
+                    lsp_read_header(r, text, len, i);
+                }
+            }
+            for (; i < next; i++) {
+                if (text[i] == '\n') line++;  // Between 'void' and 'kaj'
+            }
+        } else {
+            i++;
+        }
+    }
+
+    for (int r = 0; r < count; r++) {
+        regions[r].end = r + 1 < count ? regions[r + 1].start : len;
+        regions[r].last_line = r + 1 < count ? regions[r + 1].first_line : line;
+    }
+    *result = regions;
+    return count;
+}
+
+/* Parsing a region */
+
+static unsigned long long lsp_hash(unsigned long long h, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char*)data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static void lsp_free_parse(LspParse *parse) {
+    if (!parse) return;
+    for (int i = 0; i < parse->diagnostic_count; i++) free(parse->diagnostics[i].message);
+    for (int i = 0; i < parse->symbol_count; i++) free(parse->symbols[i].name);
+    free(parse->diagnostics);
+    free(parse->symbols);
+    free(parse);
+}
+
+typedef struct {
+    LspParse *parse;
+    const LspParse *globals; // Visible to a function (NULL while parsing the globals)
+    const LspRegion *region;
+} LspParseJob;
+
+static void lsp_seed(void *user) {
+    LspParseJob *job = (LspParseJob*)user;
+    if (job->globals) {
+        for (int i = 0; i < job->globals->symbol_count; i++) {
+            const LspSymbol *s = &job->globals->symbols[i];
+            insert_symbol_typed(s->name, s->kind, s->type);
+        }
+    }
+    // Parameters are ints (see 'parameter_list' in parser.y)
+    for (int i = 0; i < job->region->param_count; i++) {
+        insert_symbol_typed(job->region->params[i], SYM_VAR, TYPE_INT);
+    }
+}
+
+static void lsp_diagnostic(void *user, int line, int syntax, const char *message) {
+    LspParse *parse = ((LspParseJob*)user)->parse;
+    LspDiagnostic *list = (LspDiagnostic*)realloc(parse->diagnostics, sizeof(LspDiagnostic) * (parse->diagnostic_count + 1));
+    if (!list) return;
+    parse->diagnostics = list;
+    list[parse->diagnostic_count].line = line;
+    list[parse->diagnostic_count].message = strdup(message);
+    parse->diagnostic_count++;
+}
+
+static void lsp_symbol(void *user, const Symbol *sym) {
+    LspParse *parse = ((LspParseJob*)user)->parse;
+    LspSymbol *list = (LspSymbol*)realloc(parse->symbols, sizeof(LspSymbol) * (parse->symbol_count + 1));
+    if (!list) return;
+    parse->symbols = list;
+    list[parse->symbol_count].name = strdup(sym->name);
+    list[parse->symbol_count].kind = sym->type;
+    list[parse->symbol_count].type = sym->value_type;
+    list[parse->symbol_count].line = sym->line_declared;
+    parse->symbol_count++;
+}
+
+static int lsp_symbol_compare(const void *a, const void *b) {
+    const LspSymbol *x = (const LspSymbol*)a, *y = (const LspSymbol*)b;
+    if (x->line != y->line) return x->line - y->line;
+    return strcmp(x->name, y->name);
+}
+
+static LspParse* lsp_parse_region(const LspDocument *doc, const LspRegion *region,
+                                  const LspParse *globals, unsigned long long key) {
+    LspParse *parse = (LspParse*)calloc(1, sizeof(LspParse));
+    if (!parse) return NULL;
+    parse->key = key;
+    if (region->end == region->start) return parse;
+
+    FILE *in = fmemopen(doc->text.data + region->start, region->end - region->start, "r");
+    if (!in) return parse;
+    LspParseJob job = {parse, globals, region};
+    KothaParseHooks hooks = {&job, lsp_seed, lsp_diagnostic, lsp_symbol, 0};
+    parse->failed = !kotha_parse_region(in, &hooks, NULL);
+    fclose(in);
+    if (parse->symbol_count > 1) qsort(parse->symbols, parse->symbol_count, sizeof(LspSymbol), lsp_symbol_compare);
+    return parse;
+}
+
+/* Cached parse for 'key', or a new one */
+static LspParse* lsp_region_parse(LspServer *server, LspDocument *doc, const LspRegion *region,
+                                  const LspParse *globals, unsigned long long key) {
+    for (int i = 0; i < doc->cache_count; i++) {
+        if (doc->cache[i]->key == key) {
+            doc->cache[i]->used = 1;
+            server->reused++;
+            return doc->cache[i];
+        }
+    }
+    LspParse *parse = lsp_parse_region(doc, region, globals, key);
+    if (!parse) return NULL;
+    LspParse **cache = (LspParse**)realloc(doc->cache, sizeof(LspParse*) * (doc->cache_count + 1));
+    if (!cache) {
+        lsp_free_parse(parse);
+        return NULL;
+    }
+    doc->cache = cache;
+    doc->cache[doc->cache_count++] = parse;
+    parse->used = 1;
+    server->parsed++;
+    return parse;
+}
+
+/* Re-split the document and bring every region's parse up to date */
+static void lsp_update(LspServer *server, LspDocument *doc) {
+    LspRegion *regions;
+    int count = lsp_split(doc->text.data, doc->text.len, &regions);
+    if (count == 0) return;
+    lsp_free_regions(doc->regions, doc->region_count);
+    doc->regions = regions;
+    doc->region_count = count;
+
+    server->parsed = server->reused = 0;
+    for (int i = 0; i < doc->cache_count; i++) doc->cache[i]->used = 0;
+
+    // The globals first: the functions' keys include the symbols they declare
+    LspRegion *globals_region = &regions[0];
+    unsigned long long key = lsp_hash(14695981039346656037ULL, "G", 1);
+    key = lsp_hash(key, doc->text.data + globals_region->start, globals_region->end - globals_region->start);
+    LspParse *globals = globals_region->parse = lsp_region_parse(server, doc, globals_region, NULL, key);
+
+    // While the globals don't parse (mid-edit, usually) the functions keep
+    // the last globals that did, rather than reporting every use of one
+    if (globals && (!globals->failed || !doc->scope)) doc->scope = globals;
+    globals = doc->scope;
+    if (globals) globals->used = 1;
+
+    unsigned long long scope = lsp_hash(14695981039346656037ULL, "F", 1);
+    for (int i = 0; globals && i < globals->symbol_count; i++) {
+        const LspSymbol *s = &globals->symbols[i];
+        scope = lsp_hash(scope, s->name, strlen(s->name) + 1);
+        scope = lsp_hash(scope, &s->kind, sizeof(s->kind));
+        scope = lsp_hash(scope, &s->type, sizeof(s->type));
+    }
+    for (int r = 1; r < count; r++) {
+        LspRegion *region = &regions[r];
+        key = lsp_hash(scope, doc->text.data + region->start, region->end - region->start);
+        region->parse = lsp_region_parse(server, doc, region, globals, key);
+    }
+
+    // Drop the parses of text that is gone
+    int kept = 0;
+    for (int i = 0; i < doc->cache_count; i++) {
+        if (doc->cache[i]->used) {
+            doc->cache[kept++] = doc->cache[i];
+        } else {
+            lsp_free_parse(doc->cache[i]);
+        }
+    }
+    doc->cache_count = kept;
+}
+
+/* Messages */
+
+static void lsp_send(LspBuf *body) {
+    printf("Content-Length: %zu\r\n\r\n", body->len);
+    fwrite(body->data, 1, body->len, stdout);
+    fflush(stdout);
+}
+
+/* Start a response to 'id' (echoed as it was sent) */
+static void lsp_response(LspBuf *b, const Json *id) {
+    buf_puts(b, "{\"jsonrpc\":\"2.0\",\"id\":");
+    if (id && id->type == JSON_STRING) {
+        buf_json(b, id->text, id->text_len);
+    } else if (id && id->type == JSON_NUMBER) {
+        buf_puts(b, id->text);
+    } else {
+        buf_puts(b, "null");
+    }
+}
+
+static void lsp_error(const Json *id, int code, const char *message) {
+    LspBuf b = {0};
+    lsp_response(&b, id);
+    buf_printf(&b, ",\"error\":{\"code\":%d,\"message\":", code);
+    buf_json_str(&b, message);
+    buf_puts(&b, "}}");
+    lsp_send(&b);
+    free(b.data);
+}
+
+static void buf_range(LspBuf *b, int start_line, int start_char, int end_line, int end_char) {
+    buf_printf(b, "{\"start\":{\"line\":%d,\"character\":%d},\"end\":{\"line\":%d,\"character\":%d}}",
+               start_line, start_char, end_line, end_char);
+}
+
+/* A region-relative line as a document line */
+static int lsp_region_line(const LspDocument *doc, const LspRegion *region, int line) {
+    int result = region->first_line + (line > 0 ? line - 1 : 0);
+    if (result > region->last_line) result = region->last_line;
+    if (result >= doc->line_count) result = doc->line_count - 1;
+    return result < 0 ? 0 : result;
+}
+
+/* The whole of a document line, without leading whitespace */
+static void buf_line_range(LspBuf *b, const LspDocument *doc, int line) {
+    size_t start = doc->lines[line], end = lsp_line_end(doc, line);
+    size_t first = start;
+    while (first < end && (doc->text.data[first] == ' ' || doc->text.data[first] == '\t')) first++;
+    int from = lsp_utf16_length(doc->text.data + start, first - start);
+    int to = lsp_utf16_length(doc->text.data + start, end - start);
+    buf_range(b, line, first < end ? from : 0, line, to);
+}
+
+static void lsp_publish(const LspDocument *doc, const char *uri, int clear) {
+    LspBuf b = {0};
+    buf_puts(&b, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":");
+    buf_json_str(&b, uri);
+    buf_puts(&b, ",\"diagnostics\":[");
+    int first = 1;
+    for (int r = 0; !clear && r < doc->region_count; r++) {
+        const LspRegion *region = &doc->regions[r];
+        if (!region->parse) continue;
+        for (int i = 0; i < region->parse->diagnostic_count; i++) {
+            const LspDiagnostic *d = &region->parse->diagnostics[i];
+            if (!first) buf_puts(&b, ",");
+            first = 0;
+            buf_puts(&b, "{\"range\":");
+            buf_line_range(&b, doc, lsp_region_line(doc, region, d->line));
+            buf_puts(&b, ",\"severity\":1,\"source\":\"kotha\",\"message\":");
+            buf_json_str(&b, d->message);
+            buf_puts(&b, "}");
+        }
+    }
+    buf_puts(&b, "]}}");
+    lsp_send(&b);
+    free(b.data);
+}
+
+/* Symbols and hover */
+
+static const char* lsp_type_name(VarType type) {
+    switch (type) {
+        case TYPE_INT: return "purno";
+        case TYPE_FLOAT: return "doshomik";
+        case TYPE_STRING: return "bornona";
+        case TYPE_BOOL: return "sotyo_mittha";
+        case TYPE_VOID: return "void";
+        case TYPE_ARRAY_INT: return "purno talika";
+        case TYPE_ARRAY_FLOAT: return "doshomik talika";
+        default: return "?";
+    }
+}
+
+/* LSP SymbolKind */
+static int lsp_symbol_kind(const LspSymbol *s) {
+    if (s->kind == SYM_CONST) return 14;                                    // Constant
+    if (s->type == TYPE_ARRAY_INT || s->type == TYPE_ARRAY_FLOAT) return 18; // Array
+    return 13;                                                               // Variable
+}
+
+/* Range of the first 'name' on a document line (the whole line if absent) */
+static void buf_name_range(LspBuf *b, const LspDocument *doc, int line, const char *name) {
+    size_t start = doc->lines[line], end = lsp_line_end(doc, line);
+    for (size_t i = start; i < end; i++) {
+        if (lsp_word_at(doc->text.data + start, end - start, i - start, name)) {
+            int from = lsp_utf16_length(doc->text.data + start, i - start);
+            buf_range(b, line, from, line, from + (int)strlen(name));
+            return;
+        }
+    }
+    buf_line_range(b, doc, line);
+}
+
+static void buf_symbol(LspBuf *b, const LspDocument *doc, const LspRegion *region, const LspSymbol *s) {
+    int line = lsp_region_line(doc, region, s->line);
+    buf_puts(b, "{\"name\":");
+    buf_json_str(b, s->name);
+    buf_printf(b, ",\"kind\":%d,\"detail\":", lsp_symbol_kind(s));
+    buf_json_str(b, lsp_type_name(s->type));
+    buf_puts(b, ",\"range\":");
+    buf_line_range(b, doc, line);
+    buf_puts(b, ",\"selectionRange\":");
+    buf_name_range(b, doc, line, s->name);
+    buf_puts(b, "}");
+}
+
+static void buf_signature(LspBuf *b, const LspRegion *region) {
+    if (region->kind == REGION_MAIN) {
+        buf_puts(b, "main function");
+        return;
+    }
+    buf_printf(b, "kaj %s(", region->name);
+    for (int p = 0; p < region->param_count; p++) {
+        buf_printf(b, "%s%s", p ? ", " : "", region->params[p]);
+    }
+    buf_puts(b, ")");
+}
+
+static void lsp_document_symbols(const LspDocument *doc, const Json *id) {
+    LspBuf b = {0};
+    lsp_response(&b, id);
+    buf_puts(&b, ",\"result\":[");
+    int first = 1;
+    for (int r = 0; r < doc->region_count; r++) {
+        const LspRegion *region = &doc->regions[r];
+        const LspParse *parse = region->parse;
+        if (region->kind == REGION_GLOBALS) {
+            for (int i = 0; parse && i < parse->symbol_count; i++) {
+                if (!first) buf_puts(&b, ",");
+                first = 0;
+                buf_symbol(&b, doc, region, &parse->symbols[i]);
+            }
+            continue;
+        }
+
+        // A function, with the variables it declares as children
+        int last = region->last_line;
+        if (last >= doc->line_count) last = doc->line_count - 1;
+        if (last > region->first_line && doc->lines[last] == region->end) last--;  // Ends at a line start
+        LspBuf signature = {0};
+        buf_signature(&signature, region);
+        if (!first) buf_puts(&b, ",");
+        first = 0;
+        buf_puts(&b, "{\"name\":");
+        buf_json_str(&b, region->name);
+        buf_printf(&b, ",\"kind\":12,\"detail\":");
+        buf_json_str(&b, signature.data ? signature.data : "");
+        free(signature.data);
+        buf_puts(&b, ",\"range\":");
+        size_t start = doc->lines[region->first_line];
+        buf_range(&b, region->first_line, lsp_utf16_length(doc->text.data + start, region->start - start),
+                  last, lsp_utf16_length(doc->text.data + doc->lines[last], lsp_line_end(doc, last) - doc->lines[last]));
+        buf_puts(&b, ",\"selectionRange\":");
+        buf_name_range(&b, doc, region->first_line, region->kind == REGION_MAIN ? "main" : region->name);
+        buf_puts(&b, ",\"children\":[");
+        for (int i = 0; parse && i < parse->symbol_count; i++) {
+            if (i) buf_puts(&b, ",");
+            buf_symbol(&b, doc, region, &parse->symbols[i]);
+        }
+        buf_puts(&b, "]}");
+    }
+    buf_puts(&b, "]}");
+    lsp_send(&b);
+    free(b.data);
+}
+
+static const struct {
+    const char *word;
+    const char *meaning;
+} lsp_keywords[] = {
+    {"purno", "Integer type"}, {"doshomik", "Floating-point type"}, {"bornona", "String type"},
+    {"sotyo_mittha", "Boolean type"}, {"sotti", "true"}, {"mittha", "false"}, {"sthir", "Constant"},
+    {"jodi", "if"}, {"othoba", "else if"}, {"noyto", "else"}, {"jotokkhon", "while loop"},
+    {"cholbe", "for loop: cholbe (i theke a porjonto b)"}, {"theke", "from (loop start)"},
+    {"porjonto", "to (loop end)"}, {"somantorale", "Parallel loop iterations"},
+    {"jog", "Sum these variables across parallel iterations"}, {"paltaw", "switch"}, {"holo", "case"},
+    {"kaj", "Function definition"}, {"ferot", "return"}, {"dekhaw", "Print a value"},
+    {"nao", "Read input into a variable"}, {"talika", "Array"}, {"porishkar", "Clear the screen"},
+    {"songjukto", "String concatenation"}, {"wait", "Pause this fiber for some seconds"},
+    {"spawn", "Run a block as a new fiber"}, {"isolate", "Run a block on another thread, in its own VM"},
+    {"typeof", "Type of an expression, as a string"},
+    {NULL, NULL}
+};
+
+static const LspSymbol* lsp_find_symbol(const LspParse *parse, const char *name) {
+    for (int i = 0; parse && i < parse->symbol_count; i++) {
+        if (strcmp(parse->symbols[i].name, name) == 0) return &parse->symbols[i];
+    }
+    return NULL;
+}
+
+static void lsp_hover(const LspDocument *doc, const Json *id, int line, int character) {
+    LspBuf b = {0};
+    lsp_response(&b, id);
+    buf_puts(&b, ",\"result\":");
+
+    // The identifier under the cursor
+    size_t at = lsp_offset(doc, line, character);
+    size_t start = at, end = at;
+    while (start > 0 && lsp_ident_char(doc->text.data[start - 1])) start--;
+    end = lsp_ident_end(doc->text.data, doc->text.len, end);
+    if (line >= doc->line_count || start == end) {
+        buf_puts(&b, "null}");
+        lsp_send(&b);
+        free(b.data);
+        return;
+    }
+    char *word = strndup(doc->text.data + start, end - start);
+
+    const LspRegion *here = NULL;
+    for (int r = 0; r < doc->region_count; r++) {
+        if (doc->regions[r].start <= at) here = &doc->regions[r];
+    }
+
+    LspBuf text = {0};
+    const LspSymbol *sym = NULL;
+    const LspRegion *owner = NULL;
+    if (here && (sym = lsp_find_symbol(here->parse, word))) {
+        owner = here;
+    } else if (doc->region_count > 0 && (sym = lsp_find_symbol(doc->regions[0].parse, word))) {
+        owner = &doc->regions[0];
+    }
+
+    if (sym) {
+        buf_printf(&text, "```kotha\n%s%s %s\n```\n", sym->kind == SYM_CONST ? "sthir " : "", lsp_type_name(sym->type), sym->name);
+        buf_printf(&text, "%s, declared on line %d", owner->kind == REGION_GLOBALS ? "Global" : "Local",
+                   lsp_region_line(doc, owner, sym->line) + 1);
+    } else {
+        for (int p = 0; here && p < here->param_count && !text.len; p++) {
+            if (strcmp(here->params[p], word) == 0) {
+                buf_printf(&text, "```kotha\npurno %s\n```\nParameter of %s", word, here->name);
+            }
+        }
+        for (int r = 1; r < doc->region_count && !text.len; r++) {
+            const LspRegion *region = &doc->regions[r];
+            if (region->kind == REGION_FUNCTION && strcmp(region->name, word) == 0) {
+                buf_puts(&text, "```kotha\n");
+                buf_signature(&text, region);
+                buf_printf(&text, "\n```\nFunction, defined on line %d", region->first_line + 1);
+            }
+        }
+        for (int k = 0; lsp_keywords[k].word && !text.len; k++) {
+            if (strcmp(lsp_keywords[k].word, word) == 0) {
+                buf_printf(&text, "`%s`: %s", word, lsp_keywords[k].meaning);
+            }
+        }
+    }
+
+    if (text.len) {
+        size_t line_start = doc->lines[line];
+        buf_puts(&b, "{\"contents\":{\"kind\":\"markdown\",\"value\":");
+        buf_json(&b, text.data, text.len);
+        buf_puts(&b, "},\"range\":");
+        buf_range(&b, line, lsp_utf16_length(doc->text.data + line_start, start - line_start),
+                  line, lsp_utf16_length(doc->text.data + line_start, end - line_start));
+        buf_puts(&b, "}}");
+    } else {
+        buf_puts(&b, "null}");
+    }
+    lsp_send(&b);
+    free(text.data);
+    free(word);
+    free(b.data);
+}
+
+/* Document lifecycle */
+
+static LspDocument* lsp_find(LspServer *server, const char *uri) {
+    for (LspDocument *doc = server->documents; doc; doc = doc->next) {
+        if (uri && strcmp(doc->uri, uri) == 0) return doc;
+    }
+    return NULL;
+}
+
+static void lsp_close(LspServer *server, const char *uri) {
+    for (LspDocument **link = &server->documents; *link; link = &(*link)->next) {
+        LspDocument *doc = *link;
+        if (strcmp(doc->uri, uri) != 0) continue;
+        *link = doc->next;
+        for (int i = 0; i < doc->cache_count; i++) lsp_free_parse(doc->cache[i]);
+        free(doc->cache);
+        lsp_free_regions(doc->regions, doc->region_count);
+        free(doc->lines);
+        free(doc->text.data);
+        free(doc->uri);
+        free(doc);
+        return;
+    }
+}
+
+/* Apply one contentChanges entry: a range edit, or the whole text */
+static void lsp_apply_change(LspDocument *doc, const Json *change) {
+    const char *text = json_get_string(change, "text");
+    Json *text_value = json_get(change, "text");
+    if (!text) return;
+    size_t text_len = text_value->text_len;
+    Json *range = json_get(change, "range");
+    if (!range) {
+        doc->text.len = 0;
+        buf_append(&doc->text, text, text_len);
+        lsp_index_lines(doc);
+        return;
+    }
+
+    Json *start = json_get(range, "start"), *end = json_get(range, "end");
+    size_t from = lsp_offset(doc, json_get_int(start, "line", 0), json_get_int(start, "character", 0));
+    size_t to = lsp_offset(doc, json_get_int(end, "line", 0), json_get_int(end, "character", 0));
+    if (to < from) to = from;
+    if (!buf_reserve(&doc->text, text_len)) return;
+    memmove(doc->text.data + from + text_len, doc->text.data + to, doc->text.len - to + 1);
+    memcpy(doc->text.data + from, text, text_len);
+    doc->text.len = doc->text.len - (to - from) + text_len;
+    lsp_index_lines(doc);  // The next change's positions are in the new text
+}
+
+static void lsp_changed(LspServer *server, LspDocument *doc) {
+    double start = lsp_now_ms();
+    lsp_update(server, doc);
+    lsp_publish(doc, doc->uri, 0);
+    if (server->config->debug) {
+        fprintf(stderr, "lsp: %s v%d: %d lines, %d regions, %d parsed, %d cached, %.3f ms\n",
+                doc->uri, doc->version, doc->line_count, doc->region_count,
+                server->parsed, server->reused, lsp_now_ms() - start);
+    }
+}
+
+/* Requests and notifications */
+
+static void lsp_dispatch(LspServer *server, const Json *message) {
+    const char *method = json_get_string(message, "method");
+    const Json *id = json_get(message, "id");
+    const Json *params = json_get(message, "params");
+    const Json *document = json_get(params, "textDocument");
+    const char *uri = json_get_string(document, "uri");
+    if (!method) return;  // A response to us; we send no requests
+
+    if (strcmp(method, "initialize") == 0) {
+        LspBuf b = {0};
+        lsp_response(&b, id);
+        buf_puts(&b, ",\"result\":{\"capabilities\":{"
+                     "\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
+                     "\"documentSymbolProvider\":true,\"hoverProvider\":true},"
+                     "\"serverInfo\":{\"name\":\"kotha\"}}}");
+        lsp_send(&b);
+        free(b.data);
+    } else if (strcmp(method, "shutdown") == 0) {
+        server->shutdown = 1;
+        LspBuf b = {0};
+        lsp_response(&b, id);
+        buf_puts(&b, ",\"result\":null}");
+        lsp_send(&b);
+        free(b.data);
+    } else if (strcmp(method, "textDocument/didOpen") == 0) {
+        const char *text = json_get_string(document, "text");
+        if (!uri || !text) return;
+        lsp_close(server, uri);
+        LspDocument *doc = (LspDocument*)calloc(1, sizeof(LspDocument));
+        if (!doc) return;
+        doc->uri = strdup(uri);
+        doc->version = json_get_int(document, "version", 0);
+        buf_append(&doc->text, text, json_get(document, "text")->text_len);
+        lsp_index_lines(doc);
+        doc->next = server->documents;
+        server->documents = doc;
+        lsp_changed(server, doc);
+    } else if (strcmp(method, "textDocument/didChange") == 0) {
+        LspDocument *doc = lsp_find(server, uri);
+        Json *changes = json_get(params, "contentChanges");
+        if (!doc || !changes) return;
+        for (Json *change = changes->child; change; change = change->next) {
+            lsp_apply_change(doc, change);
+        }
+        doc->version = json_get_int(document, "version", doc->version);
+        lsp_changed(server, doc);
+    } else if (strcmp(method, "textDocument/didClose") == 0) {
+        LspDocument *doc = lsp_find(server, uri);
+        if (!doc) return;
+        lsp_publish(doc, uri, 1);
+        lsp_close(server, uri);
+    } else if (strcmp(method, "textDocument/documentSymbol") == 0) {
+        LspDocument *doc = lsp_find(server, uri);
+        if (!doc) {
+            lsp_error(id, -32602, "Unknown document");
+            return;
+        }
+        lsp_document_symbols(doc, id);
+    } else if (strcmp(method, "textDocument/hover") == 0) {
+        LspDocument *doc = lsp_find(server, uri);
+        Json *position = json_get(params, "position");
+        if (!doc) {
+            lsp_error(id, -32602, "Unknown document");
+            return;
+        }
+        lsp_hover(doc, id, json_get_int(position, "line", 0), json_get_int(position, "character", 0));
+    } else if (id) {
+        lsp_error(id, -32601, "Method not found");
+    }
+    // Other notifications (initialized, $/cancelRequest, ...) need nothing
+}
+
+/* Read one message body (after its Content-Length header); NULL at EOF */
+static char* lsp_read(size_t *len) {
+    char line[1024];
+    long long length = -1;
+    while (fgets(line, sizeof(line), stdin)) {
+        if (strcmp(line, "\r\n") == 0 || strcmp(line, "\n") == 0) {
+            if (length < 0) continue;  // No header yet
+            if (length > LSP_MAX_MESSAGE) return NULL;
+            char *body = (char*)malloc(length + 1);
+            if (!body) return NULL;
+            if (fread(body, 1, length, stdin) != (size_t)length) {
+                free(body);
+                return NULL;
+            }
+            body[length] = '\0';
+            *len = (size_t)length;
+            return body;
+        }
+        if (strncasecmp(line, "Content-Length:", 15) == 0) length = atoll(line + 15);
+    }
+    return NULL;
+}
+
+/* Public API */
+
+int lsp_run(const LspConfig *config) {
+    LspServer server;
+    memset(&server, 0, sizeof(server));
+    server.config = config;
+
+    size_t len;
+    char *body;
+    int status = 1;
+    while ((body = lsp_read(&len)) != NULL) {
+        Json *message = json_parse(body, len);
+        free(body);
+        if (!message) {
+            lsp_error(NULL, -32700, "Parse error");
+            continue;
+        }
+        const char *method = json_get_string(message, "method");
+        if (method && strcmp(method, "exit") == 0) {
+            status = server.shutdown ? 0 : 1;
+            json_free(message);
+            break;
+        }
+        lsp_dispatch(&server, message);
+        json_free(message);
+    }
+
+    while (server.documents) lsp_close(&server, server.documents->uri);
+    return status;
+}
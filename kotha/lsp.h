@@ -0,0 +1,43 @@
+/*
+ * Kotha Language Server Header
+ * kotha lsp: diagnostics, document symbols and hover over stdio (LSP)
+ */
+
+#ifndef LSP_H
+#define LSP_H
+
+#include <stddef.h>
+
+typedef struct {
+    int debug;              // Log each document update and its cost to stderr
+} LspConfig;
+
+/* Serve one client on stdin/stdout until it sends 'exit'. Returns the exit
+ * status (0 if it asked for shutdown first). */
+int lsp_run(const LspConfig *config);
+
+/* Top-level regions of a source file (also used by run --watch) */
+typedef enum {
+    REGION_GLOBALS,          // Everything before the first function
+    REGION_FUNCTION,         // kaj name(...) { ... } or void kaj ...
+    REGION_MAIN              // main function { ... }
+} RegionKind;
+
+typedef struct {
+    RegionKind kind;
+    size_t start, end;       // Bytes of the document
+    int first_line;          // Line of 'start', from 0
+    int last_line;
+    char *name;              // Function name (NULL for the globals)
+    char **params;
+    int param_count;
+    struct LspParse *parse;  // Language server only
+} LspRegion;
+
+/* Cut text at every 'kaj', 'void kaj' and 'main function' outside braces,
+ * strings and comments. Region 0 is always the globals. Returns the number
+ * of regions (0 if out of memory). */
+int lsp_split(const char *text, size_t len, LspRegion **regions);
+void lsp_free_regions(LspRegion *regions, int count);
+
+#endif /* LSP_H */
@@ -7,10 +7,20 @@
 #include <stdlib.h>
 #include <string.h>
 #include "vm.h"
+#include "vm_jit.h"
+#include "vm_trace.h"
+#include "vm_perf.h"
+#include "vm_fiber.h"
+#include "vm_par.h"
+#include "vm_isolate.h"
+#include "codegen_x86.h"
+#include "codegen_c.h"
 #include "ir.h"
 #include "ast.h"
 #include "interp.h"
+#include "tier.h"
 #include "optimizer.h"
+#include "parser.tab.h"
 
 #define VERSION "0.2.0"
 
@@ -19,6 +29,9 @@ typedef enum {
     CMD_BUILD,      // kotha build
     CMD_RUN,        // kotha run
     CMD_REPL,       // kotha repl
+    CMD_BATCH,      // kotha batch
+    CMD_SERVE,      // kotha serve
+    CMD_LSP,        // kotha lsp
     CMD_HELP,       // kotha help
     CMD_VERSION,    // kotha version
     CMD_LEGACY      // Legacy flag-based mode
@@ -31,6 +44,8 @@ typedef enum {
     MODE_INTERPRET,    // Direct interpretation
     MODE_OPTIMIZE,     // Show optimizations
     MODE_BYTECODE,     // Show bytecode
+    MODE_NATIVE,       // Compile IR to x86-64 assembly and link
+    MODE_TIERED,       // Run in the VM, JIT compiling once the program is hot
     MODE_HELP,
     MODE_VERSION
 } ExecutionMode;
@@ -45,17 +60,31 @@ typedef struct {
     int verbose;
     int vm_mode;
     int optimize_level;
+    int gc_max_pause_us;    // Incremental GC slice budget (0 = stop-the-world)
+    int gc_slice_objects;
+    int gc_threads;         // Threads for full collections (1 = serial)
+    int par_threads;        // Threads for somantorale loops (0 = one per core)
+    int jit;                // Run VM bytecode as native code
+    int trace_jit;          // Compile hot loops to native traces
+    int asm_only;           // Native build: stop after writing assembly
+    int perf;               // Write perf map/jitdump for generated code
+    int watch;              // Run: re-run on every save
+    int jobs;               // Batch: scripts run at once; serve: workers (0 = one per core)
+    int port;               // Serve: TCP port on 127.0.0.1
+    long long fuel;         // Serve: instructions per request
+    long long memory_mb;    // Serve: heap per request
+    long long timeout_ms;   // Serve: wall time per request
 } Config;
 
 /* Forward declarations */
-extern int yyparse();
-extern FILE *yyin;
-extern ASTNode *root;
-extern IRInstr *ir_head;
-extern int generate_c;
+extern __thread int generate_c;
 
 /* REPL */
 #include "repl.h"
+#include "batch.h"
+#include "serve.h"
+#include "lsp.h"
+#include "watch.h"
 
 /* Print usage */
 void print_usage(const char *prog_name) {
@@ -67,6 +96,9 @@ void print_usage(const char *prog_name) {
     printf("  build <file>     Compile Kotha file to executable\n");
     printf("  run <file>       Compile and run Kotha file\n");
     printf("  repl             Start interactive REPL\n");
+    printf("  batch <dir|list> Run many scripts concurrently in one process\n");
+    printf("  serve            Run programs sent over HTTP (POST /run) on a worker pool\n");
+    printf("  lsp              Language server for editors (LSP over stdin/stdout)\n");
     printf("  help             Show this help message\n");
     printf("  version          Show version information\n");
     printf("\n");
@@ -74,11 +106,35 @@ void print_usage(const char *prog_name) {
     printf("Build Options:\n");
     printf("  -o <file>        Specify output file name\n");
     printf("  --vm             Build for VM mode\n");
+    printf("  --native         Build an x86-64 executable with as/ld (no C compiler)\n");
+    printf("  -S               With --native, write assembly only (<output>.s)\n");
     printf("\n");
     
     printf("Run Options:\n");
     printf("  --vm             Run in VM mode\n");
     printf("  --debug          Enable debug output\n");
+    printf("  --gc-max-pause=<t>  Incremental GC, max pause per slice (e.g. 1ms, 500us)\n");
+    printf("  --gc-slice=<n>   Incremental GC, objects traced per slice\n");
+    printf("  --gc-threads=<n> Mark and sweep full collections on n threads\n");
+    printf("  --threads=<n>    Run 'cholbe somantorale' loops on n threads (default: all cores)\n");
+    printf("  --jit            Compile bytecode to native code (implies --vm)\n");
+    printf("  --trace-jit      Compile hot loops to native traces (implies --vm)\n");
+    printf("  --tiered         Start in the VM, move to the JIT once the program is hot\n");
+    printf("  --perf           Write /tmp/perf-<pid>.map and jitdump for 'perf record'\n");
+    printf("  --watch          Run again on every save, rebuilding only what changed (implies --vm)\n");
+    printf("\n");
+    
+    printf("Batch Options:\n");
+    printf("  -j <n>           Run n scripts at once (default: all cores)\n");
+    printf("  --jit, --trace-jit, --gc-*, --threads=<n>  As for run (--threads defaults to 1)\n");
+    printf("\n");
+    
+    printf("Serve Options:\n");
+    printf("  --port=<n>       Listen on 127.0.0.1:n (default: 8090; 0 picks a free port)\n");
+    printf("  -j <n>           Worker processes (default: all cores, at least 2)\n");
+    printf("  --fuel=<n>       Instructions per request (default: 100000000)\n");
+    printf("  --memory=<mb>    Heap per request (default: 256)\n");
+    printf("  --timeout=<ms>   Wall time per request (default: 10000)\n");
     printf("\n");
     
     printf("Legacy Options (deprecated):\n");
@@ -91,9 +147,13 @@ void print_usage(const char *prog_name) {
     printf("Examples:\n");
     printf("  %s build program.kotha\n", prog_name);
     printf("  %s build program.kotha -o myapp\n", prog_name);
+    printf("  %s build program.kotha --native\n", prog_name);
     printf("  %s run program.kotha\n", prog_name);
     printf("  %s run program.kotha --vm --debug\n", prog_name);
+    printf("  %s run program.kotha --watch\n", prog_name);
     printf("  %s repl\n", prog_name);
+    printf("  %s batch tests/ -j 8\n", prog_name);
+    printf("  %s serve --port=8090\n", prog_name);
     printf("\n");
 }
 
@@ -104,6 +164,18 @@ void print_version() {
     printf("Built with: Flex, Bison, C\n");
 }
 
+/* Parse a duration like "1ms", "500us" or "2" (milliseconds) into microseconds */
+static int parse_duration_us(const char *text) {
+    char *unit;
+    double value = strtod(text, &unit);
+    
+    if (unit == text || value <= 0) return 0;
+    if (strcmp(unit, "us") == 0) return (int)value;
+    if (strcmp(unit, "ms") == 0 || *unit == '\0') return (int)(value * 1000);
+    if (strcmp(unit, "s") == 0) return (int)(value * 1000000);
+    return 0;
+}
+
 /* Parse command-line arguments */
 Config parse_args(int argc, char **argv) {
     Config config = {
@@ -114,7 +186,21 @@ Config parse_args(int argc, char **argv) {
         .debug = 0,
         .verbose = 0,
         .vm_mode = 0,
-        .optimize_level = 0
+        .optimize_level = 0,
+        .gc_max_pause_us = 0,
+        .gc_slice_objects = 0,
+        .gc_threads = 1,
+        .par_threads = 0,
+        .jit = 0,
+        .trace_jit = 0,
+        .asm_only = 0,
+        .perf = 0,
+        .watch = 0,
+        .jobs = 0,
+        .port = 8090,
+        .fuel = 100000000,
+        .memory_mb = 256,
+        .timeout_ms = 10000
     };
     
     // Check for subcommands
@@ -125,6 +211,14 @@ Config parse_args(int argc, char **argv) {
         } else if (strcmp(argv[1], "run") == 0) {
             config.command = CMD_RUN;
             config.mode = MODE_COMPILE_C;
+        } else if (strcmp(argv[1], "batch") == 0) {
+            config.command = CMD_BATCH;
+            config.mode = MODE_VM;
+        } else if (strcmp(argv[1], "serve") == 0) {
+            config.command = CMD_SERVE;
+            config.mode = MODE_VM;
+        } else if (strcmp(argv[1], "lsp") == 0) {
+            config.command = CMD_LSP;
         } else if (strcmp(argv[1], "repl") == 0) {
             config.command = CMD_REPL;
             return config;
@@ -154,6 +248,27 @@ Config parse_args(int argc, char **argv) {
             } else {
                 config.mode = MODE_VM;
             }
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            config.jit = 1;
+            config.vm_mode = 1;
+            config.mode = MODE_VM;
+        } else if (strcmp(argv[i], "--trace-jit") == 0) {
+            config.trace_jit = 1;
+            config.vm_mode = 1;
+            config.mode = MODE_VM;
+        } else if (strcmp(argv[i], "--perf") == 0) {
+            config.perf = 1;
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            config.watch = 1;
+            config.vm_mode = 1;
+            config.mode = MODE_VM;
+        } else if (strcmp(argv[i], "--tiered") == 0) {
+            config.mode = MODE_TIERED;
+        } else if (strcmp(argv[i], "--native") == 0) {
+            config.mode = MODE_NATIVE;
+        } else if (strcmp(argv[i], "-S") == 0) {
+            config.asm_only = 1;
+            config.mode = MODE_NATIVE;
         } else if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--interpret") == 0) {
             config.mode = MODE_INTERPRET;
         } else if (strcmp(argv[i], "-O") == 0 || strcmp(argv[i], "--optimize") == 0) {
@@ -162,6 +277,43 @@ Config parse_args(int argc, char **argv) {
             config.mode = MODE_BYTECODE;
         } else if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--debug") == 0) {
             config.debug = 1;
+        } else if (strncmp(argv[i], "--gc-max-pause=", 15) == 0) {
+            config.gc_max_pause_us = parse_duration_us(argv[i] + 15);
+            if (config.gc_max_pause_us <= 0) {
+                fprintf(stderr, "Warning: Invalid GC pause '%s', using stop-the-world GC\n", argv[i] + 15);
+                config.gc_max_pause_us = 0;
+            }
+        } else if (strncmp(argv[i], "--gc-slice=", 11) == 0) {
+            config.gc_slice_objects = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--gc-threads=", 13) == 0) {
+            config.gc_threads = atoi(argv[i] + 13);
+            if (config.gc_threads < 1 || config.gc_threads > GC_MAX_THREADS) {
+                fprintf(stderr, "Warning: GC threads must be 1-%d, using 1\n", GC_MAX_THREADS);
+                config.gc_threads = 1;
+            }
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            config.par_threads = atoi(argv[i] + 10);
+            if (config.par_threads < 1 || config.par_threads > PAR_MAX_THREADS) {
+                fprintf(stderr, "Warning: Threads must be 1-%d, using one per core\n", PAR_MAX_THREADS);
+                config.par_threads = 0;
+            }
+        } else if (strncmp(argv[i], "-j", 2) == 0) {
+            const char *jobs = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "0");
+            config.jobs = atoi(jobs);
+            if (config.jobs < 1) {
+                fprintf(stderr, "Warning: Invalid job count '%s', using one per core\n", jobs);
+                config.jobs = 0;
+            }
+        } else if (strncmp(argv[i], "--port=", 7) == 0) {
+            config.port = atoi(argv[i] + 7);
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            config.port = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "--fuel=", 7) == 0) {
+            config.fuel = atoll(argv[i] + 7);
+        } else if (strncmp(argv[i], "--memory=", 9) == 0) {
+            config.memory_mb = atoll(argv[i] + 9);
+        } else if (strncmp(argv[i], "--timeout=", 10) == 0) {
+            config.timeout_ms = atoll(argv[i] + 10);
         } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
             config.output_file = argv[++i];
         } else if (argv[i][0] != '-') {
@@ -192,11 +344,58 @@ int main(int argc, char **argv) {
     if (config.command == CMD_REPL) {
         REPLConfig repl_config = {
             .debug = config.debug,
-            .vm_mode = 1
+            .vm_mode = 1,
+            .gc_max_pause_us = config.gc_max_pause_us,
+            .gc_slice_objects = config.gc_slice_objects,
+            .gc_threads = config.gc_threads
         };
         return repl_start(&repl_config);
     }
     
+    // Handle batch command
+    if (config.command == CMD_BATCH) {
+        if (!config.input_file) {
+            fprintf(stderr, "Error: No scripts specified for batch command\n");
+            fprintf(stderr, "Usage: %s batch <dir|listfile> [-j n] [--jit]\n", argv[0]);
+            return 1;
+        }
+        BatchConfig batch_config = {
+            .jobs = config.jobs,
+            .jit = config.jit,
+            .trace_jit = config.trace_jit,
+            .gc_max_pause_us = config.gc_max_pause_us,
+            .gc_slice_objects = config.gc_slice_objects,
+            .gc_threads = config.gc_threads,
+            .par_threads = config.par_threads
+        };
+        return batch_run(config.input_file, &batch_config);
+    }
+    
+    // Handle serve command
+    if (config.command == CMD_SERVE) {
+        if (config.port < 0 || config.port > 65535) {
+            fprintf(stderr, "Error: Invalid port %d\n", config.port);
+            return 1;
+        }
+        ServeConfig serve_config = {
+            .port = config.port,
+            .workers = config.jobs,
+            .fuel = config.fuel,
+            .memory_mb = config.memory_mb,
+            .timeout_ms = config.timeout_ms,
+            .debug = config.debug
+        };
+        return serve_run(&serve_config);
+    }
+    
+    // Handle lsp command: stdout carries the protocol, so nothing else may print
+    if (config.command == CMD_LSP) {
+        LspConfig lsp_config = {
+            .debug = config.debug
+        };
+        return lsp_run(&lsp_config);
+    }
+    
     // Handle build command
     if (config.command == CMD_BUILD) {
         if (!config.input_file) {
@@ -216,8 +415,8 @@ int main(int argc, char **argv) {
             config.output_file = base;
         }
         
-        // Continue with normal compilation flow
-        // Will compile and create executable
+        // Continue with normal compilation flow; the C goes to <output>.c
+        // and is compiled below (--native builds from the IR instead)
     }
     
     // Handle run command
@@ -228,6 +427,19 @@ int main(int argc, char **argv) {
             return 1;
         }
         
+        if (config.watch) {
+            WatchConfig watch_config = {
+                .jit = config.jit,
+                .trace_jit = config.trace_jit,
+                .gc_max_pause_us = config.gc_max_pause_us,
+                .gc_slice_objects = config.gc_slice_objects,
+                .gc_threads = config.gc_threads,
+                .par_threads = config.par_threads,
+                .debug = config.debug
+            };
+            return watch_run(config.input_file, &watch_config);
+        }
+        
         if (config.debug) {
             printf("▶️  Running %s...\n", config.input_file);
         }
@@ -243,8 +455,8 @@ int main(int argc, char **argv) {
     }
     
     // Open input file
-    yyin = fopen(config.input_file, "r");
-    if (!yyin) {
+    FILE *input = fopen(config.input_file, "r");
+    if (!input) {
         fprintf(stderr, "Error: Cannot open file '%s'\n", config.input_file);
         return 1;
     }
@@ -255,32 +467,61 @@ int main(int argc, char **argv) {
     }
     
     // Disable C generation for non-C modes
-    if (config.mode != MODE_COMPILE_C) {
-        generate_c = 0;
-    }
+    generate_c = config.mode == MODE_COMPILE_C;
     
     if (config.debug) {
         fprintf(stderr, "DEBUG: generate_c = %d\n", generate_c);
     }
     
-    int parse_result = yyparse();
-    fclose(yyin);
+    // kotha build writes the C to a file for the C compiler
+    FILE *c_out = generate_c ? stdout : NULL;
+    char *c_file = NULL;
+    if (generate_c && config.command == CMD_BUILD) {
+        c_file = (char*)malloc(strlen(config.output_file) + 3);
+        if (c_file) sprintf(c_file, "%s.c", config.output_file);
+        c_out = c_file ? fopen(c_file, "w") : NULL;
+        if (!c_out) {
+            fprintf(stderr, "Error: Cannot write '%s'\n", c_file ? c_file : config.output_file);
+            free(c_file);
+            fclose(input);
+            return 1;
+        }
+    }
+    
+    int parsed;
+    ASTNode *root = kotha_parse(input, c_out, NULL, &parsed);
+    fclose(input);
+    if (c_file) fclose(c_out);
     
-    if (parse_result != 0) {
+    if (!parsed) {
         fprintf(stderr, "Parse error\n");
+        if (c_file) remove(c_file);
+        free(c_file);
         return 1;
     }
     
+    // Name generated code and interpreted functions for Linux perf
+    if (config.perf && (config.mode == MODE_VM || config.mode == MODE_TIERED)) {
+        vm_perf_open(config.input_file);
+    }
+    
     // Execute based on mode
+    int status = 0;
     switch (config.mode) {
         case MODE_COMPILE_C:
-            // Default mode - C code already generated by parser
+            // Default mode - kotha_parse wrote the C (codegen_c) after parsing
             if (config.debug) {
                 fprintf(stderr, "C code generated successfully\n");
             }
+            if (c_file) {
+                status = codegen_c_build(c_file, config.output_file);
+                if (!config.debug) remove(c_file);   // --debug keeps the C
+                if (status == 0) printf("✅ Built %s\n", config.output_file);
+            }
             break;
         
-        case MODE_VM: {
+        case MODE_VM:
+        case MODE_TIERED: {
             if (config.debug) {
                 fprintf(stderr, "Generating bytecode...\n");
             }
@@ -308,21 +549,107 @@ int main(int argc, char **argv) {
                 fprintf(stderr, "Running in VM...\n");
                 vm->debug_mode = 1;
             }
+            vm->gc_max_pause_us = config.gc_max_pause_us;
+            vm->gc_slice_objects = config.gc_slice_objects;
+            vm->gc_threads = config.gc_threads;
+            vm->par_threads = config.par_threads;
+            
+            // Tiering brings its own JIT; traces are for plain VM runs
+            if (config.trace_jit && config.mode == MODE_VM && !vm_trace_create(vm)) {
+                fprintf(stderr, "Warning: Tracing JIT unavailable on this platform, using the interpreter\n");
+            }
             
             // Run VM
-            vm_run(vm);
+            VMJit *jit = NULL;
+            if (config.mode == MODE_TIERED) {
+                if (config.debug) fprintf(stderr, "Running tiered (VM -> JIT)...\n");
+                status = tier_run(vm, config.debug);
+            } else if (config.jit) {
+                jit = vm_jit_compile(vm);
+                if (!jit) {
+                    fprintf(stderr, "Warning: JIT unavailable on this platform, using the interpreter\n");
+                }
+            }
+            
+            if (jit) {
+                vm_jit_run(jit, vm);
+            } else if (config.mode == MODE_VM) {
+                vm_run(vm);
+            }
+            
+            // A runtime error, here or in an isolate, fails the run (tier_run
+            // reports its own)
+            if (config.mode == MODE_VM && (vm->error_count > 0 ||
+                    (vm->isolates && __atomic_load_n(&vm->isolates->shutdown, __ATOMIC_ACQUIRE)))) {
+                status = 1;
+            }
             
             if (config.debug) {
                 fprintf(stderr, "\nVM Statistics:\n");
+                if (jit) {
+                    fprintf(stderr, "  JIT: %d instructions inline, %d via interpreter (%zu bytes of code)\n",
+                            jit->fast_count, jit->fallback_count, jit->mapping);
+                }
+                if (vm->tracer) {
+                    fprintf(stderr, "  Traces: %d compiled, %d aborted, %d side exits\n",
+                            vm->tracer->trace_count, vm->tracer->abort_count, vm->tracer->exit_count);
+                }
+                if (vm->sched) {
+                    fprintf(stderr, "  Fibers: %d spawned, %d switches (peak %d alive)\n",
+                            vm->sched->spawned, vm->sched->switches, vm->sched->peak_live);
+                }
+                if (vm->par_pool && vm->par_pool->loops > 0) {
+                    fprintf(stderr, "  Parallel loops: %d run on %d threads, %lld chunks (%lld stolen)\n",
+                            vm->par_pool->loops, vm->par_pool->count,
+                            vm->par_pool->chunks, vm->par_pool->steals);
+                }
+                if (vm->isolates && vm->isolates->started > 0) {
+                    fprintf(stderr, "  Isolates: %d started, %lld messages, %lld instructions\n",
+                            vm->isolates->started, vm->isolates->messages,
+                            vm->isolates->instructions);
+                }
                 fprintf(stderr, "  Instructions executed: %d\n", vm->instruction_count);
                 fprintf(stderr, "  GC runs: %d\n", vm->gc_count);
+                fprintf(stderr, "  Minor GC runs: %d\n", vm->minor_gc_count);
+                if (vm->gc_slice_count > 0) {
+                    fprintf(stderr, "  GC mark slices: %d (longest pause: %dus)\n",
+                            vm->gc_slice_count, vm->gc_longest_pause_us);
+                }
             }
             
+            vm_jit_free(jit);
             vm_free(vm);
             free(vm);
             break;
         }
         
+        case MODE_NATIVE: {
+            if (!ir_head) {
+                if (config.debug) fprintf(stderr, "Generating 3-Address Code (IR)...\n");
+                ir_init();
+                ir_generate(root);
+            }
+            
+            if (!ir_head) {
+                fprintf(stderr, "Error: No IR generated from AST\n");
+                return 1;
+            }
+            
+            const char *output = config.output_file ? config.output_file : "a.out";
+            if (config.debug) {
+                fprintf(stderr, "Generating x86-64 assembly for %s...\n", output);
+            }
+            if (codegen_x86_build(ir_head, output, config.asm_only, config.debug) != 0) {
+                return 1;
+            }
+            if (config.asm_only) {
+                printf("✅ Wrote %s.s\n", output);
+            } else {
+                printf("✅ Built %s\n", output);
+            }
+            break;
+        }
+        
         case MODE_INTERPRET:
             if (config.debug) {
                 fprintf(stderr, "Interpreting...\n");
@@ -387,5 +714,7 @@ int main(int argc, char **argv) {
             return 1;
     }
     
-    return 0;
+    vm_perf_close();
+    free(c_file);
+    return status;
 }
@@ -20,7 +20,4 @@ char* optimize_expr(const char* expr);
 void print_opt_stats();
 void reset_opt_stats();
 
-/* Codegen cleanup */
-void codegen_vm_cleanup();
-
 #endif /* OPTIMIZER_H */
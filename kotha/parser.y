@@ -7,39 +7,103 @@
 #include "interp.h"
 #include "ir.h"
 #include "vm.h"
+#include "codegen_c.h"
 
 // Forward decl
 // codegen_vm is declared in vm.h
 
-extern int yylineno;  // Line number from lexer
-extern char* yytext;   // Current token text
-
-ASTNode *root = NULL; // Root of the AST
-
-void yyerror(const char *s) {
-    fprintf(stderr, "\n");
-    fprintf(stderr, "🐯 Kotha Compiler Error\n");
-    fprintf(stderr, "━━━━━━━━━━━━━━━━━━━━━━━━\n");
-    fprintf(stderr, "Line %d: %s\n", yylineno, s);
-    fprintf(stderr, "Near: '%s'\n", yytext);
-    fprintf(stderr, "\n");
-    fprintf(stderr, "💡 Common fixes:\n");
-    fprintf(stderr, "  • Check for missing semicolons (;)\n");
-    fprintf(stderr, "  • Verify parentheses () and braces {} are balanced\n");
-    fprintf(stderr, "  • Make sure keywords are spelled correctly\n");
-    fprintf(stderr, "  • Check that variables are declared with 'dhoro'\n");
-    fprintf(stderr, "\n");
+/* Parser state is per thread (and the scanner per call, see kotha_parse),
+ * so several threads can compile at once */
+__thread ASTNode *root = NULL; // Root of the AST
+static __thread ASTNode *program;  // Globals and functions, kept for codegen_c
+static __thread FILE *parse_err;  // Diagnostics (NULL = stderr)
+static __thread const struct KothaParseHooks *parse_hooks;  // Set by kotha_parse_region
+static void parse_hooks_report(int line, int syntax, const char *message);
+
+char *yyget_text(void *scanner);
+
+void yyerror(void *scanner, const char *s) {
+    if (parse_hooks) {
+        char message[256];
+        const char *near = yyget_text(scanner);
+        if (near && *near) {
+            snprintf(message, sizeof(message), "%s near '%s'", s, near);
+        } else {
+            snprintf(message, sizeof(message), "%s at end of input", s);
+        }
+        parse_hooks_report(ast_current_line, 1, message);
+        return;
+    }
+    FILE *err = parse_err ? parse_err : stderr;
+    fprintf(err, "\n");
+    fprintf(err, "🐯 Kotha Compiler Error\n");
+    fprintf(err, "━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    fprintf(err, "Line %d: %s\n", ast_current_line, s);
+    fprintf(err, "Near: '%s'\n", yyget_text(scanner));
+    fprintf(err, "\n");
+    fprintf(err, "💡 Common fixes:\n");
+    fprintf(err, "  • Check for missing semicolons (;)\n");
+    fprintf(err, "  • Verify parentheses () and braces {} are balanced\n");
+    fprintf(err, "  • Make sure keywords are spelled correctly\n");
+    fprintf(err, "  • Check that variables are declared with 'dhoro'\n");
+    fprintf(err, "\n");
 }
 
-int yylex();
+__thread int generate_c = 1; // Keep the whole program for the C backend
+
+// Nodes only the C backend uses are dropped unless the program is kept
+static ASTNode* c_only(ASTNode *node) {
+    if (generate_c) return node;
+    free_ast(node);
+    return NULL;
+}
 
-char param_buf[1024];
-int first_param;
-int has_random = 0;
-int generate_c = 1; // Default to generating C code
+// Append b to the list a (chained through 'next')
+static ASTNode* append_node(ASTNode *a, ASTNode *b) {
+    if (!a) return b;
+    ASTNode *curr = a;
+    while (curr->next) curr = curr->next;
+    curr->next = b;
+    return a;
+}
 
 %}
 
+/* Reentrant: the scanner is passed through yyparse to yylex */
+%define api.pure full
+%param {void *scanner}
+
+%code {
+int yylex(YYSTYPE *lvalp, void *scanner);
+}
+
+%code provides {
+#include <stdio.h>
+
+/* Parse a program from 'in' (see parser.y) */
+struct ASTNode* kotha_parse(FILE *in, FILE *c_out, FILE *err, int *ok);
+
+/* Callbacks for parsing one top-level region of a file (language server,
+ * run --watch). Lines are counted from first_line, or from the start of
+ * the region when it is 0. */
+struct Symbol;
+typedef struct KothaParseHooks {
+    void *user;
+    void (*seed)(void *user);    // Declare the symbols the region can see
+    void (*diagnostic)(void *user, int line, int syntax, const char *message);
+    void (*symbol)(void *user, const struct Symbol *sym);  // Each one it declares
+    int first_line;
+} KothaParseHooks;
+
+/* Parse 'in' without printing anything, reporting through 'hooks'.
+ * Returns 1 if it parsed. If 'ast' is set it receives the main function's
+ * body (when the region is the main function) for the caller to free. */
+int kotha_parse_region(FILE *in, const KothaParseHooks *hooks, struct ASTNode **ast);
+
+/* Scanner: report a character no token starts with */
+void kotha_unknown_char(const char *text);
+}
+
 %union {
     int ival;
     float fval;
@@ -50,8 +114,9 @@ int generate_c = 1; // Default to generating C code
 /* Keywords */
 %token INCLUDE
 %token JODI OTHOBA NOYTO PALTAW HOLO SES CHOLBE THEKE PORJONTO JOTOKKHON FEROT
+%token SOMANTORALE JOG
 %token TYPE_INT_KW TYPE_FLOAT_KW TYPE_STRING_KW TYPE_BOOL_KW CONST
-%token TALIKA NEW DEKHAW NAO RANDOM PORISHKAR WAIT SONGJUKTO KAJ VOID
+%token TALIKA NEW DEKHAW NAO RANDOM PORISHKAR WAIT SPAWN ISOLATE SONGJUKTO KAJ VOID
 %token MAIN TYPEOF
 
 /* Exception handling tokens */
@@ -86,122 +151,25 @@ int generate_c = 1; // Default to generating C code
 %right NOT
 %right INC DEC
 
-%type <sval> arguments arg_list
+%type <node> arguments arg_list
 %type <node> expression statements statement block
 %type <node> declaration assignment compound_assignment
 %type <node> if_statement if_head while_statement for_statement print_statement
-%type <node> try_statement throw_statement input_statement
+%type <node> try_statement throw_statement input_statement wait_statement spawn_statement
+%type <node> isolate_statement
 %type <node> return_statement function_call_stmt function_call
 %type <node> array_decl array_2d_decl array_assign array_2d_assign
 %type <node> increment_stmt decrement_stmt
-%type <sval> var_declarator_list var_declarator
+%type <node> var_declarator_list var_declarator
+%type <node> reduction_opt reduction_list
+%type <node> global_declarations global_declaration functions function parameters parameter_list
+%type <node> else_if_list_opt else_if_list else_if_clause else_part_opt else_part finally_opt
+%type <node> clear_statement import_statement
 
 %{
 // Forward declarations
 VarType infer_type(ASTNode *node);
 
-// Helper to convert AST expression back to C string for transpilation
-char* ast_to_c(ASTNode *node) {
-    if (!node) return strdup("");
-    char buf[1024];
-    if (node->type == NODE_LITERAL_INT) {
-        sprintf(buf, "%d", node->ival);
-        return strdup(buf);
-    }
-    if (node->type == NODE_LITERAL_FLOAT) {
-        sprintf(buf, "%f", node->fval);
-        return strdup(buf);
-    }
-    if (node->type == NODE_VAR_REF) return strdup(node->sval);
-    if (node->type == NODE_LITERAL_STRING) return strdup(node->sval);
-    if (node->type == NODE_FUNC_CALL) return strdup(node->sval);
-    if (node->type == NODE_BIN_OP) {
-        char *l = ast_to_c(node->left);
-        char *r = ast_to_c(node->right);
-        
-        // Check if this is string concatenation
-        if (node->op == PLUS) {
-            VarType left_type = infer_type(node->left);
-            VarType right_type = infer_type(node->right);
-            
-            // If either side is a string, do string concatenation
-            if (left_type == TYPE_STRING || right_type == TYPE_STRING) {
-                char *res = malloc(1024);
-                
-                // Build concatenation expression
-                strcpy(res, "(kotha_str_reset(), ");
-                
-                // Add left operand
-                if (left_type == TYPE_STRING) {
-                    strcat(res, "kotha_str_concat_str(");
-                    strcat(res, l);
-                    strcat(res, "), ");
-                } else if (left_type == TYPE_INT || left_type == TYPE_BOOL) {
-                    strcat(res, "kotha_str_concat_int(");
-                    strcat(res, l);
-                    strcat(res, "), ");
-                } else if (left_type == TYPE_FLOAT) {
-                    strcat(res, "kotha_str_concat_float(");
-                    strcat(res, l);
-                    strcat(res, "), ");
-                }
-                
-                // Add right operand
-                if (right_type == TYPE_STRING) {
-                    strcat(res, "kotha_str_concat_str(");
-                    strcat(res, r);
-                    strcat(res, "))");
-                } else if (right_type == TYPE_INT || right_type == TYPE_BOOL) {
-                    strcat(res, "kotha_str_concat_int(");
-                    strcat(res, r);
-                    strcat(res, "))");
-                } else if (right_type == TYPE_FLOAT) {
-                    strcat(res, "kotha_str_concat_float(");
-                    strcat(res, r);
-                    strcat(res, "))");
-                }
-                
-                free(l); free(r);
-                return res;
-            }
-        }
-        
-        // Regular arithmetic operation
-        char op_str[4] = "+";
-        switch(node->op) {
-            case PLUS: strcpy(op_str, "+"); break;
-            case MINUS: strcpy(op_str, "-"); break;
-            case MULT: strcpy(op_str, "*"); break;
-            case DIV: strcpy(op_str, "/"); break;
-            case MOD: strcpy(op_str, "%"); break;
-            case GT: strcpy(op_str, ">"); break;
-            case LT: strcpy(op_str, "<"); break;
-            case GTE: strcpy(op_str, ">="); break;
-            case LTE: strcpy(op_str, "<="); break;
-            case EQ: strcpy(op_str, "=="); break;
-            case NEQ: strcpy(op_str, "!="); break;
-            case AND: strcpy(op_str, "&&"); break;
-            case OR: strcpy(op_str, "||"); break;
-        }
-        char *res = malloc(strlen(l) + strlen(r) + 10);
-        sprintf(res, "%s %s %s", l, op_str, r); 
-        free(l); free(r);
-        return res;
-    }
-    if (node->type == NODE_UN_OP) {
-        char *operand = ast_to_c(node->left);
-        char *res = malloc(strlen(operand) + 5);
-        if (node->op == NOT) {
-            sprintf(res, "!%s", operand);
-        } else {
-            sprintf(res, "%s", operand);
-        }
-        free(operand);
-        return res;
-    }
-    return strdup("expr");
-}
-
 // Type inference: Determine the type of an AST expression node
 VarType infer_type(ASTNode *node) {
     if (!node) return TYPE_UNKNOWN;
@@ -224,6 +192,10 @@ VarType infer_type(ASTNode *node) {
             VarType left_type = infer_type(node->left);
             VarType right_type = infer_type(node->right);
             
+            // string + anything concatenates
+            if (node->op == PLUS && (left_type == TYPE_STRING || right_type == TYPE_STRING))
+                return TYPE_STRING;
+            
             // Arithmetic operators: result type depends on operands
             if (node->op == PLUS || node->op == MINUS || 
                 node->op == MULT || node->op == DIV || node->op == MOD) {
@@ -329,21 +301,76 @@ int types_compatible(VarType t1, VarType t2, int op) {
 
 // Report a type error with helpful message
 void type_error(const char *msg, int line) {
-    fprintf(stderr, "\n🐯 Kotha Type Error\n");
-    fprintf(stderr, "━━━━━━━━━━━━━━━━━━\n");
+    if (parse_hooks) {
+        parse_hooks_report(line, 0, msg);
+        return;
+    }
+    FILE *err = parse_err ? parse_err : stderr;
+    fprintf(err, "\n🐯 Kotha Type Error\n");
+    fprintf(err, "━━━━━━━━━━━━━━━━━━\n");
     if (line > 0) {
-        fprintf(stderr, "Line %d: %s\n", line, msg);
+        fprintf(err, "Line %d: %s\n", line, msg);
     } else {
-        fprintf(stderr, "%s\n", msg);
+        fprintf(err, "%s\n", msg);
     }
-    fprintf(stderr, "\n💡 Type Checking Tips:\n");
-    fprintf(stderr, "  • Variables declared with 'dhoro' are integers\n");
-    fprintf(stderr, "  • String literals cannot be assigned to int variables\n");
-    fprintf(stderr, "  • Cannot mix strings and numbers in arithmetic\n");
-    fprintf(stderr, "\n");
+    fprintf(err, "\n💡 Type Checking Tips:\n");
+    fprintf(err, "  • Variables declared with 'dhoro' are integers\n");
+    fprintf(err, "  • String literals cannot be assigned to int variables\n");
+    fprintf(err, "  • Cannot mix strings and numbers in arithmetic\n");
+    fprintf(err, "\n");
     // Don't exit - let compilation continue to find more errors
 }
 
+// A global variable; the node takes 'name'
+static ASTNode* global_decl(char *name, VarType type, ASTNode *init, int is_const) {
+    insert_symbol_typed(name, SYM_VAR, type);
+    ASTNode *node = create_node(NODE_VAR_DECL);
+    node->sval = name;
+    node->left = init;
+    node->value_type = type;
+    if (is_const) node->op = CONST;
+    return c_only(node);
+}
+
+// talika name[rows] or name[rows][cols]; the node takes 'name'
+static ASTNode* array_decl_node(char *name, int rows, int cols) {
+    ASTNode *node = create_node(NODE_ARRAY_DECL);
+    node->sval = name;
+    node->value_type = TYPE_ARRAY_INT;
+    node->params = create_int_node(rows);
+    if (cols > 0) node->params->next = create_int_node(cols);
+    return node;
+}
+
+// kaj name(params) { body }; the node takes 'name'
+static ASTNode* function_node(char *name, VarType returns, ASTNode *params, ASTNode *body) {
+    ASTNode *node = create_node(NODE_FUNC_DECL);
+    node->sval = name;
+    node->value_type = returns;
+    node->params = params;
+    node->body = body;
+    return node;
+}
+
+// name op= value; the node takes 'name'
+static ASTNode* compound_node(char *name, int op, ASTNode *value) {
+    ASTNode *node = create_node(NODE_COMPOUND_ASSIGN);
+    node->sval = name;
+    node->op = op;
+    node->left = value;
+    return node;
+}
+
+// Chain 'jodi ... noyto ... othoba' through 'right': each else-if is the
+// previous one's else branch, and the final block the last one's
+static ASTNode* else_chain(ASTNode *else_ifs, ASTNode *otherwise) {
+    if (!else_ifs) return otherwise;
+    ASTNode *rest = else_ifs->next;
+    else_ifs->next = NULL;
+    else_ifs->right = else_chain(rest, otherwise);
+    return else_ifs;
+}
+
 // Get type name for error messages
 const char* type_name(VarType t) {
     switch(t) {
@@ -365,215 +392,82 @@ const char* type_name(VarType t) {
 %%
 
 program:
-    {
-        if (generate_c) {
-            printf("#include <stdio.h>\n");
-            printf("#include <string.h>\n");
-            printf("#include <stdlib.h>\n");
-            printf("#include <time.h>\n");
-            printf("#ifdef _WIN32\n");
-            printf("#include <windows.h>\n");
-            printf("#define sleep(x) Sleep((x)*1000)\n");
-            printf("#else\n");
-            printf("#include <unistd.h>\n");
-            printf("#endif\n\n");
-            
-            // Add string concatenation helper functions
-            printf("// String concatenation helpers\n");
-            printf("static char kotha_str_buffer[4096];\n");
-            printf("static int kotha_str_offset = 0;\n\n");
-            
-            printf("char* kotha_str_reset() {\n");
-            printf("    kotha_str_offset = 0;\n");
-            printf("    kotha_str_buffer[0] = '\\0';\n");
-            printf("    return kotha_str_buffer;\n");
-            printf("}\n\n");
-            
-            printf("char* kotha_str_concat_str(const char* s) {\n");
-            printf("    int len = strlen(s);\n");
-            printf("    if (kotha_str_offset + len < 4096) {\n");
-            printf("        strcpy(kotha_str_buffer + kotha_str_offset, s);\n");
-            printf("        kotha_str_offset += len;\n");
-            printf("    }\n");
-            printf("    return kotha_str_buffer;\n");
-            printf("}\n\n");
-            
-            printf("char* kotha_str_concat_int(int val) {\n");
-            printf("    char temp[32];\n");
-            printf("    sprintf(temp, \"%%d\", val);\n");
-            printf("    return kotha_str_concat_str(temp);\n");
-            printf("}\n\n");
-            
-            printf("char* kotha_str_concat_float(float val) {\n");
-            printf("    char temp[32];\n");
-            printf("    sprintf(temp, \"%%g\", val);\n");
-            printf("    return kotha_str_concat_str(temp);\n");
-            printf("}\n\n");
-            
-            // Add type conversion functions
-            printf("// Type conversion functions\n");
-            
-            // purno (int) conversions
-            printf("float purno_to_doshomik(int val) { return (float)val; }\n");
-            printf("char* purno_to_bornona(int val) {\n");
-            printf("    static char buf[32];\n");
-            printf("    sprintf(buf, \"%%d\", val);\n");
-            printf("    return buf;\n");
-            printf("}\n");
-            printf("int purno_to_sotyo_mittha(int val) { return val != 0; }\n\n");
-            
-            // doshomik (float) conversions
-            printf("int doshomik_to_purno(float val) { return (int)val; }\n");
-            printf("char* doshomik_to_bornona(float val) {\n");
-            printf("    static char buf[32];\n");
-            printf("    sprintf(buf, \"%%g\", val);\n");
-            printf("    return buf;\n");
-            printf("}\n");
-            printf("int doshomik_to_sotyo_mittha(float val) { return val != 0.0; }\n\n");
-            
-            // bornona (string) conversions
-            printf("int bornona_to_purno(const char* str) { return atoi(str); }\n");
-            printf("float bornona_to_doshomik(const char* str) { return atof(str); }\n");
-            printf("int bornona_to_sotyo_mittha(const char* str) { return strlen(str) > 0; }\n\n");
-            
-            // sotyo_mittha (bool) conversions
-            printf("int sotyo_mittha_to_purno(int val) { return val; }\n");
-            printf("float sotyo_mittha_to_doshomik(int val) { return (float)val; }\n");
-            printf("char* sotyo_mittha_to_bornona(int val) {\n");
-            printf("    static char buf[8];\n");
-            printf("    sprintf(buf, \"%%s\", val ? \"sotti\" : \"mittha\");\n");
-            printf("    return buf;\n");
-            printf("}\n\n");
-            
-            // typeof() functions
-            printf("// typeof() helper functions\n");
-            printf("const char* kotha_typeof_purno() { return \"purno\"; }\n");
-            printf("const char* kotha_typeof_doshomik() { return \"doshomik\"; }\n");
-            printf("const char* kotha_typeof_bornona() { return \"bornona\"; }\n");
-            printf("const char* kotha_typeof_sotyo_mittha() { return \"sotyo_mittha\"; }\n\n");
-        }
+    global_declarations functions {
+        if (generate_c) program = append_node($1, $2);
     }
-    global_declarations
-    functions
     ;
 
 global_declarations:
-    /* empty */
-    | global_declarations global_declaration
+    /* empty */ { $$ = NULL; }
+    | global_declarations global_declaration { $$ = append_node($1, $2); }
     ;
 
 global_declaration:
       /* Integer declarations */
-      TYPE_INT_KW ID ASSIGN expression SEMICOLON { 
-        insert_symbol_typed($2, SYM_VAR, TYPE_INT);
-        if (generate_c) {
-            char *s = ast_to_c($4);
-            printf("int %s = %s;\n", $2, s); 
-            free($2); free(s); 
-        }
-      }
-    | TYPE_INT_KW ID SEMICOLON { 
-        insert_symbol_typed($2, SYM_VAR, TYPE_INT);
-        if (generate_c) { printf("int %s;\n", $2); free($2); } 
-      }
+      TYPE_INT_KW ID ASSIGN expression SEMICOLON { $$ = global_decl($2, TYPE_INT, $4, 0); }
+    | TYPE_INT_KW ID SEMICOLON { $$ = global_decl($2, TYPE_INT, NULL, 0); }
     
       /* Float declarations */
-    | TYPE_FLOAT_KW ID ASSIGN expression SEMICOLON { 
-        insert_symbol_typed($2, SYM_VAR, TYPE_FLOAT);
-        if (generate_c) {
-            char *s = ast_to_c($4);
-            printf("float %s = %s;\n", $2, s); 
-            free($2); free(s); 
-        }
-      }
-    | TYPE_FLOAT_KW ID SEMICOLON { 
-        insert_symbol_typed($2, SYM_VAR, TYPE_FLOAT);
-        if (generate_c) { printf("float %s;\n", $2); free($2); } 
-      }
+    | TYPE_FLOAT_KW ID ASSIGN expression SEMICOLON { $$ = global_decl($2, TYPE_FLOAT, $4, 0); }
+    | TYPE_FLOAT_KW ID SEMICOLON { $$ = global_decl($2, TYPE_FLOAT, NULL, 0); }
     
       /* String declarations */
-    | TYPE_STRING_KW ID ASSIGN STR SEMICOLON { 
-        insert_symbol_typed($2, SYM_VAR, TYPE_STRING);
-        if (generate_c) { printf("char %s[256] = %s;\n", $2, $4); free($2); free($4); } 
-      }
-    | TYPE_STRING_KW ID SEMICOLON { 
-        insert_symbol_typed($2, SYM_VAR, TYPE_STRING);
-        if (generate_c) { printf("char %s[256];\n", $2); free($2); } 
+    | TYPE_STRING_KW ID ASSIGN STR SEMICOLON {
+        $$ = global_decl($2, TYPE_STRING, create_string_node($4), 0);
+        free($4);
       }
+    | TYPE_STRING_KW ID SEMICOLON { $$ = global_decl($2, TYPE_STRING, NULL, 0); }
     
       /* Boolean declarations */
-    | TYPE_BOOL_KW ID ASSIGN expression SEMICOLON { 
-        insert_symbol_typed($2, SYM_VAR, TYPE_BOOL);
-        if (generate_c) {
-            char *s = ast_to_c($4);
-            printf("int %s = %s;\n", $2, s); 
-            free($2); free(s); 
-        }
-      }
-    | TYPE_BOOL_KW ID SEMICOLON { 
-        insert_symbol_typed($2, SYM_VAR, TYPE_BOOL);
-        if (generate_c) { printf("int %s = 0;\n", $2); free($2); } 
-      }
+    | TYPE_BOOL_KW ID ASSIGN expression SEMICOLON { $$ = global_decl($2, TYPE_BOOL, $4, 0); }
+    | TYPE_BOOL_KW ID SEMICOLON { $$ = global_decl($2, TYPE_BOOL, create_int_node(0), 0); }
     
       /* Const variants */
-    | CONST TYPE_INT_KW ID ASSIGN expression SEMICOLON { 
-        insert_symbol_typed($3, SYM_VAR, TYPE_INT);
-        if (generate_c) {
-            char *s = ast_to_c($5);
-            printf("const int %s = %s;\n", $3, s); 
-            free($3); free(s); 
-        }
-      }
-    | CONST TYPE_FLOAT_KW ID ASSIGN expression SEMICOLON { 
-        insert_symbol_typed($3, SYM_VAR, TYPE_FLOAT);
-        if (generate_c) {
-            char *s = ast_to_c($5);
-            printf("const float %s = %s;\n", $3, s); 
-            free($3); free(s); 
-        }
-      }
+    | CONST TYPE_INT_KW ID ASSIGN expression SEMICOLON { $$ = global_decl($3, TYPE_INT, $5, 1); }
+    | CONST TYPE_FLOAT_KW ID ASSIGN expression SEMICOLON { $$ = global_decl($3, TYPE_FLOAT, $5, 1); }
     
       /* Arrays */
     | TALIKA ID LBRACKET INT RBRACKET SEMICOLON { 
         insert_symbol_typed($2, SYM_VAR, TYPE_ARRAY_INT);
-        if (generate_c) { printf("int %s[%d];\n", $2, $4); free($2); } 
+        $$ = c_only(array_decl_node($2, $4, 0));
       }
     | TALIKA ID LBRACKET INT RBRACKET LBRACKET INT RBRACKET SEMICOLON { 
         insert_symbol_typed($2, SYM_VAR, TYPE_ARRAY_INT);
-        if (generate_c) { printf("int %s[%d][%d];\n", $2, $4, $7); free($2); } 
+        $$ = c_only(array_decl_node($2, $4, $7));
       }
     ;
 
 functions:
-    /* empty */
-    | functions function
+    /* empty */ { $$ = NULL; }
+    | functions function { $$ = append_node($1, $2); }
     ;
 
 function:
-    KAJ ID LPAREN { strcpy(param_buf, ""); first_param = 1; } parameters RPAREN LBRACE { if (generate_c) { printf("int %s(%s) {\n", $2, param_buf); free($2); } } statements RBRACE { if (generate_c) { printf("}\n\n"); } }
-    | VOID KAJ ID LPAREN { strcpy(param_buf, ""); first_param = 1; } parameters RPAREN LBRACE { if (generate_c) { printf("void %s(%s) {\n", $3, param_buf); free($3); } } statements RBRACE { if (generate_c) { printf("}\n\n"); } }
-    | MAIN LBRACE { 
-        if (generate_c) {
-            printf("int main() {\n");
-            if (has_random) printf("    srand(time(NULL));\n");
-        }
-    } statements RBRACE { 
+    KAJ ID LPAREN parameters RPAREN LBRACE statements RBRACE {
+        $$ = c_only(function_node($2, TYPE_INT, $4, $7));
+    }
+    | VOID KAJ ID LPAREN parameters RPAREN LBRACE statements RBRACE {
+        $$ = c_only(function_node($3, TYPE_VOID, $5, $8));
+    }
+    | MAIN LBRACE statements RBRACE { 
+        root = $3; // Capture AST root
+        $$ = NULL;
         if (generate_c) {
-            // The statements are printed by their own rules, so we just close main
-            printf("    return 0;\n}\n"); 
+            // The body stays root's; kotha_parse detaches it before freeing
+            $$ = function_node(strdup("main"), TYPE_INT, NULL, $3);
+            $$->op = MAIN;
         }
-        root = $4; // Capture AST root, $4 is statements (after embedded action)
     }
     ;
 
 parameters:
-    /* empty */
-    | parameter_list
+    /* empty */ { $$ = NULL; }
+    | parameter_list { $$ = $1; }
     ;
 
 parameter_list:
-    ID { if (generate_c) { if (first_param) { sprintf(param_buf, "int %s", $1); first_param = 0; } else { sprintf(param_buf + strlen(param_buf), ", int %s", $1); } free($1); } }
-    | parameter_list COMMA ID { if (generate_c) { sprintf(param_buf + strlen(param_buf), ", int %s", $3); free($3); } }
+    ID { $$ = create_id_node($1); free($1); }
+    | parameter_list COMMA ID { $$ = append_node($1, create_id_node($3)); free($3); }
     ;
 
 statements:
@@ -602,191 +496,80 @@ statement:
     | return_statement { $$ = $1; }
     | function_call_stmt { $$ = $1; }
     | input_statement { $$ = $1; }
-    | clear_statement { $$ = NULL; }
-    | wait_statement { $$ = NULL; }
-    | array_decl { $$ = NULL; }
-    | array_2d_decl { $$ = NULL; }
-    | array_assign { $$ = NULL; }
-    | array_2d_assign { $$ = NULL; }
-    | compound_assignment { $$ = NULL; }
+    | clear_statement { $$ = c_only($1); }
+    | wait_statement { $$ = $1; }
+    | spawn_statement { $$ = $1; }
+    | isolate_statement { $$ = $1; }
+    /* Arrays, compound assignment and the rest are not in the VM yet */
+    | array_decl { $$ = c_only($1); }
+    | array_2d_decl { $$ = c_only($1); }
+    | array_assign { $$ = c_only($1); }
+    | array_2d_assign { $$ = c_only($1); }
+    | compound_assignment { $$ = c_only($1); }
     | increment_stmt { $$ = $1; }
     | decrement_stmt { $$ = $1; }
-    | import_statement { $$ = NULL; }
+    | import_statement { $$ = c_only($1); }
     ;
 
 /* Variable declarator list - supports comma-separated declarations */
 var_declarator_list:
     var_declarator { $$ = $1; }
     | var_declarator_list COMMA var_declarator {
-        // Concatenate the declarators with comma
-        char *result = malloc(strlen($1) + strlen($3) + 3);
-        sprintf(result, "%s, %s", $1, $3);
-        free($1); free($3);
-        $$ = result;
+        // Chain the declarators in source order
+        ASTNode *curr = $1;
+        while (curr->next) curr = curr->next;
+        curr->next = $3;
+        $$ = $1;
     }
     ;
 
 var_declarator:
-    ID { $$ = strdup($1); free($1); }
+    ID {
+        $$ = create_node(NODE_VAR_DECL);
+        $$->sval = $1;
+    }
     | ID ASSIGN expression {
-        char *expr_str = ast_to_c($3);
-        char *result = malloc(strlen($1) + strlen(expr_str) + 4);
-        sprintf(result, "%s = %s", $1, expr_str);
-        free($1); free(expr_str);
-        $$ = result;
+        $$ = create_node(NODE_VAR_DECL);
+        $$->sval = $1;
+        $$->left = $3;
     }
     ;
 
 declaration:
     /* Integer declarations */
     TYPE_INT_KW var_declarator_list SEMICOLON { 
-        $$ = create_node(NODE_VAR_DECL);
-        
-        if (generate_c) {
-            printf("    int %s;\n", $2);
+        $$ = $2;
+        for (ASTNode *d = $2; d; d = d->next) {
+            insert_symbol_typed(d->sval, SYM_VAR, TYPE_INT);
+            d->value_type = TYPE_INT;
         }
-        
-        // Parse the declarator list and insert symbols
-        char *decl_copy = strdup($2);
-        char *token = strtok(decl_copy, ",");
-        while (token != NULL) {
-            // Trim whitespace
-            while (*token == ' ') token++;
-            char *end = token + strlen(token) - 1;
-            while (end > token && *end == ' ') end--;
-            *(end + 1) = '\0';
-            
-            // Extract variable name (before '=' if present)
-            char *eq = strchr(token, '=');
-            if (eq) {
-                *eq = '\0';
-                end = eq - 1;
-                while (end > token && *end == ' ') end--;
-                *(end + 1) = '\0';
-            }
-            
-            insert_symbol_typed(token, SYM_VAR, TYPE_INT);
-            token = strtok(NULL, ",");
-        }
-        free(decl_copy);
-        free($2);
     }
     
     /* Float declarations */
     | TYPE_FLOAT_KW var_declarator_list SEMICOLON { 
-        $$ = create_node(NODE_VAR_DECL);
-        
-        if (generate_c) {
-            printf("    float %s;\n", $2);
-        }
-        
-        // Parse and insert symbols
-        char *decl_copy = strdup($2);
-        char *token = strtok(decl_copy, ",");
-        while (token != NULL) {
-            while (*token == ' ') token++;
-            char *end = token + strlen(token) - 1;
-            while (end > token && *end == ' ') end--;
-            *(end + 1) = '\0';
-            
-            char *eq = strchr(token, '=');
-            if (eq) {
-                *eq = '\0';
-                end = eq - 1;
-                while (end > token && *end == ' ') end--;
-                *(end + 1) = '\0';
-            }
-            
-            insert_symbol_typed(token, SYM_VAR, TYPE_FLOAT);
-            token = strtok(NULL, ",");
+        $$ = $2;
+        for (ASTNode *d = $2; d; d = d->next) {
+            insert_symbol_typed(d->sval, SYM_VAR, TYPE_FLOAT);
+            d->value_type = TYPE_FLOAT;
         }
-        free(decl_copy);
-        free($2);
     }
     
     /* String declarations */
     | TYPE_STRING_KW var_declarator_list SEMICOLON { 
-        $$ = create_node(NODE_VAR_DECL);
-        
-        if (generate_c) {
-            // For strings, need to convert to char arrays
-            char *decl_copy = strdup($2);
-            char *token = strtok(decl_copy, ",");
-            int first = 1;
-            while (token != NULL) {
-                while (*token == ' ') token++;
-                if (!first) printf("    ");
-                
-                // Check if initialized
-                char *eq = strchr(token, '=');
-                if (eq) {
-                    *eq = '\0';
-                    char *var_name = token;
-                    char *init_val = eq + 1;
-                    while (*var_name == ' ') var_name++;
-                    while (*init_val == ' ') init_val++;
-                    
-                    char *end = var_name + strlen(var_name) - 1;
-                    while (end > var_name && *end == ' ') end--;
-                    *(end + 1) = '\0';
-                    
-                    // Check if init_val is a string literal (starts with ")
-                    if (init_val[0] == '"') {
-                        // String literal - can use direct initialization
-                        printf("char %s[256] = %s;\n", var_name, init_val);
-                    } else {
-                        // Function call or expression - need to use strcpy
-                        printf("char %s[256];\n", var_name);
-                        printf("    strcpy(%s, %s);\n", var_name, init_val);
-                    }
-                    insert_symbol_typed(var_name, SYM_VAR, TYPE_STRING);
-                } else {
-                    char *end = token + strlen(token) - 1;
-                    while (end > token && *end == ' ') end--;
-                    *(end + 1) = '\0';
-                    
-                    printf("char %s[256];\n", token);
-                    insert_symbol_typed(token, SYM_VAR, TYPE_STRING);
-                }
-                
-                token = strtok(NULL, ",");
-                first = 0;
-            }
-            free(decl_copy);
+        $$ = $2;
+        for (ASTNode *d = $2; d; d = d->next) {
+            insert_symbol_typed(d->sval, SYM_VAR, TYPE_STRING);
+            d->value_type = TYPE_STRING;
         }
-        free($2);
     }
     
     /* Boolean declarations */
     | TYPE_BOOL_KW var_declarator_list SEMICOLON { 
-        $$ = create_node(NODE_VAR_DECL);
-        
-        if (generate_c) {
-            printf("    int %s;\n", $2);
-        }
-        
-        // Parse and insert symbols
-        char *decl_copy = strdup($2);
-        char *token = strtok(decl_copy, ",");
-        while (token != NULL) {
-            while (*token == ' ') token++;
-            char *end = token + strlen(token) - 1;
-            while (end > token && *end == ' ') end--;
-            *(end + 1) = '\0';
-            
-            char *eq = strchr(token, '=');
-            if (eq) {
-                *eq = '\0';
-                end = eq - 1;
-                while (end > token && *end == ' ') end--;
-                *(end + 1) = '\0';
-            }
-            
-            insert_symbol_typed(token, SYM_VAR, TYPE_BOOL);
-            token = strtok(NULL, ",");
+        $$ = $2;
+        for (ASTNode *d = $2; d; d = d->next) {
+            insert_symbol_typed(d->sval, SYM_VAR, TYPE_BOOL);
+            d->value_type = TYPE_BOOL;
         }
-        free(decl_copy);
-        free($2);
     }
     ;
 
@@ -794,41 +577,8 @@ print_statement:
     DEKHAW LPAREN expression RPAREN SEMICOLON {
         $$ = create_node(NODE_PRINT);
         $$->left = $3;
-        
-        if (generate_c) {
-            char *expr_str = ast_to_c($3);
-            
-            // Infer the type of the expression to use correct printf format
-            VarType expr_type = infer_type($3);
-            
-            // Check if this is a string concatenation result
-            // String concatenation returns a string, so check if expression contains kotha_str_
-            int is_string_concat = (strstr(expr_str, "kotha_str_") != NULL);
-            
-            if (is_string_concat || expr_type == TYPE_STRING) {
-                printf("    printf(\"%%s\\n\", %s);\n", expr_str);
-            } else {
-                switch (expr_type) {
-                    case TYPE_INT:
-                    case TYPE_BOOL:
-                        printf("    printf(\"%%d\\n\", %s);\n", expr_str);
-                        break;
-                    case TYPE_FLOAT:
-                        printf("    printf(\"%%f\\n\", %s);\n", expr_str);
-                        break;
-                    default:
-                        // Default to integer format
-                        printf("    printf(\"%%d\\n\", %s);\n", expr_str);
-                        break;
-                }
-            }
-            free(expr_str);
-        }
     }
     | DEKHAW LPAREN STR RPAREN SEMICOLON { 
-        if (generate_c) {
-            printf("    printf(\"%%s\\n\", %s);\n", $3); 
-        }
         $$ = create_node(NODE_PRINT);
         $$->left = create_string_node($3);
         free($3); 
@@ -836,61 +586,53 @@ print_statement:
     ;
 
 block:
-    LBRACE { if (generate_c) { printf("{\n"); } } statements RBRACE { 
-        if (generate_c) { printf("}\n"); } 
+    LBRACE statements RBRACE { 
         $$ = create_node(NODE_BLOCK);
-        $$->body = $3;
+        $$->body = $2;
     }
     ;
 
 
 
 while_statement:
-    JOTOKKHON LPAREN expression RPAREN {
-        if (generate_c) {
-            char *s = ast_to_c($3);
-            printf("    while (%s) ", s);
-            free(s);
-        }
-    } block {
+    JOTOKKHON LPAREN expression RPAREN block {
         $$ = create_node(NODE_WHILE);
         $$->cond = $3;
-        $$->body = $6;
+        $$->body = $5;
     }
     ;
 
 
 
 array_decl:
-    TALIKA ID LBRACKET INT RBRACKET SEMICOLON { if (generate_c) { printf("    int %s[%d];\n", $2, $4); free($2); } }
+    TALIKA ID LBRACKET INT RBRACKET SEMICOLON {
+        insert_symbol_typed($2, SYM_VAR, TYPE_ARRAY_INT);
+        $$ = array_decl_node($2, $4, 0);
+    }
     ;
 
 array_2d_decl:
-    TALIKA ID LBRACKET INT RBRACKET LBRACKET INT RBRACKET SEMICOLON { if (generate_c) { printf("    int %s[%d][%d];\n", $2, $4, $7); free($2); } }
+    TALIKA ID LBRACKET INT RBRACKET LBRACKET INT RBRACKET SEMICOLON {
+        insert_symbol_typed($2, SYM_VAR, TYPE_ARRAY_INT);
+        $$ = array_decl_node($2, $4, $7);
+    }
     ;
 
 array_assign:
     ID LBRACKET expression RBRACKET ASSIGN expression SEMICOLON { 
-        if (generate_c) {
-            char *idx = ast_to_c($3);
-            char *val = ast_to_c($6);
-            printf("    %s[%s] = %s;\n", $1, idx, val); 
-            free($1); free(idx); free(val); 
-        }
-        $$ = NULL;
+        $$ = create_node(NODE_ARRAY_ASSIGN);
+        $$->sval = $1;
+        $$->params = $3;
+        $$->left = $6;
     }
     ;
 
 array_2d_assign:
     ID LBRACKET expression RBRACKET LBRACKET expression RBRACKET ASSIGN expression SEMICOLON { 
-        if (generate_c) {
-            char *idx1 = ast_to_c($3);
-            char *idx2 = ast_to_c($6);
-            char *val = ast_to_c($9);
-            printf("    %s[%s][%s] = %s;\n", $1, idx1, idx2, val); 
-            free($1); free(idx1); free(idx2); free(val); 
-        }
-        $$ = NULL;
+        $$ = create_node(NODE_ARRAY_ASSIGN);
+        $$->sval = $1;
+        $$->params = append_node($3, $6);
+        $$->left = $9;
     }
     ;
 
@@ -904,13 +646,7 @@ assignment:
             char error_msg[256];
             sprintf(error_msg, "Type mismatch: Cannot assign %s to %s variable '%s'",
                     type_name(expr_type), type_name(var_type), $1);
-            type_error(error_msg, yylineno);
-        }
-        
-        if (generate_c) {
-            char *s = ast_to_c($3);
-            printf("    %s = %s;\n", $1, s); 
-            free(s);
+            type_error(error_msg, ast_current_line);
         }
         
         $$ = create_node(NODE_ASSIGN);
@@ -921,41 +657,15 @@ assignment:
     ;
 
 compound_assignment:
-    ID PLUSEQ expression SEMICOLON { 
-        char *s = ast_to_c($3); 
-        printf("    %s += %s;\n", $1, s); 
-        free($1); free(s); 
-        $$ = NULL;
-    }
-    | ID MINUSEQ expression SEMICOLON { 
-        char *s = ast_to_c($3); 
-        printf("    %s -= %s;\n", $1, s); 
-        free($1); free(s); 
-        $$ = NULL;
-    }
-    | ID MULTEQ expression SEMICOLON { 
-        char *s = ast_to_c($3); 
-        printf("    %s *= %s;\n", $1, s); 
-        free($1); free(s); 
-        $$ = NULL;
-    }
-    | ID DIVEQ expression SEMICOLON { 
-        char *s = ast_to_c($3); 
-        printf("    %s /= %s;\n", $1, s); 
-        free($1); free(s); 
-        $$ = NULL;
-    }
-    | ID MODEQ expression SEMICOLON { 
-        char *s = ast_to_c($3); 
-        printf("    %s %%= %s;\n", $1, s); 
-        free($1); free(s); 
-        $$ = NULL;
-    }
+    ID PLUSEQ expression SEMICOLON { $$ = compound_node($1, PLUS, $3); }
+    | ID MINUSEQ expression SEMICOLON { $$ = compound_node($1, MINUS, $3); }
+    | ID MULTEQ expression SEMICOLON { $$ = compound_node($1, MULT, $3); }
+    | ID DIVEQ expression SEMICOLON { $$ = compound_node($1, DIV, $3); }
+    | ID MODEQ expression SEMICOLON { $$ = compound_node($1, MOD, $3); }
     ;
 
 increment_stmt:
     ID INC SEMICOLON { 
-        if (generate_c) { printf("    %s++;\n", $1); }
         $$ = create_node(NODE_UN_OP);
         $$->op = INC;
         $$->sval = strdup($1);
@@ -963,7 +673,6 @@ increment_stmt:
         free($1);
     }
     | INC ID SEMICOLON { 
-        if (generate_c) { printf("    ++%s;\n", $2); }
         $$ = create_node(NODE_UN_OP);
         $$->op = INC;
         $$->sval = strdup($2);
@@ -974,7 +683,6 @@ increment_stmt:
 
 decrement_stmt:
     ID DEC SEMICOLON { 
-        if (generate_c) { printf("    %s--;\n", $1); }
         $$ = create_node(NODE_UN_OP);
         $$->op = DEC;
         $$->sval = strdup($1);
@@ -982,7 +690,6 @@ decrement_stmt:
         free($1);
     }
     | DEC ID SEMICOLON { 
-        if (generate_c) { printf("    --%s;\n", $2); }
         $$ = create_node(NODE_UN_OP);
         $$->op = DEC;
         $$->sval = strdup($2);
@@ -995,179 +702,128 @@ input_statement:
     NAO LPAREN ID RPAREN SEMICOLON { 
         // Create AST node for input
         $$ = create_node(NODE_INPUT);
-        $$->sval = strdup($3);
-        
-        if (generate_c) {
-            // Check variable type to determine scanf format
-            VarType var_type = get_symbol_type($3);
-            switch (var_type) {
-                case TYPE_INT:
-                    // purno - integer type
-                    printf("    scanf(\"%%d\", &%s);\n", $3);
-                    break;
-                case TYPE_FLOAT:
-                    // doshomik - float type
-                    printf("    scanf(\"%%f\", &%s);\n", $3);
-                    break;
-                case TYPE_STRING:
-                    // bornona - string type (no & needed for arrays)
-                    printf("    scanf(\"%%s\", %s);\n", $3);
-                    break;
-                case TYPE_BOOL:
-                    // sotyo_mittha - boolean type (stored as int)
-                    printf("    scanf(\"%%d\", &%s);\n", $3);
-                    break;
-                default:
-                    // Unknown type - default to integer
-                    printf("    scanf(\"%%d\", &%s);\n", $3);
-                    break;
-            }
-        }
-        
-        free($3);
+        $$->sval = $3;
     }
     ;
 
 clear_statement:
-    PORISHKAR LPAREN RPAREN SEMICOLON { if (generate_c) { printf("    #ifdef _WIN32\n    system(\"cls\");\n    #else\n    system(\"clear\");\n    #endif\n"); } }
+    PORISHKAR LPAREN RPAREN SEMICOLON { $$ = create_node(NODE_CLEAR); }
     ;
 
 wait_statement:
     WAIT LPAREN expression RPAREN SEMICOLON { 
-        char *s = ast_to_c($3);
-        printf("    #ifdef _WIN32\n    Sleep(%s * 1000);\n    #else\n    sleep(%s);\n    #endif\n", s, s); 
-        free(s);
+        $$ = create_node(NODE_WAIT);
+        $$->left = $3;
+    }
+    ;
+
+/* spawn { ... } runs the block as a new fiber in the VM. The C backend
+ * has no scheduler, so there the block simply runs in place. */
+spawn_statement:
+    SPAWN block {
+        $$ = create_node(NODE_SPAWN);
+        $$->body = $2;
+    }
+    ;
+
+/* isolate { ... } runs the block on its own thread in a separate VM that
+ * starts with copies of the locals. Without a VM it runs in place. */
+isolate_statement:
+    ISOLATE block {
+        $$ = create_node(NODE_ISOLATE);
+        $$->body = $2;
     }
     ;
 
 import_statement:
     INCLUDE STR SEMICOLON {
-        // Generate #include directive
-        printf("%s\n", $2);
-        free($2);
+        $$ = create_node(NODE_INCLUDE);
+        $$->sval = $2;
     }
     ;
 
 return_statement:
     FEROT expression SEMICOLON { 
-        if (generate_c) {
-            char *s = ast_to_c($2);
-            printf("    return %s;\n", s); 
-            free(s); 
-        }
+        $$ = create_node(NODE_RETURN);
+        $$->left = $2;
     }
     | FEROT SEMICOLON { 
-        printf("    return;\n"); 
         $$ = create_node(NODE_RETURN);
     }
     ;
 
 function_call_stmt:
-    function_call SEMICOLON { 
-        if (generate_c) {
-            char *s = ast_to_c($1);
-            printf("    %s;\n", s); 
-            free(s); 
-        }
-        $$ = $1;
-    }
+    function_call SEMICOLON { $$ = $1; }
     ;
 
 function_call:
     ID LPAREN arguments RPAREN {
         $$ = create_node(NODE_FUNC_CALL);
-        char *call_str = malloc(strlen($1) + strlen($3) + 3);
-        sprintf(call_str, "%s(%s)", $1, $3);
-        $$->sval = call_str;
-        free($1); free($3);
+        $$->sval = $1;     // Function name
+        $$->params = $3;   // Argument expressions chained through 'next'
     }
     ;
 
 
 if_statement:
     if_head else_if_list_opt else_part_opt {
-        $$ = create_node(NODE_IF);
-        $$->cond = $1->cond;
-        $$->body = $1->body;
-        // We are losing the else/else-if AST nodes here but for verification it's fine
-        // as we rely on transpilation.
+        $$ = $1;
+        // The VM does not run else branches yet; codegen_c does
+        $$->right = c_only(else_chain($2, $3));
     }
     ;
 
 if_head:
-    JODI LPAREN expression RPAREN { 
-        if (generate_c) {
-            char *s = ast_to_c($3);
-            printf("    if (%s) ", s); 
-            free(s); 
-        }
-    } block {
+    JODI LPAREN expression RPAREN block {
         $$ = create_node(NODE_IF);
         $$->cond = $3;
-        $$->body = $6;
+        $$->body = $5;
     }
     ;
 
 else_if_list_opt:
-    /* empty */
-    | else_if_list
+    /* empty */ { $$ = NULL; }
+    | else_if_list { $$ = $1; }
     ;
 
 else_part_opt:
-    /* empty */
-    | else_part
+    /* empty */ { $$ = NULL; }
+    | else_part { $$ = $1; }
     ;
 
 else_if_list:
-    else_if_clause
-    | else_if_list else_if_clause
+    else_if_clause { $$ = $1; }
+    | else_if_list else_if_clause { $$ = append_node($1, $2); }
     ;
 
 else_if_clause:
-    NOYTO LPAREN expression RPAREN { 
-        if (generate_c) {
-            char *s = ast_to_c($3);
-            printf("    else if (%s) ", s); 
-            free(s); 
-        }
-    } block
+    NOYTO LPAREN expression RPAREN block {
+        $$ = create_node(NODE_IF);
+        $$->cond = $3;
+        $$->body = $5;
+    }
     ;
 
 else_part:
-    OTHOBA { if (generate_c) { printf("    else "); } } block
-    ;
-
-while_statement:
-    JOTOKKHON LPAREN expression RPAREN {
-        char *s = ast_to_c($3);
-        printf("    while (%s) ", s);
-        free(s);
-    } block {
-        $$ = create_node(NODE_WHILE);
-        $$->cond = $3;
-        $$->body = $6;
-    }
+    OTHOBA block { $$ = $2; }
     ;
 
 try_statement:
-    TRY { printf("    try "); } block CATCH { printf(" catch (...) "); } block finally_opt {
+    TRY block CATCH block finally_opt {
         $$ = create_node(NODE_TRY);
-        $$->body = $3;
-        $$->catch_body = $6;
+        $$->body = $2;
+        $$->catch_body = $4;
+        $$->right = c_only($5);
     }
     ;
 
 finally_opt:
-    /* empty */
-    | FINALLY { printf(" finally "); } block
+    /* empty */ { $$ = NULL; }
+    | FINALLY block { $$ = $2; }
     ;
 
 throw_statement:
     THROW expression SEMICOLON {
-        char *s = ast_to_c($2);
-        printf("    throw %s;\n", s);
-        free(s);
-        
         $$ = create_node(NODE_THROW);
         $$->left = $2;
     }
@@ -1177,41 +833,46 @@ throw_statement:
 
 for_statement:
     CHOLBE LPAREN ID THEKE expression PORJONTO expression RPAREN { 
-        if (generate_c) {
-            // Generate C for loop header
-            char *start_str = ast_to_c($5);
-            char *end_str = ast_to_c($7);
-            printf("    for (int %s = %s; %s <= %s; %s++) ", $3, start_str, $3, end_str, $3); 
-            free(start_str);
-            free(end_str);
-        }
-        free($3);
+        insert_symbol_typed($3, SYM_VAR, TYPE_INT);
     } block {
         $$ = create_node(NODE_FOR); 
         // The block ($10) is the body of the for loop.
         $$->body = $10;
         // Store loop variable, start, end expressions for AST
-        $$->sval = strdup($3); // Loop variable ID
+        $$->sval = $3; // Loop variable ID
         $$->left = $5; // Start expression
         $$->right = $7; // End expression
     }
+    /* cholbe somantorale (...) jog(sum) { }: iterations may run in any order
+     * on several threads; the jog variables are summed across them */
+    | CHOLBE SOMANTORALE LPAREN ID THEKE expression PORJONTO expression RPAREN reduction_opt {
+        insert_symbol_typed($4, SYM_VAR, TYPE_INT);
+    } block {
+        $$ = create_node(NODE_PAR_FOR);
+        $$->body = $12;
+        $$->sval = $4;
+        $$->left = $6;
+        $$->right = $8;
+        $$->params = $10; // Reduction variables (NODE_VAR_REF list)
+    }
     ;
 
-switch_statement:
-    PALTAW LPAREN expression RPAREN { if (generate_c) { printf("    switch (%s) {\n", $3); free($3); } } LBRACE cases RBRACE { if (generate_c) { printf("    }\n"); } }
-    ;
-
-cases:
-    /* empty */
-    | cases case
+reduction_opt:
+    /* empty */ { $$ = NULL; }
+    | JOG LPAREN reduction_list RPAREN { $$ = $3; }
     ;
 
-case:
-    HOLO expression COLON { if (generate_c) { printf("    case %s:\n", $2); free($2); } } statements
-    | OTHOBA COLON { if (generate_c) { printf("    default:\n"); } } statements
+reduction_list:
+    ID { $$ = create_id_node($1); free($1); }
+    | reduction_list COMMA ID {
+        ASTNode *curr = $1;
+        while (curr->next) curr = curr->next;
+        curr->next = create_id_node($3);
+        free($3);
+        $$ = $1;
+    }
     ;
 
-
 expression:
       INT { $$ = create_int_node($1); }
     | FLOAT { $$ = create_float_node($1); }
@@ -1225,7 +886,7 @@ expression:
            // We can treat as error or warning. For strict validation, error.
            // However, to avoid halting transpilation immediately if we want to catch multiple errors,
            // we can print and set a flag. Or use type_error.
-           type_error(error_msg, yylineno);
+           type_error(error_msg, ast_current_line);
         }
         $$ = create_id_node($1); 
         free($1); 
@@ -1260,19 +921,19 @@ expression:
         
         switch (expr_type) {
             case TYPE_INT:
-                typeof_call = strdup("kotha_typeof_purno()");
+                typeof_call = strdup("kotha_typeof_purno");
                 break;
             case TYPE_FLOAT:
-                typeof_call = strdup("kotha_typeof_doshomik()");
+                typeof_call = strdup("kotha_typeof_doshomik");
                 break;
             case TYPE_STRING:
-                typeof_call = strdup("kotha_typeof_bornona()");
+                typeof_call = strdup("kotha_typeof_bornona");
                 break;
             case TYPE_BOOL:
-                typeof_call = strdup("kotha_typeof_sotyo_mittha()");
+                typeof_call = strdup("kotha_typeof_sotyo_mittha");
                 break;
             default:
-                typeof_call = strdup("kotha_typeof_purno()");  // Default
+                typeof_call = strdup("kotha_typeof_purno");  // Default
                 break;
         }
         
@@ -1287,24 +948,109 @@ expression:
     ;
 
 arguments:
-    /* empty */ { $$ = strdup(""); }
+    /* empty */ { $$ = NULL; }
     | arg_list { $$ = $1; }
     ;
 
 arg_list:
-    expression { $$ = ast_to_c($1); }
+    expression { $$ = $1; }
     | arg_list COMMA expression { 
-        char *s = ast_to_c($3);
-        char *res = malloc(strlen($1) + strlen(s) + 3);
-        sprintf(res, "%s, %s", $1, s);
-        $$ = res;
-        free($1); free(s);
+        ASTNode *curr = $1;
+        while (curr->next) curr = curr->next;
+        curr->next = $3;
+        $$ = $1;
     }
     ;
 
 %%
 
+int yylex_init(void **scanner);
+int yylex_destroy(void *scanner);
+void yyset_in(FILE *in, void *scanner);
+
+/* Parse a program from 'in' with a private scanner. The C translation
+ * (codegen_c) is written to c_out (NULL = none) once the whole file has
+ * parsed; diagnostics go to err (NULL = stderr). Returns the main
+ * function's body; *ok is 0 after a syntax error. */
+ASTNode* kotha_parse(FILE *in, FILE *c_out, FILE *err, int *ok) {
+    void *scanner;
+    *ok = 0;
+    if (yylex_init(&scanner) != 0) return NULL;
+    yyset_in(in, scanner);
+
+    root = NULL;
+    program = NULL;
+    generate_c = c_out != NULL;
+    parse_err = err;
+    ast_current_line = 1;
+    free_symtab();
+    init_symtab();
+
+    *ok = yyparse(scanner) == 0;
+
+    yylex_destroy(scanner);
+    free_symtab();
+    parse_err = NULL;
+
+    if (*ok && c_out) codegen_c(program, c_out);
+    // main's body is returned as root, the rest of the program is not
+    for (ASTNode *f = program; f; f = f->next) {
+        if (f->type == NODE_FUNC_DECL && f->op == MAIN) f->body = NULL;
+    }
+    free_ast(program);
+    program = NULL;
+    return root;
+}
+
+static void parse_hooks_report(int line, int syntax, const char *message) {
+    if (parse_hooks->diagnostic) parse_hooks->diagnostic(parse_hooks->user, line, syntax, message);
+}
+
+static void kotha_report_symbol(const Symbol *sym, void *user) {
+    if (sym->scope_level > 0) parse_hooks->symbol(parse_hooks->user, sym);
+}
 
+/* The seeded symbols live in scope 0 and the region's own in scope 1, so
+ * only the latter are passed to hooks->symbol */
+int kotha_parse_region(FILE *in, const KothaParseHooks *hooks, ASTNode **ast) {
+    void *scanner;
+    if (yylex_init(&scanner) != 0) return 0;
+    yyset_in(in, scanner);
+
+    root = NULL;
+    generate_c = 0;
+    parse_hooks = hooks;
+    ast_current_line = hooks->first_line > 0 ? hooks->first_line : 1;
+    ast_line_offset = ast_current_line - 1;
+    free_symtab();
+    init_symtab();
+    if (hooks->seed) hooks->seed(hooks->user);
+    enter_scope();
+
+    int ok = yyparse(scanner) == 0;
+
+    yylex_destroy(scanner);
+    if (hooks->symbol) symtab_each(kotha_report_symbol, NULL);
+    free_symtab();
+    if (ast) {
+        *ast = root;
+    } else {
+        free_ast(root);
+    }
+    root = NULL;
+    parse_hooks = NULL;
+    ast_line_offset = 0;
+    return ok;
+}
 
+void kotha_unknown_char(const char *text) {
+    char message[64];
+    snprintf(message, sizeof(message), "Unknown character: %s", text);
+    if (parse_hooks) {
+        parse_hooks_report(ast_current_line, 1, message);
+        return;
+    }
+    fprintf(parse_err ? parse_err : stderr, "%s\n", message);
+}
 
 /* End of parser */
@@ -6,6 +6,7 @@
 #include "vm.h"
 #include "ir.h"
 #include "ast.h"
+#include "parser.tab.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,10 +14,6 @@
 #define VERSION "0.2.0"
 
 /* External parser functions */
-extern int yyparse();
-extern FILE *yyin;
-extern ASTNode *root;
-extern IRInstr *ir_head;
 extern void ir_init();
 extern void ir_generate(ASTNode *node);
 extern VM* codegen_vm(IRInstr *ir);
@@ -77,8 +74,14 @@ int repl_handle_command(const char *cmd, VM *vm) {
     }
     
     if (strcmp(command, ":reset") == 0 || strcmp(command, ":r") == 0) {
+        int gc_max_pause_us = vm->gc_max_pause_us;
+        int gc_slice_objects = vm->gc_slice_objects;
+        int gc_threads = vm->gc_threads;
         vm_free(vm);
         vm_init(vm);
+        vm->gc_max_pause_us = gc_max_pause_us;
+        vm->gc_slice_objects = gc_slice_objects;
+        vm->gc_threads = gc_threads;
         printf("VM state reset.\n\n");
         return 0;
     }
@@ -107,17 +110,14 @@ int repl_execute_line(const char *line, VM *vm) {
         return -1;
     }
     
-    extern FILE *yyin;
-    yyin = input;
-    
     // Reset parser state
-    root = NULL;
     ir_head = NULL;
     
-    int parse_result = yyparse();
+    int parsed;
+    ASTNode *root = kotha_parse(input, stdout, NULL, &parsed);
     fclose(input);
     
-    if (parse_result != 0) {
+    if (!parsed) {
         printf("Syntax error\n");
         return -1;
     }
@@ -144,6 +144,9 @@ int repl_execute_line(const char *line, VM *vm) {
     // Copy globals from persistent VM
     memcpy(temp_vm->globals, vm->globals, sizeof(vm->globals));
     temp_vm->global_count = vm->global_count;
+    temp_vm->gc_max_pause_us = vm->gc_max_pause_us;
+    temp_vm->gc_slice_objects = vm->gc_slice_objects;
+    temp_vm->gc_threads = vm->gc_threads;
     
     // Execute
     vm_run(temp_vm);
@@ -170,6 +173,9 @@ int repl_start(REPLConfig *config) {
     VM vm;
     vm_init(&vm);
     vm.debug_mode = config->debug;
+    vm.gc_max_pause_us = config->gc_max_pause_us;
+    vm.gc_slice_objects = config->gc_slice_objects;
+    vm.gc_threads = config->gc_threads;
     
     char line[1024];
     int line_num = 1;
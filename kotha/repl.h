@@ -12,6 +12,9 @@
 typedef struct {
     int debug;
     int vm_mode;
+    int gc_max_pause_us;    // Incremental GC budgets (0 = stop-the-world)
+    int gc_slice_objects;
+    int gc_threads;         // Threads for full collections
 } REPLConfig;
 
 /* Start REPL */
@@ -0,0 +1,651 @@
+/*
+ * Kotha Execution Server
+ * A small HTTP/1.1 server on localhost for the IDE and other tools. The
+ * parent binds the socket, warms the runtime up once and forks a pool of
+ * workers that accept connections themselves. Each request is compiled
+ * and run in-process through libkotha, within the request's instruction
+ * (fuel), heap and time limits, so a run costs no fork, exec or C compile.
+ *
+ *   POST /run     {"code": "...", "inputs": [..], "fuel": n, "memory_mb": n,
+ *                  "timeout_ms": n}  (also served as /api/run)
+ *   -> {"stdout": "...", "stderr": "...", "exit_code": 0, "status": "ok",
+ *       "instructions": n, "time_ms": t}
+ *   GET /health   -> {"status": "ok", "worker": pid}
+ *
+ * A run past its timeout ends with status "limit exceeded". A worker that
+ * crashes, or stays stuck SERVE_GRACE_S past the deadline (it answers 504
+ * first), is replaced; workers are also recycled after SERVE_MAX_REQUESTS
+ * requests.
+ */
+
+#include "serve.h"
+#include "kotha.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define SERVE_MAX_WORKERS 64
+#define SERVE_MAX_HEADER (16 * 1024)
+#define SERVE_MAX_BODY (1024 * 1024)
+#define SERVE_MAX_OUTPUT (1024 * 1024)  // Per stream; the rest is dropped
+#define SERVE_MAX_REQUESTS 1000          // Before a worker is recycled
+#define SERVE_IO_TIMEOUT_S 5             // Reading a request, writing a response
+#define SERVE_GRACE_S 2                  // Past the deadline before a worker gives up
+
+static volatile sig_atomic_t serve_stopping = 0;
+static volatile sig_atomic_t serve_client = -1;   // Connection whose program is running
+
+/* Growable byte buffer, optionally capped */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    size_t limit;           // 0 = unlimited
+    int truncated;
+} ServeBuf;
+
+static int buf_reserve(ServeBuf *b, size_t extra) {
+    if (b->len + extra + 1 <= b->cap) return 1;
+    size_t cap = b->cap ? b->cap : 256;
+    while (cap < b->len + extra + 1) cap *= 2;
+    char *data = (char*)realloc(b->data, cap);
+    if (!data) return 0;
+    b->data = data;
+    b->cap = cap;
+    return 1;
+}
+
+static void buf_append(ServeBuf *b, const char *data, size_t len) {
+    if (b->limit && b->len + len > b->limit) {
+        len = b->len < b->limit ? b->limit - b->len : 0;
+        b->truncated = 1;
+    }
+    if (!buf_reserve(b, len)) {
+        b->truncated = 1;
+        return;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+}
+
+static void buf_printf(ServeBuf *b, const char *format, ...) {
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (n > 0) buf_append(b, text, n < (int)sizeof(text) ? (size_t)n : sizeof(text) - 1);
+}
+
+/* JSON string contents, escaped */
+static void buf_append_json(ServeBuf *b, const char *s, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        switch (c) {
+            case '"': buf_append(b, "\\\"", 2); break;
+            case '\\': buf_append(b, "\\\\", 2); break;
+            case '\n': buf_append(b, "\\n", 2); break;
+            case '\r': buf_append(b, "\\r", 2); break;
+            case '\t': buf_append(b, "\\t", 2); break;
+            default:
+                if (c < 0x20) {
+                    buf_printf(b, "\\u%04x", c);
+                } else {
+                    buf_append(b, (const char*)&s[i], 1);
+                }
+        }
+    }
+}
+
+/* Request JSON: just the fields /run needs. Unknown fields are skipped. */
+
+typedef struct {
+    ServeBuf code;
+    ServeBuf input;          // "inputs" joined one per line, or "stdin"
+    long long fuel;
+    long long memory_mb;
+    long long timeout_ms;
+} ServeRequest;
+
+static const char* json_ws(const char *p) {
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+    return p;
+}
+
+static void json_utf8(ServeBuf *out, unsigned code) {
+    char bytes[4];
+    int n;
+    if (code < 0x80) {
+        bytes[0] = (char)code; n = 1;
+    } else if (code < 0x800) {
+        bytes[0] = (char)(0xC0 | (code >> 6));
+        bytes[1] = (char)(0x80 | (code & 0x3F)); n = 2;
+    } else if (code < 0x10000) {
+        bytes[0] = (char)(0xE0 | (code >> 12));
+        bytes[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+        bytes[2] = (char)(0x80 | (code & 0x3F)); n = 3;
+    } else {
+        bytes[0] = (char)(0xF0 | (code >> 18));
+        bytes[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+        bytes[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+        bytes[3] = (char)(0x80 | (code & 0x3F)); n = 4;
+    }
+    if (out) buf_append(out, bytes, n);
+}
+
+static int json_hex4(const char *p, unsigned *code) {
+    *code = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        int digit = (c >= '0' && c <= '9') ? c - '0' :
+                    (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+                    (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+        if (digit < 0) return 0;
+        *code = (*code << 4) | (unsigned)digit;
+    }
+    return 1;
+}
+
+/* String at p (after the opening quote) into out (NULL = skip). Returns
+ * the position after the closing quote, or NULL. */
+static const char* json_string(const char *p, ServeBuf *out) {
+    while (*p && *p != '"') {
+        if (*p != '\\') {
+            const char *run = p;
+            while (*p && *p != '"' && *p != '\\') p++;
+            if (out) buf_append(out, run, (size_t)(p - run));
+            continue;
+        }
+        p++;
+        char c = *p++;
+        switch (c) {
+            case 'n': if (out) buf_append(out, "\n", 1); break;
+            case 't': if (out) buf_append(out, "\t", 1); break;
+            case 'r': if (out) buf_append(out, "\r", 1); break;
+            case 'b': if (out) buf_append(out, "\b", 1); break;
+            case 'f': if (out) buf_append(out, "\f", 1); break;
+            case 'u': {
+                unsigned code;
+                if (!json_hex4(p, &code)) return NULL;
+                p += 4;
+                // Surrogate pair
+                if (code >= 0xD800 && code < 0xDC00 && p[0] == '\\' && p[1] == 'u') {
+                    unsigned low;
+                    if (json_hex4(p + 2, &low) && low >= 0xDC00 && low < 0xE000) {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        p += 6;
+                    }
+                }
+                json_utf8(out, code);
+                break;
+            }
+            case '\0': return NULL;
+            default: if (out) buf_append(out, &c, 1); break;   // \" \\ \/
+        }
+    }
+    return *p == '"' ? p + 1 : NULL;
+}
+
+/* Any value; strings and numbers are appended to 'out' when it is given
+ * (arrays one element per line). Returns the position after it, or NULL. */
+static const char* json_value(const char *p, ServeBuf *out, int depth) {
+    p = json_ws(p);
+    if (depth > 32) return NULL;
+    if (*p == '"') return json_string(p + 1, out);
+    if (*p == '[' || *p == '{') {
+        char close = *p == '[' ? ']' : '}';
+        p = json_ws(p + 1);
+        if (*p == close) return p + 1;
+        for (;;) {
+            if (close == '}') {
+                if (*p != '"' || !(p = json_string(p + 1, NULL))) return NULL;
+                p = json_ws(p);
+                if (*p++ != ':') return NULL;
+                p = json_value(p, NULL, depth + 1);
+            } else {
+                p = json_value(p, out, depth + 1);
+                if (out) buf_append(out, "\n", 1);
+            }
+            if (!p) return NULL;
+            p = json_ws(p);
+            if (*p == ',') {
+                p = json_ws(p + 1);
+            } else if (*p == close) {
+                return p + 1;
+            } else {
+                return NULL;
+            }
+        }
+    }
+    const char *start = p;
+    while (*p && !strchr(",]} \t\r\n", *p)) p++;
+    if (p == start) return NULL;
+    if (out) buf_append(out, start, (size_t)(p - start));
+    return p;
+}
+
+static int json_request(const char *body, ServeRequest *req) {
+    const char *p = json_ws(body);
+    if (*p++ != '{') return 0;
+    p = json_ws(p);
+    if (*p == '}') return 1;
+
+    for (;;) {
+        ServeBuf key = {0};
+        if (*p != '"' || !(p = json_string(p + 1, &key))) {
+            free(key.data);
+            return 0;
+        }
+        p = json_ws(p);
+        if (*p++ != ':') {
+            free(key.data);
+            return 0;
+        }
+
+        const char *name = key.data ? key.data : "";
+        ServeBuf number = {0};
+        if (strcmp(name, "code") == 0) {
+            p = json_value(p, &req->code, 0);
+        } else if (strcmp(name, "inputs") == 0 || strcmp(name, "stdin") == 0) {
+            p = json_value(p, &req->input, 0);
+        } else if (strcmp(name, "fuel") == 0 || strcmp(name, "memory_mb") == 0 ||
+                   strcmp(name, "timeout_ms") == 0) {
+            p = json_value(p, &number, 0);
+            long long value = number.data ? atoll(number.data) : 0;
+            if (name[0] == 'f') req->fuel = value;
+            else if (name[0] == 'm') req->memory_mb = value;
+            else req->timeout_ms = value;
+        } else {
+            p = json_value(p, NULL, 0);
+        }
+        free(number.data);
+        free(key.data);
+        if (!p) return 0;
+
+        p = json_ws(p);
+        if (*p == ',') {
+            p = json_ws(p + 1);
+        } else {
+            return *p == '}';
+        }
+    }
+}
+
+/* Running a request */
+
+typedef struct {
+    ServeBuf out;
+    ServeBuf err;
+    const char *input;
+    size_t input_len;
+    size_t input_pos;
+} ServeRun;
+
+static void run_write(void *user, const char *data, size_t len) {
+    buf_append(&((ServeRun*)user)->out, data, len);
+}
+
+static void run_error(void *user, const char *data, size_t len) {
+    buf_append(&((ServeRun*)user)->err, data, len);
+}
+
+static size_t run_read(void *user, char *buf, size_t len) {
+    ServeRun *run = (ServeRun*)user;
+    size_t left = run->input_len - run->input_pos;
+    if (len > left) len = left;
+    memcpy(buf, run->input + run->input_pos, len);
+    run->input_pos += len;
+    return len;
+}
+
+/* The request's own limit, within the server's (<= 0: none) */
+static long long serve_cap(long long requested, long long most) {
+    if (most <= 0) return requested > 0 ? requested : 0;
+    return requested > 0 && requested < most ? requested : most;
+}
+
+static double serve_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static const char* serve_status_name(KothaStatus status) {
+    switch (status) {
+        case KOTHA_OK: return "ok";
+        case KOTHA_COMPILE_ERROR: return "compile error";
+        case KOTHA_RUNTIME_ERROR: return "runtime error";
+        case KOTHA_LIMIT_EXCEEDED: return "limit exceeded";
+        case KOTHA_INVALID: return "internal error";
+    }
+    return "?";
+}
+
+/* Run the request's program and write the response JSON into 'json' */
+static void serve_execute(const ServeConfig *config, ServeRequest *req, ServeBuf *json) {
+    ServeRun run;
+    memset(&run, 0, sizeof(run));
+    run.out.limit = SERVE_MAX_OUTPUT;
+    run.err.limit = SERVE_MAX_OUTPUT;
+    run.input = req->input.data ? req->input.data : "";
+    run.input_len = req->input.len;
+
+    KothaLimits limits;
+    memset(&limits, 0, sizeof(limits));
+    limits.max_instructions = serve_cap(req->fuel, config->fuel);
+    limits.max_time_ms = serve_cap(req->timeout_ms, config->timeout_ms);
+    limits.max_heap_bytes = serve_cap(req->memory_mb, config->memory_mb) * 1024 * 1024;
+    limits.threads = 1;
+
+    // Backstop for a run stuck where the VM cannot check the clock (an
+    // isolate, say): serve_on_alarm answers 504 and the worker exits. No
+    // time limit means no alarm.
+    if (limits.max_time_ms > 0)
+        alarm((unsigned)((limits.max_time_ms + 999) / 1000 + SERVE_GRACE_S));
+
+    double start = serve_now_ms();
+    KothaStatus status = KOTHA_INVALID;
+    KothaVM *vm = kotha_compile(req->code.data ? req->code.data : "", req->code.len);
+    if (vm) {
+        KothaIO io = {&run, run_write, run_error, run_read};
+        kotha_set_io(vm, &io);
+        status = kotha_run(vm, &limits);
+        if (status == KOTHA_COMPILE_ERROR) {
+            const char *diagnostics = kotha_diagnostics(vm);
+            buf_append(&run.err, diagnostics, strlen(diagnostics));
+        }
+    }
+    long long instructions = kotha_instructions(vm);
+    kotha_free(vm);
+    double elapsed = serve_now_ms() - start;
+    alarm(0);
+
+    if (run.out.truncated) buf_append(&run.err, "[output truncated]\n", 19);
+
+    buf_append(json, "{\"stdout\": \"", 12);
+    buf_append_json(json, run.out.data ? run.out.data : "", run.out.len);
+    buf_append(json, "\", \"stderr\": \"", 14);
+    buf_append_json(json, run.err.data ? run.err.data : "", run.err.len);
+    buf_printf(json, "\", \"exit_code\": %d, \"status\": \"%s\", \"instructions\": %lld, \"time_ms\": %.3f}",
+               status == KOTHA_OK ? 0 : 1, serve_status_name(status), instructions, elapsed);
+
+    free(run.out.data);
+    free(run.err.data);
+}
+
+/* HTTP */
+
+static int serve_send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        data += n;
+        len -= (size_t)n;
+    }
+    return 1;
+}
+
+static void serve_respond(int fd, int code, const char *reason, const char *body, size_t len) {
+    char head[512];
+    int n = snprintf(head, sizeof(head),
+                     "HTTP/1.1 %d %s\r\n"
+                     "Content-Type: application/json\r\n"
+                     "Content-Length: %zu\r\n"
+                     "Access-Control-Allow-Origin: *\r\n"
+                     "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n"
+                     "Access-Control-Allow-Headers: Content-Type\r\n"
+                     "Connection: close\r\n\r\n",
+                     code, reason, len);
+    if (serve_send_all(fd, head, (size_t)n) && len > 0) {
+        serve_send_all(fd, body, len);
+    }
+}
+
+static void serve_error(int fd, int code, const char *reason) {
+    char body[128];
+    int n = snprintf(body, sizeof(body), "{\"error\": \"%s\"}", reason);
+    serve_respond(fd, code, reason, body, (size_t)n);
+}
+
+/* Read the request head and body; 0 if the client went away or sent junk */
+static int serve_read_request(int fd, ServeBuf *req, size_t *head_len, size_t *body_len) {
+    char chunk[4096];
+    char *end = NULL;
+    while (!end) {
+        if (req->len >= SERVE_MAX_HEADER) return 0;
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        buf_append(req, chunk, (size_t)n);
+        end = strstr(req->data, "\r\n\r\n");
+    }
+    *head_len = (size_t)(end - req->data) + 4;
+
+    // Content-Length (header names are case-insensitive)
+    long long length = 0;
+    for (const char *line = strstr(req->data, "\r\n"); line && line < end; line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line + 2, "Content-Length:", 15) == 0) {
+            length = atoll(line + 17);
+        }
+    }
+    if (length < 0 || length > SERVE_MAX_BODY) return 0;
+    *body_len = (size_t)length;
+
+    while (req->len < *head_len + *body_len) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        buf_append(req, chunk, (size_t)n);
+    }
+    return 1;
+}
+
+static void serve_connection(const ServeConfig *config, int fd) {
+    struct timeval timeout = {SERVE_IO_TIMEOUT_S, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    ServeBuf raw = {0};
+    size_t head_len = 0, body_len = 0;
+    if (!serve_read_request(fd, &raw, &head_len, &body_len)) {
+        free(raw.data);
+        return;
+    }
+
+    char method[16] = "", path[256] = "";
+    sscanf(raw.data, "%15s %255s", method, path);
+    char *query = strchr(path, '?');
+    if (query) *query = '\0';
+
+    if (strcmp(method, "OPTIONS") == 0) {
+        serve_respond(fd, 204, "No Content", NULL, 0);
+    } else if (strcmp(path, "/health") == 0) {
+        char body[64];
+        int n = snprintf(body, sizeof(body), "{\"status\": \"ok\", \"worker\": %d}", (int)getpid());
+        serve_respond(fd, 200, "OK", body, (size_t)n);
+    } else if (strcmp(path, "/run") == 0 || strcmp(path, "/api/run") == 0) {
+        if (strcmp(method, "POST") != 0) {
+            serve_error(fd, 405, "Method Not Allowed");
+        } else {
+            ServeRequest req;
+            memset(&req, 0, sizeof(req));
+            raw.data[head_len + body_len] = '\0';
+            if (!json_request(raw.data + head_len, &req)) {
+                serve_error(fd, 400, "Bad Request");
+            } else {
+                ServeBuf json = {0};
+                serve_client = fd;
+                serve_execute(config, &req, &json);
+                serve_client = -1;
+                serve_respond(fd, 200, "OK", json.data ? json.data : "{}", json.len);
+                if (config->debug) {
+                    fprintf(stderr, "[serve %d] %s %zu bytes of code -> %zu bytes\n",
+                            (int)getpid(), path, req.code.len, json.len);
+                }
+                free(json.data);
+            }
+            free(req.code.data);
+            free(req.input.data);
+        }
+    } else {
+        serve_error(fd, 404, "Not Found");
+    }
+    free(raw.data);
+}
+
+/* Processes */
+
+/* SIGALRM in a worker: the run overran its deadline by SERVE_GRACE_S.
+ * Answer the client (only async-signal-safe calls) and exit; the parent
+ * starts a replacement. */
+static void serve_on_alarm(int sig) {
+    static const char response[] =
+        "HTTP/1.1 504 Gateway Timeout\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: 28\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "Connection: close\r\n\r\n"
+        "{\"error\": \"Gateway Timeout\"}";
+    if (serve_client >= 0) send(serve_client, response, sizeof(response) - 1, MSG_NOSIGNAL);
+    _exit(1);
+}
+
+static void serve_worker(const ServeConfig *config, int listener) {
+    signal(SIGINT, SIG_IGN);    // The parent decides when to stop
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGALRM, serve_on_alarm);
+
+    for (int served = 0; served < SERVE_MAX_REQUESTS; ) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            _exit(1);
+        }
+        serve_connection(config, fd);
+        close(fd);
+        served++;
+    }
+    _exit(0);
+}
+
+static pid_t serve_spawn(const ServeConfig *config, int listener) {
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) serve_worker(config, listener);
+    return pid;
+}
+
+static void serve_on_signal(int sig) {
+    serve_stopping = 1;
+}
+
+/* Compile and run a tiny program, so every worker starts with the
+ * runtime's one-time setup done and its pages already touched */
+static void serve_warm_up(void) {
+    static const char program[] = "main function {\n    purno x = 1;\n    dekhaw(x);\n}\n";
+    ServeRun run;
+    memset(&run, 0, sizeof(run));
+    KothaVM *vm = kotha_compile(program, sizeof(program) - 1);
+    if (vm) {
+        KothaIO io = {&run, run_write, run_error, NULL};
+        KothaLimits limits;
+        memset(&limits, 0, sizeof(limits));
+        limits.threads = 1;
+        limits.max_instructions = 1000;
+        kotha_set_io(vm, &io);
+        kotha_run(vm, &limits);
+    }
+    kotha_free(vm);
+    free(run.out.data);
+    free(run.err.data);
+}
+
+int serve_run(const ServeConfig *config) {
+    int workers = config->workers;
+    if (workers <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = online > 2 ? (int)online : 2;
+    }
+    if (workers > SERVE_MAX_WORKERS) workers = SERVE_MAX_WORKERS;
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) {
+        perror("socket");
+        return 1;
+    }
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)config->port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 128) < 0) {
+        fprintf(stderr, "Error: Cannot listen on 127.0.0.1:%d: %s\n", config->port, strerror(errno));
+        close(listener);
+        return 1;
+    }
+    // Port 0 asks the kernel for a free port; report the one it picked
+    socklen_t addr_len = sizeof(addr);
+    int port = getsockname(listener, (struct sockaddr*)&addr, &addr_len) == 0 ? ntohs(addr.sin_port)
+                                                                           : config->port;
+
+    serve_warm_up();
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = serve_on_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    pid_t pids[SERVE_MAX_WORKERS];
+    for (int i = 0; i < workers; i++) {
+        pids[i] = serve_spawn(config, listener);
+    }
+    printf("Kotha server listening on http://127.0.0.1:%d (%d workers; fuel %lld, heap %lld MB, timeout %lld ms)\n",
+           port, workers, config->fuel, config->memory_mb, config->timeout_ms);
+    fflush(stdout);
+
+    // Replace workers as they exit (recycled, crashed or killed)
+    while (!serve_stopping) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < workers; i++) {
+            if (pids[i] != pid) continue;
+            if (config->debug && (WIFSIGNALED(status) || WEXITSTATUS(status) != 0)) {
+                fprintf(stderr, "[serve] Worker %d stopped (%s %d), restarting\n", (int)pid,
+                        WIFSIGNALED(status) ? "signal" : "status",
+                        WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status));
+            }
+            if (!serve_stopping) pids[i] = serve_spawn(config, listener);
+            break;
+        }
+    }
+
+    for (int i = 0; i < workers; i++) {
+        if (pids[i] > 0) kill(pids[i], SIGTERM);
+    }
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR) { }
+    close(listener);
+    printf("\nKotha server stopped\n");
+    return 0;
+}
@@ -0,0 +1,22 @@
+/*
+ * Kotha Execution Server Header
+ * kotha serve --port N: run JSON requests on the VM in pre-forked workers
+ */
+
+#ifndef SERVE_H
+#define SERVE_H
+
+typedef struct {
+    int port;
+    int workers;            // Worker processes (0 = one per core, at least 2)
+    long long fuel;         // Most instructions a request may run
+    long long memory_mb;    // Most heap a request may use
+    long long timeout_ms;   // Most wall time a request may take
+    int debug;              // Log each request to stderr
+} ServeConfig;
+
+/* Listen on 127.0.0.1:port (port 0: a free port, printed at startup) and
+ * serve until SIGINT/SIGTERM. Returns the exit status. */
+int serve_run(const ServeConfig *config);
+
+#endif /* SERVE_H */
@@ -1,13 +1,15 @@
 // Symbol Table - Full Implementation
 #include "symtab.h"
+#include "ast.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
 #define HASH_SIZE 211
 
-static Symbol *hash_table[HASH_SIZE];
-static int current_scope = 0;
+// Per thread, so several threads can compile at once
+static __thread Symbol *hash_table[HASH_SIZE];
+static __thread int current_scope = 0;
 
 /* Hash function */
 static unsigned int hash(const char *str) {
@@ -74,7 +76,7 @@ int insert_symbol_typed(const char *name, SymbolType type, VarType value_type) {
     new_sym->type = type;
     new_sym->value_type = value_type;
     new_sym->scope_level = current_scope;
-    new_sym->line_declared = 0;
+    new_sym->line_declared = ast_current_line;
     new_sym->array_size = 0;
     new_sym->array_cols = 0;
     new_sym->next = hash_table[idx];
@@ -119,6 +121,15 @@ Symbol* lookup_symbol(const char *name) {
     return best;
 }
 
+/* Call fn for every symbol in the table */
+void symtab_each(void (*fn)(const Symbol *sym, void *user), void *user) {
+    for (int i = 0; i < HASH_SIZE; i++) {
+        for (Symbol *s = hash_table[i]; s; s = s->next) {
+            fn(s, user);
+        }
+    }
+}
+
 /* Cleanup */
 void free_symtab() {
     for (int i = 0; i < HASH_SIZE; i++) {
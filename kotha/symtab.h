@@ -64,6 +64,9 @@ int set_symbol_type(const char *name, VarType value_type);
 /* Lookup a symbol in all active scopes (stack) */
 Symbol* lookup_symbol(const char *name);
 
+/* Call fn for every symbol in the table */
+void symtab_each(void (*fn)(const Symbol *sym, void *user), void *user);
+
 /* Cleanup */
 void free_symtab();
 
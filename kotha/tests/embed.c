@@ -0,0 +1,124 @@
+/*
+ * libkotha embedding test (built and run by tests/run.sh)
+ * Compiles programs from memory and checks their output, status and
+ * diagnostics through the callback I/O, including two VMs run at once.
+ */
+
+#include "kotha.h"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+/* Captured output of one run */
+typedef struct {
+    char out[256];
+    char err[1024];
+    const char *input;
+} Capture;
+
+static void cap_append(char *buf, size_t size, const char *data, size_t len) {
+    size_t used = strlen(buf);
+    if (used + len >= size) len = size - used - 1;
+    memcpy(buf + used, data, len);
+    buf[used + len] = '\0';
+}
+
+static void on_write(void *user, const char *data, size_t len) {
+    Capture *c = (Capture*)user;
+    cap_append(c->out, sizeof(c->out), data, len);
+}
+
+static void on_error(void *user, const char *data, size_t len) {
+    Capture *c = (Capture*)user;
+    cap_append(c->err, sizeof(c->err), data, len);
+}
+
+static size_t on_read(void *user, char *buf, size_t len) {
+    Capture *c = (Capture*)user;
+    size_t n = strlen(c->input);
+    if (n > len) n = len;
+    memcpy(buf, c->input, n);
+    c->input += n;
+    return n;
+}
+
+/* Compile and run 'src' with the given limits (NULL for none) */
+static KothaStatus run(const char *src, const KothaLimits *limits, Capture *c) {
+    memset(c, 0, sizeof(*c));
+    if (!c->input) c->input = "";
+    KothaVM *vm = kotha_compile(src, strlen(src));
+    if (!vm) return KOTHA_INVALID;
+    KothaIO io = {c, on_write, on_error, on_read};
+    kotha_set_io(vm, &io);
+    KothaStatus status = kotha_run(vm, limits);
+    if (status == KOTHA_COMPILE_ERROR) {
+        const char *diagnostics = kotha_diagnostics(vm);
+        cap_append(c->err, sizeof(c->err), diagnostics, strlen(diagnostics));
+    }
+    kotha_free(vm);
+    return status;
+}
+
+static int failed = 0;
+
+static void check(const char *name, int ok) {
+    printf("%s embed %s\n", ok ? "PASS" : "FAIL", name);
+    if (!ok) failed = 1;
+}
+
+static const char *SUM =
+    "main function {\n"
+    "    purno s = 0;\n"
+    "    cholbe (i theke 1 porjonto 100) {\n"
+    "        s = s + i;\n"
+    "    }\n"
+    "    dekhaw(s);\n"
+    "}\n";
+
+static void* run_sum(void *arg) {
+    Capture *c = (Capture*)arg;
+    KothaLimits limits = {0};
+    limits.threads = 1;
+    return (void*)(size_t)(run(SUM, &limits, c) == KOTHA_OK);
+}
+
+int main(void) {
+    Capture c;
+
+    check("output", run(SUM, NULL, &c) == KOTHA_OK && strcmp(c.out, "5050\n") == 0);
+
+    const char *doubler = "main function {\n    purno x;\n    nao(x);\n    dekhaw(x * 2);\n}\n";
+    memset(&c, 0, sizeof(c));
+    KothaVM *vm = kotha_compile(doubler, strlen(doubler));
+    c.input = "21\n";
+    KothaIO io = {&c, on_write, on_error, on_read};
+    kotha_set_io(vm, &io);
+    check("input", kotha_run(vm, NULL) == KOTHA_OK && strcmp(c.out, "42\n") == 0);
+    check("run twice", kotha_run(vm, NULL) == KOTHA_INVALID);
+    kotha_free(vm);
+
+    check("compile error", run("main function {\n    dekhaw(1\n}\n", NULL, &c) == KOTHA_COMPILE_ERROR &&
+                           strstr(c.err, "Line 3") != NULL);
+
+    check("runtime error", run("main function {\n    purno c = kotha_channel_new(1);\n"
+                               "    kotha_channel_close(c);\n    kotha_channel_send(c, 1);\n}\n",
+                               NULL, &c) == KOTHA_RUNTIME_ERROR &&
+                           strstr(c.err, "Send on a closed channel") != NULL);
+
+    KothaLimits fuel = {0};
+    fuel.max_instructions = 1000;
+    check("fuel limit", run("main function {\n    purno i = 0;\n    jotokkhon (1 < 2) {\n"
+                            "        i++;\n    }\n}\n", &fuel, &c) == KOTHA_LIMIT_EXCEEDED);
+
+    // Two VMs at once on separate threads
+    Capture a, b;
+    pthread_t ta, tb;
+    void *ok_a = NULL, *ok_b = NULL;
+    pthread_create(&ta, NULL, run_sum, &a);
+    pthread_create(&tb, NULL, run_sum, &b);
+    pthread_join(ta, &ok_a);
+    pthread_join(tb, &ok_b);
+    check("threads", ok_a && ok_b && strcmp(a.out, "5050\n") == 0 && strcmp(b.out, "5050\n") == 0);
+
+    return failed;
+}
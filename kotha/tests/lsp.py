@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""
+Smoke test for kotha lsp (run by tests/run.sh from the kotha directory)
+Talks LSP over the server's stdin/stdout: initialize, open a document with
+a syntax error, fix it, list its symbols and shut down.
+"""
+
+import json
+import subprocess
+import sys
+import threading
+
+URI = 'file:///tmp/lsp_test.kotha'
+BROKEN = 'main function {\n    purno x = 1;\n    dekhaw(x\n}\n'
+FIXED = 'main function {\n    purno x = 1;\n    dekhaw(x);\n}\n'
+
+failed = False
+
+
+def check(name, ok, detail=''):
+    global failed
+    print(('PASS ' if ok else 'FAIL ') + name)
+    if not ok:
+        print('  ' + str(detail))
+        failed = True
+
+
+def send(server, message):
+    body = json.dumps(dict(message, jsonrpc='2.0')).encode()
+    server.stdin.write(b'Content-Length: %d\r\n\r\n' % len(body) + body)
+    server.stdin.flush()
+
+
+def receive(server):
+    length = 0
+    while True:
+        line = server.stdout.readline()
+        if not line:
+            raise EOFError('server closed its output')
+        line = line.strip()
+        if not line:
+            break
+        if line.lower().startswith(b'content-length:'):
+            length = int(line.split(b':')[1])
+    return json.loads(server.stdout.read(length))
+
+
+def receive_method(server, method):
+    """Skips messages until one for 'method' arrives"""
+    while True:
+        message = receive(server)
+        if message.get('method') == method:
+            return message
+
+
+def main():
+    server = subprocess.Popen(['./kotha', 'lsp'], stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                              stderr=subprocess.DEVNULL)
+    watchdog = threading.Timer(20, server.kill)
+    watchdog.start()
+    try:
+        send(server, {'id': 1, 'method': 'initialize', 'params': {'capabilities': {}}})
+        reply = receive(server)
+        check('lsp initialize', reply.get('id') == 1 and 'capabilities' in reply.get('result', {}), reply)
+        send(server, {'method': 'initialized', 'params': {}})
+
+        send(server, {'method': 'textDocument/didOpen', 'params': {'textDocument': {
+            'uri': URI, 'languageId': 'kotha', 'version': 1, 'text': BROKEN}}})
+        params = receive_method(server, 'textDocument/publishDiagnostics')['params']
+        diagnostics = params.get('diagnostics', [])
+        check('lsp didOpen diagnostics', params.get('uri') == URI and len(diagnostics) == 1
+              and diagnostics[0]['range']['start']['line'] == 3, params)
+
+        send(server, {'method': 'textDocument/didChange', 'params': {
+            'textDocument': {'uri': URI, 'version': 2}, 'contentChanges': [{'text': FIXED}]}})
+        params = receive_method(server, 'textDocument/publishDiagnostics')['params']
+        check('lsp didChange clears diagnostics', params.get('diagnostics') == [], params)
+
+        send(server, {'id': 2, 'method': 'textDocument/documentSymbol',
+                      'params': {'textDocument': {'uri': URI}}})
+        reply = receive(server)
+        names = [symbol.get('name') for symbol in reply.get('result') or []]
+        check('lsp documentSymbol', reply.get('id') == 2 and 'main' in ' '.join(names), reply)
+
+        send(server, {'id': 3, 'method': 'shutdown'})
+        reply = receive(server)
+        send(server, {'method': 'exit'})
+        check('lsp shutdown and exit', reply.get('id') == 3 and server.wait(timeout=10) == 0,
+              (reply, server.returncode))
+    except (EOFError, ValueError) as e:
+        check('lsp session', False, e)
+    finally:
+        watchdog.cancel()
+        if server.poll() is None:
+            server.kill()
+            server.wait()
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,67 @@
+#!/bin/sh
+# Run the test programs and compare their output with the .out files.
+#
+#   tests/NAME.kotha        run with --vm, --jit and --tiered, each with the
+#                           default GC, incremental slices and parallel marking
+#   tests/build/NAME.kotha  compiled to an executable with 'kotha build', then run
+#   tests/batch/            run with 'kotha batch', compared with summary.out
+#   tests/NAME.py           Python scripts that drive kotha serve and kotha lsp
+#   tests/embed.c           linked with libkotha.a and run
+#
+# Run from the kotha directory (make test). Exits 1 if any test fails.
+
+status=0
+tmp=${TMPDIR:-/tmp}/kotha-test.$$
+mkdir -p "$tmp"
+trap 'rm -rf "$tmp"' EXIT
+
+check() {
+    if diff "$1" "$tmp/out" >/dev/null; then
+        echo "PASS $2"
+    else
+        echo "FAIL $2"
+        diff "$1" "$tmp/out" | head -20
+        status=1
+    fi
+}
+
+for t in tests/*.kotha; do
+    for mode in --vm --jit --tiered; do
+        for gc in "" --gc-slice=64 --gc-threads=4; do
+            ./kotha run $mode $gc "$t" >"$tmp/out" 2>&1
+            check "${t%.kotha}.out" "$t $mode${gc:+ $gc}"
+        done
+    done
+done
+
+for t in tests/build/*.kotha; do
+    if ./kotha build "$t" -o "$tmp/prog" >"$tmp/out" 2>&1; then
+        "$tmp/prog" >"$tmp/out" 2>&1
+    fi
+    check "${t%.kotha}.out" "$t build"
+done
+
+# Times and instruction counts in the batch summary vary; only each
+# script's status is compared, along with the exit status
+./kotha batch tests/batch -j 2 >"$tmp/raw" 2>&1
+echo "exit $?" >>"$tmp/raw"
+sed -E -e 's/^([a-z ]*[a-z]) +[0-9]+\.[0-9]+ +[0-9]+ +/\1  /' \
+       -e 's/; [0-9]+ instructions.*$//' "$tmp/raw" >"$tmp/out"
+check tests/batch/summary.out "tests/batch/ batch"
+
+for t in tests/*.py; do
+    if command -v python3 >/dev/null 2>&1; then
+        python3 "$t" || status=1
+    else
+        echo "SKIP $t (no python3)"
+    fi
+done
+
+if ${CC:-gcc} -I. tests/embed.c -o "$tmp/embed" libkotha.a -lm -pthread; then
+    "$tmp/embed" || status=1
+else
+    echo "FAIL tests/embed.c (build)"
+    status=1
+fi
+
+exit $status
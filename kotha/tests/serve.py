@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+"""
+Tests for kotha serve (run by tests/run.sh from the kotha directory)
+Starts the server on a free port and checks /health, /run within the fuel
+and time limits, a request that is stuck where the VM cannot stop it, and
+a malformed request.
+"""
+
+import json
+import subprocess
+import sys
+import time
+import urllib.error
+import urllib.request
+
+LOOP = 'main function {\n    purno i = 0;\n    jotokkhon (1 < 2) {\n        i++;\n    }\n}\n'
+
+failed = False
+
+
+def check(name, ok, detail=''):
+    global failed
+    print(('PASS ' if ok else 'FAIL ') + name)
+    if not ok:
+        print('  ' + str(detail))
+        failed = True
+
+
+def request(port, path, body=None, raw=None):
+    """Returns (HTTP status, parsed JSON body)"""
+    data = raw if raw is not None else (json.dumps(body).encode() if body is not None else None)
+    req = urllib.request.Request('http://127.0.0.1:%d%s' % (port, path), data)
+    try:
+        with urllib.request.urlopen(req, timeout=30) as response:
+            return response.status, json.loads(response.read())
+    except urllib.error.HTTPError as e:
+        return e.code, json.loads(e.read() or b'{}')
+
+
+def main():
+    server = subprocess.Popen(['./kotha', 'serve', '--port=0', '-j', '2', '--timeout=5000'],
+                              stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, text=True)
+    try:
+        banner = server.stdout.readline()
+        port = int(banner.split('127.0.0.1:')[1].split()[0])
+
+        status, body = request(port, '/health')
+        check('serve /health', status == 200 and body.get('status') == 'ok', body)
+
+        status, body = request(port, '/run', {'code': 'main function {\n    dekhaw(6 * 7);\n}\n'})
+        check('serve /run', status == 200 and body.get('stdout') == '42\n' and body.get('status') == 'ok', body)
+
+        status, body = request(port, '/run', {'code': LOOP, 'fuel': 1000})
+        check('serve /run fuel limit', status == 200 and body.get('status') == 'limit exceeded'
+              and body.get('instructions') == 1000, body)
+
+        start = time.time()
+        status, body = request(port, '/run', {'code': 'main function {\n    wait(30);\n}\n', 'timeout_ms': 300})
+        elapsed = time.time() - start
+        check('serve /run timeout', status == 200 and body.get('status') == 'limit exceeded'
+              and elapsed < 5, (elapsed, body))
+
+        # An isolate that never yields: the worker answers 504 and is replaced
+        code = LOOP.replace('    jotokkhon', '    isolate {\n    jotokkhon').replace('    }\n}', '    }\n    }\n}')
+        status, body = request(port, '/run', {'code': code, 'timeout_ms': 300})
+        check('serve /run stuck isolate', status == 504, (status, body))
+
+        status, body = request(port, '/run', raw=b'{"code": ')
+        check('serve /run bad JSON', status == 400, (status, body))
+
+        status, body = request(port, '/health')
+        check('serve /health after 504', status == 200 and body.get('status') == 'ok', body)
+    finally:
+        server.terminate()
+        server.wait()
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
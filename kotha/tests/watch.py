@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+"""
+Test for kotha run --watch (run by tests/run.sh from the kotha directory)
+Saves a script several times and checks that each save is rebuilt and run,
+re-parsing only the region that changed, and that a syntax error is
+reported without running.
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+import threading
+
+PROGRAM = 'main function {\n    dekhaw(%s);\n}\n'
+
+failed = False
+
+
+def check(name, ok, detail=''):
+    global failed
+    print(('PASS ' if ok else 'FAIL ') + name)
+    if not ok:
+        print('  ' + repr(detail))
+        failed = True
+
+
+def read_run(watcher):
+    """Lines printed for one run, up to the 'Watching' line that ends it"""
+    lines = []
+    while True:
+        line = watcher.stdout.readline()
+        if not line:
+            raise EOFError('watcher exited')
+        if line.startswith('\U0001f440'):
+            return lines
+        lines.append(line.rstrip('\n'))
+
+
+def save(path, text):
+    with open(path, 'w') as f:
+        f.write(text)
+
+
+def main():
+    directory = tempfile.mkdtemp(prefix='kotha-watch.')
+    path = os.path.join(directory, 'script.kotha')
+    save(path, 'purno unused = 0;\n' + PROGRAM % '41')
+
+    watcher = subprocess.Popen(['./kotha', 'run', path, '--watch'], stdout=subprocess.PIPE,
+                               stderr=subprocess.STDOUT, text=True, encoding='utf-8')
+    watchdog = threading.Timer(20, watcher.kill)
+    watchdog.start()
+    try:
+        lines = read_run(watcher)
+        check('watch first run', '41' in lines, lines)
+
+        save(path, 'purno unused = 0;\n' + PROGRAM % '42')
+        lines = read_run(watcher)
+        check('watch rerun on save', '42' in lines and any('1 of 2 regions' in l for l in lines), lines)
+
+        save(path, 'purno unused = 0;\n' + PROGRAM % '4 +')
+        lines = read_run(watcher)
+        check('watch syntax error', any('syntax error' in l for l in lines)
+              and any('not run' in l for l in lines), lines)
+
+        save(path, 'purno unused = 0;\n' + PROGRAM % '43')
+        lines = read_run(watcher)
+        check('watch fixed', '43' in lines, lines)
+    except EOFError as e:
+        check('watch session', False, e)
+    finally:
+        watchdog.cancel()
+        watcher.terminate()
+        watcher.wait()
+        os.remove(path)
+        os.rmdir(directory)
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,139 @@
+/*
+ * Kotha Tiered Execution
+ * Programs start in the bytecode interpreter, which only needs the
+ * program compiled to bytecode. After TIER_JIT_THRESHOLD interpreted
+ * instructions the bytecode is handed to the baseline JIT.
+ *
+ * Compilation happens on a background thread; the interpreter keeps going
+ * and switches to native code at the next check once it is published.
+ * Compiled code can be entered at any pc, so the switch happens in the
+ * middle of a loop, a call or a fiber, with the VM's state as it is.
+ *
+ * Both tiers run the same bytecode on the same VM, so tiering never
+ * changes what a program does, only how fast it runs.
+ */
+
+#include "tier.h"
+#include "vm_jit.h"
+#include "vm_isolate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+typedef enum {
+    TIER_BYTECODE,           // Interpreted
+    TIER_JIT,                // Runs in JIT-compiled code
+    TIER_FAILED              // JIT unavailable; stays interpreted
+} TierLevel;
+
+/* Tiering state for one run */
+typedef struct {
+    VM *vm;
+    int level;               // TierLevel, published by the compile thread
+    int jit_queued;          // JIT compile requested
+    long instructions;       // Bytecode instructions interpreted
+    double compile_ms;       // Time the JIT compile took
+
+    // Compiled code, written before 'level' is published
+    VMJit *jit;
+
+    // Background compile thread
+    pthread_t thread;
+    int thread_started;
+} TierState;
+
+static double tier_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* Compile thread: bytecode -> native code (the bytecode is read-only) */
+static void* tier_compile_thread(void *arg) {
+    TierState *t = (TierState*)arg;
+
+    double start = tier_now_ms();
+    VMJit *jit = vm_jit_compile(t->vm);
+    t->compile_ms = tier_now_ms() - start;
+
+    if (!jit) {
+        __atomic_store_n(&t->level, TIER_FAILED, __ATOMIC_RELEASE);
+        return NULL;
+    }
+    t->jit = jit;
+    __atomic_store_n(&t->level, TIER_JIT, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Ask for native code once the bytecode has run long enough (compiles
+ * here, on the interpreter's thread, if no thread can be started) */
+static void tier_maybe_request_jit(TierState *t) {
+    if (t->jit_queued || t->instructions < TIER_JIT_THRESHOLD) return;
+
+    t->jit_queued = 1;
+    if (!vm_jit_supported()) {
+        t->level = TIER_FAILED;
+        return;
+    }
+    t->thread_started = pthread_create(&t->thread, NULL, tier_compile_thread, t) == 0;
+    if (!t->thread_started) tier_compile_thread(t);
+}
+
+/* Interpret the bytecode, switching to the JIT mid-run as soon as it is
+ * published */
+static void tier_run_bytecode(TierState *t) {
+    VM *vm = t->vm;
+    int budget = TIER_CHECK_INTERVAL;
+
+    vm_reserve_locals(vm);
+    while (vm->ip < vm->code_size) {
+        if (!vm_execute_instruction(vm)) break;
+        if (--budget > 0) continue;
+
+        t->instructions += TIER_CHECK_INTERVAL;
+        budget = TIER_CHECK_INTERVAL;
+        tier_maybe_request_jit(t);
+        if (__atomic_load_n(&t->level, __ATOMIC_ACQUIRE) == TIER_JIT) {
+            vm_jit_run(t->jit, vm);
+            return;
+        }
+    }
+    t->instructions += TIER_CHECK_INTERVAL - budget;
+}
+
+static void tier_print_stats(TierState *t) {
+    static const char *names[] = {"bytecode", "JIT", "bytecode (JIT unavailable)"};
+
+    fprintf(stderr, "\nTier Statistics:\n");
+    fprintf(stderr, "  Finished in: %s\n", names[t->level]);
+    fprintf(stderr, "  Bytecode instructions interpreted: %ld\n", t->instructions);
+    if (t->jit) {
+        fprintf(stderr, "  JIT: compiled in %.3f ms, %d instructions inline, %d via interpreter\n",
+                t->compile_ms, t->jit->fast_count, t->jit->fallback_count);
+    }
+}
+
+int tier_run(VM *vm, int debug) {
+    if (!vm) return 1;
+
+    TierState t;
+    memset(&t, 0, sizeof(t));
+    t.vm = vm;
+    t.level = TIER_BYTECODE;
+
+    tier_run_bytecode(&t);
+    fflush(vm->out);
+
+    // A compile still running when the program ended is finished and dropped
+    if (t.thread_started) pthread_join(t.thread, NULL);
+    if (debug) tier_print_stats(&t);
+
+    VMIsolateGroup *group = vm->isolates;
+    int failed = vm->error_count > 0 || (group && __atomic_load_n(&group->shutdown, __ATOMIC_ACQUIRE));
+
+    vm->jit = NULL;
+    vm_jit_free(t.jit);
+    return failed ? 1 : 0;
+}
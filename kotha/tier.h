@@ -0,0 +1,18 @@
+/*
+ * Kotha Tiered Execution Header
+ * Starts in the bytecode interpreter and moves hot programs to the JIT
+ */
+
+#ifndef TIER_H
+#define TIER_H
+
+#include "vm.h"
+
+#define TIER_JIT_THRESHOLD  100000  // Bytecode instructions run before the program is JIT compiled
+#define TIER_CHECK_INTERVAL 1024    // Bytecode instructions between tier-up checks
+
+/* Run the compiled program, tiering up to the JIT on a background compile
+ * thread. Returns 0 on success, 1 if the program stopped with an error. */
+int tier_run(VM *vm, int debug);
+
+#endif /* TIER_H */
@@ -4,10 +4,20 @@
  */
 
 #include "vm.h"
+#include "vm_map.h"
+#include "vm_mem.h"
+#include "vm_trace.h"
+#include "vm_perf.h"
+#include "vm_fiber.h"
+#include "vm_par.h"
+#include "vm_isolate.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
 
 /* Helper macros */
 #define STACK_MAX (vm->sp + 1)
@@ -27,11 +37,18 @@
     vm_push(vm, result); \
 } while(0)
 
+/* Old-space side bitmaps: one bit per heap granule */
+#define BITMAP_WORD(index) ((index) / 64)
+#define BITMAP_BIT(index) (1ULL << ((index) % 64))
+#define BITMAP_WORDS(bytes) (((bytes) / HEAP_GRANULE + 63) / 64)
+#define GRANULE_OBJECT(vm, index) ((HeapObject*)&(vm)->heap[(size_t)(index) * HEAP_GRANULE])
+
 /* Initialize VM */
 void vm_init(VM *vm) {
     if (!vm) return;
     
     memset(vm, 0, sizeof(VM));
+    vm->code = (Instruction*)calloc(MAX_CODE, sizeof(Instruction));
     vm->sp = -1;
     vm->ip = 0;
     vm->fp = 0;
@@ -42,19 +59,59 @@ void vm_init(VM *vm) {
     vm->function_count = 0;
     vm->string_count = 0;
     vm->heap_used = 0;
-    vm->first_object = NULL;
+    vm->mark_bits = NULL;
+    vm->start_bits = NULL;
     vm->bytes_allocated = 0;
-    vm->gc_threshold = 1024 * 1024;  // 1MB initial threshold
+    vm->gc_threshold = GC_INITIAL_THRESHOLD;  // Old-space bytes before a major collection
     vm->current_line = 0;
     vm->debug_mode = 0;
     vm->instruction_count = 0;
     vm->gc_count = 0;
+    vm->out = stdout;
+    vm->in = stdin;
+    vm->err = stderr;
+}
+
+/* Point a fresh VM at src's program. The code, stack maps and loop table
+ * stay src's (src must outlive vm); the constants, function table and
+ * string literals are copied, since running adds to them. */
+void vm_share_program(VM *vm, const VM *src) {
+    free(vm->code);
+    vm->code = src->code;
+    vm->code_size = src->code_size;
+    vm->stack_maps = src->stack_maps;
+    vm->stack_map_count = src->stack_map_count;
+    vm->stack_map_bits = src->stack_map_bits;
+    vm->par_loops = src->par_loops;
+    vm->par_loop_count = src->par_loop_count;
+    vm->shared_code = 1;
+    vm->local_count = src->local_count;
+
+    memcpy(vm->constants, src->constants, sizeof(ConstantEntry) * src->constant_count);
+    vm->constant_count = src->constant_count;
+    for (int i = 0; i < src->function_count; i++) {
+        vm->functions[i] = src->functions[i];
+        vm->functions[i].name = src->functions[i].name ? strdup(src->functions[i].name) : NULL;
+    }
+    vm->function_count = src->function_count;
+
+    // Literals keep their ids (the bytecode refers to them by id)
+    for (int i = 0; i < src->static_string_count; i++) {
+        vm_add_string(vm, src->strings[i].str ? src->strings[i].str : "");
+    }
+    vm->static_string_count = vm->string_count;
 }
 
 /* Free VM resources */
 void vm_free(VM *vm) {
     if (!vm) return;
     
+    // The root VM owns the isolate group (its isolates are joined by now)
+    if (vm->isolates && vm_isolate_root(vm->isolates) == vm) {
+        vm_isolate_free(vm->isolates);
+    }
+    vm->isolates = NULL;
+    
     // Free all strings in pool
     for (int i = 0; i < vm->string_count; i++) {
         if (vm->strings[i].str) {
@@ -70,6 +127,90 @@ void vm_free(VM *vm) {
             vm->functions[i].name = NULL;
         }
     }
+    
+    // Free tables owned by live maps (old space, then unpromoted young maps)
+    for (int w = 0; w < BITMAP_WORDS(vm->heap_used); w++) {
+        for (uint64_t bits = vm->start_bits[w]; bits; bits &= bits - 1) {
+            HeapObject *obj = GRANULE_OBJECT(vm, (size_t)w * 64 + __builtin_ctzll(bits));
+            if (obj->type == OBJ_MAP) {
+                vm_map_destroy((VMMap*)obj->data);
+            }
+        }
+    }
+    free(vm->mark_bits);
+    free(vm->start_bits);
+    vm->mark_bits = NULL;
+    vm->start_bits = NULL;
+    
+    for (int offset = 0; offset < vm->nursery_used; ) {
+        HeapObject *obj = (HeapObject*)&vm->nursery[offset];
+        if (obj->type == OBJ_MAP && !(obj->flags & HEAP_FORWARDED)) {
+            vm_map_destroy((VMMap*)obj->data);
+        }
+        offset += (int)sizeof(HeapObject) + (int)obj->size;
+    }
+    vm->nursery_used = 0;
+    
+    // Return heap memory to the OS
+    for (int i = 0; i < vm->large_count; i++) {
+        HeapObject *obj = vm->large_objects[i];
+        if (obj) {
+            vm_mem_release(obj, sizeof(HeapObject) + obj->size);
+        }
+    }
+    free(vm->large_objects);
+    free(vm->large_free_ids);
+    vm->large_objects = NULL;
+    vm->large_free_ids = NULL;
+    vm->large_count = vm->large_free_count = vm->large_capacity = 0;
+    
+    vm_mem_release(vm->nursery, NURSERY_SIZE);
+    vm_mem_release(vm->heap_reservation, (size_t)MAX_HEAP + VM_HUGE_PAGE_SIZE);
+    vm->nursery = NULL;
+    vm->heap = NULL;
+    vm->heap_reservation = NULL;
+    vm->heap_used = vm->heap_committed = 0;
+    
+    vm_trace_free(vm->tracer);
+    vm->tracer = NULL;
+    vm->trace_recording = 0;
+    
+    vm_fiber_free(vm->sched);
+    vm->sched = NULL;
+    
+    vm_par_free(vm->par_pool);
+    vm->par_pool = NULL;
+    if (!vm->shared_code) {
+        free(vm->par_loops);
+        free(vm->code);
+        free(vm->stack_maps);
+        free(vm->stack_map_bits);
+    }
+    vm->par_loops = NULL;
+    vm->par_loop_count = 0;
+    vm->code = NULL;
+    vm->code_size = 0;
+    vm->shared_code = 0;
+    
+    if (vm->local_names) {
+        for (int i = 0; i < vm->local_count; i++) {
+            free(vm->local_names[i]);
+        }
+        free(vm->local_names);
+        vm->local_names = NULL;
+    }
+    
+    free(vm->gray.items);
+    free(vm->promoted.items);
+    free(vm->remembered.items);
+    memset(&vm->gray, 0, sizeof(GCWorklist));
+    memset(&vm->promoted, 0, sizeof(GCWorklist));
+    memset(&vm->remembered, 0, sizeof(GCWorklist));
+    vm->gc_phase = GC_IDLE;
+    
+    vm->stack_maps = NULL;
+    vm->stack_map_bits = NULL;
+    vm->stack_map_count = vm->stack_map_capacity = 0;
 }
 
 /* Add instruction */
@@ -78,7 +219,7 @@ void vm_add_instr(VM *vm, OpCode op, int arg) {
 }
 
 void vm_add_instr_line(VM *vm, OpCode op, int arg, int line) {
-    if (!vm || vm->code_size >= MAX_CODE) {
+    if (!vm || !vm->code || vm->code_size >= MAX_CODE) {
         fprintf(stderr, "VM Error: Code size exceeded\n");
         return;
     }
@@ -135,14 +276,27 @@ Value vm_get_constant(VM *vm, int index) {
 }
 
 /* String pool */
+uint32_t vm_hash_string(const char *str) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char*)str; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
 int vm_add_string(VM *vm, const char *str) {
     if (!str || vm->string_count >= MAX_STRINGS) {
         return -1;
     }
     
+    uint32_t hash = vm_hash_string(str);
+    
     // Check if string already exists (deduplication)
     for (int i = 0; i < vm->string_count; i++) {
-        if (vm->strings[i].str && strcmp(vm->strings[i].str, str) == 0) {
+        if (vm->strings[i].str && vm->strings[i].hash == hash &&
+            strcmp(vm->strings[i].str, str) == 0) {
             return i;
         }
     }
@@ -150,7 +304,8 @@ int vm_add_string(VM *vm, const char *str) {
     // Add new string
     vm->strings[vm->string_count].str = strdup(str);
     vm->strings[vm->string_count].length = strlen(str);
-    vm->strings[vm->string_count].marked = 0;
+    vm->strings[vm->string_count].hash = hash;
+    vm->strings[vm->string_count].marked = (vm->gc_phase == GC_MARKING);  // Allocate black
     return vm->string_count++;
 }
 
@@ -202,10 +357,318 @@ int vm_get_function(VM *vm, const char *name) {
     return -1;
 }
 
-/* Heap management - Mark & Sweep */
+/* Heap management - Segregated-fit free lists (objects never move) */
+
+/* Incremental GC hooks (defined with the collector below) */
+static int gc_is_incremental(VM *vm);
+static void gc_incremental_step(VM *vm);
+
+#define BLOCK_SIZE(obj) ((int)sizeof(HeapObject) + (int)(obj)->size)
+#define FREE_NEXT(block) (*(HeapObject**)(block)->data)  // Free-list link
+
+/* Header plus payload, rounded up to a whole number of granules */
+static int heap_block_size(int size) {
+    int total = (int)sizeof(HeapObject) + size;
+    return (total + HEAP_GRANULE - 1) & ~(HEAP_GRANULE - 1);
+}
+
+static int heap_size_class(int block_size) {
+    return block_size / HEAP_GRANULE - 1;
+}
+
+/* Write a free block header; returns the list the block belongs on
+ * (a size class, or HEAP_SIZE_CLASSES for the large list) */
+static int heap_format_free(HeapObject *block, int block_size) {
+    block->size = block_size - (int)sizeof(HeapObject);
+    block->type = OBJ_FREE;
+    block->flags = 0;
+    return block_size <= HEAP_SMALL_MAX ? heap_size_class(block_size) : HEAP_SIZE_CLASSES;
+}
+
+static HeapObject** heap_free_list(VM *vm, int list) {
+    return list < HEAP_SIZE_CLASSES ? &vm->free_lists[list] : &vm->large_free;
+}
+
+/* Turn a block into a free block and push it on the matching list */
+static void heap_free_block(VM *vm, HeapObject *block, int block_size) {
+    HeapObject **head = heap_free_list(vm, heap_format_free(block, block_size));
+    FREE_NEXT(block) = *head;
+    *head = block;
+}
+
+/* Best fit from the large list; the tail is split off when big enough */
+static HeapObject* heap_take_large(VM *vm, int block_size) {
+    HeapObject **best = NULL;
+    
+    for (HeapObject **link = &vm->large_free; *link; link = &FREE_NEXT(*link)) {
+        int avail = BLOCK_SIZE(*link);
+        if (avail >= block_size && (!best || avail < BLOCK_SIZE(*best))) {
+            best = link;
+            if (avail == block_size) break;  // Exact fit
+        }
+    }
+    if (!best) return NULL;
+    
+    HeapObject *block = *best;
+    *best = FREE_NEXT(block);
+    
+    int avail = BLOCK_SIZE(block);
+    if (avail - block_size >= heap_block_size(0)) {
+        heap_free_block(vm, (HeapObject*)((uint8_t*)block + block_size), avail - block_size);
+        avail = block_size;
+    }
+    block->size = avail - (int)sizeof(HeapObject);
+    return block;
+}
+
+/* Resize the mark and start bitmaps to cover 'committed' bytes of old space */
+static int heap_grow_bitmaps(VM *vm, int committed) {
+    size_t old_words = BITMAP_WORDS(vm->heap_committed);
+    size_t words = BITMAP_WORDS(committed);
+    
+    uint64_t *marks = (uint64_t*)realloc(vm->mark_bits, words * sizeof(uint64_t));
+    if (!marks) return 0;
+    vm->mark_bits = marks;
+    
+    uint64_t *starts = (uint64_t*)realloc(vm->start_bits, words * sizeof(uint64_t));
+    if (!starts) return 0;
+    vm->start_bits = starts;
+    
+    memset(marks + old_words, 0, (words - old_words) * sizeof(uint64_t));
+    memset(starts + old_words, 0, (words - old_words) * sizeof(uint64_t));
+    return 1;
+}
+
+/* Bytes the old space and large objects may use together */
+static int heap_limit(VM *vm) {
+    return vm->heap_limit > 0 && vm->heap_limit < MAX_HEAP ? vm->heap_limit : MAX_HEAP;
+}
+
+/* Commit more of the reservation so the frontier can reach 'needed' bytes */
+static int heap_grow(VM *vm, int needed) {
+    int limit = heap_limit(vm);
+    if (needed > limit) return 0;
+    
+    if (!vm->heap) {
+        // Reserve once; align so that big regions can be backed by huge pages
+        vm->heap_reservation = vm_mem_reserve((size_t)MAX_HEAP + VM_HUGE_PAGE_SIZE);
+        if (!vm->heap_reservation) return 0;
+        
+        uintptr_t base = ((uintptr_t)vm->heap_reservation + VM_HUGE_PAGE_SIZE - 1) &
+                         ~(uintptr_t)(VM_HUGE_PAGE_SIZE - 1);
+        vm->heap = (uint8_t*)base;
+    }
+    
+    while (vm->heap_committed < needed) {
+        // Regions double with the heap, so a large heap is a few big regions
+        int region = vm->heap_committed < HEAP_MIN_REGION ? HEAP_MIN_REGION : vm->heap_committed;
+        if (region > HEAP_MAX_REGION) region = HEAP_MAX_REGION;
+        if (region > limit - vm->heap_committed) region = limit - vm->heap_committed;
+        
+        if (!heap_grow_bitmaps(vm, vm->heap_committed + region)) return 0;
+        
+        uint8_t *start = vm->heap + vm->heap_committed;
+        if (!vm_mem_commit(start, region)) return 0;
+        if (region >= VM_HUGE_PAGE_SIZE) {
+            vm_mem_advise_huge(start, region);
+        }
+        vm->heap_committed += region;
+    }
+    return 1;
+}
+
+/* Find a block of exactly block_size bytes (or larger, for the large path) */
+static HeapObject* heap_take_block(VM *vm, int block_size) {
+    HeapObject *block;
+    
+    if (block_size <= HEAP_SMALL_MAX) {
+        // O(1): pop the size-class list
+        int cls = heap_size_class(block_size);
+        block = vm->free_lists[cls];
+        if (block) {
+            vm->free_lists[cls] = FREE_NEXT(block);
+            return block;
+        }
+    } else {
+        block = heap_take_large(vm, block_size);
+        if (block) return block;
+    }
+    
+    // Bump-allocate from the untouched end of the heap
+    if (vm->heap_used + block_size <= vm->heap_committed ||
+        heap_grow(vm, vm->heap_used + block_size)) {
+        block = (HeapObject*)&vm->heap[vm->heap_used];
+        block->size = block_size - (int)sizeof(HeapObject);
+        vm->heap_used += block_size;
+        return block;
+    }
+    
+    // Last resort for small requests: split a large free block
+    return block_size <= HEAP_SMALL_MAX ? heap_take_large(vm, block_size) : NULL;
+}
+
+static int heap_object_is_young(VM *vm, HeapObject *obj) {
+    return vm->nursery && (uint8_t*)obj >= vm->nursery && (uint8_t*)obj < vm->nursery + NURSERY_SIZE;
+}
+
+static int heap_object_is_old(VM *vm, HeapObject *obj) {
+    return vm->heap && (uint8_t*)obj >= vm->heap && (uint8_t*)obj < vm->heap + vm->heap_used;
+}
+
+/* Granule index of an old-space object (its bit in the side bitmaps) */
+static size_t heap_granule(VM *vm, HeapObject *obj) {
+    return (size_t)((uint8_t*)obj - vm->heap) / HEAP_GRANULE;
+}
+
+/* Set the mark of any object; returns 1 if it was already marked */
+static int heap_test_and_mark(VM *vm, HeapObject *obj) {
+    if (heap_object_is_old(vm, obj)) {
+        size_t index = heap_granule(vm, obj);
+        uint64_t *word = &vm->mark_bits[BITMAP_WORD(index)];
+        if (*word & BITMAP_BIT(index)) return 1;
+        *word |= BITMAP_BIT(index);
+        return 0;
+    }
+    
+    if (obj->flags & HEAP_MARKED) return 1;
+    obj->flags |= HEAP_MARKED;
+    return 0;
+}
+
+static int heap_is_marked(VM *vm, HeapObject *obj) {
+    if (heap_object_is_old(vm, obj)) {
+        size_t index = heap_granule(vm, obj);
+        return (vm->mark_bits[BITMAP_WORD(index)] & BITMAP_BIT(index)) != 0;
+    }
+    return (obj->flags & HEAP_MARKED) != 0;
+}
+
+/* heap_ptr value for a nursery or old-space object (large objects keep their id) */
+static int heap_object_ptr(VM *vm, HeapObject *obj) {
+    if (heap_object_is_young(vm, obj)) {
+        return NURSERY_BASE + (int)((uint8_t*)obj - vm->nursery);
+    }
+    return (int)((uint8_t*)obj - vm->heap);
+}
+
+/* Turn a block into a live old-space object */
+static void heap_adopt_block(VM *vm, HeapObject *obj, ObjType type) {
+    obj->type = type;
+    obj->flags = 0;
+    
+    size_t index = heap_granule(vm, obj);
+    vm->start_bits[BITMAP_WORD(index)] |= BITMAP_BIT(index);
+    if (vm->gc_phase == GC_MARKING) {
+        vm->mark_bits[BITMAP_WORD(index)] |= BITMAP_BIT(index);  // Allocate black during a cycle
+    }
+    vm->bytes_allocated += BLOCK_SIZE(obj);
+}
+
+/* Map a page run for a large object (old space plus large objects stay within MAX_HEAP) */
+static HeapObject* large_map(VM *vm, int size) {
+    size_t page = vm_mem_page_size();
+    size_t mapping = (sizeof(HeapObject) + (size_t)size + page - 1) & ~(page - 1);
+    
+    if ((size_t)vm->bytes_allocated + mapping > (size_t)heap_limit(vm)) return NULL;
+    
+    HeapObject *obj = (HeapObject*)vm_mem_map(mapping);
+    if (!obj) return NULL;
+    
+    if (mapping >= VM_HUGE_PAGE_SIZE) {
+        vm_mem_advise_huge(obj, mapping);
+    }
+    obj->size = (int)(mapping - sizeof(HeapObject));
+    return obj;
+}
+
+/* Allocate in the large object space; returns LOS_BASE + id */
+static int large_alloc(VM *vm, int size, ObjType type) {
+    HeapObject *obj = large_map(vm, size);
+    if (!obj) {
+        vm_gc_collect(vm);
+        
+        obj = large_map(vm, size);
+        if (!obj) {
+            vm->heap_exhausted = 1;
+            vm_runtime_error(vm, "Out of heap memory");
+            return -1;
+        }
+    }
+    
+    int id;
+    if (vm->large_free_count > 0) {
+        id = vm->large_free_ids[--vm->large_free_count];
+    } else {
+        if (vm->large_count >= vm->large_capacity) {
+            int capacity = vm->large_capacity ? vm->large_capacity * 2 : 16;
+            HeapObject **objects = (HeapObject**)realloc(vm->large_objects, sizeof(HeapObject*) * capacity);
+            int *free_ids = objects ? (int*)realloc(vm->large_free_ids, sizeof(int) * capacity) : NULL;
+            if (objects) vm->large_objects = objects;
+            if (!objects || !free_ids) {
+                vm_mem_release(obj, sizeof(HeapObject) + obj->size);
+                vm_runtime_error(vm, "Out of memory growing large object table");
+                return -1;
+            }
+            vm->large_free_ids = free_ids;
+            vm->large_capacity = capacity;
+        }
+        id = vm->large_count++;
+    }
+    
+    obj->type = type;
+    obj->flags = vm->gc_phase == GC_MARKING ? HEAP_MARKED : 0;  // Allocate black during a cycle
+    vm->large_objects[id] = obj;
+    
+    int mapping = (int)sizeof(HeapObject) + obj->size;
+    vm->large_bytes += mapping;
+    vm->bytes_allocated += mapping;
+    return LOS_BASE + id;
+}
+
 int vm_alloc_heap(VM *vm, int size) {
+    return vm_alloc_object(vm, size, OBJ_RAW);
+}
+
+int vm_alloc_object(VM *vm, int size, ObjType type) {
+    if (size < 0 || size > MAX_HEAP) {
+        vm_runtime_error(vm, "Invalid heap allocation size: %d", size);
+        return -1;
+    }
+    
+    // Incremental collector: pay for marking a slice at a time
+    if (gc_is_incremental(vm)) {
+        gc_incremental_step(vm);
+    }
+    
+    int block_size = heap_block_size(size);
+    
+    // Small objects: bump-allocate in the nursery
+    if (block_size <= PRETENURE_SIZE) {
+        if (!vm->nursery) {
+            vm->nursery = (uint8_t*)vm_mem_map(NURSERY_SIZE);
+            if (!vm->nursery) {
+                vm_runtime_error(vm, "Out of memory mapping the nursery");
+                return -1;
+            }
+        }
+        if (vm->nursery_used + block_size > NURSERY_SIZE) {
+            vm_gc_minor(vm);
+        }
+        
+        HeapObject *obj = (HeapObject*)&vm->nursery[vm->nursery_used];
+        obj->size = block_size - (int)sizeof(HeapObject);
+        obj->type = type;
+        obj->flags = 0;
+        
+        if (type == OBJ_MAP) vm->nursery_maps++;
+        
+        int ptr = NURSERY_BASE + vm->nursery_used;
+        vm->nursery_used += block_size;
+        return ptr;
+    }
+    
     // Trigger GC if we exceed threshold
-    if (vm->bytes_allocated > vm->gc_threshold) {
+    if (!gc_is_incremental(vm) && vm->bytes_allocated > vm->gc_threshold) {
         vm_gc_collect(vm);
         
         // Increase threshold for next time
@@ -214,31 +677,24 @@ int vm_alloc_heap(VM *vm, int size) {
         }
     }
     
-    // Check if we have space
-    int total_size = sizeof(HeapObject) + size;
-    if (vm->heap_used + total_size > MAX_HEAP) {
+    if (block_size > LARGE_OBJECT_SIZE) {
+        return large_alloc(vm, size, type);
+    }
+    
+    HeapObject *obj = heap_take_block(vm, block_size);
+    if (!obj) {
         vm_gc_collect(vm);
         
-        if (vm->heap_used + total_size > MAX_HEAP) {
+        obj = heap_take_block(vm, block_size);
+        if (!obj) {
+            vm->heap_exhausted = 1;
             vm_runtime_error(vm, "Out of heap memory");
             return -1;
         }
     }
     
-    // Allocate object
-    int ptr = vm->heap_used;
-    HeapObject *obj = (HeapObject*)&vm->heap[ptr];
-    obj->size = size;
-    obj->marked = 0;
-    obj->next = vm->first_object;
-    
-    // Add to object list
-    vm->first_object = obj;
-    
-    vm->heap_used += total_size;
-    vm->bytes_allocated += total_size;
-    
-    return ptr;
+    heap_adopt_block(vm, obj, type);
+    return heap_object_ptr(vm, obj);
 }
 
 void vm_free_heap(VM *vm, int ptr) {
@@ -246,24 +702,421 @@ void vm_free_heap(VM *vm, int ptr) {
     // This function is kept for API compatibility
 }
 
-void* vm_get_heap_ptr(VM *vm, int ptr) {
-    if (ptr < 0 || ptr >= vm->heap_used) return NULL;
+void* vm_get_heap_ptr(VM *vm, int ptr) {
+    HeapObject *obj = vm_heap_object(vm, ptr);
+    return obj ? obj->data : NULL;
+}
+
+HeapObject* vm_heap_object(VM *vm, int ptr) {
+    if (VM_IS_LARGE(ptr)) {
+        int id = ptr - LOS_BASE;
+        return id < vm->large_count ? vm->large_objects[id] : NULL;
+    }
+    if (VM_IS_YOUNG(ptr)) {
+        int offset = ptr - NURSERY_BASE;
+        return offset < vm->nursery_used ? (HeapObject*)&vm->nursery[offset] : NULL;
+    }
+    if (ptr < 0 || ptr >= vm->heap_used || ptr % HEAP_GRANULE) return NULL;
+    
+    // Only object starts are valid (free blocks and interior pointers are not)
+    size_t index = (size_t)ptr / HEAP_GRANULE;
+    if (!(vm->start_bits[BITMAP_WORD(index)] & BITMAP_BIT(index))) return NULL;
+    return (HeapObject*)&vm->heap[ptr];
+}
+
+/* Garbage collection - Mark & Sweep Algorithm */
+
+static void gc_worklist_push(VM *vm, GCWorklist *list, HeapObject *obj) {
+    if (list->count >= list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 64;
+        HeapObject **items = (HeapObject**)realloc(list->items, sizeof(HeapObject*) * capacity);
+        if (!items) {
+            vm_runtime_error(vm, "Out of memory in garbage collector");
+            return;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = obj;
+}
+
+/* Mark a single value (heap object or pooled string) */
+void vm_gc_mark_value(VM *vm, Value val) {
+    if (val.type == VAL_HEAP_PTR) {
+        // While marking incrementally the nursery keeps moving; young
+        // objects are traced at the final remark instead
+        if (VM_IS_YOUNG(val.as.heap_ptr) && vm->gc_phase == GC_MARKING) return;
+        
+        HeapObject *heap_obj = vm_heap_object(vm, val.as.heap_ptr);
+        if (heap_obj && !heap_test_and_mark(vm, heap_obj)) {
+            if (heap_obj->type == OBJ_MAP || heap_obj->type == OBJ_ARRAY) {
+                gc_worklist_push(vm, &vm->gray, heap_obj);
+            }
+        }
+    } else if (val.type == VAL_STRING) {
+        int str_id = val.as.string_id;
+        if (str_id >= 0 && str_id < vm->string_count) {
+            vm->strings[str_id].marked = 1;
+        }
+    }
+}
+
+/* Apply fn to every Value slot an object holds */
+typedef void (*GCSlotFn)(VM *vm, Value *slot);
+
+static void gc_visit_slots(VM *vm, HeapObject *obj, GCSlotFn fn) {
+    if (obj->type == OBJ_MAP) {
+        VMMap *map = (VMMap*)obj->data;
+        for (int i = vm_map_next(map, 0); i >= 0; i = vm_map_next(map, i + 1)) {
+            fn(vm, &map->slots[i].key);
+            fn(vm, &map->slots[i].value);
+        }
+    } else if (obj->type == OBJ_ARRAY) {
+        VMArray *arr = (VMArray*)obj->data;
+        for (int i = 0; i < arr->length; i++) {
+            fn(vm, &arr->items[i]);
+        }
+    }
+}
+
+static void gc_mark_slot(VM *vm, Value *slot) {
+    vm_gc_mark_value(vm, *slot);
+}
+
+/* Stack maps */
+static int stack_map_words(VM *vm) {
+    return (vm->local_count + 31) / 32;
+}
+
+void vm_add_stack_map(VM *vm, int pc, const uint32_t *live) {
+    int words = stack_map_words(vm);
+    if (words == 0) return;
+    
+    if (vm->stack_map_count > 0 && vm->stack_maps[vm->stack_map_count - 1].pc >= pc) {
+        fprintf(stderr, "VM Error: Stack maps must be added in pc order\n");
+        return;
+    }
+    
+    if (vm->stack_map_count >= vm->stack_map_capacity) {
+        int capacity = vm->stack_map_capacity ? vm->stack_map_capacity * 2 : 16;
+        StackMap *maps = (StackMap*)realloc(vm->stack_maps, sizeof(StackMap) * capacity);
+        if (!maps) return;  // Safepoint stays unmapped and is scanned conservatively
+        vm->stack_maps = maps;
+        
+        uint32_t *bits = (uint32_t*)realloc(vm->stack_map_bits,
+                                            sizeof(uint32_t) * words * capacity);
+        if (!bits) return;
+        vm->stack_map_bits = bits;
+        vm->stack_map_capacity = capacity;
+    }
+    
+    StackMap *map = &vm->stack_maps[vm->stack_map_count++];
+    map->pc = pc;
+    map->offset = (vm->stack_map_count - 1) * words;
+    memcpy(&vm->stack_map_bits[map->offset], live, sizeof(uint32_t) * words);
+}
+
+const uint32_t* vm_find_stack_map(VM *vm, int pc) {
+    int lo = 0, hi = vm->stack_map_count - 1;
+    
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (vm->stack_maps[mid].pc == pc) {
+            return &vm->stack_map_bits[vm->stack_maps[mid].offset];
+        }
+        if (vm->stack_maps[mid].pc < pc) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return NULL;
+}
+
+/* Roots are the stack slots followed by the globals, then the saved stacks
+ * of suspended fibers. Top-level locals are filtered through the stack map
+ * of the safepoint they are suspended at; callee frames and operands have
+ * no map and are scanned conservatively. */
+static int gc_root_count(VM *vm) {
+    return vm->sp + 1 + vm->global_count + vm_fiber_root_count(vm);
+}
+
+static const uint32_t* gc_root_stack_map(VM *vm) {
+    if (vm->local_count == 0) return NULL;
+    
+    int pc = vm->frame_count > 0 ? vm->frames[0].return_addr - 1 : vm->ip - 1;
+    return vm_find_stack_map(vm, pc);
+}
+
+/* Root slot i, or NULL if it holds a dead local */
+static Value* gc_root_slot(VM *vm, const uint32_t *live, int i) {
+    if (i > vm->sp + vm->global_count) return vm_fiber_root(vm, i - vm->sp - 1 - vm->global_count);
+    if (i > vm->sp) return &vm->globals[i - vm->sp - 1];
+    
+    if (live && i < vm->local_count && !(live[i / 32] & (1u << (i % 32)))) {
+        // Dead until its next store: drop the reference so a later
+        // conservative scan cannot see a stale (possibly young) pointer
+        Value zero = {VAL_INT, {.int_val = 0}};
+        vm->stack[i] = zero;
+        return NULL;
+    }
+    return &vm->stack[i];
+}
+
+static void gc_visit_roots(VM *vm, GCSlotFn fn) {
+    const uint32_t *live = gc_root_stack_map(vm);
+    int count = gc_root_count(vm);
+    
+    for (int i = 0; i < count; i++) {
+        Value *slot = gc_root_slot(vm, live, i);
+        if (slot) fn(vm, slot);
+    }
+}
+
+/* Trace references held by gray objects until none are left */
+static void gc_trace_references(VM *vm) {
+    while (vm->gray.count > 0) {
+        HeapObject *obj = vm->gray.items[--vm->gray.count];
+        gc_visit_slots(vm, obj, gc_mark_slot);
+    }
+}
+
+/* Shade everything the mutator can reach directly */
+static void gc_mark_static_roots(VM *vm) {
+    // Mark from roots: Constants pool
+    for (int i = 0; i < vm->constant_count; i++) {
+        Value val = vm->constants[i].value;
+        
+        if (val.type == VAL_STRING) {
+            vm_gc_mark_value(vm, val);
+        }
+    }
+    
+    // Mark from roots: String literals referenced by LOAD_STR
+    for (int i = 0; i < vm->static_string_count; i++) {
+        vm->strings[i].marked = 1;
+    }
+}
+
+static void gc_mark_roots(VM *vm) {
+    // Mark from roots: Stack (frame locals live here too) and globals
+    gc_visit_roots(vm, gc_mark_slot);
+    gc_mark_static_roots(vm);
+}
+
+/* Parallel collection
+ * Full stop-the-world collections can run on vm->gc_threads threads. The
+ * caller takes part as thread 0; helpers are started per collection. Work
+ * is claimed dynamically, so a helper that fails to start only costs
+ * parallelism. */
+
+/* Run fn once per argument block: blocks 1.. on new threads, block 0 on the caller */
+static void gc_parallel_run(int threads, void *(*fn)(void*), void *args, size_t stride) {
+    pthread_t helpers[GC_MAX_THREADS];
+    int started[GC_MAX_THREADS] = {0};
+    
+    for (int i = 1; i < threads; i++) {
+        started[i] = pthread_create(&helpers[i], NULL, fn, (char*)args + i * stride) == 0;
+    }
+    fn(args);
+    for (int i = 1; i < threads; i++) {
+        if (started[i]) pthread_join(helpers[i], NULL);
+    }
+}
+
+static int gc_parallel_threads(VM *vm) {
+    if (vm->gc_threads <= 1 || vm->bytes_allocated < GC_PARALLEL_MIN_HEAP) return 1;
+    return vm->gc_threads < GC_MAX_THREADS ? vm->gc_threads : GC_MAX_THREADS;
+}
+
+struct GCMarkTeam;
+
+/* One marking thread. Objects are pushed on a private stack; when it gets
+ * deep and the shared stack is empty, half of it is moved to the shared
+ * stack where idle markers can steal it. */
+typedef struct {
+    struct GCMarkTeam *team;
+    GCWorklist local;
+    GCWorklist shared;         // Guarded by lock
+    int shared_count;          // Atomic copy of shared.count for lock-free peeks
+    pthread_mutex_t lock;
+} GCMarker;
+
+typedef struct GCMarkTeam {
+    VM *vm;
+    GCMarker *markers;
+    int count;
+    const uint32_t *live;      // Stack map for the root slots
+    int root_count;
+    int next_root;             // Next unclaimed root slot (atomic)
+    int active;                // Markers that have started (atomic)
+    int idle;                  // Markers out of work (atomic)
+} GCMarkTeam;
+
+static __thread GCMarker *gc_marker;
+
+/* Atomic variant of heap_test_and_mark for concurrent markers */
+static int heap_test_and_mark_atomic(VM *vm, HeapObject *obj) {
+    if (heap_object_is_old(vm, obj)) {
+        size_t index = heap_granule(vm, obj);
+        uint64_t prev = __atomic_fetch_or(&vm->mark_bits[BITMAP_WORD(index)],
+                                          BITMAP_BIT(index), __ATOMIC_RELAXED);
+        return (prev & BITMAP_BIT(index)) != 0;
+    }
+    return (__atomic_fetch_or(&obj->flags, HEAP_MARKED, __ATOMIC_RELAXED) & HEAP_MARKED) != 0;
+}
+
+/* Move the older half of the private stack where other markers can take it */
+static void gc_marker_share(VM *vm, GCMarker *m) {
+    int half = m->local.count / 2;
+    
+    pthread_mutex_lock(&m->lock);
+    for (int i = 0; i < half; i++) {
+        gc_worklist_push(vm, &m->shared, m->local.items[i]);
+    }
+    __atomic_store_n(&m->shared_count, m->shared.count, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&m->lock);
+    
+    memmove(m->local.items, m->local.items + half, sizeof(HeapObject*) * (m->local.count - half));
+    m->local.count -= half;
+}
+
+/* GCSlotFn for marker threads */
+static void gc_par_mark_slot(VM *vm, Value *slot) {
+    Value val = *slot;
+    
+    if (val.type == VAL_HEAP_PTR) {
+        HeapObject *obj = vm_heap_object(vm, val.as.heap_ptr);
+        if (!obj || heap_test_and_mark_atomic(vm, obj)) return;
+        if (obj->type != OBJ_MAP && obj->type != OBJ_ARRAY) return;
+        
+        GCMarker *m = gc_marker;
+        gc_worklist_push(vm, &m->local, obj);
+        if (m->local.count >= GC_SHARE_THRESHOLD &&
+            __atomic_load_n(&m->shared_count, __ATOMIC_ACQUIRE) == 0) {
+            gc_marker_share(vm, m);
+        }
+    } else if (val.type == VAL_STRING) {
+        int str_id = val.as.string_id;
+        if (str_id >= 0 && str_id < vm->string_count) {
+            __atomic_store_n(&vm->strings[str_id].marked, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/* Move work from a marker's shared stack to our private one (half when stealing) */
+static int gc_marker_take(VM *vm, GCMarker *from, GCMarker *to, int all) {
+    if (__atomic_load_n(&from->shared_count, __ATOMIC_ACQUIRE) == 0) return 0;
+    
+    pthread_mutex_lock(&from->lock);
+    int take = all ? from->shared.count : (from->shared.count + 1) / 2;
+    for (int i = 0; i < take; i++) {
+        gc_worklist_push(vm, &to->local, from->shared.items[--from->shared.count]);
+    }
+    __atomic_store_n(&from->shared_count, from->shared.count, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&from->lock);
+    return take;
+}
+
+static int gc_marker_steal(VM *vm, GCMarker *self) {
+    GCMarkTeam *team = self->team;
+    int me = (int)(self - team->markers);
+    
+    for (int i = 1; i < team->count; i++) {
+        if (gc_marker_take(vm, &team->markers[(me + i) % team->count], self, 0)) return 1;
+    }
+    return 0;
+}
+
+/* Out of work: wait until someone shares more, or everyone is idle.
+ * Returns 1 when marking is finished for this thread. */
+static int gc_marker_idle(GCMarker *self) {
+    GCMarkTeam *team = self->team;
+    __atomic_fetch_add(&team->idle, 1, __ATOMIC_ACQ_REL);
+    
+    for (;;) {
+        int active = __atomic_load_n(&team->active, __ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&team->idle, __ATOMIC_ACQUIRE) == active) return 1;
+        
+        for (int i = 0; i < team->count; i++) {
+            if (__atomic_load_n(&team->markers[i].shared_count, __ATOMIC_ACQUIRE) > 0) {
+                __atomic_fetch_sub(&team->idle, 1, __ATOMIC_ACQ_REL);
+                return 0;
+            }
+        }
+        sched_yield();
+    }
+}
+
+static void* gc_mark_worker(void *arg) {
+    GCMarker *self = (GCMarker*)arg;
+    GCMarkTeam *team = self->team;
+    VM *vm = team->vm;
+    
+    gc_marker = self;
+    __atomic_fetch_add(&team->active, 1, __ATOMIC_ACQ_REL);
+    
+    for (;;) {
+        // Own work first, then unclaimed roots, then other markers' work
+        if (self->local.count > 0 || gc_marker_take(vm, self, self, 1)) {
+            HeapObject *obj = self->local.items[--self->local.count];
+            gc_visit_slots(vm, obj, gc_par_mark_slot);
+            continue;
+        }
+        
+        int first = __atomic_fetch_add(&team->next_root, GC_ROOT_CHUNK, __ATOMIC_RELAXED);
+        if (first < team->root_count) {
+            int end = first + GC_ROOT_CHUNK < team->root_count ? first + GC_ROOT_CHUNK : team->root_count;
+            for (int i = first; i < end; i++) {
+                Value *slot = gc_root_slot(vm, team->live, i);
+                if (slot) gc_par_mark_slot(vm, slot);
+            }
+            continue;
+        }
+        
+        if (gc_marker_steal(vm, self)) continue;
+        if (gc_marker_idle(self)) break;
+    }
+    
+    gc_marker = NULL;
+    return NULL;
+}
+
+/* Mark from the roots on 'threads' threads (strings and constants already done) */
+static int gc_parallel_mark(VM *vm, int threads) {
+    GCMarker *markers = (GCMarker*)calloc(threads, sizeof(GCMarker));
+    if (!markers) return 0;
+    
+    GCMarkTeam team = {0};
+    team.vm = vm;
+    team.markers = markers;
+    team.count = threads;
+    team.live = gc_root_stack_map(vm);
+    team.root_count = gc_root_count(vm);
+    
+    for (int i = 0; i < threads; i++) {
+        markers[i].team = &team;
+        pthread_mutex_init(&markers[i].lock, NULL);
+    }
+    
+    gc_parallel_run(threads, gc_mark_worker, markers, sizeof(GCMarker));
     
-    HeapObject *obj = (HeapObject*)&vm->heap[ptr];
-    return obj->data;
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_destroy(&markers[i].lock);
+        free(markers[i].local.items);
+        free(markers[i].shared.items);
+    }
+    free(markers);
+    return 1;
 }
 
-/* Garbage collection - Mark & Sweep Algorithm */
-
 /* Mark phase: trace from roots and mark all reachable objects */
 void vm_gc_mark(VM *vm) {
     if (!vm) return;
     
     // First, unmark all objects
-    HeapObject *obj = vm->first_object;
-    while (obj) {
-        obj->marked = 0;
-        obj = obj->next;
+    if (vm->mark_bits) {
+        memset(vm->mark_bits, 0, BITMAP_WORDS(vm->heap_used) * sizeof(uint64_t));
+    }
+    for (int i = 0; i < vm->large_count; i++) {
+        if (vm->large_objects[i]) vm->large_objects[i]->flags &= ~HEAP_MARKED;
     }
     
     // Unmark all strings
@@ -271,129 +1124,186 @@ void vm_gc_mark(VM *vm) {
         vm->strings[i].marked = 0;
     }
     
-    // Mark from roots: Stack
-    for (int i = 0; i <= vm->sp; i++) {
-        Value val = vm->stack[i];
-        
-        if (val.type == VAL_HEAP_PTR) {
-            int ptr = val.as.heap_ptr;
-            if (ptr >= 0 && ptr < vm->heap_used) {
-                HeapObject *heap_obj = (HeapObject*)&vm->heap[ptr];
-                heap_obj->marked = 1;
-            }
-        } else if (val.type == VAL_STRING) {
-            int str_id = val.as.string_id;
-            if (str_id >= 0 && str_id < vm->string_count) {
-                vm->strings[str_id].marked = 1;
-            }
-        }
+    int threads = gc_parallel_threads(vm);
+    if (threads > 1) {
+        gc_mark_static_roots(vm);
+        if (gc_parallel_mark(vm, threads)) return;
     }
     
-    // Mark from roots: Globals
-    for (int i = 0; i < vm->global_count; i++) {
-        Value val = vm->globals[i];
+    gc_mark_roots(vm);
+    
+    // Mark everything reachable from the roots
+    gc_trace_references(vm);
+}
+
+/* Old space is swept in chunks of bitmap words that are independent of each
+ * other, so they can be handed to different threads. Free blocks found
+ * inside a chunk go on chunk-local lists; the run before its first live
+ * object may continue from the previous chunk and is left to the merge. */
+typedef struct {
+    int first_word, end_word;
+    int first_live;            // Offset of the first live object (-1 if none)
+    int live_end;              // End of the last live block
+    int live_bytes;
+    HeapObject *heads[HEAP_SIZE_CLASSES + 1];  // Last list holds large blocks
+    HeapObject *tails[HEAP_SIZE_CLASSES + 1];
+} GCSweepChunk;
+
+typedef struct {
+    VM *vm;
+    GCSweepChunk *chunks;
+    int count;
+    int next;                  // Next unclaimed chunk (atomic)
+} GCSweepTeam;
+
+static void gc_chunk_free_block(GCSweepChunk *chunk, HeapObject *block, int block_size) {
+    int list = heap_format_free(block, block_size);
+    FREE_NEXT(block) = NULL;
+    if (chunk->tails[list]) {
+        FREE_NEXT(chunk->tails[list]) = block;
+    } else {
+        chunk->heads[list] = block;
+    }
+    chunk->tails[list] = block;
+}
+
+/* The bitmaps are scanned a word (64 granules) at a time: live objects are
+ * start & mark, dead ones start & ~mark, and the gap between two live
+ * objects (dead objects and old free blocks alike) becomes one free block. */
+static void gc_sweep_chunk(VM *vm, GCSweepChunk *chunk) {
+    chunk->first_live = -1;
+    chunk->live_end = 0;
+    chunk->live_bytes = 0;
+    memset(chunk->heads, 0, sizeof(chunk->heads));
+    memset(chunk->tails, 0, sizeof(chunk->tails));
+    
+    for (int w = chunk->first_word; w < chunk->end_word; w++) {
+        uint64_t starts = vm->start_bits[w];
+        if (!starts) continue;
         
-        if (val.type == VAL_HEAP_PTR) {
-            int ptr = val.as.heap_ptr;
-            if (ptr >= 0 && ptr < vm->heap_used) {
-                HeapObject *heap_obj = (HeapObject*)&vm->heap[ptr];
-                heap_obj->marked = 1;
-            }
-        } else if (val.type == VAL_STRING) {
-            int str_id = val.as.string_id;
-            if (str_id >= 0 && str_id < vm->string_count) {
-                vm->strings[str_id].marked = 1;
+        uint64_t live = starts & vm->mark_bits[w];
+        
+        // Release out-of-heap storage
+        for (uint64_t dead = starts & ~live; dead; dead &= dead - 1) {
+            HeapObject *obj = GRANULE_OBJECT(vm, (size_t)w * 64 + __builtin_ctzll(dead));
+            if (obj->type == OBJ_MAP) {
+                vm_map_destroy((VMMap*)obj->data);
             }
         }
-    }
-    
-    // Mark from roots: Call frames (local variables)
-    for (int f = 0; f < vm->frame_count; f++) {
-        CallFrame *frame = &vm->frames[f];
-        int base = frame->frame_pointer;
         
-        for (int i = 0; i < frame->num_locals && (base + i) <= vm->sp; i++) {
-            Value val = vm->stack[base + i];
+        vm->start_bits[w] = live;
+        vm->mark_bits[w] = 0;  // Survivors start the next cycle white
+        
+        for (; live; live &= live - 1) {
+            int offset = (w * 64 + __builtin_ctzll(live)) * HEAP_GRANULE;
+            HeapObject *obj = (HeapObject*)&vm->heap[offset];
             
-            if (val.type == VAL_HEAP_PTR) {
-                int ptr = val.as.heap_ptr;
-                if (ptr >= 0 && ptr < vm->heap_used) {
-                    HeapObject *heap_obj = (HeapObject*)&vm->heap[ptr];
-                    heap_obj->marked = 1;
-                }
-            } else if (val.type == VAL_STRING) {
-                int str_id = val.as.string_id;
-                if (str_id >= 0 && str_id < vm->string_count) {
-                    vm->strings[str_id].marked = 1;
-                }
+            if (chunk->first_live < 0) {
+                chunk->first_live = offset;
+            } else if (offset > chunk->live_end) {
+                gc_chunk_free_block(chunk, (HeapObject*)&vm->heap[chunk->live_end],
+                                    offset - chunk->live_end);
             }
+            chunk->live_end = offset + BLOCK_SIZE(obj);
+            chunk->live_bytes += BLOCK_SIZE(obj);
         }
     }
+}
+
+static void* gc_sweep_worker(void *arg) {
+    GCSweepTeam *team = (GCSweepTeam*)arg;
     
-    // Mark from roots: Constants pool
-    for (int i = 0; i < vm->constant_count; i++) {
-        Value val = vm->constants[i].value;
+    for (;;) {
+        int i = __atomic_fetch_add(&team->next, 1, __ATOMIC_RELAXED);
+        if (i >= team->count) break;
+        gc_sweep_chunk(team->vm, &team->chunks[i]);
+    }
+    return NULL;
+}
+
+/* Splice swept chunks together in address order; returns live old-space bytes */
+static int gc_sweep_merge(VM *vm, GCSweepChunk *chunks, int count) {
+    memset(vm->free_lists, 0, sizeof(vm->free_lists));
+    vm->large_free = NULL;
+    
+    int live_bytes = 0;
+    int live_end = 0;
+    
+    for (int i = 0; i < count; i++) {
+        GCSweepChunk *chunk = &chunks[i];
+        if (chunk->first_live < 0) continue;
         
-        if (val.type == VAL_STRING) {
-            int str_id = val.as.string_id;
-            if (str_id >= 0 && str_id < vm->string_count) {
-                vm->strings[str_id].marked = 1;
-            }
+        // Gap between the previous chunk's last object and our first one
+        if (chunk->first_live > live_end) {
+            heap_free_block(vm, (HeapObject*)&vm->heap[live_end], chunk->first_live - live_end);
+        }
+        live_end = chunk->live_end;
+        live_bytes += chunk->live_bytes;
+        
+        for (int list = 0; list <= HEAP_SIZE_CLASSES; list++) {
+            if (!chunk->heads[list]) continue;
+            HeapObject **head = heap_free_list(vm, list);
+            FREE_NEXT(chunk->tails[list]) = *head;
+            *head = chunk->heads[list];
         }
     }
+    
+    // The free run touching the frontier goes back to the bump region
+    vm->heap_used = live_end;
+    return live_bytes;
 }
 
 /* Sweep phase: reclaim unmarked objects */
 void vm_gc_sweep(VM *vm) {
     if (!vm) return;
     
-    // Sweep heap objects
-    HeapObject **obj_ptr = &vm->first_object;
-    int bytes_freed = 0;
+    // Rebuild the free lists from scratch (live objects never move)
+    int words = BITMAP_WORDS(vm->heap_used);
+    int threads = gc_parallel_threads(vm);
+    int count = threads > 1 ? (words + GC_SWEEP_CHUNK_WORDS - 1) / GC_SWEEP_CHUNK_WORDS : 1;
     
-    while (*obj_ptr) {
-        HeapObject *obj = *obj_ptr;
-        
-        if (!obj->marked) {
-            // Remove from list
-            *obj_ptr = obj->next;
-            
-            // Track freed bytes
-            bytes_freed += sizeof(HeapObject) + obj->size;
-        } else {
-            // Keep object, move to next
-            obj_ptr = &obj->next;
-        }
+    GCSweepChunk single;
+    GCSweepChunk *chunks = count > 1 ? (GCSweepChunk*)malloc(sizeof(GCSweepChunk) * count) : NULL;
+    if (!chunks) {
+        chunks = &single;
+        count = 1;
+    }
+    for (int i = 0; i < count; i++) {
+        chunks[i].first_word = (int)((long long)words * i / count);
+        chunks[i].end_word = (int)((long long)words * (i + 1) / count);
+    }
+    
+    if (count > 1) {
+        GCSweepTeam team = {vm, chunks, count, 0};
+        gc_parallel_run(threads < count ? threads : count, gc_sweep_worker, &team, 0);
+    } else {
+        gc_sweep_chunk(vm, chunks);
     }
     
-    // Compact heap by rebuilding it from marked objects
-    int new_heap_used = 0;
-    HeapObject *new_first = NULL;
-    HeapObject **new_tail = &new_first;
+    int live_bytes = gc_sweep_merge(vm, chunks, count);
+    if (chunks != &single) free(chunks);
     
-    obj_ptr = &vm->first_object;
-    while (*obj_ptr) {
-        HeapObject *obj = *obj_ptr;
-        int obj_size = sizeof(HeapObject) + obj->size;
+    // Large objects: unmap dead page runs, recycle their ids
+    vm->large_bytes = 0;
+    for (int i = 0; i < vm->large_count; i++) {
+        HeapObject *obj = vm->large_objects[i];
+        if (!obj) continue;
         
-        // Copy to new position
-        if (new_heap_used != (uint8_t*)obj - vm->heap) {
-            memmove(&vm->heap[new_heap_used], obj, obj_size);
+        int mapping = (int)sizeof(HeapObject) + (int)obj->size;
+        if (obj->flags & HEAP_MARKED) {
+            obj->flags &= ~HEAP_MARKED;
+            vm->large_bytes += mapping;
+        } else {
+            if (obj->type == OBJ_MAP) {
+                vm_map_destroy((VMMap*)obj->data);
+            }
+            vm_mem_release(obj, mapping);
+            vm->large_objects[i] = NULL;
+            vm->large_free_ids[vm->large_free_count++] = i;
         }
-        
-        // Update object pointer
-        HeapObject *new_obj = (HeapObject*)&vm->heap[new_heap_used];
-        *new_tail = new_obj;
-        new_tail = &new_obj->next;
-        
-        new_heap_used += obj_size;
-        obj_ptr = &obj->next;
     }
     
-    *new_tail = NULL;
-    vm->first_object = new_first;
-    vm->heap_used = new_heap_used;
-    vm->bytes_allocated -= bytes_freed;
+    vm->bytes_allocated = live_bytes + vm->large_bytes;
     
     // Sweep strings
     for (int i = 0; i < vm->string_count; i++) {
@@ -405,13 +1315,239 @@ void vm_gc_sweep(VM *vm) {
     }
 }
 
-/* Collect garbage */
+/* Minor collection - copy surviving young objects into old space */
+
+
+/* Promote a young object (once) and return its old-space heap_ptr */
+static int gc_promote(VM *vm, HeapObject *young) {
+    if (young->flags & HEAP_FORWARDED) {
+        return heap_object_ptr(vm, *(HeapObject**)young->data);  // Already forwarded
+    }
+    
+    HeapObject *obj = heap_take_block(vm, BLOCK_SIZE(young));
+    if (!obj) return -1;
+    
+    int capacity = obj->size;  // Best fit may hand back a slightly larger block
+    memcpy(obj, young, BLOCK_SIZE(young));
+    obj->size = capacity;
+    heap_adopt_block(vm, obj, (ObjType)young->type);
+    
+    young->flags |= HEAP_FORWARDED;
+    *(HeapObject**)young->data = obj;  // Forwarding pointer (payload is at least 8 bytes)
+    
+    // Promoted objects may still point into the nursery (Cheney-style worklist).
+    // During a marking cycle they are also gray: the marker has never seen
+    // their old referents.
+    if (obj->type == OBJ_MAP || obj->type == OBJ_ARRAY) {
+        gc_worklist_push(vm, &vm->promoted, obj);
+        if (vm->gc_phase == GC_MARKING) {
+            gc_worklist_push(vm, &vm->gray, obj);
+        }
+    }
+    return heap_object_ptr(vm, obj);
+}
+
+/* Rewrite a slot that points into the nursery */
+static void gc_evacuate_slot(VM *vm, Value *slot) {
+    if (slot->type != VAL_HEAP_PTR || !VM_IS_YOUNG(slot->as.heap_ptr)) return;
+    
+    HeapObject *young = vm_heap_object(vm, slot->as.heap_ptr);
+    if (!young) return;
+    
+    int ptr = gc_promote(vm, young);
+    if (ptr < 0) {
+        vm->promotion_failed = 1;
+        return;
+    }
+    slot->as.heap_ptr = ptr;
+}
+
+/* Evacuate everything reachable from the roots and the remembered set.
+ * Cost is proportional to surviving young data, not to the old heap. */
+static void gc_evacuate_nursery(VM *vm) {
+    if (vm->nursery_used == 0) return;
+    
+    int promoted_before = vm->bytes_allocated;
+    vm->promotion_failed = 0;
+    
+    // Roots: Stack (locals live here too) and globals
+    gc_visit_roots(vm, gc_evacuate_slot);
+    
+    // Old objects written with young pointers since the last collection
+    for (int i = 0; i < vm->remembered.count; i++) {
+        HeapObject *obj = vm->remembered.items[i];
+        obj->flags &= ~HEAP_REMEMBERED;
+        gc_visit_slots(vm, obj, gc_evacuate_slot);
+    }
+    vm->remembered.count = 0;
+    
+    // Scan promoted objects until no young references are left
+    while (vm->promoted.count > 0) {
+        HeapObject *obj = vm->promoted.items[--vm->promoted.count];
+        gc_visit_slots(vm, obj, gc_evacuate_slot);
+    }
+    
+    // Young maps that did not survive still own malloc'd tables
+    if (vm->nursery_maps > 0) {
+        for (int offset = 0; offset < vm->nursery_used; ) {
+            HeapObject *obj = (HeapObject*)&vm->nursery[offset];
+            if (obj->type == OBJ_MAP && !(obj->flags & HEAP_FORWARDED)) {
+                vm_map_destroy((VMMap*)obj->data);
+            }
+            offset += BLOCK_SIZE(obj);
+        }
+    }
+    
+    if (vm->debug_mode) {
+        printf("[GC minor #%d] Promoted %d of %d nursery bytes\n",
+               vm->minor_gc_count + 1, vm->bytes_allocated - promoted_before, vm->nursery_used);
+    }
+    
+    vm->nursery_used = 0;
+    vm->nursery_maps = 0;
+    vm->minor_gc_count++;
+    
+    if (vm->promotion_failed) {
+        vm_runtime_error(vm, "Out of heap memory (promoting young objects)");
+        vm->ip = vm->code_size;  // Halt: some references could not be updated
+    }
+}
+
+void vm_gc_minor(VM *vm) {
+    if (!vm) return;
+    
+    // Make sure old space can take the worst case (every young object survives)
+    int old_bytes = vm->bytes_allocated - vm->large_bytes;
+    if (MAX_HEAP - old_bytes < vm->nursery_used + HEAP_SMALL_MAX) {
+        vm_gc_collect(vm);
+        return;
+    }
+    gc_evacuate_nursery(vm);
+}
+
+/* Write barrier for heap stores.
+ * Dijkstra insertion barrier: while marking, the stored value is shaded so a
+ * black object never points at a white one. Generational part: old objects
+ * that receive a young pointer go into the remembered set. */
+void vm_write_barrier(VM *vm, HeapObject *owner, Value val) {
+    if (vm->gc_phase == GC_MARKING) {
+        vm_gc_mark_value(vm, val);
+    }
+    
+    if (val.type != VAL_HEAP_PTR || !VM_IS_YOUNG(val.as.heap_ptr)) return;
+    if ((owner->flags & HEAP_REMEMBERED) || heap_object_is_young(vm, owner)) return;
+    
+    owner->flags |= HEAP_REMEMBERED;
+    gc_worklist_push(vm, &vm->remembered, owner);
+}
+
+/* Incremental marking (tri-color)
+ * White objects are unmarked, gray ones are marked and on the gray list,
+ * black ones are marked and traced. Allocations run bounded mark slices;
+ * the stack and globals are not barriered, so they are rescanned when the
+ * cycle finishes. */
+
+static long long gc_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int gc_is_incremental(VM *vm) {
+    return vm->gc_max_pause_us > 0 || vm->gc_slice_objects > 0;
+}
+
+static void gc_record_pause(VM *vm, long long start_us) {
+    int pause = (int)(gc_now_us() - start_us);
+    if (pause > vm->gc_longest_pause_us) {
+        vm->gc_longest_pause_us = pause;
+    }
+}
+
+/* Begin a cycle: shade the roots, later slices do the tracing */
+static void gc_start_cycle(VM *vm) {
+    // Heap objects are already white (sweep clears survivors)
+    for (int i = 0; i < vm->string_count; i++) {
+        vm->strings[i].marked = 0;
+    }
+    
+    vm->gc_phase = GC_MARKING;
+    gc_mark_roots(vm);
+    
+    if (vm->debug_mode) {
+        printf("[GC #%d] Incremental mark started (%d bytes in old space)\n",
+               vm->gc_count + 1, vm->bytes_allocated);
+    }
+}
+
+/* Trace gray objects within the slice budget. Returns 1 once none are left. */
+static int gc_mark_slice(VM *vm) {
+    long long deadline = vm->gc_max_pause_us > 0 ? gc_now_us() + vm->gc_max_pause_us : 0;
+    int traced = 0;
+    
+    while (vm->gray.count > 0) {
+        HeapObject *obj = vm->gray.items[--vm->gray.count];
+        gc_visit_slots(vm, obj, gc_mark_slot);
+        traced++;
+        
+        if (vm->gc_slice_objects > 0 && traced >= vm->gc_slice_objects) break;
+        if (deadline && traced % GC_TIME_CHECK_INTERVAL == 0 && gc_now_us() >= deadline) break;
+    }
+    
+    vm->gc_slice_count++;
+    return vm->gray.count == 0;
+}
+
+/* Allocation-driven GC work: start a cycle past the threshold, else run a slice */
+static void gc_incremental_step(VM *vm) {
+    if (vm->gc_phase == GC_IDLE && vm->bytes_allocated <= vm->gc_threshold) return;
+    
+    long long start = gc_now_us();
+    
+    if (vm->gc_phase == GC_IDLE) {
+        gc_start_cycle(vm);
+    } else if (gc_mark_slice(vm)) {
+        vm_gc_collect(vm);  // Gray set is empty: remark and sweep
+    }
+    
+    gc_record_pause(vm, start);
+}
+
+/* Drop remembered objects that did not survive marking */
+static void gc_prune_remembered(VM *vm) {
+    int kept = 0;
+    for (int i = 0; i < vm->remembered.count; i++) {
+        if (heap_is_marked(vm, vm->remembered.items[i])) {
+            vm->remembered.items[kept++] = vm->remembered.items[i];
+        }
+    }
+    vm->remembered.count = kept;
+}
+
+/* Collect garbage (full collection of both generations).
+ * If an incremental cycle is running it is finished instead of restarted. */
 void vm_gc_collect(VM *vm) {
     if (!vm) return;
     
     int before = vm->bytes_allocated;
     
-    vm_gc_mark(vm);
+    if (vm->gc_phase == GC_MARKING) {
+        // Remark: young objects are traced from here on. Roots may have
+        // changed without a barrier, and black remembered objects may point
+        // at young objects the marker skipped.
+        vm->gc_phase = GC_IDLE;
+        gc_mark_roots(vm);
+        for (int i = 0; i < vm->remembered.count; i++) {
+            gc_visit_slots(vm, vm->remembered.items[i], gc_mark_slot);
+        }
+        gc_trace_references(vm);
+    } else {
+        vm_gc_mark(vm);
+    }
+    
+    // Dead old objects must leave the remembered set before sweep frees them
+    gc_prune_remembered(vm);
+    
     vm_gc_sweep(vm);
     vm->gc_count++;
     
@@ -420,6 +1556,9 @@ void vm_gc_collect(VM *vm) {
         printf("[GC #%d] Collected %d bytes (before: %d, after: %d)\n",
                vm->gc_count, freed, before, vm->bytes_allocated);
     }
+    
+    // Old space now has room: empty the nursery as well
+    gc_evacuate_nursery(vm);
 }
 
 /* Function calls */
@@ -461,6 +1600,39 @@ void vm_return_function(VM *vm) {
     }
 }
 
+/* Heap object of the given kind behind a value, or NULL */
+static HeapObject* value_as_object(VM *vm, Value val, ObjType type) {
+    if (val.type != VAL_HEAP_PTR) return NULL;
+    HeapObject *obj = vm_heap_object(vm, val.as.heap_ptr);
+    if (!obj || obj->type != (int)type) return NULL;
+    return obj;
+}
+
+/* Map helpers */
+static VMMap* value_as_map(VM *vm, Value val) {
+    HeapObject *obj = value_as_object(vm, val, OBJ_MAP);
+    return obj ? (VMMap*)obj->data : NULL;
+}
+
+uint32_t vm_value_hash(VM *vm, Value key) {
+    if (key.type == VAL_STRING) {
+        // Interned strings carry their hash
+        if (key.as.string_id >= 0 && key.as.string_id < vm->string_count) {
+            return vm->strings[key.as.string_id].hash;
+        }
+        return 0;
+    }
+    
+    // Integer mix (murmur3 finalizer)
+    uint32_t h = (uint32_t)key.as.int_val ^ ((uint32_t)key.type << 24);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
 /* Execute single instruction */
 int vm_execute_instruction(VM *vm) {
     if (vm->ip >= vm->code_size) {
@@ -470,12 +1642,19 @@ int vm_execute_instruction(VM *vm) {
     Instruction instr = vm->code[vm->ip++];
     vm->instruction_count++;
     
+    if (vm->trace_recording) {
+        vm_trace_record(vm, instr, vm->ip - 1);
+    }
+    
     if (instr.line > 0) {
         vm->current_line = instr.line;
     }
     
     switch (instr.code) {
         case OP_HALT:
+            // The program ends once every fiber and isolate has finished
+            if (vm_fiber_exit(vm)) return 1;
+            vm_isolate_join(vm);
             return 0;
         
         case OP_NOP:
@@ -629,9 +1808,15 @@ int vm_execute_instruction(VM *vm) {
             break;
         }
         
-        case OP_JMP:
+        case OP_JMP: {
+            int from = vm->ip - 1;
             vm->ip = instr.arg;
+            // Backward jumps close loops: count them, record or enter a trace
+            if (vm->tracer && instr.arg <= from) {
+                vm_trace_loop_edge(vm, instr.arg);
+            }
             break;
+        }
         
         case OP_JMP_FALSE: {
             Value cond = vm_pop(vm);
@@ -677,9 +1862,11 @@ int vm_execute_instruction(VM *vm) {
         case OP_PRINT: {
             Value val = vm_pop(vm);
             if (val.type == VAL_INT) {
-                printf("%d\n", val.as.int_val);
+                fprintf(vm->out, "%d\n", val.as.int_val);
             } else if (val.type == VAL_FLOAT) {
-                printf("%f\n", val.as.float_val);
+                fprintf(vm->out, "%f\n", val.as.float_val);
+            } else if (val.type == VAL_STRING) {
+                fprintf(vm->out, "%s\n", vm_get_string(vm, val.as.string_id));
             }
             break;
         }
@@ -687,33 +1874,217 @@ int vm_execute_instruction(VM *vm) {
         case OP_PRINT_STR: {
             Value val = vm_pop(vm);
             if (val.type == VAL_STRING) {
-                printf("%s\n", vm_get_string(vm, val.as.string_id));
+                fprintf(vm->out, "%s\n", vm_get_string(vm, val.as.string_id));
             }
             break;
         }
         
         case OP_INPUT: {
+            // With other fibers alive, wait for input without blocking them
+            if (vm_fiber_park_input(vm, vm->ip - 1)) break;
+            
             // Read integer input from user
             int input_val;
-            if (scanf("%d", &input_val) == 1) {
+            if (fscanf(vm->in, "%d", &input_val) == 1) {
                 Value val = {VAL_INT, {.int_val = input_val}};
                 vm_push(vm, val);
             } else {
                 // Clear input buffer on error
                 int c;
-                while ((c = getchar()) != '\n' && c != EOF);
+                while ((c = getc(vm->in)) != '\n' && c != EOF);
                 Value val = {VAL_INT, {.int_val = 0}};
                 vm_push(vm, val);
             }
             break;
         }
         
+        case OP_WAIT: {
+            Value seconds = vm_pop(vm);
+            double delay = 0;
+            if (seconds.type == VAL_INT) delay = seconds.as.int_val;
+            else if (seconds.type == VAL_FLOAT) delay = seconds.as.float_val;
+            vm_fiber_wait(vm, vm->ip - 1, delay);
+            break;
+        }
+        
+        case OP_SPAWN:
+            if (!vm_fiber_spawn(vm, instr.arg, vm->ip - 1)) {
+                vm_runtime_error(vm, "Out of memory starting a fiber");
+                return 0;
+            }
+            break;
+        
+        case OP_FIBER_EXIT:
+            if (vm_fiber_exit(vm)) return 1;
+            vm_isolate_join(vm);
+            return 0;
+        
+        case OP_PARALLEL:
+            if (instr.arg < 0 || instr.arg >= vm->par_loop_count) {
+                vm_runtime_error(vm, "Invalid parallel loop: %d", instr.arg);
+                return 0;
+            }
+            vm_par_run(vm, &vm->par_loops[instr.arg]);
+            break;
+        
+        case OP_PAR_END:
+            if (vm->par_worker) return 0;
+            break;
+        
+        case OP_ISOLATE:
+            if (!vm_isolate_start(vm, instr.arg, vm->ip - 1)) return 0;
+            break;
+        
+        case OP_CHAN_NEW:
+            if (!vm_chan_new(vm)) return 0;
+            break;
+        
+        case OP_CHAN_SEND:
+            if (!vm_chan_send(vm, vm->ip - 1)) return 0;
+            break;
+        
+        case OP_CHAN_RECV:
+            if (!vm_chan_recv(vm, vm->ip - 1)) return 0;
+            break;
+        
+        case OP_CHAN_CLOSE:
+            if (!vm_chan_close(vm)) return 0;
+            break;
+        
         case OP_LOAD_STR: {
             Value val = {VAL_STRING, {.string_id = instr.arg}};
             vm_push(vm, val);
             break;
         }
         
+        case OP_ALLOC: {
+            Value count = vm_pop(vm);
+            if (count.type != VAL_INT || count.as.int_val < 0 ||
+                count.as.int_val > (int)(MAX_HEAP / sizeof(Value))) {
+                vm_runtime_error(vm, "Invalid array size");
+                break;
+            }
+            
+            int length = count.as.int_val;
+            int ptr = vm_alloc_object(vm, (int)(sizeof(VMArray) + sizeof(Value) * length), OBJ_ARRAY);
+            if (ptr < 0) break;
+            
+            VMArray *arr = (VMArray*)vm_get_heap_ptr(vm, ptr);
+            arr->length = length;
+            for (int i = 0; i < length; i++) {
+                arr->items[i].type = VAL_INT;
+                arr->items[i].as.int_val = 0;
+            }
+            
+            Value val = {VAL_HEAP_PTR, {.heap_ptr = ptr}};
+            vm_push(vm, val);
+            break;
+        }
+        
+        case OP_LOAD_HEAP:
+        case OP_STORE_HEAP: {
+            Value value = {VAL_INT, {.int_val = 0}};
+            if (instr.code == OP_STORE_HEAP) {
+                value = vm_pop(vm);
+            }
+            Value index = vm_pop(vm);
+            HeapObject *owner = value_as_object(vm, vm_pop(vm), OBJ_ARRAY);
+            if (!owner) {
+                vm_runtime_error(vm, "Array operation on a non-array value");
+                break;
+            }
+            
+            VMArray *arr = (VMArray*)owner->data;
+            if (index.type != VAL_INT || index.as.int_val < 0 || index.as.int_val >= arr->length) {
+                vm_runtime_error(vm, "Array index out of bounds: %d (length %d)",
+                                 index.as.int_val, arr->length);
+                break;
+            }
+            
+            if (instr.code == OP_LOAD_HEAP) {
+                vm_push(vm, arr->items[index.as.int_val]);
+            } else {
+                arr->items[index.as.int_val] = value;
+                vm_write_barrier(vm, owner, value);
+            }
+            break;
+        }
+        
+        case OP_MAP_NEW: {
+            int ptr = vm_alloc_object(vm, sizeof(VMMap), OBJ_MAP);
+            if (ptr < 0) break;
+            
+            vm_map_init((VMMap*)vm_get_heap_ptr(vm, ptr));
+            Value val = {VAL_HEAP_PTR, {.heap_ptr = ptr}};
+            vm_push(vm, val);
+            break;
+        }
+        
+        case OP_MAP_SET: {
+            Value value = vm_pop(vm);
+            Value key = vm_pop(vm);
+            HeapObject *owner = value_as_object(vm, vm_pop(vm), OBJ_MAP);
+            if (!owner) {
+                vm_runtime_error(vm, "Map operation on a non-map value");
+                break;
+            }
+            if (key.type == VAL_HEAP_PTR) {
+                // Promotion moves objects, which would change the key's hash
+                vm_runtime_error(vm, "Map keys must be numbers or strings");
+                break;
+            }
+            if (!vm_map_set((VMMap*)owner->data, key, vm_value_hash(vm, key), value)) {
+                vm_runtime_error(vm, "Out of memory growing map");
+                break;
+            }
+            vm_write_barrier(vm, owner, value);
+            break;
+        }
+        
+        case OP_MAP_GET:
+        case OP_MAP_HAS: {
+            Value key = vm_pop(vm);
+            VMMap *map = value_as_map(vm, vm_pop(vm));
+            if (!map) {
+                vm_runtime_error(vm, "Map operation on a non-map value");
+                break;
+            }
+            
+            int slot = vm_map_find(map, key, vm_value_hash(vm, key));
+            Value result = {VAL_INT, {.int_val = 0}};
+            if (instr.code == OP_MAP_HAS) {
+                result.as.int_val = (slot >= 0);
+            } else if (slot >= 0) {
+                result = map->slots[slot].value;
+            }
+            vm_push(vm, result);
+            break;
+        }
+        
+        case OP_MAP_NEXT:
+        case OP_MAP_KEY:
+        case OP_MAP_VALUE: {
+            Value index = vm_pop(vm);
+            VMMap *map = value_as_map(vm, vm_pop(vm));
+            if (!map || index.type != VAL_INT) {
+                vm_runtime_error(vm, "Map operation on a non-map value");
+                break;
+            }
+            
+            int slot = index.as.int_val;
+            Value result = {VAL_INT, {.int_val = -1}};
+            if (instr.code == OP_MAP_NEXT) {
+                result.as.int_val = vm_map_next(map, slot);
+            } else if (slot < 0 || slot >= map->capacity || map->ctrl[slot] == MAP_CTRL_EMPTY) {
+                vm_runtime_error(vm, "Invalid map slot: %d", slot);
+                break;
+            } else {
+                result = (instr.code == OP_MAP_KEY) ? map->slots[slot].key : map->slots[slot].value;
+            }
+            vm_push(vm, result);
+            break;
+        }
+        
         case OP_LINE:
             vm->current_line = instr.arg;
             break;
@@ -727,9 +2098,35 @@ int vm_execute_instruction(VM *vm) {
 }
 
 /* Main execution loop */
+/* Reserve the top-level locals so operands never share their slots */
+void vm_reserve_locals(VM *vm) {
+    while (vm->sp < vm->local_count - 1) {
+        Value zero = {VAL_INT, {.int_val = 0}};
+        vm_push(vm, zero);
+    }
+}
+
+int vm_local_index(VM *vm, const char *name) {
+    if (!vm || !vm->local_names || !name) return -1;
+    for (int i = 0; i < vm->local_count; i++) {
+        if (vm->local_names[i] && strcmp(vm->local_names[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 void vm_run(VM *vm) {
     if (!vm) return;
     
+    vm_reserve_locals(vm);
+    
+    // Under perf, calls run through per-function trampolines
+    if (vm_perf_enabled()) {
+        vm_perf_run(vm);
+        return;
+    }
+    
     while (vm->ip < vm->code_size) {
         if (!vm_execute_instruction(vm)) {
             break;
@@ -739,27 +2136,29 @@ void vm_run(VM *vm) {
 
 /* Error handling */
 void vm_error(VM *vm, const char *format, ...) {
-    fprintf(stderr, "VM Error: ");
+    fprintf(vm->err, "VM Error: ");
     va_list args;
     va_start(args, format);
-    vfprintf(stderr, format, args);
+    vfprintf(vm->err, format, args);
     va_end(args);
-    fprintf(stderr, "\n");
+    fprintf(vm->err, "\n");
 }
 
 void vm_runtime_error(VM *vm, const char *format, ...) {
-    fprintf(stderr, "\n🐯 Kotha Runtime Error\n");
-    fprintf(stderr, "━━━━━━━━━━━━━━━━━━━━━━\n");
+    vm->error_count++;
+    fflush(vm->out);   // Output printed before the error comes first
+    fprintf(vm->err, "\n🐯 Kotha Runtime Error\n");
+    fprintf(vm->err, "━━━━━━━━━━━━━━━━━━━━━━\n");
     
     if (vm->current_line > 0) {
-        fprintf(stderr, "Line %d: ", vm->current_line);
+        fprintf(vm->err, "Line %d: ", vm->current_line);
     }
     
     va_list args;
     va_start(args, format);
-    vfprintf(stderr, format, args);
+    vfprintf(vm->err, format, args);
     va_end(args);
-    fprintf(stderr, "\n\n");
+    fprintf(vm->err, "\n\n");
     
     vm_print_stack_trace(vm);
 }
@@ -793,7 +2192,27 @@ const char* vm_opcode_name(OpCode op) {
         case OP_PRINT: return "PRINT";
         case OP_PRINT_STR: return "PRINT_STR";
         case OP_INPUT: return "INPUT";
+        case OP_WAIT: return "WAIT";
+        case OP_SPAWN: return "SPAWN";
+        case OP_FIBER_EXIT: return "FIBER_EXIT";
+        case OP_PARALLEL: return "PARALLEL";
+        case OP_PAR_END: return "PAR_END";
+        case OP_ISOLATE: return "ISOLATE";
+        case OP_CHAN_NEW: return "CHAN_NEW";
+        case OP_CHAN_SEND: return "CHAN_SEND";
+        case OP_CHAN_RECV: return "CHAN_RECV";
+        case OP_CHAN_CLOSE: return "CHAN_CLOSE";
         case OP_LOAD_STR: return "LOAD_STR";
+        case OP_ALLOC: return "ALLOC";
+        case OP_LOAD_HEAP: return "LOAD_HEAP";
+        case OP_STORE_HEAP: return "STORE_HEAP";
+        case OP_MAP_NEW: return "MAP_NEW";
+        case OP_MAP_SET: return "MAP_SET";
+        case OP_MAP_GET: return "MAP_GET";
+        case OP_MAP_HAS: return "MAP_HAS";
+        case OP_MAP_NEXT: return "MAP_NEXT";
+        case OP_MAP_KEY: return "MAP_KEY";
+        case OP_MAP_VALUE: return "MAP_VALUE";
         case OP_LINE: return "LINE";
         default: return "UNKNOWN";
     }
@@ -803,7 +2222,8 @@ void vm_print_state(VM *vm) {
     printf("=== VM State ===\n");
     printf("IP: %d, SP: %d, FP: %d\n", vm->ip, vm->sp, vm->fp);
     printf("Frames: %d, Line: %d\n", vm->frame_count, vm->current_line);
-    printf("Instructions: %d, GC runs: %d\n", vm->instruction_count, vm->gc_count);
+    printf("Instructions: %d, GC runs: %d (minor: %d)\n", vm->instruction_count,
+           vm->gc_count, vm->minor_gc_count);
     printf("Stack: [");
     for (int i = 0; i <= vm->sp && i < 10; i++) {
         if (vm->stack[i].type == VAL_INT) {
@@ -828,6 +2248,14 @@ void vm_disassemble(VM *vm) {
         if (instr.line > 0) {
             printf(" (line %d)", instr.line);
         }
+        
+        const uint32_t *live = vm_find_stack_map(vm, i);
+        if (live) {
+            printf(" ; live:");
+            for (int slot = 0; slot < vm->local_count; slot++) {
+                if (live[slot / 32] & (1u << (slot % 32))) printf(" %d", slot);
+            }
+        }
         printf("\n");
     }
     printf("============================\n");
@@ -835,14 +2263,14 @@ void vm_disassemble(VM *vm) {
 
 void vm_print_stack_trace(VM *vm) {
     if (vm->frame_count == 0) {
-        fprintf(stderr, "Stack trace: <main>\n");
+        fprintf(vm->err, "Stack trace: <main>\n");
         return;
     }
     
-    fprintf(stderr, "Stack trace:\n");
+    fprintf(vm->err, "Stack trace:\n");
     for (int i = vm->frame_count - 1; i >= 0; i--) {
         CallFrame *frame = &vm->frames[i];
-        fprintf(stderr, "  at function_%d (addr %d)\n", 
+        fprintf(vm->err, "  at function_%d (addr %d)\n", 
                 frame->function_id, frame->return_addr);
     }
 }
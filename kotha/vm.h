@@ -7,16 +7,53 @@
 #define VM_H
 
 #include <stdint.h>
+#include <stdio.h>
 
 /* Configuration */
 #define MAX_STACK 2048
 #define MAX_CODE 8192
 #define MAX_FRAMES 256
-#define MAX_HEAP 65536
+#define MAX_HEAP (1 << 30)  // Old-space address space reserved per VM (committed on demand)
 #define MAX_STRINGS 1024
 #define MAX_CONSTANTS 1024
 #define MAX_FUNCTIONS 256
 
+/* Heap allocator: blocks are rounded to granules; small blocks come from
+ * per-size-class free lists, larger ones from a best-fit list */
+#define HEAP_GRANULE 16
+#define HEAP_SIZE_CLASSES 32
+#define HEAP_SMALL_MAX (HEAP_GRANULE * HEAP_SIZE_CLASSES)
+
+/* Old space grows by committing regions of the reservation; region size
+ * doubles with the heap so big heaps get few, huge-page-backed regions */
+#define HEAP_MIN_REGION (256 * 1024)
+#define HEAP_MAX_REGION (64 * 1024 * 1024)
+#define GC_INITIAL_THRESHOLD (1024 * 1024)
+
+/* Large object space: objects above this size get their own page run.
+ * Their heap_ptr values are LOS_BASE + index into large_objects. */
+#define LARGE_OBJECT_SIZE (64 * 1024)
+
+/* Young generation: new objects are bump-allocated in the nursery and
+ * promoted to the heap above when they survive a minor collection.
+ * Young heap_ptr values are NURSERY_BASE + offset into the nursery. */
+#define NURSERY_SIZE (256 * 1024)
+#define NURSERY_BASE MAX_HEAP
+#define PRETENURE_SIZE (NURSERY_SIZE / 8)  // Larger objects skip the nursery
+#define LOS_BASE (NURSERY_BASE + NURSERY_SIZE)
+#define VM_IS_YOUNG(ptr) ((ptr) >= NURSERY_BASE && (ptr) < LOS_BASE)
+#define VM_IS_LARGE(ptr) ((ptr) >= LOS_BASE)
+
+/* Incremental marking: slice budgets of 0 mean full stop-the-world collections */
+#define GC_TIME_CHECK_INTERVAL 32  // Objects traced between clock reads
+
+/* Parallel full collections (--gc-threads) */
+#define GC_MAX_THREADS 64
+#define GC_PARALLEL_MIN_HEAP (4 * 1024 * 1024)  // Smaller heaps are collected serially
+#define GC_ROOT_CHUNK 256          // Root slots a marker claims at a time
+#define GC_SHARE_THRESHOLD 64      // Private mark stack depth before work is shared
+#define GC_SWEEP_CHUNK_WORDS 1024  // Bitmap words per sweep chunk (1 MB of heap)
+
 /* Opcodes */
 typedef enum {
     // Control flow
@@ -70,18 +107,43 @@ typedef enum {
     OP_LEAVE,       // Leave function (cleanup frame)
     
     // Heap & Strings
-    OP_ALLOC,       // Allocate heap memory
+    OP_ALLOC,       // count -> new array of count slots
     OP_FREE,        // Free heap memory
-    OP_LOAD_HEAP,   // Load from heap
-    OP_STORE_HEAP,  // Store to heap
+    OP_LOAD_HEAP,   // array index -> value
+    OP_STORE_HEAP,  // array index value -> (write barrier)
     OP_LOAD_STR,    // Load string from pool
     OP_CONCAT,      // Concatenate strings
     
+    // Maps (open-addressing hash table)
+    OP_MAP_NEW,     // Push a new empty map
+    OP_MAP_SET,     // map key value -> (insert or overwrite)
+    OP_MAP_GET,     // map key -> value (0 if missing)
+    OP_MAP_HAS,     // map key -> 1/0
+    OP_MAP_NEXT,    // map cursor -> first occupied slot >= cursor (-1 at end)
+    OP_MAP_KEY,     // map slot -> key stored in slot
+    OP_MAP_VALUE,   // map slot -> value stored in slot
+    
     // I/O
     OP_PRINT,
     OP_PRINT_STR,
     OP_INPUT,
     
+    // Fibers (see vm_fiber.h)
+    OP_WAIT,        // seconds -> (yields until the time has passed)
+    OP_SPAWN,       // Start a fiber at arg with a copy of this one's stack
+    OP_FIBER_EXIT,  // End the running fiber
+    
+    // Parallel loops (see vm_par.h)
+    OP_PARALLEL,    // Run loop arg (vm->par_loops) on the thread pool, or fall through
+    OP_PAR_END,     // Loop exit: stops a worker, no-op otherwise
+    
+    // Isolates (see vm_isolate.h)
+    OP_ISOLATE,     // Start an isolate at arg with a copy of the locals
+    OP_CHAN_NEW,    // capacity -> channel handle
+    OP_CHAN_SEND,   // channel value -> (waits while the channel is full)
+    OP_CHAN_RECV,   // channel -> value (waits while empty, 0 once closed and drained)
+    OP_CHAN_CLOSE,  // channel ->
+    
     // Exception handling
     OP_TRY,
     OP_THROW,
@@ -127,18 +189,75 @@ typedef struct {
     int function_id;     // Function identifier
 } CallFrame;
 
-/* Heap object - Mark & Sweep GC */
+/* Heap object kinds (tells the GC how to trace the payload) */
+typedef enum {
+    OBJ_RAW,             // Opaque bytes, no references
+    OBJ_MAP,             // VMMap header (see vm_map.h)
+    OBJ_ARRAY,           // VMArray: inline Value slots
+    OBJ_FREE             // Free block on a free list
+} ObjType;
+
+/* Heap object header bits (old-space objects keep their mark bit in
+ * the side bitmap, so HEAP_MARKED is only used by young and large objects) */
+#define HEAP_MARKED      0x01
+#define HEAP_REMEMBERED  0x02  // Old object already in the remembered set
+#define HEAP_FORWARDED   0x04  // Promoted young object: data holds the new HeapObject*
+
+/* Heap object - Mark & Sweep GC (objects never move once allocated).
+ * The header is a single packed 8-byte word. Free blocks keep their
+ * free-list link in the first payload word. */
 typedef struct HeapObject {
-    int size;
-    int marked;          // Mark bit for GC
-    struct HeapObject *next;  // Next object in allocation list
+    uint32_t size;       // Usable payload bytes (block size minus header)
+    uint8_t type;        // ObjType
+    uint8_t flags;       // HEAP_* bits
+    uint16_t reserved;
     char data[];         // Flexible array member
 } HeapObject;
 
+/* Growable list of object pointers (gray set, remembered set) */
+typedef struct {
+    HeapObject **items;
+    int count;
+    int capacity;
+} GCWorklist;
+
+/* Collector state between allocations */
+typedef enum {
+    GC_IDLE,             // No cycle in progress
+    GC_MARKING           // Incremental marking: allocations run mark slices
+} GCPhase;
+
+/* Liveness of the top-level locals at a safepoint (a pc that can run the GC) */
+typedef struct {
+    int pc;
+    int offset;          // First word of the slot bitmap in stack_map_bits
+} StackMap;
+
+/* Parallel cholbe loop: the sequential loop code follows OP_PARALLEL, and
+ * workers run chunks of it with their own copies of the locals */
+#define PAR_MAX_REDUCTIONS 8
+
+typedef struct {
+    int top_pc;          // Loop condition (the instruction after OP_PARALLEL)
+    int exit_pc;         // The loop's OP_PAR_END
+    int var_slot;        // Loop variable
+    int end_slot;        // Inclusive bound, evaluated once before the loop
+    int reductions[PAR_MAX_REDUCTIONS];  // jog(...) accumulators (partial sums are added)
+    int reduction_count;
+    int parallel;        // 0 if the body needs the main VM (runs sequentially)
+} VMParLoop;
+
+/* Fixed-length array payload (OBJ_ARRAY) */
+typedef struct {
+    int length;
+    Value items[];
+} VMArray;
+
 /* String pool entry */
 typedef struct {
     char *str;
     int length;
+    uint32_t hash;  // Computed once when interned (map keys reuse it)
     int marked;  // Mark bit for GC
 } StringEntry;
 
@@ -154,11 +273,18 @@ typedef struct {
     int num_params;
 } FunctionEntry;
 
+struct VMTracer;
+struct VMScheduler;
+struct VMParPool;
+struct VMJit;
+struct VMIsolateGroup;
+
 /* Virtual Machine */
 typedef struct {
     // Code
-    Instruction code[MAX_CODE];
+    Instruction *code;         // MAX_CODE entries, shared read-only with parallel workers
     int code_size;
+    int shared_code;           // Code, stack maps and loops belong to another VM
     
     // Stack
     Value stack[MAX_STACK];
@@ -185,13 +311,50 @@ typedef struct {
     // String pool
     StringEntry strings[MAX_STRINGS];
     int string_count;
+    int static_string_count;   // Literals interned by codegen (always live)
+    
+    // Stack maps (slots not listed as live at a safepoint are not roots)
+    int local_count;           // Top-level locals, reserved at the bottom of the stack
+    char **local_names;        // IR name of each local slot (see vm_local_index)
+    StackMap *stack_maps;      // Sorted by pc
+    int stack_map_count;
+    int stack_map_capacity;
+    uint32_t *stack_map_bits;  // One bit per local for each map
     
     // Heap - Mark & Sweep
-    uint8_t heap[MAX_HEAP];
-    int heap_used;
-    HeapObject *first_object;  // Head of allocated objects list
+    uint8_t *heap;             // MAX_HEAP bytes of reserved address space
+    void *heap_reservation;    // Raw reservation (heap is huge-page aligned inside)
+    int heap_used;             // Bump frontier: blocks below it are live or free
+    int heap_committed;        // Bytes of the reservation backed by memory
+    uint64_t *mark_bits;       // One bit per granule of committed old space
+    uint64_t *start_bits;      // Set at the first granule of every live object
+    HeapObject *free_lists[HEAP_SIZE_CLASSES];  // Exact-size free blocks
+    HeapObject *large_free;    // Free blocks above HEAP_SMALL_MAX (best fit)
+    
+    // Young generation
+    uint8_t *nursery;          // NURSERY_SIZE bytes, mapped on first use
+    int nursery_used;          // Bump pointer
+    int nursery_maps;          // Young maps (their tables are freed if they die)
+    GCWorklist promoted;       // Promoted objects not yet scanned for young pointers
+    GCWorklist remembered;     // Old objects that may point into the nursery
+    
+    // Large object space (each object is its own page run)
+    HeapObject **large_objects;  // NULL entries are free ids
+    int *large_free_ids;
+    int large_count;           // Ids handed out so far
+    int large_free_count;
+    int large_capacity;
+    int large_bytes;           // Mapped bytes (also counted in bytes_allocated)
     int bytes_allocated;       // Total bytes allocated
     int gc_threshold;          // GC trigger threshold
+    GCWorklist gray;           // Marked objects whose references are not traced yet
+    GCPhase gc_phase;
+    int gc_max_pause_us;       // Time budget per mark slice (0 = unlimited)
+    int gc_slice_objects;      // Object budget per mark slice (0 = unlimited)
+    int gc_threads;            // Threads for full collections (<= 1 = serial)
+    int heap_limit;            // Old-space plus large-object bytes allowed (0 = MAX_HEAP)
+    int heap_exhausted;        // An allocation failed even after a full collection
+    int promotion_failed;      // Old space ran out during a minor collection
     
     // Exception handling
     int handler_stack[MAX_STACK];
@@ -200,18 +363,50 @@ typedef struct {
     // Debugging
     int current_line;
     int debug_mode;
+    int error_count;           // Runtime errors reported so far
+    
+    // Streams for print, input and error reports (stdio unless redirected)
+    FILE *out;
+    FILE *in;
+    FILE *err;
+    
+    // Tracing JIT (NULL when disabled)
+    struct VMTracer *tracer;
+    int trace_recording;       // Feed each instruction to the trace recorder
+    
+    // Fibers (NULL until the first spawn)
+    struct VMScheduler *sched;
+    long long deadline_us;     // Limited run: waits never sleep past this monotonic time (0 = none)
+    int deadline_passed;       // A wait was cut short at deadline_us; the run must stop
+    
+    // Parallel loops
+    VMParLoop *par_loops;
+    int par_loop_count;
+    int par_threads;           // Threads for parallel loops (0 = one per core)
+    int par_worker;            // Worker context: OP_PAR_END returns to the pool
+    struct VMParPool *par_pool;  // Started by the first parallel loop
+    struct VMJit *jit;         // Set by vm_jit_run so workers run compiled code too
+    
+    // Isolates (NULL until the first isolate starts)
+    struct VMIsolateGroup *isolates;  // Shared by every VM of the program
+    int chan_backoff;          // Consecutive channel waits (grows the sleep)
     
     // Statistics
     int instruction_count;
     int gc_count;
+    int minor_gc_count;
+    int gc_slice_count;
+    int gc_longest_pause_us;
 } VM;
 
 /* VM Functions */
 void vm_init(VM *vm);
 void vm_free(VM *vm);
+void vm_share_program(VM *vm, const VM *src);  // src's bytecode, for a fresh VM
 void vm_add_instr(VM *vm, OpCode op, int arg);
 void vm_add_instr_line(VM *vm, OpCode op, int arg, int line);
 void vm_run(VM *vm);
+void vm_reserve_locals(VM *vm);
 int vm_execute_instruction(VM *vm);
 
 /* Stack operations */
@@ -226,6 +421,7 @@ Value vm_get_constant(VM *vm, int index);
 /* String pool */
 int vm_add_string(VM *vm, const char *str);
 const char* vm_get_string(VM *vm, int id);
+uint32_t vm_hash_string(const char *str);
 void vm_free_string(VM *vm, int id);
 
 /* Function table */
@@ -234,13 +430,23 @@ int vm_get_function(VM *vm, const char *name);
 
 /* Heap management */
 int vm_alloc_heap(VM *vm, int size);
+int vm_alloc_object(VM *vm, int size, ObjType type);
 void vm_free_heap(VM *vm, int ptr);
 void* vm_get_heap_ptr(VM *vm, int ptr);
+HeapObject* vm_heap_object(VM *vm, int ptr);
+uint32_t vm_value_hash(VM *vm, Value key);
 
 /* Garbage collection */
 void vm_gc_mark(VM *vm);
+void vm_gc_mark_value(VM *vm, Value val);
 void vm_gc_sweep(VM *vm);
 void vm_gc_collect(VM *vm);
+void vm_gc_minor(VM *vm);
+void vm_write_barrier(VM *vm, HeapObject *owner, Value val);
+
+/* Stack maps (added in pc order; lookup returns NULL if pc is not a safepoint) */
+void vm_add_stack_map(VM *vm, int pc, const uint32_t *live);
+const uint32_t* vm_find_stack_map(VM *vm, int pc);
 
 /* Function calls */
 void vm_call_function(VM *vm, int function_addr, int num_args);
@@ -261,4 +467,7 @@ void vm_runtime_error(VM *vm, const char *format, ...);
 struct IRInstr;
 VM *codegen_vm(struct IRInstr *ir);
 
+/* Local slot of a variable (-1 if the program never uses it) */
+int vm_local_index(VM *vm, const char *name);
+
 #endif /* VM_H */
@@ -0,0 +1,418 @@
+/*
+ * Kotha VM Fibers
+ * Many script tasks share one VM and one thread. A fiber runs until it
+ * waits, blocks on input or finishes; the scheduler then loads the next
+ * ready fiber, waking sleepers from a timer heap and parking readers
+ * until stdin has data. When nothing can run it sleeps (or polls stdin)
+ * until the earliest timer is due. A limited run (vm->deadline_us) never
+ * sleeps past its deadline; the wait that reaches it sets deadline_passed.
+ */
+
+#include "vm_fiber.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+
+static long long fiber_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void fiber_sleep_us(long long us) {
+    if (us <= 0) return;
+    struct timespec ts = {us / 1000000, (us % 1000000) * 1000};
+    while (nanosleep(&ts, &ts) != 0) { }  // Resume after signals
+}
+
+/* Cap an idle 'delay' (-1 = until woken) at the run's deadline. Returns 0
+ * once the deadline has passed, after setting vm->deadline_passed. */
+static int fiber_limit_delay(VM *vm, long long now, long long *delay) {
+    if (vm->deadline_us <= 0) return 1;
+    long long left = vm->deadline_us - now;
+    if (left <= 0) {
+        vm->deadline_passed = 1;
+        return 0;
+    }
+    if (*delay < 0 || *delay > left) *delay = left;
+    return 1;
+}
+
+/* wait() with no other fiber to run: a plain sleep, up to the deadline */
+static void fiber_sleep_alone(VM *vm, long long us) {
+    fflush(vm->out);
+    long long delay = us;
+    if (!fiber_limit_delay(vm, fiber_now_us(), &delay)) return;
+    fiber_sleep_us(delay);
+    if (delay < us) vm->deadline_passed = 1;
+}
+
+/* Grow a saved array to hold 'count' elements */
+static int fiber_reserve(void **items, int *capacity, int count, size_t size) {
+    if (count <= *capacity && *items) return 1;
+
+    int new_capacity = *capacity ? *capacity : 16;
+    while (new_capacity < count) new_capacity *= 2;
+    void *grown = realloc(*items, size * new_capacity);
+    if (!grown) return 0;
+    *items = grown;
+    *capacity = new_capacity;
+    return 1;
+}
+
+/* Fiber lifecycle */
+
+static VMFiber* fiber_new(VMScheduler *s) {
+    if (s->free) {
+        VMFiber *f = s->free;
+        s->free = f->next;
+        f->next = NULL;
+        return f;
+    }
+
+    if (!fiber_reserve((void**)&s->all, &s->all_capacity, s->all_count + 1, sizeof(VMFiber*))) {
+        return NULL;
+    }
+    VMFiber *f = (VMFiber*)calloc(1, sizeof(VMFiber));
+    if (!f) return NULL;
+    f->id = s->all_count;
+    s->all[s->all_count++] = f;
+    return f;
+}
+
+/* The first spawn turns the code that is already running into fiber 0 */
+static VMScheduler* sched_get(VM *vm) {
+    if (vm->sched) return vm->sched;
+
+    VMScheduler *s = (VMScheduler*)calloc(1, sizeof(VMScheduler));
+    if (!s) return NULL;
+
+    VMFiber *main_fiber = fiber_new(s);
+    if (!main_fiber) {
+        free(s);
+        return NULL;
+    }
+    main_fiber->state = FIBER_RUNNING;
+    s->current = main_fiber;
+    s->live = s->peak_live = 1;
+    vm->sched = s;
+    return s;
+}
+
+/* Copy the VM's execution state into f. Top-level locals that are dead
+ * at 'pc' (a safepoint) are saved as 0, so the conservative root scan of
+ * suspended fibers never sees a stale reference. */
+static int fiber_save(VM *vm, VMFiber *f, int pc) {
+    int slots = vm->sp + 1;
+    int handlers = vm->hp + 1;
+
+    if (!fiber_reserve((void**)&f->stack, &f->stack_capacity, slots, sizeof(Value)) ||
+        !fiber_reserve((void**)&f->frames, &f->frame_capacity, vm->frame_count, sizeof(CallFrame)) ||
+        !fiber_reserve((void**)&f->handlers, &f->handler_capacity, handlers, sizeof(int))) {
+        return 0;
+    }
+
+    memcpy(f->stack, vm->stack, sizeof(Value) * slots);
+    memcpy(f->frames, vm->frames, sizeof(CallFrame) * vm->frame_count);
+    memcpy(f->handlers, vm->handler_stack, sizeof(int) * handlers);
+    f->sp = vm->sp;
+    f->ip = vm->ip;
+    f->fp = vm->fp;
+    f->hp = vm->hp;
+    f->frame_count = vm->frame_count;
+    f->current_line = vm->current_line;
+
+    const uint32_t *live = vm->frame_count == 0 ? vm_find_stack_map(vm, pc) : NULL;
+    if (live) {
+        Value zero = {VAL_INT, {.int_val = 0}};
+        for (int i = 0; i < vm->local_count && i < slots; i++) {
+            if (!(live[i / 32] & (1u << (i % 32)))) f->stack[i] = zero;
+        }
+    }
+    return 1;
+}
+
+static void fiber_load(VM *vm, VMScheduler *s, VMFiber *f) {
+    memcpy(vm->stack, f->stack, sizeof(Value) * (f->sp + 1));
+    memcpy(vm->frames, f->frames, sizeof(CallFrame) * f->frame_count);
+    memcpy(vm->handler_stack, f->handlers, sizeof(int) * (f->hp + 1));
+    vm->sp = f->sp;
+    vm->ip = f->ip;
+    vm->fp = f->fp;
+    vm->hp = f->hp;
+    vm->frame_count = f->frame_count;
+    vm->current_line = f->current_line;
+
+    f->state = FIBER_RUNNING;
+    s->current = f;
+    s->switches++;
+}
+
+/* Run queue */
+
+static void ready_push(VMScheduler *s, VMFiber *f) {
+    f->state = FIBER_READY;
+    f->next = NULL;
+    if (s->ready_tail) s->ready_tail->next = f;
+    else s->ready_head = f;
+    s->ready_tail = f;
+}
+
+static VMFiber* ready_pop(VMScheduler *s) {
+    VMFiber *f = s->ready_head;
+    if (!f) return NULL;
+    s->ready_head = f->next;
+    if (!s->ready_head) s->ready_tail = NULL;
+    f->next = NULL;
+    return f;
+}
+
+/* Timer heap */
+
+static int timer_before(VMFiber *a, VMFiber *b) {
+    return a->wake_us < b->wake_us || (a->wake_us == b->wake_us && a->seq < b->seq);
+}
+
+static int timer_push(VMScheduler *s, VMFiber *f) {
+    if (!fiber_reserve((void**)&s->timers, &s->timer_capacity, s->timer_count + 1, sizeof(VMFiber*))) {
+        return 0;
+    }
+
+    f->state = FIBER_SLEEPING;
+    f->seq = s->next_seq++;
+    int i = s->timer_count++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!timer_before(f, s->timers[parent])) break;
+        s->timers[i] = s->timers[parent];
+        i = parent;
+    }
+    s->timers[i] = f;
+    return 1;
+}
+
+static VMFiber* timer_pop(VMScheduler *s) {
+    VMFiber *top = s->timers[0];
+    VMFiber *last = s->timers[--s->timer_count];
+    int i = 0;
+
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= s->timer_count) break;
+        if (child + 1 < s->timer_count && timer_before(s->timers[child + 1], s->timers[child])) child++;
+        if (!timer_before(s->timers[child], last)) break;
+        s->timers[i] = s->timers[child];
+        i = child;
+    }
+    if (s->timer_count > 0) s->timers[i] = last;
+    return top;
+}
+
+/* Input */
+
+/* 1 if a read from stdin would not block. Data already in the stdio
+ * buffer counts; errors and hangups count too (scanf reports them).
+ * Without a way to see the buffer, input is always treated as ready. */
+static int fiber_stdin_ready(void) {
+#ifdef __GLIBC__
+    // scanf("%d") skips leading whitespace anyway, so drop it here: the
+    // newline left after the previous number must not count as input
+    while (stdin->_IO_read_ptr < stdin->_IO_read_end) {
+        if (!isspace((unsigned char)*stdin->_IO_read_ptr)) return 1;
+        getc(stdin);
+    }
+    struct pollfd p = {STDIN_FILENO, POLLIN, 0};
+    return poll(&p, 1, 0) != 0;
+#else
+    return 1;
+#endif
+}
+
+static void blocked_push(VMScheduler *s, VMFiber *f) {
+    f->state = FIBER_BLOCKED;
+    f->next = NULL;
+    if (s->blocked_tail) s->blocked_tail->next = f;
+    else s->blocked = f;
+    s->blocked_tail = f;
+}
+
+/* Move every reader to the run queue; each one rechecks stdin */
+static void blocked_wake(VMScheduler *s) {
+    while (s->blocked) {
+        VMFiber *f = s->blocked;
+        s->blocked = f->next;
+        ready_push(s, f);
+    }
+    s->blocked_tail = NULL;
+}
+
+/* Load the next fiber to run, idling until one is ready. The previous
+ * fiber must already be saved (or finished). Returns 0 if none are left,
+ * or if the run's deadline passed while idle (vm->deadline_passed). */
+static int sched_run_next(VM *vm, VMScheduler *s) {
+    for (;;) {
+        long long now = fiber_now_us();
+        while (s->timer_count > 0 && s->timers[0]->wake_us <= now) {
+            ready_push(s, timer_pop(s));
+        }
+        if (s->blocked && fiber_stdin_ready()) {
+            blocked_wake(s);
+        }
+
+        VMFiber *f = ready_pop(s);
+        if (f) {
+            fiber_load(vm, s, f);
+            return 1;
+        }
+        if (s->timer_count == 0 && !s->blocked) return 0;
+
+        // Nothing to run: show pending output, then sleep until a timer
+        // is due or (with readers parked) stdin becomes readable
+        fflush(vm->out);
+        long long delay = s->timer_count > 0 ? s->timers[0]->wake_us - now : -1;
+        if (!fiber_limit_delay(vm, now, &delay)) return 0;
+        if (s->blocked) {
+            struct pollfd p = {STDIN_FILENO, POLLIN, 0};
+            poll(&p, 1, delay < 0 ? -1 : (int)((delay + 999) / 1000));
+        } else {
+            fiber_sleep_us(delay);
+        }
+    }
+}
+
+/* Suspend the running fiber with 'park', then switch. If it cannot be
+ * saved the fiber just keeps running. */
+static int sched_yield(VM *vm, VMScheduler *s, int pc, int (*park)(VMScheduler*, VMFiber*)) {
+    VMFiber *f = s->current;
+    if (!fiber_save(vm, f, pc) || !park(s, f)) return 0;
+
+    s->current = NULL;
+    // Only fails at the deadline (f itself is waiting); the run then stops
+    sched_run_next(vm, s);
+    return 1;
+}
+
+static int park_ready(VMScheduler *s, VMFiber *f) {
+    ready_push(s, f);
+    return 1;
+}
+
+static int park_blocked(VMScheduler *s, VMFiber *f) {
+    blocked_push(s, f);
+    return 1;
+}
+
+/* Public API */
+
+int vm_fiber_spawn(VM *vm, int target, int pc) {
+    VMScheduler *s = sched_get(vm);
+    if (!s) return 0;
+
+    VMFiber *f = fiber_new(s);
+    if (!f) return 0;
+    if (!fiber_save(vm, f, pc)) {
+        f->state = FIBER_DONE;
+        f->next = s->free;
+        s->free = f;
+        return 0;
+    }
+    f->ip = target;
+    ready_push(s, f);
+
+    s->spawned++;
+    s->live++;
+    if (s->live > s->peak_live) s->peak_live = s->live;
+    return 1;
+}
+
+void vm_fiber_wait(VM *vm, int pc, double seconds) {
+    long long us = seconds > 0 ? (long long)(seconds * 1000000.0) : 0;
+    VMScheduler *s = vm->sched;
+
+    if (!s || s->live == 1) {
+        fiber_sleep_alone(vm, us);
+        return;
+    }
+
+    if (us == 0) {
+        // wait(0) just lets the other ready fibers run first
+        sched_yield(vm, s, pc, park_ready);
+        return;
+    }
+
+    s->current->wake_us = fiber_now_us() + us;
+    if (!sched_yield(vm, s, pc, timer_push)) {
+        fiber_sleep_alone(vm, us);
+    }
+}
+
+int vm_fiber_park_input(VM *vm, int pc) {
+    VMScheduler *s = vm->sched;
+    // Only stdin can be polled; other streams are read in place
+    if (!s || s->live == 1 || vm->in != stdin || fiber_stdin_ready()) return 0;
+
+    int saved_ip = vm->ip;
+    vm->ip = pc;  // Resume by running the INPUT again
+    if (sched_yield(vm, s, pc, park_blocked)) return 1;
+    vm->ip = saved_ip;
+    return 0;
+}
+
+int vm_fiber_exit(VM *vm) {
+    VMScheduler *s = vm->sched;
+    if (!s || !s->current) return 0;
+
+    VMFiber *f = s->current;
+    f->state = FIBER_DONE;
+    f->next = s->free;
+    s->free = f;
+    s->current = NULL;
+    s->live--;
+
+    return sched_run_next(vm, s);
+}
+
+int vm_fiber_root_count(VM *vm) {
+    VMScheduler *s = vm->sched;
+    if (!s) return 0;
+
+    int count = 0;
+    for (int i = 0; i < s->all_count; i++) {
+        VMFiber *f = s->all[i];
+        if (f->state == FIBER_RUNNING || f->state == FIBER_DONE) continue;
+
+        if (!fiber_reserve((void**)&s->roots, &s->root_capacity, count + f->sp + 1, sizeof(Value*))) {
+            vm_runtime_error(vm, "Out of memory in garbage collector");
+            break;
+        }
+        for (int slot = 0; slot <= f->sp; slot++) {
+            s->roots[count++] = &f->stack[slot];
+        }
+    }
+    s->root_count = count;
+    return count;
+}
+
+Value* vm_fiber_root(VM *vm, int i) {
+    return vm->sched->roots[i];
+}
+
+void vm_fiber_free(VMScheduler *sched) {
+    if (!sched) return;
+
+    for (int i = 0; i < sched->all_count; i++) {
+        VMFiber *f = sched->all[i];
+        free(f->stack);
+        free(f->frames);
+        free(f->handlers);
+        free(f);
+    }
+    free(sched->all);
+    free(sched->timers);
+    free(sched->roots);
+    free(sched);
+}
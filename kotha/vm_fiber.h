@@ -0,0 +1,96 @@
+/*
+ * Kotha VM Fiber Header
+ * Cooperative fibers: spawn starts one, wait and blocking input yield
+ */
+
+#ifndef VM_FIBER_H
+#define VM_FIBER_H
+
+#include "vm.h"
+
+typedef enum {
+    FIBER_RUNNING,       // Loaded into the VM
+    FIBER_READY,         // In the run queue
+    FIBER_SLEEPING,      // In the timer heap
+    FIBER_BLOCKED,       // Waiting for stdin to become readable
+    FIBER_DONE           // On the free list
+} VMFiberState;
+
+/* A suspended fiber. Only the used part of the value stack, call frames
+ * and handler stack is saved, so an idle fiber costs a few hundred bytes.
+ * The running fiber's state lives in the VM itself (the JIT addresses
+ * vm->stack directly), and switching copies it in and out. */
+typedef struct VMFiber {
+    int id;
+    VMFiberState state;
+
+    Value *stack;            // Slots 0..sp
+    int stack_capacity;
+    CallFrame *frames;
+    int frame_capacity;
+    int *handlers;           // Handler stack entries 0..hp
+    int handler_capacity;
+    int sp, ip, fp, hp;
+    int frame_count;
+    int current_line;
+
+    long long wake_us;       // Monotonic wake-up time while sleeping
+    long long seq;           // Orders timers that expire together
+    struct VMFiber *next;    // Run queue, input waiters or free list
+} VMFiber;
+
+typedef struct VMScheduler {
+    VMFiber *current;        // Fiber loaded into the VM
+    VMFiber *ready_head;     // Run queue (FIFO)
+    VMFiber *ready_tail;
+    VMFiber **timers;        // Min-heap on (wake_us, seq)
+    int timer_count;
+    int timer_capacity;
+    VMFiber *blocked;        // Waiting for input (FIFO)
+    VMFiber *blocked_tail;
+    VMFiber *free;           // Finished fibers kept for reuse
+    VMFiber **all;           // Every fiber ever created (for cleanup)
+    int all_count;
+    int all_capacity;
+    int live;                // Fibers not finished, including the current one
+    long long next_seq;
+
+    // Flat index of saved stack slots, rebuilt for each collection
+    Value **roots;
+    int root_count;
+    int root_capacity;
+
+    // Statistics
+    int spawned;
+    int switches;
+    int peak_live;
+} VMScheduler;
+
+/* OP_SPAWN: start a fiber at 'target' whose stack is a copy of the
+ * running fiber's (locals are copied by value). 'pc' is the SPAWN
+ * instruction. The new fiber runs when the current one yields.
+ * Returns 0 if out of memory. */
+int vm_fiber_spawn(VM *vm, int target, int pc);
+
+/* OP_WAIT at 'pc': suspend the running fiber for 'seconds' and run others
+ * meanwhile. Without other fibers this just sleeps. Neither sleeps past
+ * vm->deadline_us; reaching it sets vm->deadline_passed instead. */
+void vm_fiber_wait(VM *vm, int pc, double seconds);
+
+/* OP_INPUT at 'pc': if reading stdin now would block while other fibers
+ * are alive, park the running fiber until it is readable and load the
+ * next one. Returns 1 if the fiber was parked (the INPUT is retried). */
+int vm_fiber_park_input(VM *vm, int pc);
+
+/* OP_HALT / OP_FIBER_EXIT: finish the running fiber. Returns 1 if another
+ * fiber was loaded, 0 when none are left and the program is done. */
+int vm_fiber_exit(VM *vm);
+
+/* GC roots held by suspended fibers. vm_fiber_root_count rebuilds the
+ * index; vm_fiber_root is then safe to call from several marker threads. */
+int vm_fiber_root_count(VM *vm);
+Value* vm_fiber_root(VM *vm, int i);
+
+void vm_fiber_free(VMScheduler *sched);
+
+#endif /* VM_FIBER_H */
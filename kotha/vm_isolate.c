@@ -0,0 +1,640 @@
+/*
+ * Kotha VM Isolates
+ * An isolate is a complete VM (stack, heap, GC, string pool, fibers) on
+ * its own OS thread. All VMs of a program execute the same bytecode,
+ * which is never written after codegen, so it is shared instead of
+ * copied. Nothing else is shared: the isolate starts with copies of the
+ * live locals, and values travel between isolates as encoded messages
+ * through bounded lock-free channels. A receiver decodes a message into
+ * its own heap, so no VM ever touches another VM's objects. Channels are
+ * identified by small integer handles that are valid in every isolate.
+ */
+
+#include "vm_isolate.h"
+#include "vm_fiber.h"
+#include "vm_jit.h"
+#include "vm_map.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#define MSG_MAX_DEPTH 64           // Deeper (or cyclic) values cannot be sent
+#define CHAN_SPIN_ROUNDS 16        // Waits that only yield before sleeping starts
+#define CHAN_MAX_SLEEP (1.0 / 1000) // Longest back-off sleep (seconds)
+
+/* Message encoding
+ * Tags: 'i' int, 'f' float, 'n' null, 's' string (length + bytes + NUL),
+ * 'a' array (length + items), 'm' map (count + key/value pairs). */
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} MsgWriter;
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+} MsgReader;
+
+static int msg_put(MsgWriter *w, const void *bytes, size_t size) {
+    if (w->size + size > w->capacity) {
+        size_t capacity = w->capacity ? w->capacity : 64;
+        while (capacity < w->size + size) capacity *= 2;
+        uint8_t *grown = (uint8_t*)realloc(w->data, capacity);
+        if (!grown) return 0;
+        w->data = grown;
+        w->capacity = capacity;
+    }
+    memcpy(w->data + w->size, bytes, size);
+    w->size += size;
+    return 1;
+}
+
+static int msg_put_tag(MsgWriter *w, char tag, int32_t value) {
+    return msg_put(w, &tag, 1) && msg_put(w, &value, sizeof(value));
+}
+
+/* Append 'val' from vm's heap. Returns an error message or NULL. */
+static const char* msg_encode(VM *vm, MsgWriter *w, Value val, int depth) {
+    if (depth > MSG_MAX_DEPTH) return "Value is nested too deeply to send (cyclic?)";
+
+    switch (val.type) {
+        case VAL_INT:
+            return msg_put_tag(w, 'i', val.as.int_val) ? NULL : "Out of memory encoding a message";
+
+        case VAL_FLOAT: {
+            int32_t bits;
+            memcpy(&bits, &val.as.float_val, sizeof(bits));
+            return msg_put_tag(w, 'f', bits) ? NULL : "Out of memory encoding a message";
+        }
+
+        case VAL_STRING: {
+            const char *str = vm_get_string(vm, val.as.string_id);
+            int32_t length = (int32_t)strlen(str);
+            if (!msg_put_tag(w, 's', length) || !msg_put(w, str, (size_t)length + 1)) {
+                return "Out of memory encoding a message";
+            }
+            return NULL;
+        }
+
+        case VAL_HEAP_PTR: {
+            HeapObject *obj = vm_heap_object(vm, val.as.heap_ptr);
+            if (obj && obj->type == OBJ_ARRAY) {
+                VMArray *arr = (VMArray*)obj->data;
+                if (!msg_put_tag(w, 'a', arr->length)) return "Out of memory encoding a message";
+                for (int i = 0; i < arr->length; i++) {
+                    const char *error = msg_encode(vm, w, arr->items[i], depth + 1);
+                    if (error) return error;
+                }
+                return NULL;
+            }
+            if (obj && obj->type == OBJ_MAP) {
+                VMMap *map = (VMMap*)obj->data;
+                if (!msg_put_tag(w, 'm', map->count)) return "Out of memory encoding a message";
+                for (int slot = vm_map_next(map, 0); slot >= 0; slot = vm_map_next(map, slot + 1)) {
+                    const char *error = msg_encode(vm, w, map->slots[slot].key, depth + 1);
+                    if (!error) error = msg_encode(vm, w, map->slots[slot].value, depth + 1);
+                    if (error) return error;
+                }
+                return NULL;
+            }
+            return "Only numbers, strings, arrays and maps can be sent";
+        }
+
+        case VAL_NULL:
+        default:
+            return msg_put_tag(w, 'n', 0) ? NULL : "Out of memory encoding a message";
+    }
+}
+
+static const char* msg_make(VM *vm, Value val, VMMessage *msg) {
+    MsgWriter w = {NULL, 0, 0};
+    const char *error = msg_encode(vm, &w, val, 0);
+    if (error) {
+        free(w.data);
+        return error;
+    }
+    msg->data = w.data;
+    msg->size = w.size;
+    return NULL;
+}
+
+static int msg_get_tag(MsgReader *r, char *tag, int32_t *value) {
+    if (r->size - r->pos < 1 + sizeof(int32_t)) return 0;
+    *tag = (char)r->data[r->pos];
+    memcpy(value, r->data + r->pos + 1, sizeof(int32_t));
+    r->pos += 1 + sizeof(int32_t);
+    return 1;
+}
+
+/* Decode one value into vm's heap and push it. Containers stay on the
+ * stack while their items are decoded, since every allocation may run a
+ * collection that moves young objects. Returns an error message or NULL. */
+static const char* msg_decode(VM *vm, MsgReader *r) {
+    char tag;
+    int32_t n;
+    if (!msg_get_tag(r, &tag, &n)) return "Corrupt message";
+
+    Value val = {VAL_INT, {.int_val = 0}};
+    switch (tag) {
+        case 'i':
+            val.as.int_val = n;
+            break;
+
+        case 'f':
+            val.type = VAL_FLOAT;
+            memcpy(&val.as.float_val, &n, sizeof(n));
+            break;
+
+        case 'n':
+            val.type = VAL_NULL;
+            break;
+
+        case 's': {
+            if (n < 0 || r->size - r->pos < (size_t)n + 1) return "Corrupt message";
+            int id = vm_add_string(vm, (const char*)r->data + r->pos);
+            if (id < 0) return "String pool full";
+            r->pos += (size_t)n + 1;
+            val.type = VAL_STRING;
+            val.as.string_id = id;
+            break;
+        }
+
+        case 'a': {
+            if (n < 0) return "Corrupt message";
+            int ptr = vm_alloc_object(vm, (int)(sizeof(VMArray) + sizeof(Value) * n), OBJ_ARRAY);
+            if (ptr < 0) return "Out of memory receiving a message";
+
+            VMArray *arr = (VMArray*)vm_get_heap_ptr(vm, ptr);
+            arr->length = n;
+            for (int i = 0; i < n; i++) {
+                arr->items[i] = val;
+            }
+            val.type = VAL_HEAP_PTR;
+            val.as.heap_ptr = ptr;
+            vm_push(vm, val);
+
+            for (int i = 0; i < n; i++) {
+                const char *error = msg_decode(vm, r);
+                if (error) return error;
+                Value item = vm_pop(vm);
+                HeapObject *owner = vm_heap_object(vm, vm->stack[vm->sp].as.heap_ptr);
+                ((VMArray*)owner->data)->items[i] = item;
+                vm_write_barrier(vm, owner, item);
+            }
+            return NULL;
+        }
+
+        case 'm': {
+            if (n < 0) return "Corrupt message";
+            int ptr = vm_alloc_object(vm, sizeof(VMMap), OBJ_MAP);
+            if (ptr < 0) return "Out of memory receiving a message";
+
+            vm_map_init((VMMap*)vm_get_heap_ptr(vm, ptr));
+            val.type = VAL_HEAP_PTR;
+            val.as.heap_ptr = ptr;
+            vm_push(vm, val);
+
+            for (int i = 0; i < n; i++) {
+                const char *error = msg_decode(vm, r);
+                if (!error) error = msg_decode(vm, r);
+                if (error) return error;
+                Value value = vm_pop(vm);
+                Value key = vm_pop(vm);
+                if (key.type == VAL_HEAP_PTR) return "Corrupt message";
+
+                HeapObject *owner = vm_heap_object(vm, vm->stack[vm->sp].as.heap_ptr);
+                if (!vm_map_set((VMMap*)owner->data, key, vm_value_hash(vm, key), value)) {
+                    return "Out of memory growing map";
+                }
+                vm_write_barrier(vm, owner, value);
+            }
+            return NULL;
+        }
+
+        default:
+            return "Corrupt message";
+    }
+
+    vm_push(vm, val);
+    return NULL;
+}
+
+/* Push the message's value onto vm's stack. On error the stack is reset
+ * to where it was. */
+static const char* msg_receive(VM *vm, const VMMessage *msg) {
+    MsgReader r = {msg->data, msg->size, 0};
+    int sp = vm->sp;
+    const char *error = msg_decode(vm, &r);
+    if (!error && vm->sp != sp + 1) error = "Corrupt message";
+    if (error) vm->sp = sp;
+    return error;
+}
+
+/* Channels */
+
+static VMChannel* chan_new(int capacity) {
+    size_t size = 2;
+    while (size < (size_t)capacity) size *= 2;
+
+    VMChannel *ch = (VMChannel*)calloc(1, sizeof(VMChannel));
+    if (!ch) return NULL;
+    ch->cells = (VMChanCell*)calloc(size, sizeof(VMChanCell));
+    if (!ch->cells) {
+        free(ch);
+        return NULL;
+    }
+    for (size_t i = 0; i < size; i++) {
+        ch->cells[i].seq = i;
+    }
+    ch->mask = size - 1;
+    return ch;
+}
+
+static void chan_free(VMChannel *ch) {
+    if (!ch) return;
+    for (size_t i = 0; i <= ch->mask; i++) {
+        free(ch->cells[i].msg.data);
+    }
+    free(ch->cells);
+    free(ch);
+}
+
+/* 1 if a send would find no free slot right now (a cheap pre-check, so
+ * a blocked sender does not encode its value on every retry) */
+static int chan_full(VMChannel *ch) {
+    size_t pos = __atomic_load_n(&ch->head, __ATOMIC_RELAXED);
+    size_t seq = __atomic_load_n(&ch->cells[pos & ch->mask].seq, __ATOMIC_ACQUIRE);
+    return (intptr_t)seq - (intptr_t)pos < 0;
+}
+
+/* Returns 0 if the channel is full (msg is left to the caller) */
+static int chan_try_send(VMChannel *ch, VMMessage *msg) {
+    size_t pos = __atomic_load_n(&ch->head, __ATOMIC_RELAXED);
+    VMChanCell *cell;
+
+    for (;;) {
+        cell = &ch->cells[pos & ch->mask];
+        size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ch->head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = __atomic_load_n(&ch->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->msg = *msg;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/* Returns 0 if the channel is empty */
+static int chan_try_recv(VMChannel *ch, VMMessage *msg) {
+    size_t pos = __atomic_load_n(&ch->tail, __ATOMIC_RELAXED);
+    VMChanCell *cell;
+
+    for (;;) {
+        cell = &ch->cells[pos & ch->mask];
+        size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ch->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = __atomic_load_n(&ch->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    *msg = cell->msg;
+    cell->msg.data = NULL;
+    __atomic_store_n(&cell->seq, pos + ch->mask + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/* Isolate group */
+
+static VMIsolateGroup* iso_group(VM *vm) {
+    if (vm->isolates) return vm->isolates;
+
+    VMIsolateGroup *g = (VMIsolateGroup*)calloc(1, sizeof(VMIsolateGroup));
+    if (!g) return NULL;
+    pthread_mutex_init(&g->lock, NULL);
+    g->root = vm;
+    vm->isolates = g;
+    return g;
+}
+
+VM* vm_isolate_root(VMIsolateGroup *group) {
+    return group ? group->root : NULL;
+}
+
+static int iso_shutdown(VMIsolateGroup *g) {
+    return __atomic_load_n(&g->shutdown, __ATOMIC_ACQUIRE);
+}
+
+/* Channel behind a handle, or NULL after reporting the error */
+static VMChannel* chan_lookup(VM *vm, Value handle) {
+    VMIsolateGroup *g = vm->isolates;
+    if (handle.type == VAL_INT && g) {
+        int count = __atomic_load_n(&g->channel_count, __ATOMIC_ACQUIRE);
+        int index = handle.as.int_val - 1;
+        if (index >= 0 && index < count) return g->channels[index];
+    }
+    vm_runtime_error(vm, "Not a channel");
+    return NULL;
+}
+
+/* The channel at 'pc' cannot proceed: retry the instruction later. Other
+ * fibers of this VM run meanwhile; the first rounds only yield the
+ * thread, later ones sleep for exponentially longer (up to 1 ms).
+ * Returns 0 if the program is shutting down. */
+static int chan_wait(VM *vm, int pc) {
+    if (iso_shutdown(vm->isolates)) return 0;
+
+    vm->ip = pc;
+    int round = vm->chan_backoff++;
+    if (round < CHAN_SPIN_ROUNDS) {
+        vm_fiber_wait(vm, pc, 0);
+        sched_yield();
+    } else {
+        double delay = 1e-6 * (double)(1 << (round - CHAN_SPIN_ROUNDS < 10 ? round - CHAN_SPIN_ROUNDS : 10));
+        vm_fiber_wait(vm, pc, delay < CHAN_MAX_SLEEP ? delay : CHAN_MAX_SLEEP);
+    }
+    return 1;
+}
+
+int vm_chan_new(VM *vm) {
+    Value capacity = vm_pop(vm);
+    if (capacity.type != VAL_INT || capacity.as.int_val > CHAN_MAX_CAPACITY) {
+        vm_runtime_error(vm, "Invalid channel capacity");
+        return 0;
+    }
+
+    VMIsolateGroup *g = iso_group(vm);
+    VMChannel *ch = g ? chan_new(capacity.as.int_val) : NULL;
+    if (!ch) {
+        vm_runtime_error(vm, "Out of memory creating a channel");
+        return 0;
+    }
+
+    pthread_mutex_lock(&g->lock);
+    int index = g->channel_count;
+    if (index < ISO_MAX_CHANNELS) {
+        g->channels[index] = ch;
+        __atomic_store_n(&g->channel_count, index + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&g->lock);
+
+    if (index >= ISO_MAX_CHANNELS) {
+        chan_free(ch);
+        vm_runtime_error(vm, "Too many channels (max %d)", ISO_MAX_CHANNELS);
+        return 0;
+    }
+
+    Value handle = {VAL_INT, {.int_val = index + 1}};
+    vm_push(vm, handle);
+    return 1;
+}
+
+int vm_chan_send(VM *vm, int pc) {
+    VMChannel *ch = chan_lookup(vm, vm_peek(vm, 1));
+    if (!ch) return 0;
+    if (__atomic_load_n(&ch->closed, __ATOMIC_ACQUIRE)) {
+        vm_runtime_error(vm, "Send on a closed channel");
+        return 0;
+    }
+    if (chan_full(ch)) return chan_wait(vm, pc);
+
+    VMMessage msg;
+    const char *error = msg_make(vm, vm_peek(vm, 0), &msg);
+    if (error) {
+        vm_runtime_error(vm, "%s", error);
+        return 0;
+    }
+    if (!chan_try_send(ch, &msg)) {
+        free(msg.data);
+        return chan_wait(vm, pc);
+    }
+
+    vm->sp -= 2;
+    vm->chan_backoff = 0;
+    __atomic_fetch_add(&vm->isolates->messages, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+int vm_chan_recv(VM *vm, int pc) {
+    VMChannel *ch = chan_lookup(vm, vm_peek(vm, 0));
+    if (!ch) return 0;
+
+    VMMessage msg;
+    int got = chan_try_recv(ch, &msg);
+    if (!got && __atomic_load_n(&ch->closed, __ATOMIC_ACQUIRE)) {
+        // Closed: anything sent before the close is visible now
+        got = chan_try_recv(ch, &msg);
+        if (!got) {
+            vm->stack[vm->sp].type = VAL_INT;
+            vm->stack[vm->sp].as.int_val = 0;
+            vm->chan_backoff = 0;
+            return 1;
+        }
+    }
+    if (!got) return chan_wait(vm, pc);
+
+    vm->sp--;
+    const char *error = msg_receive(vm, &msg);
+    free(msg.data);
+    if (error) {
+        vm_runtime_error(vm, "%s", error);
+        return 0;
+    }
+    vm->chan_backoff = 0;
+    return 1;
+}
+
+int vm_chan_close(VM *vm) {
+    VMChannel *ch = chan_lookup(vm, vm_pop(vm));
+    if (!ch) return 0;
+    __atomic_store_n(&ch->closed, 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/* Isolates */
+
+static void* iso_thread(void *arg) {
+    VMIsolate *iso = (VMIsolate*)arg;
+    VM *vm = iso->vm;
+
+    if (vm->jit) {
+        vm_jit_run(vm->jit, vm);
+    } else {
+        while (vm->ip < vm->code_size && vm_execute_instruction(vm)) { }
+    }
+
+    // A clean finish stops right after the block's FIBER_EXIT (or a HALT)
+    int pc = vm->ip - 1;
+    iso->finished = pc >= 0 && pc < vm->code_size &&
+                    (vm->code[pc].code == OP_FIBER_EXIT || vm->code[pc].code == OP_HALT);
+    if (!iso->finished) {
+        // Nobody may be left to drain or fill the channels this one used
+        __atomic_store_n(&vm->isolates->shutdown, 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/* Copy a live local of 'src' onto the stack of 'dst' */
+static const char* iso_copy_value(VM *src, VM *dst, Value val) {
+    if (val.type == VAL_STRING) {
+        int id = vm_add_string(dst, vm_get_string(src, val.as.string_id));
+        if (id < 0) return "String pool full";
+        val.as.string_id = id;
+    } else if (val.type == VAL_HEAP_PTR) {
+        VMMessage msg;
+        const char *error = msg_make(src, val, &msg);
+        if (!error) error = msg_receive(dst, &msg);
+        free(msg.data);
+        return error;
+    }
+    vm_push(dst, val);
+    return NULL;
+}
+
+/* A VM that runs src's program from 'target'. pc is the ISOLATE. */
+static VM* iso_create(VM *src, VMIsolateGroup *g, int target, int pc, const char **error) {
+    VM *vm = (VM*)malloc(sizeof(VM));
+    if (!vm) {
+        *error = "Out of memory starting an isolate";
+        return NULL;
+    }
+    vm_init(vm);
+    vm_share_program(vm, src);
+
+    vm->gc_max_pause_us = src->gc_max_pause_us;
+    vm->gc_slice_objects = src->gc_slice_objects;
+    vm->gc_threads = src->gc_threads;
+    vm->heap_limit = src->heap_limit;
+    vm->par_threads = src->par_threads;
+    vm->debug_mode = src->debug_mode;
+    vm->jit = src->jit;
+    vm->isolates = g;
+    vm->current_line = src->current_line;
+    vm->out = src->out;
+    vm->in = src->in;
+    vm->err = src->err;
+
+    // While the locals are copied, collections use the ISOLATE's stack map
+    vm->ip = pc + 1;
+    const uint32_t *live = vm_find_stack_map(src, pc);
+    *error = NULL;
+    for (int i = 0; i < src->local_count && !*error; i++) {
+        Value val = src->stack[i];
+        if (live && !(live[i / 32] & (1u << (i % 32)))) {
+            val.type = VAL_INT;
+            val.as.int_val = 0;
+        }
+        *error = iso_copy_value(src, vm, val);
+    }
+    if (*error) {
+        vm_free(vm);
+        free(vm);
+        return NULL;
+    }
+
+    vm->ip = target;
+    return vm;
+}
+
+int vm_isolate_start(VM *vm, int target, int pc) {
+    VMIsolateGroup *g = iso_group(vm);
+    VMIsolate *iso = g ? (VMIsolate*)calloc(1, sizeof(VMIsolate)) : NULL;
+    if (!iso) {
+        vm_runtime_error(vm, "Out of memory starting an isolate");
+        return 0;
+    }
+
+    const char *error = NULL;
+    iso->vm = iso_create(vm, g, target, pc, &error);
+    if (!iso->vm) {
+        free(iso);
+        vm_runtime_error(vm, "%s", error);
+        return 0;
+    }
+
+    pthread_mutex_lock(&g->lock);
+    int registered = 0;
+    if (g->isolate_count >= g->isolate_capacity) {
+        int capacity = g->isolate_capacity ? g->isolate_capacity * 2 : 8;
+        VMIsolate **grown = (VMIsolate**)realloc(g->isolates, sizeof(VMIsolate*) * capacity);
+        if (grown) {
+            g->isolates = grown;
+            g->isolate_capacity = capacity;
+        }
+    }
+    if (g->isolate_count < g->isolate_capacity &&
+        pthread_create(&iso->thread, NULL, iso_thread, iso) == 0) {
+        g->isolates[g->isolate_count++] = iso;
+        g->started++;
+        registered = 1;
+    }
+    pthread_mutex_unlock(&g->lock);
+
+    if (!registered) {
+        vm_free(iso->vm);
+        free(iso->vm);
+        free(iso);
+        vm_runtime_error(vm, "Could not start an isolate thread");
+        return 0;
+    }
+    return 1;
+}
+
+/* Join isolates until none are left; ones started meanwhile (by the
+ * isolates being joined) are picked up too */
+static void iso_join_all(VMIsolateGroup *g) {
+    for (;;) {
+        pthread_mutex_lock(&g->lock);
+        VMIsolate *iso = g->joined < g->isolate_count ? g->isolates[g->joined++] : NULL;
+        pthread_mutex_unlock(&g->lock);
+        if (!iso) break;
+
+        pthread_join(iso->thread, NULL);
+        g->instructions += iso->vm->instruction_count;
+        g->root->error_count += iso->vm->error_count;
+        vm_free(iso->vm);
+        free(iso->vm);
+        free(iso);
+    }
+}
+
+void vm_isolate_join(VM *vm) {
+    if (!vm->isolates || vm->isolates->root != vm) return;
+    fflush(vm->out);
+    iso_join_all(vm->isolates);
+}
+
+void vm_isolate_free(VMIsolateGroup *group) {
+    if (!group) return;
+
+    // Blocked isolates give up instead of waiting for a dead program
+    __atomic_store_n(&group->shutdown, 1, __ATOMIC_RELEASE);
+    iso_join_all(group);
+
+    for (int i = 0; i < group->channel_count; i++) {
+        chan_free(group->channels[i]);
+    }
+    free(group->isolates);
+    pthread_mutex_destroy(&group->lock);
+    free(group);
+}
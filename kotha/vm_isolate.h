@@ -0,0 +1,94 @@
+/*
+ * Kotha VM Isolates Header
+ * isolate { ... } runs a block on its own OS thread in a separate VM;
+ * isolates talk only through bounded lock-free channels
+ */
+
+#ifndef VM_ISOLATE_H
+#define VM_ISOLATE_H
+
+#include "vm.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define ISO_MAX_CHANNELS 256
+#define CHAN_MAX_CAPACITY (1 << 16)
+#define CHAN_CACHE_LINE 64
+
+/* Encoded message: a self-contained copy of a value (strings, arrays and
+ * maps included), so it can be decoded into any VM's heap */
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} VMMessage;
+
+/* Ring slot. seq tells producers and consumers whose turn the slot is. */
+typedef struct {
+    size_t seq;              // Atomic
+    VMMessage msg;
+} VMChanCell;
+
+/* Bounded MPMC queue (Vyukov): any number of isolates may send and
+ * receive. head and tail live on separate cache lines. */
+typedef struct VMChannel {
+    VMChanCell *cells;
+    size_t mask;             // Capacity - 1 (capacity is a power of two >= 2)
+    char pad0[CHAN_CACHE_LINE];
+    size_t head;             // Next slot to fill (atomic)
+    char pad1[CHAN_CACHE_LINE - sizeof(size_t)];
+    size_t tail;             // Next slot to drain (atomic)
+    char pad2[CHAN_CACHE_LINE - sizeof(size_t)];
+    int closed;              // Atomic; receivers drain what is left, then get 0
+} VMChannel;
+
+/* One started isolate */
+typedef struct {
+    VM *vm;                  // Own heap, stack and string pool; shared bytecode
+    pthread_t thread;
+    int finished;            // Reached the end of its block (vs. a runtime error)
+} VMIsolate;
+
+/* Every VM of a program shares one group, owned by the VM that started
+ * the first isolate or created the first channel */
+typedef struct VMIsolateGroup {
+    VM *root;
+    pthread_mutex_t lock;    // Channel creation and the isolate list
+
+    VMChannel *channels[ISO_MAX_CHANNELS];
+    int channel_count;       // Atomic; channels[0..count) are published
+
+    VMIsolate **isolates;
+    int isolate_count;
+    int isolate_capacity;
+    int joined;              // isolates[0..joined) have been joined and freed
+    int shutdown;            // Atomic; an isolate failed or the program ended
+
+    // Statistics
+    int started;
+    long long messages;      // Atomic
+    long long instructions;  // Executed by joined isolates
+} VMIsolateGroup;
+
+/* OP_ISOLATE at 'pc': start a VM on a new thread at 'target' with copies of
+ * the live locals. Returns 0 (after reporting the error) on failure. */
+int vm_isolate_start(VM *vm, int target, int pc);
+
+/* OP_HALT / end of the program: the group's root waits for every isolate,
+ * including ones started by other isolates. No-op in other VMs. */
+void vm_isolate_join(VM *vm);
+
+VM* vm_isolate_root(VMIsolateGroup *group);
+
+/* Channel instructions at 'pc'. They return 0 to stop the VM (error or
+ * shutdown) and 1 otherwise; a full or empty channel makes the VM retry
+ * the instruction after backing off (other fibers run meanwhile). */
+int vm_chan_new(VM *vm);
+int vm_chan_send(VM *vm, int pc);
+int vm_chan_recv(VM *vm, int pc);
+int vm_chan_close(VM *vm);
+
+/* Joins any remaining isolates and frees channels and messages */
+void vm_isolate_free(VMIsolateGroup *group);
+
+#endif /* VM_ISOLATE_H */
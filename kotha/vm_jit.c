@@ -0,0 +1,582 @@
+/*
+ * Kotha VM Baseline JIT
+ * Each bytecode instruction is translated one-to-one into a fixed machine
+ * code template. Integer arithmetic, comparisons, locals and jumps get
+ * inline fast paths guarded on VAL_INT operands and stack bounds; when a
+ * guard fails, or for instructions without a template, the code calls
+ * back into the interpreter for that one instruction.
+ *
+ * Compiled code keeps no values in registers between instructions: the
+ * operand stack stays in vm->stack, so the GC (which only runs inside
+ * interpreter fallbacks) sees exactly what the interpreter would. Fiber
+ * switches also happen in fallbacks; they reload vm->stack and ip, and
+ * compiled code carries on at the new ip.
+ *
+ * Register use (all callee-saved, so helpers preserve them):
+ *   rbx = VM*   r12 = &vm->stack[0]   r13 = sp   r14 = fp
+ */
+
+#include "vm_jit.h"
+#include "vm_mem.h"
+#include "vm_perf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+
+/* Assembly buffer */
+typedef struct {
+    uint8_t *bytes;
+    size_t len;
+    size_t capacity;
+    int failed;
+} JitBuf;
+
+/* rel32 operands patched once every address is known */
+typedef enum {
+    JIT_TO_PC,               // Entry of a pc
+    JIT_TO_SLOW,             // Interpreter fallback stub of a pc
+    JIT_TO_EPILOGUE
+} JitTarget;
+
+typedef struct {
+    size_t pos;              // Offset of the rel32
+    JitTarget kind;
+    int pc;
+} JitFixup;
+
+typedef struct {
+    VM *vm;
+    JitBuf buf;
+    size_t *pc_offset;       // code_size + 1 entries
+    size_t *slow_offset;     // (size_t)-1 if the pc has no stub
+    int *needs_slow;
+    JitFixup *fixups;
+    int fixup_count;
+    int fixup_capacity;
+    size_t epilogue;
+} JitCompiler;
+
+/* Value layout: type in the first word, payload in the second */
+#define SLOT_SIZE    ((int)sizeof(Value))
+#define TYPE_OFFSET  ((int)offsetof(Value, type))
+#define VALUE_OFFSET ((int)offsetof(Value, as))
+
+#define VM_OFFSET(field) ((int32_t)offsetof(VM, field))
+
+/* x86 condition codes (low nibble of Jcc / SETcc) */
+#define CC_E  0x4
+#define CC_NE 0x5
+#define CC_S  0x8
+#define CC_L  0xC
+#define CC_GE 0xD
+#define CC_LE 0xE
+#define CC_G  0xF
+
+#define REG_EAX 0
+#define REG_ECX 1
+#define REG_EDX 2
+
+static void emit(JitBuf *b, const void *data, size_t n) {
+    if (b->failed) return;
+
+    if (b->len + n > b->capacity) {
+        size_t capacity = b->capacity ? b->capacity * 2 : 4096;
+        while (capacity < b->len + n) capacity *= 2;
+        uint8_t *bytes = (uint8_t*)realloc(b->bytes, capacity);
+        if (!bytes) {
+            b->failed = 1;
+            return;
+        }
+        b->bytes = bytes;
+        b->capacity = capacity;
+    }
+    memcpy(b->bytes + b->len, data, n);
+    b->len += n;
+}
+
+static void emit8(JitBuf *b, uint8_t v) {
+    emit(b, &v, 1);
+}
+
+static void emit32(JitBuf *b, int32_t v) {
+    emit(b, &v, 4);
+}
+
+static void emit64(JitBuf *b, uint64_t v) {
+    emit(b, &v, 8);
+}
+
+#define EMIT_BYTES(b, ...) do { \
+    static const uint8_t bytes_[] = {__VA_ARGS__}; \
+    emit((b), bytes_, sizeof(bytes_)); \
+} while (0)
+
+/* rel32 to a target resolved later */
+static void emit_rel32(JitCompiler *c, JitTarget kind, int pc) {
+    if (c->fixup_count >= c->fixup_capacity) {
+        int capacity = c->fixup_capacity ? c->fixup_capacity * 2 : 256;
+        JitFixup *fixups = (JitFixup*)realloc(c->fixups, sizeof(JitFixup) * capacity);
+        if (!fixups) {
+            c->buf.failed = 1;
+            return;
+        }
+        c->fixups = fixups;
+        c->fixup_capacity = capacity;
+    }
+
+    JitFixup *f = &c->fixups[c->fixup_count++];
+    f->pos = c->buf.len;
+    f->kind = kind;
+    f->pc = pc;
+    emit32(&c->buf, 0);
+}
+
+static void emit_jmp(JitCompiler *c, JitTarget kind, int pc) {
+    emit8(&c->buf, 0xE9);
+    emit_rel32(c, kind, pc);
+}
+
+static void emit_jcc(JitCompiler *c, int cc, JitTarget kind, int pc) {
+    emit8(&c->buf, 0x0F);
+    emit8(&c->buf, 0x80 | cc);
+    emit_rel32(c, kind, pc);
+    if (kind == JIT_TO_SLOW) c->needs_slow[pc] = 1;
+}
+
+/* op reg, [r12 + r13*8 + disp] ; 'wide' selects 64-bit operands */
+static void emit_slot_op(JitBuf *b, const uint8_t *opcode, int oplen, int reg, int disp, int wide) {
+    emit8(b, 0x43 | (wide ? 0x08 : 0));  // REX.X (r13) + REX.B (r12)
+    emit(b, opcode, oplen);
+    emit8(b, 0x84 | (reg << 3));         // mod=10 (disp32), rm=SIB
+    emit8(b, 0xEC);                      // scale 8, index r13, base r12
+    emit32(b, disp);
+}
+
+/* Slot displacements relative to the top of the stack */
+#define TOP(n)       ((n) * SLOT_SIZE)
+#define TYPE_AT(n)   (TOP(n) + TYPE_OFFSET)
+#define VALUE_AT(n)  (TOP(n) + VALUE_OFFSET)
+
+static void emit_load32(JitBuf *b, int reg, int disp) {
+    static const uint8_t op[] = {0x8B};
+    emit_slot_op(b, op, 1, reg, disp, 0);
+}
+
+static void emit_store32(JitBuf *b, int reg, int disp) {
+    static const uint8_t op[] = {0x89};
+    emit_slot_op(b, op, 1, reg, disp, 0);
+}
+
+static void emit_store_imm32(JitBuf *b, int disp, int32_t imm) {
+    static const uint8_t op[] = {0xC7};
+    emit_slot_op(b, op, 1, 0, disp, 0);
+    emit32(b, imm);
+}
+
+/* Guard: both top slots hold VAL_INT */
+static void emit_guard_ints(JitCompiler *c, int pc, int count) {
+    static const uint8_t cmp_imm8[] = {0x83};
+
+    // cmp r13, count - 1 ; jl slow (not enough operands)
+    EMIT_BYTES(&c->buf, 0x49, 0x81, 0xFD);
+    emit32(&c->buf, count - 1);
+    emit_jcc(c, CC_L, JIT_TO_SLOW, pc);
+
+    for (int i = 0; i < count; i++) {
+        emit_slot_op(&c->buf, cmp_imm8, 1, 7, TYPE_AT(-i), 0);  // cmp dword [slot], VAL_INT
+        emit8(&c->buf, VAL_INT);
+        emit_jcc(c, CC_NE, JIT_TO_SLOW, pc);
+    }
+}
+
+/* Guard: room for one more push */
+static void emit_guard_push(JitCompiler *c, int pc) {
+    EMIT_BYTES(&c->buf, 0x49, 0x81, 0xFD);  // cmp r13, MAX_STACK - 1
+    emit32(&c->buf, MAX_STACK - 1);
+    emit_jcc(c, CC_GE, JIT_TO_SLOW, pc);
+}
+
+/* Guard: at least one value on the stack */
+static void emit_guard_pop(JitCompiler *c, int pc) {
+    EMIT_BYTES(&c->buf, 0x4D, 0x85, 0xED);  // test r13, r13
+    emit_jcc(c, CC_S, JIT_TO_SLOW, pc);
+}
+
+#define EMIT_INC_SP(b) EMIT_BYTES((b), 0x49, 0xFF, 0xC5)
+#define EMIT_DEC_SP(b) EMIT_BYTES((b), 0x49, 0xFF, 0xCD)
+
+/* Run one instruction in the interpreter. Returns JIT_NEXT when it simply
+ * fell through, JIT_EXIT_RESUME when it moved ip elsewhere, or
+ * JIT_EXIT_HALT when the program stopped. */
+static int jit_interpret(VM *vm, int pc) {
+    vm->ip = pc;
+    if (!vm_execute_instruction(vm)) return JIT_EXIT_HALT;
+    return vm->ip == pc + 1 ? JIT_NEXT : JIT_EXIT_RESUME;
+}
+
+/* Spill sp, call jit_interpret(vm, pc), reload sp and fp; eax = exit code */
+static void emit_interpret_call(JitCompiler *c, int pc) {
+    JitBuf *b = &c->buf;
+
+    EMIT_BYTES(b, 0x44, 0x89, 0xAB);        // mov [rbx + sp], r13d
+    emit32(b, VM_OFFSET(sp));
+    EMIT_BYTES(b, 0x48, 0x89, 0xDF);        // mov rdi, rbx
+    emit8(b, 0xBE);                         // mov esi, pc
+    emit32(b, pc);
+    EMIT_BYTES(b, 0x48, 0xB8);              // mov rax, jit_interpret
+    emit64(b, (uint64_t)(uintptr_t)jit_interpret);
+    EMIT_BYTES(b, 0xFF, 0xD0);              // call rax
+    EMIT_BYTES(b, 0x4C, 0x63, 0xAB);        // movsxd r13, [rbx + sp]
+    emit32(b, VM_OFFSET(sp));
+    EMIT_BYTES(b, 0x4C, 0x63, 0xB3);        // movsxd r14, [rbx + fp]
+    emit32(b, VM_OFFSET(fp));
+    EMIT_BYTES(b, 0x83, 0xF8, JIT_NEXT);    // cmp eax, JIT_NEXT
+}
+
+/* Leave compiled code at a fixed ip */
+static void emit_exit(JitCompiler *c, int ip, int code) {
+    EMIT_BYTES(&c->buf, 0xC7, 0x83);        // mov dword [rbx + ip], imm32
+    emit32(&c->buf, VM_OFFSET(ip));
+    emit32(&c->buf, ip);
+    emit8(&c->buf, 0xB8);                   // mov eax, code
+    emit32(&c->buf, code);
+    emit_jmp(c, JIT_TO_EPILOGUE, 0);
+}
+
+static int jump_target_ok(VM *vm, int target) {
+    return target >= 0 && target <= vm->code_size;
+}
+
+/* Integer ALU ops: a = top(-1), b = top(0), result replaces a */
+static void emit_int_binary(JitCompiler *c, int pc, OpCode op) {
+    JitBuf *b = &c->buf;
+
+    emit_guard_ints(c, pc, 2);
+    emit_load32(b, REG_EAX, VALUE_AT(-1));
+
+    if (op == OP_DIV || op == OP_MOD) {
+        emit_load32(b, REG_ECX, VALUE_AT(0));
+        EMIT_BYTES(b, 0x85, 0xC9);              // test ecx, ecx (zero: error path)
+        emit_jcc(c, CC_E, JIT_TO_SLOW, pc);
+        EMIT_BYTES(b, 0x83, 0xF9, 0xFF);        // cmp ecx, -1 (INT_MIN / -1 traps)
+        emit_jcc(c, CC_E, JIT_TO_SLOW, pc);
+        EMIT_BYTES(b, 0x99, 0xF7, 0xF9);        // cdq ; idiv ecx
+        emit_store32(b, op == OP_DIV ? REG_EAX : REG_EDX, VALUE_AT(-1));
+    } else {
+        static const uint8_t add[] = {0x03}, sub[] = {0x2B}, imul[] = {0x0F, 0xAF}, cmp[] = {0x3B};
+
+        switch (op) {
+            case OP_ADD: emit_slot_op(b, add, 1, REG_EAX, VALUE_AT(0), 0); break;
+            case OP_SUB: emit_slot_op(b, sub, 1, REG_EAX, VALUE_AT(0), 0); break;
+            case OP_MUL: emit_slot_op(b, imul, 2, REG_EAX, VALUE_AT(0), 0); break;
+            default: {
+                int cc = op == OP_EQ ? CC_E : op == OP_LT ? CC_L : CC_G;
+                emit_slot_op(b, cmp, 1, REG_EAX, VALUE_AT(0), 0);
+                EMIT_BYTES(b, 0x0F);
+                emit8(b, 0x90 | cc);                // setcc al
+                emit8(b, 0xC0);
+                EMIT_BYTES(b, 0x0F, 0xB6, 0xC0);    // movzx eax, al
+                break;
+            }
+        }
+        emit_store32(b, REG_EAX, VALUE_AT(-1));
+    }
+    EMIT_DEC_SP(b);
+}
+
+/* Translate one instruction. Returns 1 if it got an inline template. */
+static int emit_instruction(JitCompiler *c, int pc) {
+    VM *vm = c->vm;
+    JitBuf *b = &c->buf;
+    Instruction instr = vm->code[pc];
+
+    // Keep error reports pointing at the right source line (fallbacks set
+    // it themselves, so inline code only stores it where it changes)
+    if (instr.line > 0 && (pc == 0 || vm->code[pc - 1].line != instr.line)) {
+        EMIT_BYTES(b, 0xC7, 0x83);                  // mov dword [rbx + current_line], line
+        emit32(b, VM_OFFSET(current_line));
+        emit32(b, instr.line);
+    }
+
+    switch (instr.code) {
+        case OP_NOP:
+            return 1;
+
+        case OP_HALT:
+            break;  // Interpreted: another fiber may still be runnable
+
+        case OP_LINE:
+            EMIT_BYTES(b, 0xC7, 0x83);              // mov dword [rbx + current_line], arg
+            emit32(b, VM_OFFSET(current_line));
+            emit32(b, instr.arg);
+            return 1;
+
+        case OP_PUSH:
+            emit_guard_push(c, pc);
+            emit_store_imm32(b, TYPE_AT(1), VAL_INT);
+            emit_store_imm32(b, VALUE_AT(1), instr.arg);
+            EMIT_INC_SP(b);
+            return 1;
+
+        case OP_POP:
+            emit_guard_pop(c, pc);
+            EMIT_DEC_SP(b);
+            return 1;
+
+        case OP_DUP: {
+            static const uint8_t load[] = {0x8B}, store[] = {0x89};
+            emit_guard_pop(c, pc);
+            emit_guard_push(c, pc);
+            emit_slot_op(b, load, 1, REG_EAX, TOP(0), 1);   // mov rax, [top]
+            emit_slot_op(b, store, 1, REG_EAX, TOP(1), 1);  // mov [top + 1], rax
+            EMIT_INC_SP(b);
+            return 1;
+        }
+
+        case OP_LOAD_LOCAL: {
+            if (instr.arg < 0) break;
+            static const uint8_t store[] = {0x89};
+            EMIT_BYTES(b, 0x49, 0x8D, 0x8E);        // lea rcx, [r14 + arg]
+            emit32(b, instr.arg);
+            EMIT_BYTES(b, 0x4C, 0x39, 0xE9);        // cmp rcx, r13
+            emit_jcc(c, CC_G, JIT_TO_SLOW, pc);     // Unset local: interpreter pushes 0
+            emit_guard_push(c, pc);
+            EMIT_BYTES(b, 0x49, 0x8B, 0x04, 0xCC);  // mov rax, [r12 + rcx*8]
+            emit_slot_op(b, store, 1, REG_EAX, TOP(1), 1);
+            EMIT_INC_SP(b);
+            return 1;
+        }
+
+        case OP_STORE_LOCAL: {
+            if (instr.arg < 0) break;
+            static const uint8_t load[] = {0x8B};
+            EMIT_BYTES(b, 0x49, 0x8D, 0x8E);        // lea rcx, [r14 + arg]
+            emit32(b, instr.arg);
+            EMIT_BYTES(b, 0x4C, 0x39, 0xE9);        // cmp rcx, r13
+            emit_jcc(c, CC_GE, JIT_TO_SLOW, pc);    // Slot above the operand: stack grows
+            emit_slot_op(b, load, 1, REG_EAX, TOP(0), 1);
+            EMIT_BYTES(b, 0x49, 0x89, 0x04, 0xCC);  // mov [r12 + rcx*8], rax
+            EMIT_DEC_SP(b);
+            return 1;
+        }
+
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_MOD:
+        case OP_EQ:
+        case OP_LT:
+        case OP_GT:
+            emit_int_binary(c, pc, instr.code);
+            return 1;
+
+        case OP_JMP:
+            if (!jump_target_ok(vm, instr.arg)) break;
+            emit_jmp(c, JIT_TO_PC, instr.arg);
+            return 1;
+
+        case OP_JMP_FALSE:
+            if (!jump_target_ok(vm, instr.arg)) break;
+            emit_guard_pop(c, pc);
+            emit_load32(b, REG_EAX, TYPE_AT(0));
+            emit_load32(b, REG_ECX, VALUE_AT(0));
+            EMIT_DEC_SP(b);
+            EMIT_BYTES(b, 0x85, 0xC0);              // test eax, eax (VAL_INT)
+            emit_jcc(c, CC_NE, JIT_TO_PC, pc + 1);
+            EMIT_BYTES(b, 0x85, 0xC9);              // test ecx, ecx
+            emit_jcc(c, CC_E, JIT_TO_PC, instr.arg);
+            return 1;
+
+        default:
+            break;
+    }
+
+    // No template: the interpreter runs it, then we continue or leave
+    emit_interpret_call(c, pc);
+    emit_jcc(c, CC_NE, JIT_TO_EPILOGUE, 0);
+    return 0;
+}
+
+static void jit_compiler_free(JitCompiler *c) {
+    free(c->buf.bytes);
+    free(c->pc_offset);
+    free(c->slow_offset);
+    free(c->needs_slow);
+    free(c->fixups);
+}
+
+/* Name each Kotha function's code for perf, with a pc -> line table */
+static void jit_perf_register(VM *vm, VMJit *jit, const size_t *pc_offset, size_t code_len) {
+    VMPerfRegion *regions;
+    int count = vm_perf_regions(vm, &regions);
+    VMPerfLine *lines = (VMPerfLine*)malloc(sizeof(VMPerfLine) * (vm->code_size + 1));
+    char name[96];
+
+    vm_perf_code_load("kotha_jit::<entry>", jit->code, pc_offset[0], NULL, 0);
+    for (int i = 0; i < count && lines; i++) {
+        int line_count = 0, last = -1;
+        for (int pc = regions[i].start_pc; pc < regions[i].end_pc; pc++) {
+            int line = vm->code[pc].line;
+            if (line <= 0 || line == last) continue;
+            lines[line_count].addr = jit->code + pc_offset[pc];
+            lines[line_count++].line = last = line;
+        }
+        snprintf(name, sizeof(name), "kotha_jit::%s", regions[i].name);
+        vm_perf_code_load(name, jit->code + pc_offset[regions[i].start_pc],
+                          pc_offset[regions[i].end_pc] - pc_offset[regions[i].start_pc],
+                          lines, line_count);
+    }
+    vm_perf_code_load("kotha_jit::<slow paths>", jit->code + pc_offset[vm->code_size],
+                      code_len - pc_offset[vm->code_size], NULL, 0);
+
+    free(lines);
+    free(regions);
+}
+
+int vm_jit_supported(void) {
+    return 1;
+}
+
+VMJit* vm_jit_compile(VM *vm) {
+    if (!vm) return NULL;
+
+    JitCompiler c;
+    memset(&c, 0, sizeof(c));
+    c.vm = vm;
+    c.pc_offset = (size_t*)calloc(vm->code_size + 1, sizeof(size_t));
+    c.slow_offset = (size_t*)calloc(vm->code_size + 1, sizeof(size_t));
+    c.needs_slow = (int*)calloc(vm->code_size + 1, sizeof(int));
+
+    VMJit *jit = (VMJit*)calloc(1, sizeof(VMJit));
+    if (!jit || !c.pc_offset || !c.slow_offset || !c.needs_slow) {
+        free(jit);
+        jit_compiler_free(&c);
+        return NULL;
+    }
+
+    JitBuf *b = &c.buf;
+
+    // Prologue: int enter(VM *vm, void *target)
+    EMIT_BYTES(b, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57);  // push rbx, r12-r15
+    EMIT_BYTES(b, 0x48, 0x89, 0xFB);        // mov rbx, rdi
+    EMIT_BYTES(b, 0x4C, 0x8D, 0xA7);        // lea r12, [rdi + stack]
+    emit32(b, VM_OFFSET(stack));
+    EMIT_BYTES(b, 0x4C, 0x63, 0xAB);        // movsxd r13, [rbx + sp]
+    emit32(b, VM_OFFSET(sp));
+    EMIT_BYTES(b, 0x4C, 0x63, 0xB3);        // movsxd r14, [rbx + fp]
+    emit32(b, VM_OFFSET(fp));
+    EMIT_BYTES(b, 0xFF, 0xE6);              // jmp rsi
+
+    // Epilogue: write sp back, eax holds the exit code
+    c.epilogue = b->len;
+    EMIT_BYTES(b, 0x44, 0x89, 0xAB);        // mov [rbx + sp], r13d
+    emit32(b, VM_OFFSET(sp));
+    EMIT_BYTES(b, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3);  // pop ...; ret
+
+    // One template per instruction, in program order (functions included)
+    for (int pc = 0; pc < vm->code_size; pc++) {
+        c.pc_offset[pc] = b->len;
+        if (emit_instruction(&c, pc)) {
+            jit->fast_count++;
+        } else {
+            jit->fallback_count++;
+        }
+    }
+
+    // Falling off the end halts, like vm_run
+    c.pc_offset[vm->code_size] = b->len;
+    emit_exit(&c, vm->code_size, JIT_EXIT_HALT);
+
+    // Out-of-line fallbacks for failed guards
+    for (int pc = 0; pc < vm->code_size; pc++) {
+        if (!c.needs_slow[pc]) continue;
+        c.slow_offset[pc] = b->len;
+        emit_interpret_call(&c, pc);
+        emit_jcc(&c, CC_E, JIT_TO_PC, pc + 1);
+        emit_jmp(&c, JIT_TO_EPILOGUE, 0);
+    }
+
+    if (b->failed) {
+        free(jit);
+        jit_compiler_free(&c);
+        return NULL;
+    }
+
+    for (int i = 0; i < c.fixup_count; i++) {
+        JitFixup *f = &c.fixups[i];
+        size_t target = f->kind == JIT_TO_PC ? c.pc_offset[f->pc] :
+                        f->kind == JIT_TO_SLOW ? c.slow_offset[f->pc] : c.epilogue;
+        int32_t rel = (int32_t)((long long)target - (long long)(f->pos + 4));
+        memcpy(b->bytes + f->pos, &rel, 4);
+    }
+
+    // Copy into fresh pages, then flip them to read/execute (never W+X)
+    size_t page = vm_mem_page_size();
+    jit->mapping = (b->len + page - 1) & ~(page - 1);
+    jit->code = (uint8_t*)vm_mem_map(jit->mapping);
+    jit->entry = (void**)malloc(sizeof(void*) * (vm->code_size + 1));
+    if (!jit->code || !jit->entry) {
+        vm_jit_free(jit);
+        jit_compiler_free(&c);
+        return NULL;
+    }
+    memcpy(jit->code, b->bytes, b->len);
+    if (!vm_mem_protect_exec(jit->code, jit->mapping)) {
+        vm_jit_free(jit);
+        jit_compiler_free(&c);
+        return NULL;
+    }
+
+    jit->entry_count = vm->code_size + 1;
+    for (int pc = 0; pc <= vm->code_size; pc++) {
+        jit->entry[pc] = jit->code + c.pc_offset[pc];
+    }
+    jit->enter = (JitEntryFn)(void*)jit->code;
+
+    if (vm_perf_enabled()) jit_perf_register(vm, jit, c.pc_offset, b->len);
+
+    jit_compiler_free(&c);
+    return jit;
+}
+
+void vm_jit_run(VMJit *jit, VM *vm) {
+    if (!jit || !vm) return;
+
+    vm->jit = jit;   // Parallel loop workers run the same code
+    vm_reserve_locals(vm);
+
+    // Compiled code returns whenever control moves somewhere it cannot
+    // jump to directly (calls, returns); re-enter at the new ip
+    while (vm->ip >= 0 && vm->ip < vm->code_size && vm->ip < jit->entry_count) {
+        if (jit->enter(vm, jit->entry[vm->ip]) == JIT_EXIT_HALT) break;
+    }
+}
+
+#else /* No code generator for this host */
+
+int vm_jit_supported(void) {
+    return 0;
+}
+
+VMJit* vm_jit_compile(VM *vm) {
+    (void)vm;
+    return NULL;
+}
+
+void vm_jit_run(VMJit *jit, VM *vm) {
+    (void)jit;
+    vm_run(vm);
+}
+
+#endif
+
+void vm_jit_free(VMJit *jit) {
+    if (!jit) return;
+    vm_mem_release(jit->code, jit->mapping);
+    free(jit->entry);
+    free(jit);
+}
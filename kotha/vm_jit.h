@@ -0,0 +1,45 @@
+/*
+ * Kotha VM Baseline JIT Header
+ * Template compiler from bytecode to x86-64 machine code (Linux/SysV)
+ */
+
+#ifndef VM_JIT_H
+#define VM_JIT_H
+
+#include "vm.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Native entry: runs from 'target' until it must leave compiled code */
+typedef int (*JitEntryFn)(VM *vm, void *target);
+
+/* Exit codes of compiled code */
+#define JIT_EXIT_HALT    0   // Program finished (vm->ip is past the end or at a HALT)
+#define JIT_NEXT         1   // Internal: fallback executed, continue at pc + 1
+#define JIT_EXIT_RESUME  2   // Control moved (call/return); re-enter at vm->ip
+
+/* Compiled program. Every pc gets an entry point so execution can leave
+ * and re-enter compiled code anywhere. */
+typedef struct VMJit {
+    uint8_t *code;           // Read/execute pages
+    size_t mapping;          // Bytes mapped for code
+    void **entry;            // Native address per pc (code_size + 1 entries)
+    int entry_count;
+    JitEntryFn enter;
+    int fast_count;          // Instructions compiled to inline templates
+    int fallback_count;      // Instructions that call back into the interpreter
+} VMJit;
+
+/* 1 if this build can generate code for the host */
+int vm_jit_supported(void);
+
+/* Compile the whole program (top-level code and every function).
+ * Returns NULL when unsupported or out of memory. */
+VMJit* vm_jit_compile(VM *vm);
+
+/* Run the program in compiled code (replaces vm_run) */
+void vm_jit_run(VMJit *jit, VM *vm);
+
+void vm_jit_free(VMJit *jit);
+
+#endif /* VM_JIT_H */
@@ -0,0 +1,163 @@
+/*
+ * Kotha VM Map
+ * Open addressing with one control byte per slot. The low 7 bits of the
+ * hash (H2) are stored in the control byte so a whole group of 16 slots
+ * can be filtered with a single SIMD compare before touching any keys.
+ */
+
+#include "vm_map.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define H1(hash) ((hash) >> 7)
+#define H2(hash) ((int8_t)((hash) & 0x7f))
+
+/* Bitmask of slots in the group whose control byte equals 'tag' */
+static inline uint32_t group_match(const int8_t *group, int8_t tag) {
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(tag)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < MAP_GROUP_WIDTH; i++) {
+        if (group[i] == tag) mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+/* Keys are equal when type and payload match (strings are interned) */
+static inline int keys_equal(Value a, Value b) {
+    if (a.type != b.type) return 0;
+    if (a.type == VAL_FLOAT) return memcmp(&a.as.float_val, &b.as.float_val, sizeof(float)) == 0;
+    return a.as.int_val == b.as.int_val;
+}
+
+/* Allocate empty tables of the given capacity */
+static int map_alloc_tables(VMMap *map, int capacity) {
+    int8_t *ctrl = (int8_t*)malloc(capacity);
+    MapSlot *slots = (MapSlot*)malloc(sizeof(MapSlot) * capacity);
+    if (!ctrl || !slots) {
+        free(ctrl);
+        free(slots);
+        return 0;
+    }
+
+    memset(ctrl, MAP_CTRL_EMPTY, capacity);
+    map->ctrl = ctrl;
+    map->slots = slots;
+    map->capacity = capacity;
+    map->growth_left = capacity - capacity / 8;
+    return 1;
+}
+
+/* Find an empty slot for a key known not to be present */
+static int map_find_empty(VMMap *map, uint32_t hash) {
+    int group_mask = map->capacity / MAP_GROUP_WIDTH - 1;
+    int g = H1(hash) & group_mask;
+
+    for (int step = 1; ; step++) {
+        const int8_t *group = map->ctrl + g * MAP_GROUP_WIDTH;
+        uint32_t empty = group_match(group, MAP_CTRL_EMPTY);
+        if (empty) {
+            return g * MAP_GROUP_WIDTH + __builtin_ctz(empty);
+        }
+        g = (g + step) & group_mask;  // Triangular probing visits every group
+    }
+}
+
+/* Double the capacity and reinsert every entry */
+static int map_grow(VMMap *map) {
+    VMMap old = *map;
+    int capacity = old.capacity ? old.capacity * 2 : MAP_MIN_CAPACITY;
+
+    if (!map_alloc_tables(map, capacity)) {
+        *map = old;
+        return 0;
+    }
+
+    for (int i = 0; i < old.capacity; i++) {
+        if (old.ctrl[i] == MAP_CTRL_EMPTY) continue;
+
+        int slot = map_find_empty(map, old.slots[i].hash);
+        map->ctrl[slot] = H2(old.slots[i].hash);
+        map->slots[slot] = old.slots[i];
+        map->growth_left--;
+    }
+
+    free(old.ctrl);
+    free(old.slots);
+    return 1;
+}
+
+void vm_map_init(VMMap *map) {
+    memset(map, 0, sizeof(VMMap));
+}
+
+void vm_map_destroy(VMMap *map) {
+    if (!map) return;
+    free(map->ctrl);
+    free(map->slots);
+    memset(map, 0, sizeof(VMMap));
+}
+
+int vm_map_find(VMMap *map, Value key, uint32_t hash) {
+    if (!map || map->capacity == 0) return -1;
+
+    int group_mask = map->capacity / MAP_GROUP_WIDTH - 1;
+    int g = H1(hash) & group_mask;
+    int8_t tag = H2(hash);
+
+    for (int step = 1; step <= group_mask + 1; step++) {
+        const int8_t *group = map->ctrl + g * MAP_GROUP_WIDTH;
+        uint32_t match = group_match(group, tag);
+
+        while (match) {
+            int slot = g * MAP_GROUP_WIDTH + __builtin_ctz(match);
+            if (map->slots[slot].hash == hash && keys_equal(map->slots[slot].key, key)) {
+                return slot;
+            }
+            match &= match - 1;
+        }
+
+        // An empty slot ends the probe sequence (no deletions, so no tombstones)
+        if (group_match(group, MAP_CTRL_EMPTY)) return -1;
+
+        g = (g + step) & group_mask;
+    }
+    return -1;
+}
+
+int vm_map_set(VMMap *map, Value key, uint32_t hash, Value value) {
+    int slot = vm_map_find(map, key, hash);
+    if (slot >= 0) {
+        map->slots[slot].value = value;
+        return 1;
+    }
+
+    if (map->growth_left == 0 && !map_grow(map)) {
+        return 0;
+    }
+
+    slot = map_find_empty(map, hash);
+    map->ctrl[slot] = H2(hash);
+    map->slots[slot].key = key;
+    map->slots[slot].value = value;
+    map->slots[slot].hash = hash;
+    map->count++;
+    map->growth_left--;
+    return 1;
+}
+
+int vm_map_next(VMMap *map, int cursor) {
+    if (!map || cursor < 0) return -1;
+
+    for (int i = cursor; i < map->capacity; i++) {
+        if (map->ctrl[i] != MAP_CTRL_EMPTY) return i;
+    }
+    return -1;
+}
@@ -0,0 +1,49 @@
+/*
+ * Kotha VM Map Header
+ * Open-addressing hash map (Swiss-table style control bytes)
+ */
+
+#ifndef VM_MAP_H
+#define VM_MAP_H
+
+#include <stdint.h>
+#include "vm.h"
+
+/* Slots are probed one group of control bytes at a time */
+#define MAP_GROUP_WIDTH 16
+#define MAP_MIN_CAPACITY MAP_GROUP_WIDTH
+
+/* Control byte values: EMPTY has the high bit set, full slots hold H2 (0..127) */
+#define MAP_CTRL_EMPTY ((int8_t)-128)
+
+/* Key/value pair (hash kept so resizing never rehashes keys) */
+typedef struct {
+    Value key;
+    Value value;
+    uint32_t hash;
+} MapSlot;
+
+/* Map header - lives in the VM heap as an OBJ_MAP payload.
+ * Control bytes and slots are malloc'd and freed when the GC sweeps the map. */
+typedef struct {
+    int8_t *ctrl;        // One control byte per slot
+    MapSlot *slots;
+    int capacity;        // Power of two, multiple of MAP_GROUP_WIDTH
+    int count;           // Live entries
+    int growth_left;     // Inserts left before the 7/8 load factor is hit
+} VMMap;
+
+/* Lifecycle */
+void vm_map_init(VMMap *map);
+void vm_map_destroy(VMMap *map);
+
+/* Lookup: returns slot index or -1 */
+int vm_map_find(VMMap *map, Value key, uint32_t hash);
+
+/* Insert or overwrite. Returns 0 on allocation failure. */
+int vm_map_set(VMMap *map, Value key, uint32_t hash, Value value);
+
+/* Iteration: first occupied slot >= cursor, or -1 */
+int vm_map_next(VMMap *map, int cursor);
+
+#endif /* VM_MAP_H */
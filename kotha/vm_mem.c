@@ -0,0 +1,85 @@
+/*
+ * Kotha VM Memory
+ * Thin wrapper over mmap/mprotect (VirtualAlloc on Windows)
+ */
+
+#include "vm_mem.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+size_t vm_mem_page_size(void) {
+    static size_t cached = 0;  // Atomic: VMs on several threads may ask first
+    size_t page_size = __atomic_load_n(&cached, __ATOMIC_RELAXED);
+    
+    if (page_size == 0) {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        page_size = info.dwPageSize;
+#else
+        long size = sysconf(_SC_PAGESIZE);
+        page_size = size > 0 ? (size_t)size : 4096;
+#endif
+        __atomic_store_n(&cached, page_size, __ATOMIC_RELAXED);
+    }
+    return page_size;
+}
+
+void* vm_mem_reserve(size_t size) {
+#ifdef _WIN32
+    return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+    void *addr = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return addr == MAP_FAILED ? NULL : addr;
+#endif
+}
+
+int vm_mem_commit(void *addr, size_t size) {
+#ifdef _WIN32
+    return VirtualAlloc(addr, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#else
+    return mprotect(addr, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+void* vm_mem_map(size_t size) {
+#ifdef _WIN32
+    return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return addr == MAP_FAILED ? NULL : addr;
+#endif
+}
+
+void vm_mem_release(void *addr, size_t size) {
+    if (!addr) return;
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(addr, 0, MEM_RELEASE);
+#else
+    munmap(addr, size);
+#endif
+}
+
+int vm_mem_protect_exec(void *addr, size_t size) {
+#ifdef _WIN32
+    DWORD old;
+    return VirtualProtect(addr, size, PAGE_EXECUTE_READ, &old) != 0;
+#else
+    return mprotect(addr, size, PROT_READ | PROT_EXEC) == 0;
+#endif
+}
+
+void vm_mem_advise_huge(void *addr, size_t size) {
+#if defined(MADV_HUGEPAGE)
+    madvise(addr, size, MADV_HUGEPAGE);
+#else
+    (void)addr;
+    (void)size;
+#endif
+}
@@ -0,0 +1,35 @@
+/*
+ * Kotha VM Memory Header
+ * Page-level memory from the OS (reserve, commit, release)
+ */
+
+#ifndef VM_MEM_H
+#define VM_MEM_H
+
+#include <stddef.h>
+
+/* Regions at least this large are eligible for transparent huge pages */
+#define VM_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* System page size */
+size_t vm_mem_page_size(void);
+
+/* Reserve address space without backing memory. Returns NULL on failure. */
+void* vm_mem_reserve(size_t size);
+
+/* Back part of a reservation with read/write memory. Returns 0 on failure. */
+int vm_mem_commit(void *addr, size_t size);
+
+/* Reserve and commit in one step (zero-filled) */
+void* vm_mem_map(size_t size);
+
+/* Return a reservation or mapping to the OS */
+void vm_mem_release(void *addr, size_t size);
+
+/* Make a mapped range read/execute (and no longer writable). Returns 0 on failure. */
+int vm_mem_protect_exec(void *addr, size_t size);
+
+/* Ask for huge pages on a committed range (no-op where unsupported) */
+void vm_mem_advise_huge(void *addr, size_t size);
+
+#endif /* VM_MEM_H */
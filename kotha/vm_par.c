@@ -0,0 +1,338 @@
+/*
+ * Kotha VM Parallel Loops
+ * A cholbe somantorale loop is compiled as an ordinary loop preceded by
+ * OP_PARALLEL. When the loop runs on the pool, its iteration space is
+ * split evenly between the workers; each worker takes small chunks from
+ * the front of its range and, once that is empty, steals the upper half
+ * of another worker's range. Workers execute the shared bytecode (or JIT
+ * code) in private VM contexts with copies of the locals, stopping at the
+ * loop's OP_PAR_END. Afterwards the jog variables get the sum of the
+ * workers' partial sums and the other locals take their values from the
+ * final iteration, as if the loop had run in order.
+ */
+
+#include "vm_par.h"
+#include "vm_jit.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PAR_CHUNKS_PER_THREAD 16   // Target chunks per worker (smaller = better balance)
+
+#define RANGE_PACK(lo, hi) (((uint64_t)(lo) << 32) | (uint32_t)(hi))
+#define RANGE_LO(r) ((uint32_t)((r) >> 32))
+#define RANGE_HI(r) ((uint32_t)(r))
+
+int vm_par_thread_count(VM *vm) {
+    int threads = vm->par_threads;
+    if (threads <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (int)online : 1;
+    }
+    if (threads > PAR_MAX_THREADS) threads = PAR_MAX_THREADS;
+    return threads;
+}
+
+/* Work distribution */
+
+/* Claim up to 'grain' iterations from the front of the worker's own range */
+static int par_take(VMParWorker *w, uint32_t grain, uint32_t *lo, uint32_t *hi) {
+    uint64_t r = __atomic_load_n(&w->range, __ATOMIC_ACQUIRE);
+    for (;;) {
+        uint32_t start = RANGE_LO(r), end = RANGE_HI(r);
+        if (start >= end) return 0;
+        uint32_t stop = end - start > grain ? start + grain : end;
+        if (__atomic_compare_exchange_n(&w->range, &r, RANGE_PACK(stop, end), 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            *lo = start;
+            *hi = stop;
+            return 1;
+        }
+    }
+}
+
+/* Move the upper half of some other worker's range into our own (empty)
+ * one. The owner keeps working from the front, so the two never overlap. */
+static int par_steal(VMParWorker *w) {
+    VMParPool *pool = w->pool;
+
+    for (int k = 1; k < pool->count; k++) {
+        VMParWorker *victim = &pool->workers[(w->index + k) % pool->count];
+        uint64_t r = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+        for (;;) {
+            uint32_t start = RANGE_LO(r), end = RANGE_HI(r);
+            if (start >= end) break;
+            uint32_t mid = start + (end - start) / 2;
+            if (__atomic_compare_exchange_n(&victim->range, &r, RANGE_PACK(start, mid), 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                __atomic_store_n(&w->range, RANGE_PACK(mid, end), __ATOMIC_RELEASE);
+                w->steals++;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Execution */
+
+/* Give the worker's context the state of the VM at OP_PARALLEL */
+static void par_context_load(VMParWorker *w) {
+    VMParPool *pool = w->pool;
+    VM *src = pool->main;
+    VM *vm = w->vm;
+
+    vm->code = src->code;
+    vm->code_size = src->code_size;
+    memcpy(vm->constants, src->constants, sizeof(ConstantEntry) * src->constant_count);
+    vm->constant_count = src->constant_count;
+    memcpy(vm->strings, src->strings, sizeof(StringEntry) * src->string_count);
+    vm->string_count = src->string_count;
+    vm->static_string_count = src->static_string_count;
+
+    memcpy(vm->stack, src->stack, sizeof(Value) * (src->sp + 1));
+    vm->sp = src->sp;
+    vm->fp = 0;
+    vm->frame_count = 0;
+    vm->hp = -1;
+    vm->local_count = src->local_count;
+    vm->current_line = src->current_line;
+    vm->instruction_count = 0;
+    vm->error_count = 0;
+    vm->out = src->out;
+    vm->in = src->in;
+    vm->err = src->err;
+
+    // Partial sums start from zero; the original value is added once at the end
+    for (int i = 0; i < pool->loop->reduction_count; i++) {
+        Value zero = {VAL_INT, {.int_val = 0}};
+        vm->stack[pool->loop->reductions[i]] = zero;
+    }
+
+    w->chunks = 0;
+    w->steals = 0;
+}
+
+/* Run iterations [lo, hi) of the current loop */
+static void par_run_chunk(VMParWorker *w, uint32_t lo, uint32_t hi) {
+    VMParPool *pool = w->pool;
+    const VMParLoop *loop = pool->loop;
+    VM *vm = w->vm;
+
+    vm->sp = pool->main->sp;
+    vm->stack[loop->var_slot].type = VAL_INT;
+    vm->stack[loop->var_slot].as.int_val = pool->first + (int)lo;
+    vm->stack[loop->end_slot].type = VAL_INT;
+    vm->stack[loop->end_slot].as.int_val = pool->first + (int)(hi - 1);
+    vm->ip = loop->top_pc;
+
+    // The loop condition fails after hi - 1 and jumps to OP_PAR_END, which
+    // stops a worker context
+    if (pool->jit) {
+        vm_jit_run(pool->jit, vm);
+    } else {
+        while (vm_execute_instruction(vm)) { }
+    }
+    w->chunks++;
+
+    // Only one chunk contains the final iteration
+    if (hi == pool->total) {
+        memcpy(pool->last_locals, vm->stack, sizeof(Value) * (pool->main->sp + 1));
+    }
+}
+
+static void par_work(VMParWorker *w) {
+    VMParPool *pool = w->pool;
+    uint32_t lo, hi;
+
+    par_context_load(w);
+    for (;;) {
+        if (par_take(w, pool->grain, &lo, &hi)) {
+            par_run_chunk(w, lo, hi);
+        } else if (!par_steal(w)) {
+            // Ranges only shrink, and stolen work is run by the thief
+            break;
+        }
+    }
+}
+
+static void* par_helper_main(void *arg) {
+    VMParWorker *w = (VMParWorker*)arg;
+    VMParPool *pool = w->pool;
+    unsigned seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutdown && pool->generation == seen) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->shutdown) break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        par_work(w);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0) pthread_cond_signal(&pool->idle);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/* Pool lifecycle */
+
+static VMParPool* par_pool_new(int threads) {
+    VMParPool *pool = (VMParPool*)calloc(1, sizeof(VMParPool));
+    if (!pool) return NULL;
+
+    pool->workers = (VMParWorker*)calloc(threads, sizeof(VMParWorker));
+    pool->last_locals = (Value*)malloc(sizeof(Value) * MAX_STACK);
+    if (!pool->workers || !pool->last_locals) {
+        free(pool->workers);
+        free(pool->last_locals);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    // Worker 0 is the calling thread; stop at the first helper that fails
+    for (int i = 0; i < threads; i++) {
+        VMParWorker *w = &pool->workers[i];
+        w->pool = pool;
+        w->index = i;
+        w->vm = (VM*)calloc(1, sizeof(VM));
+        if (!w->vm) break;
+        w->vm->par_worker = 1;
+        if (i > 0) {
+            w->started = pthread_create(&w->thread, NULL, par_helper_main, w) == 0;
+            if (!w->started) {
+                free(w->vm);
+                w->vm = NULL;
+                break;
+            }
+        }
+        pool->count = i + 1;
+    }
+
+    if (pool->count == 0) {
+        vm_par_free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void vm_par_free(VMParPool *pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->count; i++) {
+        if (pool->workers[i].started) pthread_join(pool->workers[i].thread, NULL);
+        free(pool->workers[i].vm);   // Code and strings belong to the main VM
+    }
+
+    pthread_cond_destroy(&pool->idle);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->last_locals);
+    free(pool->workers);
+    free(pool);
+}
+
+/* Reduction merge, with the VM's int/float addition rules */
+static Value par_add(Value a, Value b) {
+    Value result = a;
+    if (a.type == VAL_INT && b.type == VAL_INT) {
+        result.as.int_val = a.as.int_val + b.as.int_val;
+    } else if ((a.type == VAL_INT || a.type == VAL_FLOAT) && (b.type == VAL_INT || b.type == VAL_FLOAT)) {
+        float fa = (a.type == VAL_FLOAT) ? a.as.float_val : (float)a.as.int_val;
+        float fb = (b.type == VAL_FLOAT) ? b.as.float_val : (float)b.as.int_val;
+        result.type = VAL_FLOAT;
+        result.as.float_val = fa + fb;
+    }
+    return result;
+}
+
+void vm_par_run(VM *vm, const VMParLoop *loop) {
+    if (!vm || !loop || !loop->parallel || vm->par_worker || vm->frame_count > 0) return;
+
+    // Slots live below sp at top level; anything else runs sequentially
+    if (loop->var_slot > vm->sp || loop->end_slot > vm->sp) return;
+    for (int i = 0; i < loop->reduction_count; i++) {
+        if (loop->reductions[i] > vm->sp) return;
+    }
+
+    Value first = vm->stack[loop->var_slot];
+    Value last = vm->stack[loop->end_slot];
+    if (first.type != VAL_INT || last.type != VAL_INT) return;
+    long long total = (long long)last.as.int_val - first.as.int_val + 1;
+    if (total < 2 || total > UINT32_MAX) return;
+
+    if (!vm->par_pool) {
+        int threads = vm_par_thread_count(vm);
+        if (threads < 2) return;
+        vm->par_pool = par_pool_new(threads);
+        if (!vm->par_pool) {
+            vm->par_threads = 1;   // Don't retry for every loop
+            return;
+        }
+    }
+    VMParPool *pool = vm->par_pool;
+    if (pool->count < 2) return;
+
+    // Post the loop: even split, chunks of 'grain' iterations
+    pool->main = vm;
+    pool->loop = loop;
+    pool->jit = vm->jit;
+    pool->first = first.as.int_val;
+    pool->total = (uint32_t)total;
+    pool->grain = pool->total / ((uint32_t)pool->count * PAR_CHUNKS_PER_THREAD);
+    if (pool->grain == 0) pool->grain = 1;
+    for (int i = 0; i < pool->count; i++) {
+        uint32_t lo = (uint32_t)(total * i / pool->count);
+        uint32_t hi = (uint32_t)(total * (i + 1) / pool->count);
+        __atomic_store_n(&pool->workers[i].range, RANGE_PACK(lo, hi), __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->busy = pool->count - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    par_work(&pool->workers[0]);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0) pthread_cond_wait(&pool->idle, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+
+    // Merge: partial sums first (they read the original values)
+    Value sums[PAR_MAX_REDUCTIONS];
+    for (int i = 0; i < loop->reduction_count; i++) {
+        sums[i] = vm->stack[loop->reductions[i]];
+        for (int k = 0; k < pool->count; k++) {
+            sums[i] = par_add(sums[i], pool->workers[k].vm->stack[loop->reductions[i]]);
+        }
+    }
+
+    memcpy(vm->stack, pool->last_locals, sizeof(Value) * (vm->sp + 1));
+    for (int i = 0; i < loop->reduction_count; i++) {
+        vm->stack[loop->reductions[i]] = sums[i];
+    }
+
+    for (int k = 0; k < pool->count; k++) {
+        vm->instruction_count += pool->workers[k].vm->instruction_count;
+        vm->error_count += pool->workers[k].vm->error_count;
+        pool->chunks += pool->workers[k].chunks;
+        pool->steals += pool->workers[k].steals;
+    }
+    pool->loops++;
+
+    vm->ip = loop->exit_pc;
+}
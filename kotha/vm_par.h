@@ -0,0 +1,65 @@
+/*
+ * Kotha VM Parallel Loops Header
+ * cholbe somantorale: loop iterations on a work-stealing thread pool
+ */
+
+#ifndef VM_PAR_H
+#define VM_PAR_H
+
+#include "vm.h"
+#include <stdint.h>
+#include <pthread.h>
+
+#define PAR_MAX_THREADS 64
+
+/* One pool thread (worker 0 is the thread that reached the loop). Each
+ * worker runs the shared bytecode in its own VM context. */
+typedef struct {
+    struct VMParPool *pool;
+    int index;
+    VM *vm;                  // Private context: stack, constants, string table
+    uint64_t range;          // Unclaimed iterations, (lo << 32) | hi (atomic)
+    pthread_t thread;
+    int started;
+    int chunks;              // Statistics for the current loop
+    int steals;
+} VMParWorker;
+
+typedef struct VMParPool {
+    VMParWorker *workers;
+    int count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;     // A loop was posted (or shutdown)
+    pthread_cond_t idle;     // The last helper finished the loop
+    unsigned generation;     // Bumped for every loop
+    int busy;                // Helpers still working on the current loop
+    int shutdown;
+
+    // Current loop (written before the generation is bumped)
+    VM *main;
+    const VMParLoop *loop;
+    struct VMJit *jit;
+    int first;               // Value of the loop variable at offset 0
+    uint32_t total;          // Iterations
+    uint32_t grain;          // Iterations claimed at a time
+    Value *last_locals;      // Locals after the final iteration (lastprivate)
+
+    // Statistics
+    int loops;
+    long long chunks;
+    long long steals;
+} VMParPool;
+
+/* OP_PARALLEL: run the loop on the pool and continue at its exit. Returns
+ * without doing anything when the loop should run sequentially (one
+ * thread, fewer than two iterations, or a body that needs the main VM);
+ * execution then simply falls into the loop. */
+void vm_par_run(VM *vm, const VMParLoop *loop);
+
+/* Threads a pool for this VM would use */
+int vm_par_thread_count(VM *vm);
+
+void vm_par_free(VMParPool *pool);
+
+#endif /* VM_PAR_H */
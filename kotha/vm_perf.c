@@ -0,0 +1,376 @@
+/*
+ * Kotha VM Profiler Support
+ * perf resolves samples in anonymous executable memory through two files
+ * the process writes itself:
+ *   /tmp/perf-<pid>.map   "start size name" per code block, read by perf report
+ *   /tmp/jit-<pid>.dump   jitdump records with code and line tables, turned
+ *                         into ELF images by 'perf inject --jit'
+ * (see tools/perf/Documentation/jitdump-specification.txt in Linux).
+ *
+ * JIT code and traces register themselves when compiled. The bytecode
+ * interpreter has no code per function, so each Kotha function gets a tiny
+ * trampoline that calls back into the interpreter; with call graphs
+ * (perf record -g) interpreter samples show up under the script function.
+ */
+
+#include "vm_perf.h"
+#include "vm_mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define JITDUMP_MAGIC       0x4A695444
+#define JITDUMP_VERSION     1
+#define JIT_CODE_LOAD       0
+#define JIT_CODE_CLOSE      3
+#define JIT_CODE_DEBUG_INFO 2
+
+#if defined(__x86_64__)
+#define JITDUMP_ELF_MACH    62      // EM_X86_64
+#elif defined(__aarch64__)
+#define JITDUMP_ELF_MACH    183     // EM_AARCH64
+#else
+#define JITDUMP_ELF_MACH    0
+#endif
+
+#define PERF_TRAMPOLINE_SIZE 16
+
+/* Trampoline pages stay mapped until vm_perf_close so names stay valid */
+typedef struct PerfMapping {
+    void *addr;
+    size_t size;
+    struct PerfMapping *next;
+} PerfMapping;
+
+static struct {
+    int enabled;
+    FILE *map;
+    FILE *dump;
+    void *dump_marker;       // The mmap perf record looks for
+    size_t marker_size;
+    char *source;
+    uint64_t code_index;
+    PerfMapping *mappings;
+    pthread_mutex_t lock;
+} perf = {0, NULL, NULL, NULL, 0, NULL, 0, NULL, PTHREAD_MUTEX_INITIALIZER};
+
+/* Interpreter trampolines for the program being run */
+typedef int (*PerfRunFn)(VM *vm, int depth);
+typedef int (*PerfTrampoline)(VM *vm, int depth, PerfRunFn run);
+
+static struct {
+    VMPerfRegion *regions;
+    int region_count;
+    PerfTrampoline *entry;
+} trampolines;
+
+static uint64_t perf_timestamp(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);   // Matches 'perf record -k mono'
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void dump_u32(uint32_t value) {
+    fwrite(&value, sizeof(value), 1, perf.dump);
+}
+
+static void dump_u64(uint64_t value) {
+    fwrite(&value, sizeof(value), 1, perf.dump);
+}
+
+int vm_perf_open(const char *source) {
+    if (perf.enabled) return 1;
+
+    char path[64];
+    int pid = (int)getpid();
+
+    snprintf(path, sizeof(path), "/tmp/perf-%d.map", pid);
+    perf.map = fopen(path, "w");
+    if (!perf.map) {
+        fprintf(stderr, "Warning: Cannot write %s\n", path);
+        return 0;
+    }
+
+    snprintf(path, sizeof(path), "/tmp/jit-%d.dump", pid);
+    perf.dump = fopen(path, "w+");
+    if (perf.dump) {
+        // perf record only notices the dump through an executable mapping of it
+        perf.marker_size = vm_mem_page_size();
+        perf.dump_marker = mmap(NULL, perf.marker_size, PROT_READ | PROT_EXEC, MAP_PRIVATE,
+                                fileno(perf.dump), 0);
+        if (perf.dump_marker == MAP_FAILED) perf.dump_marker = NULL;
+
+        dump_u32(JITDUMP_MAGIC);
+        dump_u32(JITDUMP_VERSION);
+        dump_u32(40);                    // Header size
+        dump_u32(JITDUMP_ELF_MACH);
+        dump_u32(0);                     // pad1
+        dump_u32((uint32_t)pid);
+        dump_u64(perf_timestamp());
+        dump_u64(0);                     // flags
+        fflush(perf.dump);
+    } else {
+        fprintf(stderr, "Warning: Cannot write %s, only the perf map is available\n", path);
+    }
+
+    char *full = source ? realpath(source, NULL) : NULL;
+    perf.source = full ? full : strdup(source ? source : "<kotha>");
+    perf.enabled = 1;
+    return 1;
+}
+
+int vm_perf_enabled(void) {
+    return perf.enabled;
+}
+
+void vm_perf_close(void) {
+    if (!perf.enabled) return;
+
+    pthread_mutex_lock(&perf.lock);
+    if (perf.dump) {
+        dump_u32(JIT_CODE_CLOSE);
+        dump_u32(16);
+        dump_u64(perf_timestamp());
+        if (perf.dump_marker) munmap(perf.dump_marker, perf.marker_size);
+        fclose(perf.dump);
+        perf.dump = NULL;
+    }
+    fclose(perf.map);
+    perf.map = NULL;
+
+    while (perf.mappings) {
+        PerfMapping *next = perf.mappings->next;
+        vm_mem_release(perf.mappings->addr, perf.mappings->size);
+        free(perf.mappings);
+        perf.mappings = next;
+    }
+    free(perf.source);
+    perf.source = NULL;
+    perf.enabled = 0;
+    pthread_mutex_unlock(&perf.lock);
+
+    free(trampolines.regions);
+    free(trampolines.entry);
+    memset(&trampolines, 0, sizeof(trampolines));
+}
+
+static int compare_ints(const void *a, const void *b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+int vm_perf_regions(VM *vm, VMPerfRegion **regions) {
+    int *starts = (int*)malloc(sizeof(int) * (vm->function_count + 2));
+    VMPerfRegion *out = (VMPerfRegion*)malloc(sizeof(VMPerfRegion) * (vm->function_count + 2));
+    if (!starts || !out) {
+        free(starts);
+        free(out);
+        *regions = NULL;
+        return 0;
+    }
+
+    // Function entry points split the code; anything before the first is top-level
+    int n = 0;
+    starts[n++] = 0;
+    for (int i = 0; i < vm->function_count; i++) {
+        int addr = vm->functions[i].address;
+        if (addr > 0 && addr < vm->code_size) starts[n++] = addr;
+    }
+    qsort(starts, n, sizeof(int), compare_ints);
+
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        if (i > 0 && starts[i] == starts[i - 1]) continue;
+
+        VMPerfRegion *r = &out[count++];
+        r->start_pc = starts[i];
+        r->end_pc = vm->code_size;
+        if (count > 1) out[count - 2].end_pc = r->start_pc;
+
+        snprintf(r->name, sizeof(r->name), "<main>");
+        for (int f = 0; f < vm->function_count; f++) {
+            const char *name = vm->functions[f].name;
+            if (vm->functions[f].address != r->start_pc || !name) continue;
+            if (strncmp(name, "func_", 5) == 0) name += 5;
+            else if (strncmp(name, "function_", 9) == 0) name += 9;
+            snprintf(r->name, sizeof(r->name), "%s", name);
+            break;
+        }
+    }
+
+    free(starts);
+    *regions = out;
+    return count;
+}
+
+void vm_perf_code_load(const char *name, const void *code, size_t size,
+                       const VMPerfLine *lines, int line_count) {
+    if (!perf.enabled || !code || size == 0) return;
+
+    pthread_mutex_lock(&perf.lock);
+    fprintf(perf.map, "%lx %zx %s\n", (unsigned long)(uintptr_t)code, size, name);
+    fflush(perf.map);
+
+    if (perf.dump) {
+        uint64_t now = perf_timestamp();
+        size_t file_len = strlen(perf.source) + 1;
+
+        // Line table first; perf inject attaches it to the next load at this address
+        if (lines && line_count > 0) {
+            dump_u32(JIT_CODE_DEBUG_INFO);
+            dump_u32((uint32_t)(16 + 16 + (size_t)line_count * (16 + file_len)));
+            dump_u64(now);
+            dump_u64((uint64_t)(uintptr_t)code);
+            dump_u64((uint64_t)line_count);
+            for (int i = 0; i < line_count; i++) {
+                dump_u64((uint64_t)(uintptr_t)lines[i].addr);
+                dump_u32((uint32_t)lines[i].line);
+                dump_u32(0);             // discriminator
+                fwrite(perf.source, 1, file_len, perf.dump);
+            }
+        }
+
+        size_t name_len = strlen(name) + 1;
+        dump_u32(JIT_CODE_LOAD);
+        dump_u32((uint32_t)(16 + 40 + name_len + size));
+        dump_u64(now);
+        dump_u32((uint32_t)getpid());
+        dump_u32((uint32_t)syscall(SYS_gettid));
+        dump_u64((uint64_t)(uintptr_t)code);     // vma
+        dump_u64((uint64_t)(uintptr_t)code);     // code_addr
+        dump_u64((uint64_t)size);
+        dump_u64(perf.code_index++);
+        fwrite(name, 1, name_len, perf.dump);
+        fwrite(code, 1, size, perf.dump);
+        fflush(perf.dump);
+    }
+    pthread_mutex_unlock(&perf.lock);
+}
+
+/* Run until the frame at 'depth' returns (1) or the program ends (0).
+ * Each call descends through the callee's trampoline. */
+static int perf_interpret(VM *vm, int depth) {
+    while (vm->ip < vm->code_size) {
+        int frames = vm->frame_count;
+        if (!vm_execute_instruction(vm)) return 0;
+
+        if (vm->frame_count > frames) {
+            int region = 0;
+            for (int i = 0; i < trampolines.region_count; i++) {
+                if (trampolines.regions[i].start_pc <= vm->ip) region = i;
+            }
+            if (!trampolines.entry[region](vm, vm->frame_count, perf_interpret)) return 0;
+        }
+        // Returns and exceptions may unwind past this level
+        if (vm->frame_count < depth) return 1;
+    }
+    return 0;
+}
+
+/* push rbp; mov rbp, rsp; call rdx; pop rbp; ret */
+static const uint8_t trampoline_code[] = {0x55, 0x48, 0x89, 0xE5, 0xFF, 0xD2, 0x5D, 0xC3};
+
+static int perf_make_trampolines(VM *vm) {
+#if defined(__x86_64__)
+    free(trampolines.regions);
+    free(trampolines.entry);
+    trampolines.region_count = vm_perf_regions(vm, &trampolines.regions);
+    trampolines.entry = (PerfTrampoline*)malloc(sizeof(PerfTrampoline) * (trampolines.region_count + 1));
+    if (trampolines.region_count == 0 || !trampolines.entry) return 0;
+
+    size_t page = vm_mem_page_size();
+    size_t size = ((size_t)trampolines.region_count * PERF_TRAMPOLINE_SIZE + page - 1) & ~(page - 1);
+    uint8_t *code = (uint8_t*)vm_mem_map(size);
+    PerfMapping *mapping = (PerfMapping*)malloc(sizeof(PerfMapping));
+    if (!code || !mapping) {
+        vm_mem_release(code, size);
+        free(mapping);
+        return 0;
+    }
+
+    memset(code, 0xCC, size);
+    for (int i = 0; i < trampolines.region_count; i++) {
+        memcpy(code + i * PERF_TRAMPOLINE_SIZE, trampoline_code, sizeof(trampoline_code));
+    }
+    if (!vm_mem_protect_exec(code, size)) {
+        vm_mem_release(code, size);
+        free(mapping);
+        return 0;
+    }
+
+    mapping->addr = code;
+    mapping->size = size;
+    pthread_mutex_lock(&perf.lock);
+    mapping->next = perf.mappings;
+    perf.mappings = mapping;
+    pthread_mutex_unlock(&perf.lock);
+
+    for (int i = 0; i < trampolines.region_count; i++) {
+        uint8_t *entry = code + i * PERF_TRAMPOLINE_SIZE;
+        char name[96];
+        snprintf(name, sizeof(name), "kotha::%s", trampolines.regions[i].name);
+        trampolines.entry[i] = (PerfTrampoline)(void*)entry;
+        vm_perf_code_load(name, entry, sizeof(trampoline_code), NULL, 0);
+    }
+    return 1;
+#else
+    (void)vm;
+    return 0;
+#endif
+}
+
+void vm_perf_run(VM *vm) {
+    if (!perf_make_trampolines(vm)) {
+        // No trampolines on this host: plain interpretation
+        while (vm->ip < vm->code_size && vm_execute_instruction(vm));
+        return;
+    }
+
+    int region = 0;
+    for (int i = 0; i < trampolines.region_count; i++) {
+        if (trampolines.regions[i].start_pc <= vm->ip) region = i;
+    }
+    trampolines.entry[region](vm, vm->frame_count, perf_interpret);
+}
+
+#else /* No perf on this platform */
+
+int vm_perf_open(const char *source) {
+    (void)source;
+    fprintf(stderr, "Warning: perf output is only supported on Linux\n");
+    return 0;
+}
+
+int vm_perf_enabled(void) {
+    return 0;
+}
+
+void vm_perf_close(void) {
+}
+
+int vm_perf_regions(VM *vm, VMPerfRegion **regions) {
+    (void)vm;
+    *regions = NULL;
+    return 0;
+}
+
+void vm_perf_code_load(const char *name, const void *code, size_t size,
+                       const VMPerfLine *lines, int line_count) {
+    (void)name; (void)code; (void)size; (void)lines; (void)line_count;
+}
+
+void vm_perf_run(VM *vm) {
+    while (vm->ip < vm->code_size && vm_execute_instruction(vm));
+}
+
+#endif
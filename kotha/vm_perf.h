@@ -0,0 +1,46 @@
+/*
+ * Kotha VM Profiler Support Header
+ * perf map and jitdump output so Linux perf can name generated code
+ */
+
+#ifndef VM_PERF_H
+#define VM_PERF_H
+
+#include "vm.h"
+#include <stddef.h>
+
+/* A Kotha function as a bytecode range (top-level code is "<main>") */
+typedef struct {
+    int start_pc;
+    int end_pc;              // Exclusive
+    char name[64];
+} VMPerfRegion;
+
+/* Source line of the generated code starting at addr */
+typedef struct {
+    const void *addr;
+    int line;
+} VMPerfLine;
+
+/* Start writing /tmp/perf-<pid>.map and /tmp/jit-<pid>.dump. 'source' is
+ * the script path recorded in line tables. Returns 0 where unsupported. */
+int vm_perf_open(const char *source);
+
+int vm_perf_enabled(void);
+
+/* Finish the jitdump and close both files */
+void vm_perf_close(void);
+
+/* Split the program into per-function ranges (sorted by pc). The array
+ * is malloc'd; returns the count. */
+int vm_perf_regions(VM *vm, VMPerfRegion **regions);
+
+/* Name a block of generated code (thread-safe). lines may be NULL. */
+void vm_perf_code_load(const char *name, const void *code, size_t size,
+                       const VMPerfLine *lines, int line_count);
+
+/* Interpret the program with each Kotha function call running under its
+ * own named trampoline, so perf call graphs show script functions */
+void vm_perf_run(VM *vm);
+
+#endif /* VM_PERF_H */
@@ -0,0 +1,1223 @@
+/*
+ * Kotha VM Tracing JIT
+ * The interpreter counts backward jumps per loop header. Once a loop is
+ * hot, the next iteration is recorded instruction by instruction into a
+ * linear SSA trace (the operand stack is resolved away while recording,
+ * and every branch becomes a guard in the direction it was observed).
+ *
+ * At the closing jump the trace is optimized and compiled:
+ *   - constants are folded and comparisons of comparisons simplified,
+ *     so guards on constant conditions disappear
+ *   - type checks on locals run once at trace entry, not per iteration
+ *   - guards fuse with the comparison they test
+ *   - values live in registers (linear scan, spilling to the native stack)
+ *
+ * A guard failure jumps to a side exit that writes the snapshot taken at
+ * that guard (live locals and pending operands) back into the frame; the
+ * VM then resumes in the interpreter with sp, ip and current_line set as
+ * if it had run every instruction itself.
+ */
+
+#include "vm_trace.h"
+#include "vm_mem.h"
+#include "vm_perf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+
+/* Trace IR */
+typedef enum {
+    TIR_CONST,               // value
+    TIR_LOCAL,               // Local 'value' at the start of an iteration
+    TIR_ADD,
+    TIR_SUB,
+    TIR_MUL,
+    TIR_DIV,
+    TIR_MOD,
+    TIR_NEG,
+    TIR_EQ,
+    TIR_NE,
+    TIR_LT,
+    TIR_LE,
+    TIR_GT,
+    TIR_GE,
+    TIR_GUARD_TRUE,          // Exit unless a != 0
+    TIR_GUARD_FALSE          // Exit unless a == 0
+} TraceOp;
+
+typedef struct {
+    uint8_t op;
+    int a, b;
+    int value;
+    int exit;                // Snapshot for guards and checked division (-1 = none)
+} TraceIns;
+
+/* Snapshot entry: frame slot <- IR value */
+typedef struct {
+    int slot;
+    int ref;
+} TraceSlot;
+
+#define REF_NONE    (-1)
+#define REF_PENDING (-2)     // Local not touched yet; resolved when the trace closes
+
+struct TraceRecorder {
+    int header;
+    int base;                // Frame base in vm->stack
+    int depth;               // Frame-relative sp at the header
+    int line;
+
+    TraceIns ir[TRACE_MAX_IR];
+    int ir_count;
+
+    int *slots;              // Current IR value of each local (depth + 1 entries)
+    int *entry;              // TIR_LOCAL of each local, or REF_NONE
+    uint8_t *written;
+
+    int stack[TRACE_MAX_STACK];
+    int sp;                  // Operands above the frame's base depth
+
+    TraceExit exits[TRACE_MAX_EXITS];
+    int exit_first[TRACE_MAX_EXITS];
+    int exit_slots[TRACE_MAX_EXITS];
+    int exit_owner[TRACE_MAX_EXITS];  // IR index of the guard
+    int exit_count;
+
+    TraceSlot snap[TRACE_MAX_SNAP];
+    int snap_count;
+};
+
+static int tir_is_compare(int op) {
+    return op >= TIR_EQ && op <= TIR_GE;
+}
+
+static int tir_has_operands(int op) {
+    return op != TIR_CONST && op != TIR_LOCAL;
+}
+
+static int tir_is_binary(int op) {
+    return tir_has_operands(op) && op != TIR_NEG && op != TIR_GUARD_TRUE && op != TIR_GUARD_FALSE;
+}
+
+/* Bytecode liveness */
+static int local_is_live(VMTracer *t, int pc, int local) {
+    if (local < 0 || local >= t->local_limit || pc < 0 || pc > t->code_size) return 0;
+    return (t->live[(size_t)pc * t->live_words + local / 64] >> (local % 64)) & 1;
+}
+
+static int compute_liveness(VMTracer *t, VM *vm) {
+    int n = vm->code_size;
+    int limit = 0;
+
+    for (int pc = 0; pc < n; pc++) {
+        OpCode op = vm->code[pc].code;
+        if ((op == OP_LOAD_LOCAL || op == OP_STORE_LOCAL) && vm->code[pc].arg >= limit) {
+            limit = vm->code[pc].arg + 1;
+        }
+    }
+
+    t->local_limit = limit;
+    t->live_words = (limit + 63) / 64;
+    if (t->live_words == 0) t->live_words = 1;
+    t->live = (uint64_t*)calloc((size_t)(n + 1) * t->live_words, sizeof(uint64_t));
+    if (!t->live) return 0;
+
+    uint64_t *scratch = (uint64_t*)malloc(sizeof(uint64_t) * t->live_words);
+    if (!scratch) return 0;
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int pc = n - 1; pc >= 0; pc--) {
+            Instruction instr = vm->code[pc];
+            int succ[2] = {-1, -1};
+
+            switch (instr.code) {
+                case OP_HALT:
+                case OP_RETURN:
+                case OP_FIBER_EXIT:
+                    break;
+                case OP_JMP:
+                    succ[0] = instr.arg;
+                    break;
+                case OP_JMP_FALSE:
+                case OP_JMP_TRUE:
+                case OP_TRY:
+                case OP_SPAWN:
+                case OP_ISOLATE:
+                    succ[0] = pc + 1;
+                    succ[1] = instr.arg;
+                    break;
+                case OP_PARALLEL:
+                    succ[0] = pc + 1;
+                    if (instr.arg >= 0 && instr.arg < vm->par_loop_count) {
+                        succ[1] = vm->par_loops[instr.arg].exit_pc;
+                    }
+                    break;
+                default:
+                    succ[0] = pc + 1;
+                    break;
+            }
+
+            memset(scratch, 0, sizeof(uint64_t) * t->live_words);
+            for (int s = 0; s < 2; s++) {
+                if (succ[s] < 0 || succ[s] > n) continue;
+                uint64_t *out = &t->live[(size_t)succ[s] * t->live_words];
+                for (int w = 0; w < t->live_words; w++) scratch[w] |= out[w];
+            }
+
+            if (instr.arg >= 0 && instr.arg < limit) {
+                if (instr.code == OP_STORE_LOCAL) scratch[instr.arg / 64] &= ~(1ULL << (instr.arg % 64));
+                if (instr.code == OP_LOAD_LOCAL) scratch[instr.arg / 64] |= 1ULL << (instr.arg % 64);
+            }
+
+            uint64_t *in = &t->live[(size_t)pc * t->live_words];
+            if (memcmp(in, scratch, sizeof(uint64_t) * t->live_words) != 0) {
+                memcpy(in, scratch, sizeof(uint64_t) * t->live_words);
+                changed = 1;
+            }
+        }
+    }
+
+    free(scratch);
+    return 1;
+}
+
+/* Recording */
+static int rec_emit(TraceRecorder *r, int op, int a, int b, int value) {
+    if (r->ir_count >= TRACE_MAX_IR) return REF_NONE;
+    TraceIns *ins = &r->ir[r->ir_count];
+    ins->op = (uint8_t)op;
+    ins->a = a;
+    ins->b = b;
+    ins->value = value;
+    ins->exit = -1;
+    return r->ir_count++;
+}
+
+static int rec_const(TraceRecorder *r, int value) {
+    return rec_emit(r, TIR_CONST, REF_NONE, REF_NONE, value);
+}
+
+static int rec_is_const(TraceRecorder *r, int ref, int value) {
+    return r->ir[ref].op == TIR_CONST && r->ir[ref].value == value;
+}
+
+static int rec_push(TraceRecorder *r, int ref) {
+    if (ref < 0 || r->sp >= TRACE_MAX_STACK) return 0;
+    r->stack[r->sp++] = ref;
+    return 1;
+}
+
+static int rec_pop(TraceRecorder *r) {
+    return r->sp > 0 ? r->stack[--r->sp] : REF_NONE;
+}
+
+/* Snapshot of the state the interpreter needs to resume at 'pc' */
+static int rec_snapshot(VMTracer *t, TraceRecorder *r, int pc) {
+    if (r->exit_count >= TRACE_MAX_EXITS) return -1;
+
+    int e = r->exit_count;
+    r->exits[e].pc = pc;
+    r->exits[e].line = r->line;
+    r->exits[e].stack_depth = r->sp;
+    r->exits[e].hits = 0;
+    r->exit_first[e] = r->snap_count;
+
+    for (int i = 0; i < r->sp; i++) {
+        if (r->snap_count >= TRACE_MAX_SNAP) return -1;
+        r->snap[r->snap_count].slot = r->depth + 1 + i;
+        r->snap[r->snap_count].ref = r->stack[i];
+        r->snap_count++;
+    }
+    for (int k = 0; k <= r->depth; k++) {
+        if (!local_is_live(t, pc, k)) continue;
+        if (r->slots[k] < 0 && !r->written[k]) {
+            // Untouched so far: memory is current unless a later write in
+            // this iteration makes it loop-carried (decided at close)
+            if (r->snap_count >= TRACE_MAX_SNAP) return -1;
+            r->snap[r->snap_count].slot = k;
+            r->snap[r->snap_count].ref = REF_PENDING;
+            r->snap_count++;
+            continue;
+        }
+        if (r->snap_count >= TRACE_MAX_SNAP) return -1;
+        r->snap[r->snap_count].slot = k;
+        r->snap[r->snap_count].ref = r->slots[k];
+        r->snap_count++;
+    }
+
+    r->exit_slots[e] = r->snap_count - r->exit_first[e];
+    r->exit_count++;
+    return e;
+}
+
+static int fold_binary(int op, int a, int b, int *result) {
+    unsigned int ua = (unsigned int)a, ub = (unsigned int)b;
+
+    switch (op) {
+        case TIR_ADD: *result = (int)(ua + ub); return 1;
+        case TIR_SUB: *result = (int)(ua - ub); return 1;
+        case TIR_MUL: *result = (int)(ua * ub); return 1;
+        case TIR_DIV: if (b == 0 || b == -1) return 0; *result = a / b; return 1;
+        case TIR_MOD: if (b == 0 || b == -1) return 0; *result = a % b; return 1;
+        case TIR_EQ: *result = a == b; return 1;
+        case TIR_NE: *result = a != b; return 1;
+        case TIR_LT: *result = a < b; return 1;
+        case TIR_LE: *result = a <= b; return 1;
+        case TIR_GT: *result = a > b; return 1;
+        case TIR_GE: *result = a >= b; return 1;
+        default: return 0;
+    }
+}
+
+static int invert_compare(int op) {
+    switch (op) {
+        case TIR_EQ: return TIR_NE;
+        case TIR_NE: return TIR_EQ;
+        case TIR_LT: return TIR_GE;
+        case TIR_GE: return TIR_LT;
+        case TIR_GT: return TIR_LE;
+        default: return TIR_GT;  // TIR_LE
+    }
+}
+
+/* Emit a binary op with constant folding and algebraic simplification */
+static int rec_binary(TraceRecorder *r, int op, int a, int b) {
+    int folded;
+
+    if (r->ir[a].op == TIR_CONST && r->ir[b].op == TIR_CONST &&
+        fold_binary(op, r->ir[a].value, r->ir[b].value, &folded)) {
+        return rec_const(r, folded);
+    }
+
+    switch (op) {
+        case TIR_ADD:
+            if (rec_is_const(r, b, 0)) return a;
+            if (rec_is_const(r, a, 0)) return b;
+            break;
+        case TIR_SUB:
+            if (rec_is_const(r, b, 0)) return a;
+            break;
+        case TIR_MUL:
+            if (rec_is_const(r, b, 1)) return a;
+            if (rec_is_const(r, a, 1)) return b;
+            break;
+        case TIR_EQ:
+            // (x cmp y) == 0 is the inverted comparison (how <=, >=, != compile)
+            if (rec_is_const(r, b, 0) && tir_is_compare(r->ir[a].op)) {
+                TraceIns cmp = r->ir[a];
+                return rec_emit(r, invert_compare(cmp.op), cmp.a, cmp.b, 0);
+            }
+            break;
+        default:
+            break;
+    }
+
+    return rec_emit(r, op, a, b, 0);
+}
+
+static void trace_stop(VM *vm) {
+    VMTracer *t = vm->tracer;
+    TraceRecorder *r = t->rec;
+
+    if (r) {
+        free(r->slots);
+        free(r->entry);
+        free(r->written);
+        free(r);
+    }
+    t->rec = NULL;
+    vm->trace_recording = 0;
+}
+
+static void trace_abort(VM *vm, int pc, const char *reason) {
+    VMTracer *t = vm->tracer;
+    int header = t->rec ? t->rec->header : -1;
+
+    if (vm->debug_mode) {
+        fprintf(stderr, "[TRACE] Aborted loop at %d (pc %d: %s)\n", header, pc, reason);
+    }
+    t->abort_count++;
+    if (header >= 0 && ++t->attempts[header] >= TRACE_MAX_ATTEMPTS) {
+        t->hot[header] = -1;
+    }
+    trace_stop(vm);
+}
+
+static int trace_compile(VM *vm, TraceRecorder *r);
+
+static const char* record_instruction(VM *vm, TraceRecorder *r, Instruction instr, int pc) {
+    VMTracer *t = vm->tracer;
+
+    switch (instr.code) {
+        case OP_NOP:
+            return NULL;
+
+        case OP_LINE:
+            r->line = instr.arg;
+            return NULL;
+
+        case OP_PUSH:
+            return rec_push(r, rec_const(r, instr.arg)) ? NULL : "trace too long";
+
+        case OP_POP:
+            return rec_pop(r) >= 0 ? NULL : "pops below the loop's stack";
+
+        case OP_DUP:
+            if (r->sp == 0) return "reads below the loop's stack";
+            return rec_push(r, r->stack[r->sp - 1]) ? NULL : "stack too deep";
+
+        case OP_LOAD_LOCAL: {
+            int k = instr.arg;
+            if (k < 0 || k > r->depth) return "local outside the frame";
+            if (r->slots[k] < 0) {
+                if (vm->stack[r->base + k].type != VAL_INT) return "non-integer local";
+                if (r->entry[k] < 0) r->entry[k] = rec_emit(r, TIR_LOCAL, REF_NONE, REF_NONE, k);
+                r->slots[k] = r->entry[k];
+            }
+            return rec_push(r, r->slots[k]) ? NULL : "stack too deep";
+        }
+
+        case OP_STORE_LOCAL: {
+            int k = instr.arg;
+            if (k < 0 || k > r->depth) return "local outside the frame";
+            int ref = rec_pop(r);
+            if (ref < 0) return "pops below the loop's stack";
+            r->slots[k] = ref;
+            r->written[k] = 1;
+            return NULL;
+        }
+
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_MOD:
+        case OP_EQ:
+        case OP_LT:
+        case OP_GT: {
+            static const int ops[] = {
+                [OP_ADD] = TIR_ADD, [OP_SUB] = TIR_SUB, [OP_MUL] = TIR_MUL,
+                [OP_DIV] = TIR_DIV, [OP_MOD] = TIR_MOD,
+                [OP_EQ] = TIR_EQ, [OP_LT] = TIR_LT, [OP_GT] = TIR_GT
+            };
+            if (r->sp < 2) return "reads below the loop's stack";
+
+            int a = r->stack[r->sp - 2];
+            int b = r->stack[r->sp - 1];
+            int op = ops[instr.code];
+            int exit = -1;
+
+            if (op == TIR_DIV || op == TIR_MOD) {
+                if (rec_is_const(r, b, 0)) return "division by zero";
+                if (r->ir[b].op != TIR_CONST || r->ir[b].value == -1) {
+                    // Divisor check exits before the operands are popped
+                    exit = rec_snapshot(t, r, pc);
+                    if (exit < 0) return "too many exits";
+                }
+            }
+
+            r->sp -= 2;
+            int ref = exit >= 0 ? rec_emit(r, op, a, b, 0) : rec_binary(r, op, a, b);
+            if (ref < 0) return "trace too long";
+            if (exit >= 0) {
+                r->ir[ref].exit = exit;
+                r->exit_owner[exit] = ref;
+            }
+            return rec_push(r, ref) ? NULL : "stack too deep";
+        }
+
+        case OP_NEG: {
+            int a = rec_pop(r);
+            if (a < 0) return "reads below the loop's stack";
+            int ref = r->ir[a].op == TIR_CONST ?
+                      rec_const(r, (int)(0u - (unsigned int)r->ir[a].value)) :
+                      rec_emit(r, TIR_NEG, a, REF_NONE, 0);
+            return rec_push(r, ref) ? NULL : "trace too long";
+        }
+
+        case OP_JMP:
+            if (instr.arg == r->header) {
+                if (r->sp != 0) return "stack depth changes across the loop";
+                return trace_compile(vm, r) ? NULL : "code generation failed";
+            }
+            if (instr.arg <= pc) return "inner loop";
+            return NULL;
+
+        case OP_JMP_FALSE: {
+            Value observed = vm->stack[vm->sp];
+            int cond = rec_pop(r);
+            if (cond < 0) return "reads below the loop's stack";
+            if (observed.type != VAL_INT) return "non-integer condition";
+
+            int taken = observed.as.int_val == 0;
+            if (r->ir[cond].op == TIR_CONST) return NULL;  // Guard folded away
+
+            int exit = rec_snapshot(t, r, taken ? pc + 1 : instr.arg);
+            if (exit < 0) return "too many exits";
+            int ref = rec_emit(r, taken ? TIR_GUARD_FALSE : TIR_GUARD_TRUE, cond, REF_NONE, 0);
+            if (ref < 0) return "trace too long";
+            r->ir[ref].exit = exit;
+            r->exit_owner[exit] = ref;
+            return NULL;
+        }
+
+        default:
+            return "unsupported instruction";
+    }
+}
+
+void vm_trace_record(VM *vm, Instruction instr, int pc) {
+    VMTracer *t = vm->tracer;
+    if (!t || !t->rec) {
+        vm->trace_recording = 0;
+        return;
+    }
+
+    TraceRecorder *r = t->rec;
+    if (instr.line > 0) r->line = instr.line;
+
+    const char *error = record_instruction(vm, r, instr, pc);
+    if (error) {
+        trace_abort(vm, pc, error);
+    }
+}
+
+/* Code generation */
+typedef struct {
+    uint8_t *bytes;
+    size_t len;
+    size_t capacity;
+    int failed;
+} TraceBuf;
+
+typedef enum {
+    LOC_NONE,
+    LOC_REG,
+    LOC_SPILL,               // [rsp + 8 * value]
+    LOC_CONST
+} TraceLocKind;
+
+typedef struct {
+    int kind;
+    int value;
+} TraceLoc;
+
+typedef struct {
+    size_t pos;              // rel32 to patch
+    int exit;                // -1 = loop head
+} TraceFixup;
+
+#define REG_RAX 0
+#define REG_RCX 1
+#define REG_RDX 2
+
+#define SLOT_SIZE    ((int)sizeof(Value))
+#define TYPE_OFFSET  ((int)offsetof(Value, type))
+#define VALUE_OFFSET ((int)offsetof(Value, as))
+
+/* Allocatable registers: rbx holds the frame, rax/rcx/rdx are scratch */
+static const int trace_regs[] = {6, 7, 8, 9, 10, 11, 5, 12, 13, 14, 15};
+#define TRACE_REG_COUNT ((int)(sizeof(trace_regs) / sizeof(trace_regs[0])))
+
+static void tb_emit(TraceBuf *b, const void *data, size_t n) {
+    if (b->failed) return;
+
+    if (b->len + n > b->capacity) {
+        size_t capacity = b->capacity ? b->capacity * 2 : 1024;
+        while (capacity < b->len + n) capacity *= 2;
+        uint8_t *bytes = (uint8_t*)realloc(b->bytes, capacity);
+        if (!bytes) {
+            b->failed = 1;
+            return;
+        }
+        b->bytes = bytes;
+        b->capacity = capacity;
+    }
+    memcpy(b->bytes + b->len, data, n);
+    b->len += n;
+}
+
+static void tb_byte(TraceBuf *b, uint8_t v) {
+    tb_emit(b, &v, 1);
+}
+
+static void tb_u32(TraceBuf *b, int32_t v) {
+    tb_emit(b, &v, 4);
+}
+
+static void emit_rex(TraceBuf *b, int wide, int reg, int rm) {
+    uint8_t rex = 0x40 | (wide ? 0x08 : 0) | (reg >= 8 ? 0x04 : 0) | (rm >= 8 ? 0x01 : 0);
+    if (rex != 0x40) tb_byte(b, rex);
+}
+
+static void emit_modrm(TraceBuf *b, int reg, TraceLoc loc) {
+    if (loc.kind == LOC_REG) {
+        tb_byte(b, 0xC0 | (reg & 7) << 3 | (loc.value & 7));
+    } else {
+        tb_byte(b, 0x84 | (reg & 7) << 3);  // [rsp + disp32]
+        tb_byte(b, 0x24);
+        tb_u32(b, loc.value * 8);
+    }
+}
+
+/* op reg32, r/m32 (or op r/m32, reg32 for store-form opcodes) */
+static void emit_op_rm(TraceBuf *b, const uint8_t *opcode, int oplen, int reg, TraceLoc loc) {
+    emit_rex(b, 0, reg, loc.kind == LOC_REG ? loc.value : 0);
+    tb_emit(b, opcode, oplen);
+    emit_modrm(b, reg, loc);
+}
+
+static void emit_load(TraceBuf *b, int reg, TraceLoc loc) {
+    static const uint8_t mov[] = {0x8B};
+
+    if (loc.kind == LOC_CONST) {
+        emit_rex(b, 0, 0, reg);
+        tb_byte(b, 0xB8 | (reg & 7));
+        tb_u32(b, loc.value);
+        return;
+    }
+    if (loc.kind == LOC_REG && loc.value == reg) return;
+    emit_op_rm(b, mov, 1, reg, loc);
+}
+
+static void emit_store(TraceBuf *b, TraceLoc loc, int reg) {
+    static const uint8_t mov[] = {0x89};
+
+    if (loc.kind == LOC_REG && loc.value == reg) return;
+    emit_op_rm(b, mov, 1, reg, loc);
+}
+
+typedef enum { ALU_ADD, ALU_SUB, ALU_CMP, ALU_IMUL } TraceAlu;
+
+static void emit_alu(TraceBuf *b, TraceAlu alu, int reg, TraceLoc loc) {
+    static const uint8_t add[] = {0x03}, sub[] = {0x2B}, cmp[] = {0x3B}, imul[] = {0x0F, 0xAF};
+    static const int ext[] = {0, 5, 7, 0};
+
+    if (loc.kind == LOC_CONST) {
+        if (alu == ALU_IMUL) {
+            emit_rex(b, 0, reg, reg);
+            tb_byte(b, 0x69);                 // imul reg, reg, imm32
+            tb_byte(b, 0xC0 | (reg & 7) << 3 | (reg & 7));
+        } else {
+            emit_rex(b, 0, 0, reg);
+            tb_byte(b, 0x81);                 // op reg, imm32
+            tb_byte(b, 0xC0 | ext[alu] << 3 | (reg & 7));
+        }
+        tb_u32(b, loc.value);
+        return;
+    }
+
+    switch (alu) {
+        case ALU_ADD: emit_op_rm(b, add, 1, reg, loc); break;
+        case ALU_SUB: emit_op_rm(b, sub, 1, reg, loc); break;
+        case ALU_CMP: emit_op_rm(b, cmp, 1, reg, loc); break;
+        case ALU_IMUL: emit_op_rm(b, imul, 2, reg, loc); break;
+    }
+}
+
+/* mov reg, [rbx + disp] / mov [rbx + disp], reg / mov dword [rbx + disp], imm */
+static void emit_frame_op(TraceBuf *b, uint8_t opcode, int reg, int disp) {
+    emit_rex(b, 0, reg, 0);
+    tb_byte(b, opcode);
+    tb_byte(b, 0x83 | (reg & 7) << 3);
+    tb_u32(b, disp);
+}
+
+static void emit_frame_imm(TraceBuf *b, int disp, int32_t imm) {
+    tb_byte(b, 0xC7);
+    tb_byte(b, 0x83);
+    tb_u32(b, disp);
+    tb_u32(b, imm);
+}
+
+static void emit_jump(TraceBuf *b, TraceFixup *fixups, int *fixup_count, int cc, int exit) {
+    if (cc < 0) {
+        tb_byte(b, 0xE9);
+    } else {
+        tb_byte(b, 0x0F);
+        tb_byte(b, 0x80 | cc);
+    }
+    fixups[*fixup_count].pos = b->len;
+    fixups[*fixup_count].exit = exit;
+    (*fixup_count)++;
+    tb_u32(b, 0);
+}
+
+static int compare_cc(int op) {
+    switch (op) {
+        case TIR_EQ: return 0x4;
+        case TIR_NE: return 0x5;
+        case TIR_LT: return 0xC;
+        case TIR_GE: return 0xD;
+        case TIR_LE: return 0xE;
+        default: return 0xF;     // TIR_GT
+    }
+}
+
+static int loc_equal(TraceLoc x, TraceLoc y) {
+    return x.kind == y.kind && x.value == y.value;
+}
+
+/* Back edge: loop-carried locals take their end-of-iteration values */
+typedef struct {
+    TraceLoc dst;
+    TraceLoc src;
+} TraceMove;
+
+static void emit_parallel_moves(TraceBuf *b, TraceMove *moves, int count) {
+    int pending = count;
+
+    while (pending > 0) {
+        int progress = 0;
+        for (int i = 0; i < pending; i++) {
+            int blocked = 0;
+            for (int j = 0; j < pending; j++) {
+                if (j != i && loc_equal(moves[j].src, moves[i].dst)) blocked = 1;
+            }
+            if (blocked) continue;
+
+            if (moves[i].dst.kind == LOC_REG) {
+                emit_load(b, moves[i].dst.value, moves[i].src);
+            } else {
+                emit_load(b, REG_RAX, moves[i].src);
+                emit_store(b, moves[i].dst, REG_RAX);
+            }
+            moves[i] = moves[--pending];
+            progress = 1;
+            break;
+        }
+
+        if (!progress) {
+            // Every remaining move is on a cycle: park one value in edx
+            TraceLoc parked = moves[0].dst;
+            TraceLoc edx = {LOC_REG, REG_RDX};
+            emit_load(b, REG_RDX, parked);
+            for (int j = 0; j < pending; j++) {
+                if (loc_equal(moves[j].src, parked)) moves[j].src = edx;
+            }
+        }
+    }
+}
+
+static void free_trace(VMTrace *trace) {
+    if (!trace) return;
+    vm_mem_release(trace->code, trace->mapping);
+    free(trace->entry_locals);
+    free(trace->exits);
+    free(trace);
+}
+
+/* Optimize, allocate registers and assemble the recorded loop */
+static int trace_compile(VM *vm, TraceRecorder *r) {
+    VMTracer *t = vm->tracer;
+    int n = r->ir_count;
+
+    // Untouched locals in snapshots: restore them only if the loop writes
+    // them (they are then carried in a register from the previous iteration)
+    for (int i = 0; i < r->snap_count; i++) {
+        TraceSlot *s = &r->snap[i];
+        if (s->slot > r->depth) continue;  // Pending operand
+        if (s->ref >= 0 && r->ir[s->ref].op == TIR_LOCAL && !r->written[s->slot] &&
+            r->ir[s->ref].value == s->slot) {
+            s->ref = REF_NONE;  // Never written by the loop: memory is current
+            continue;
+        }
+        if (s->ref != REF_PENDING) continue;
+        if (!r->written[s->slot]) {
+            s->ref = REF_NONE;
+            continue;
+        }
+        if (r->entry[s->slot] < 0) {
+            r->entry[s->slot] = rec_emit(r, TIR_LOCAL, REF_NONE, REF_NONE, s->slot);
+            if (r->entry[s->slot] < 0) return 0;
+        }
+        s->ref = r->entry[s->slot];
+    }
+    n = r->ir_count;
+
+    int *live = (int*)calloc(n, sizeof(int));
+    int *uses = (int*)calloc(n, sizeof(int));
+    int *fused = (int*)calloc(n, sizeof(int));
+    int *last = (int*)malloc(sizeof(int) * n);
+    TraceLoc *loc = (TraceLoc*)calloc(n, sizeof(TraceLoc));
+    TraceMove *moves = (TraceMove*)malloc(sizeof(TraceMove) * (r->depth + 1));
+    TraceFixup *fixups = (TraceFixup*)malloc(sizeof(TraceFixup) * (2 * n + 2));
+    TraceBuf buf = {0};
+    VMTrace *trace = (VMTrace*)calloc(1, sizeof(VMTrace));
+    int ok = 0;
+
+    if (!live || !uses || !fused || !last || !loc || !moves || !fixups || !trace) goto done;
+
+    // Roots: guards, checked divisions, snapshot values, back-edge values
+    for (int i = 0; i < n; i++) {
+        last[i] = -2;
+        if (r->ir[i].exit >= 0) live[i] = 1;
+    }
+    for (int i = 0; i < r->snap_count; i++) {
+        int ref = r->snap[i].ref;
+        if (ref >= 0) {
+            live[ref] = 1;
+            uses[ref]++;
+        }
+    }
+    for (int k = 0; k <= r->depth; k++) {
+        if (r->entry[k] >= 0 && r->written[k] && r->slots[k] != r->entry[k]) {
+            live[r->slots[k]] = 1;
+            uses[r->slots[k]]++;
+        }
+    }
+
+    // Dead code elimination (operands always precede their users)
+    for (int i = n - 1; i >= 0; i--) {
+        if (!live[i] || !tir_has_operands(r->ir[i].op)) continue;
+        live[r->ir[i].a] = 1;
+        uses[r->ir[i].a]++;
+        if (tir_is_binary(r->ir[i].op)) {
+            live[r->ir[i].b] = 1;
+            uses[r->ir[i].b]++;
+        }
+    }
+
+    // A comparison only tested by one guard becomes a cmp + jcc
+    for (int i = 0; i < n; i++) {
+        TraceIns *ins = &r->ir[i];
+        if ((ins->op == TIR_GUARD_TRUE || ins->op == TIR_GUARD_FALSE) &&
+            tir_is_compare(r->ir[ins->a].op) && uses[ins->a] == 1) {
+            fused[ins->a] = 1;
+        }
+    }
+
+    // Live ranges; TIR_LOCAL values are carried around the whole loop
+    for (int i = 0; i < n; i++) {
+        TraceIns *ins = &r->ir[i];
+        if (!live[i] || fused[i] || !tir_has_operands(ins->op)) continue;
+
+        int operands[4] = {ins->a, tir_is_binary(ins->op) ? ins->b : REF_NONE, REF_NONE, REF_NONE};
+        if (fused[ins->a]) {
+            operands[0] = r->ir[ins->a].a;
+            operands[1] = r->ir[ins->a].b;
+        }
+        for (int j = 0; j < 4; j++) {
+            if (operands[j] >= 0 && last[operands[j]] < i) last[operands[j]] = i;
+        }
+    }
+    for (int e = 0; e < r->exit_count; e++) {
+        for (int i = 0; i < r->exit_slots[e]; i++) {
+            int ref = r->snap[r->exit_first[e] + i].ref;
+            if (ref >= 0 && last[ref] < r->exit_owner[e]) last[ref] = r->exit_owner[e];
+        }
+    }
+    for (int k = 0; k <= r->depth; k++) {
+        if (r->entry[k] >= 0 && r->written[k] && r->slots[k] != r->entry[k]) last[r->slots[k]] = n;
+    }
+
+    // Linear scan allocation
+    int active[TRACE_REG_COUNT];
+    int active_count = 0;
+    int free_regs[TRACE_REG_COUNT];
+    int free_count = 0;
+    int spill_count = 0;
+    for (int i = TRACE_REG_COUNT - 1; i >= 0; i--) free_regs[free_count++] = trace_regs[i];
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < n; i++) {
+            TraceIns *ins = &r->ir[i];
+            if (!live[i] || fused[i] || ins->op == TIR_GUARD_TRUE || ins->op == TIR_GUARD_FALSE) continue;
+            if (ins->op == TIR_CONST) {
+                loc[i].kind = LOC_CONST;
+                loc[i].value = ins->value;
+                continue;
+            }
+            // Carried locals first (start before the loop), then in order
+            if ((pass == 0) != (ins->op == TIR_LOCAL)) continue;
+
+            int start = ins->op == TIR_LOCAL ? -1 : i;
+            int end = ins->op == TIR_LOCAL ? n : last[i];
+
+            for (int j = 0; j < active_count; ) {
+                int other = active[j];
+                int other_end = r->ir[other].op == TIR_LOCAL ? n : last[other];
+                if (other_end <= start) {
+                    free_regs[free_count++] = loc[other].value;
+                    active[j] = active[--active_count];
+                } else {
+                    j++;
+                }
+            }
+
+            if (free_count > 0) {
+                loc[i].kind = LOC_REG;
+                loc[i].value = free_regs[--free_count];
+                active[active_count++] = i;
+                continue;
+            }
+
+            // Spill whichever live value ends last
+            int victim = -1, victim_end = end;
+            for (int j = 0; j < active_count; j++) {
+                int other = active[j];
+                int other_end = r->ir[other].op == TIR_LOCAL ? n : last[other];
+                if (other_end > victim_end) {
+                    victim = j;
+                    victim_end = other_end;
+                }
+            }
+            if (victim >= 0) {
+                int other = active[victim];
+                loc[i] = loc[other];
+                loc[other].kind = LOC_SPILL;
+                loc[other].value = spill_count++;
+                active[victim] = i;
+            } else {
+                loc[i].kind = LOC_SPILL;
+                loc[i].value = spill_count++;
+            }
+        }
+    }
+
+    int frame_size = (spill_count * 8 + 15) & ~15;
+    int fixup_count = 0;
+    TraceBuf *b = &buf;
+
+    // Prologue: int trace(Value *frame)
+    static const uint8_t prologue[] = {0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57};
+    tb_emit(b, prologue, sizeof(prologue));
+    tb_byte(b, 0x48); tb_byte(b, 0x81); tb_byte(b, 0xEC);  // sub rsp, frame_size
+    tb_u32(b, frame_size);
+    tb_byte(b, 0x48); tb_byte(b, 0x89); tb_byte(b, 0xFB);  // mov rbx, rdi
+
+    // Load carried locals (types were checked before entry)
+    int entry_count = 0;
+    trace->entry_locals = (int*)malloc(sizeof(int) * (r->depth + 1));
+    if (!trace->entry_locals) goto done;
+    for (int i = 0; i < n; i++) {
+        if (!live[i] || r->ir[i].op != TIR_LOCAL) continue;
+        int reg = loc[i].kind == LOC_REG ? loc[i].value : REG_RAX;
+        emit_frame_op(b, 0x8B, reg, r->ir[i].value * SLOT_SIZE + VALUE_OFFSET);
+        emit_store(b, loc[i], reg);
+        trace->entry_locals[entry_count++] = r->ir[i].value;
+    }
+    trace->entry_count = entry_count;
+
+    size_t loop_head = b->len;
+
+    for (int i = 0; i < n; i++) {
+        TraceIns *ins = &r->ir[i];
+        if (!live[i] || fused[i]) continue;
+
+        switch (ins->op) {
+            case TIR_CONST:
+            case TIR_LOCAL:
+                break;
+
+            case TIR_ADD:
+            case TIR_SUB:
+            case TIR_MUL: {
+                TraceAlu alu = ins->op == TIR_ADD ? ALU_ADD : ins->op == TIR_SUB ? ALU_SUB : ALU_IMUL;
+                TraceLoc rhs = loc[ins->b];
+                int dst = (loc[i].kind == LOC_REG && !(rhs.kind == LOC_REG && rhs.value == loc[i].value)) ?
+                          loc[i].value : REG_RAX;
+                emit_load(b, dst, loc[ins->a]);
+                emit_alu(b, alu, dst, rhs);
+                emit_store(b, loc[i], dst);
+                break;
+            }
+
+            case TIR_NEG: {
+                int dst = loc[i].kind == LOC_REG ? loc[i].value : REG_RAX;
+                emit_load(b, dst, loc[ins->a]);
+                emit_rex(b, 0, 0, dst);
+                tb_byte(b, 0xF7);                                  // neg dst
+                tb_byte(b, 0xD8 | (dst & 7));
+                emit_store(b, loc[i], dst);
+                break;
+            }
+
+            case TIR_DIV:
+            case TIR_MOD:
+                emit_load(b, REG_RCX, loc[ins->b]);
+                if (ins->exit >= 0) {
+                    tb_byte(b, 0x85); tb_byte(b, 0xC9);                // test ecx, ecx
+                    emit_jump(b, fixups, &fixup_count, 0x4, ins->exit);
+                    tb_byte(b, 0x83); tb_byte(b, 0xF9); tb_byte(b, 0xFF);  // cmp ecx, -1
+                    emit_jump(b, fixups, &fixup_count, 0x4, ins->exit);
+                }
+                emit_load(b, REG_RAX, loc[ins->a]);
+                tb_byte(b, 0x99);                                      // cdq
+                tb_byte(b, 0xF7); tb_byte(b, 0xF9);                    // idiv ecx
+                emit_store(b, loc[i], ins->op == TIR_DIV ? REG_RAX : REG_RDX);
+                break;
+
+            case TIR_GUARD_TRUE:
+            case TIR_GUARD_FALSE: {
+                TraceIns *cond = &r->ir[ins->a];
+                int exit_if_true = ins->op == TIR_GUARD_FALSE;
+                if (fused[ins->a]) {
+                    emit_load(b, REG_RAX, loc[cond->a]);
+                    emit_alu(b, ALU_CMP, REG_RAX, loc[cond->b]);
+                    int cc = compare_cc(cond->op);
+                    emit_jump(b, fixups, &fixup_count, exit_if_true ? cc : cc ^ 1, ins->exit);
+                } else {
+                    emit_load(b, REG_RAX, loc[ins->a]);
+                    tb_byte(b, 0x85); tb_byte(b, 0xC0);                // test eax, eax
+                    emit_jump(b, fixups, &fixup_count, exit_if_true ? 0x5 : 0x4, ins->exit);
+                }
+                break;
+            }
+
+            default: {
+                // Comparison materialized as 0/1
+                emit_load(b, REG_RAX, loc[ins->a]);
+                emit_alu(b, ALU_CMP, REG_RAX, loc[ins->b]);
+                tb_byte(b, 0x0F); tb_byte(b, 0x90 | compare_cc(ins->op)); tb_byte(b, 0xC0);  // setcc al
+                tb_byte(b, 0x0F); tb_byte(b, 0xB6); tb_byte(b, 0xC0);  // movzx eax, al
+                emit_store(b, loc[i], REG_RAX);
+                break;
+            }
+        }
+    }
+
+    // Back edge
+    int move_count = 0;
+    for (int k = 0; k <= r->depth; k++) {
+        int carried = r->entry[k];
+        if (carried < 0 || !live[carried] || !r->written[k] || r->slots[k] == carried) continue;
+        moves[move_count].dst = loc[carried];
+        moves[move_count].src = loc[r->slots[k]];
+        if (!loc_equal(moves[move_count].dst, moves[move_count].src)) move_count++;
+    }
+    emit_parallel_moves(b, moves, move_count);
+    emit_jump(b, fixups, &fixup_count, -1, -1);
+
+    // Side exits write their snapshot into the frame
+    size_t *exit_offset = (size_t*)malloc(sizeof(size_t) * (r->exit_count + 1));
+    if (!exit_offset) goto done;
+    for (int e = 0; e < r->exit_count; e++) {
+        exit_offset[e] = b->len;
+        for (int i = 0; i < r->exit_slots[e]; i++) {
+            TraceSlot *s = &r->snap[r->exit_first[e] + i];
+            if (s->ref < 0) continue;
+            int disp = s->slot * SLOT_SIZE;
+            if (loc[s->ref].kind == LOC_CONST) {
+                emit_frame_imm(b, disp + VALUE_OFFSET, loc[s->ref].value);
+            } else {
+                int reg = loc[s->ref].kind == LOC_REG ? loc[s->ref].value : REG_RAX;
+                emit_load(b, reg, loc[s->ref]);
+                emit_frame_op(b, 0x89, reg, disp + VALUE_OFFSET);
+            }
+            emit_frame_imm(b, disp + TYPE_OFFSET, VAL_INT);
+        }
+        tb_byte(b, 0xB8);                                      // mov eax, exit
+        tb_u32(b, e);
+        tb_byte(b, 0xE9);                                      // jmp epilogue
+        tb_u32(b, 0);
+    }
+
+    // Epilogue
+    size_t epilogue = b->len;
+    tb_byte(b, 0x48); tb_byte(b, 0x81); tb_byte(b, 0xC4);  // add rsp, frame_size
+    tb_u32(b, frame_size);
+    static const uint8_t pops[] = {0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3};
+    tb_emit(b, pops, sizeof(pops));
+
+    if (b->failed) {
+        free(exit_offset);
+        goto done;
+    }
+
+    for (int i = 0; i < fixup_count; i++) {
+        size_t target = fixups[i].exit < 0 ? loop_head : exit_offset[fixups[i].exit];
+        int32_t rel = (int32_t)((long long)target - (long long)(fixups[i].pos + 4));
+        memcpy(b->bytes + fixups[i].pos, &rel, 4);
+    }
+    for (int e = 0; e < r->exit_count; e++) {
+        // The exit stub's jmp is its last 4 bytes before the next stub
+        size_t end = e + 1 < r->exit_count ? exit_offset[e + 1] : epilogue;
+        int32_t rel = (int32_t)((long long)epilogue - (long long)end);
+        memcpy(b->bytes + end - 4, &rel, 4);
+    }
+    free(exit_offset);
+
+    size_t page = vm_mem_page_size();
+    trace->mapping = (b->len + page - 1) & ~(page - 1);
+    trace->code = (uint8_t*)vm_mem_map(trace->mapping);
+    trace->exits = (TraceExit*)malloc(sizeof(TraceExit) * (r->exit_count ? r->exit_count : 1));
+    if (!trace->code || !trace->exits) goto done;
+    memcpy(trace->code, b->bytes, b->len);
+    if (!vm_mem_protect_exec(trace->code, trace->mapping)) goto done;
+
+    memcpy(trace->exits, r->exits, sizeof(TraceExit) * r->exit_count);
+    trace->exit_count = r->exit_count;
+    trace->header = r->header;
+    trace->depth = r->depth;
+    for (int e = 0; e < r->exit_count; e++) {
+        if (r->exits[e].stack_depth > trace->max_stack) trace->max_stack = r->exits[e].stack_depth;
+    }
+    trace->fn = (TraceFn)(void*)trace->code;
+
+    if (vm_perf_enabled()) {
+        char name[64];
+        VMPerfLine line = {trace->code, vm->code[r->header].line};
+        snprintf(name, sizeof(name), "kotha_trace::loop@%d", r->header);
+        vm_perf_code_load(name, trace->code, b->len, &line, line.line > 0 ? 1 : 0);
+    }
+
+    t->traces[r->header] = trace;
+    t->trace_count++;
+    if (vm->debug_mode) {
+        fprintf(stderr, "[TRACE] Compiled loop at %d: %d IR, %d exits, %d spills, %zu bytes\n",
+                r->header, n, r->exit_count, spill_count, b->len);
+    }
+    trace = NULL;
+    ok = 1;
+
+done:
+    free_trace(trace);
+    free(buf.bytes);
+    free(live);
+    free(uses);
+    free(fused);
+    free(last);
+    free(loc);
+    free(moves);
+    free(fixups);
+    if (ok) trace_stop(vm);
+    return ok;
+}
+
+static void trace_start(VM *vm, int header) {
+    VMTracer *t = vm->tracer;
+    int base = vm->frame_count > 0 ? vm->fp : 0;
+    int depth = vm->sp - base;
+
+    if (depth < 0) return;
+    if (!t->live && !compute_liveness(t, vm)) return;
+
+    TraceRecorder *r = (TraceRecorder*)calloc(1, sizeof(TraceRecorder));
+    if (!r) return;
+    r->slots = (int*)malloc(sizeof(int) * (depth + 1));
+    r->entry = (int*)malloc(sizeof(int) * (depth + 1));
+    r->written = (uint8_t*)calloc(depth + 1, 1);
+    if (!r->slots || !r->entry || !r->written) {
+        free(r->slots);
+        free(r->entry);
+        free(r->written);
+        free(r);
+        return;
+    }
+
+    for (int k = 0; k <= depth; k++) r->slots[k] = r->entry[k] = REF_NONE;
+    r->header = header;
+    r->base = base;
+    r->depth = depth;
+    r->line = vm->current_line;
+
+    t->rec = r;
+    t->hot[header] = 0;
+    vm->trace_recording = 1;
+}
+
+static void trace_run(VM *vm, VMTrace *trace) {
+    int base = vm->frame_count > 0 ? vm->fp : 0;
+
+    if (vm->sp - base != trace->depth) return;
+    if (base + trace->depth + trace->max_stack >= MAX_STACK) return;
+
+    Value *frame = &vm->stack[base];
+    for (int i = 0; i < trace->entry_count; i++) {
+        if (frame[trace->entry_locals[i]].type != VAL_INT) return;
+    }
+
+    TraceExit *exit = &trace->exits[trace->fn(frame)];
+    exit->hits++;
+    trace->runs++;
+    vm->tracer->exit_count++;
+
+    vm->sp = base + trace->depth + exit->stack_depth;
+    vm->ip = exit->pc;
+    if (exit->line > 0) vm->current_line = exit->line;
+}
+
+void vm_trace_loop_edge(VM *vm, int header) {
+    VMTracer *t = vm->tracer;
+
+    if (!t || vm->trace_recording || header < 0 || header >= t->code_size) return;
+
+    if (t->traces[header]) {
+        trace_run(vm, t->traces[header]);
+        return;
+    }
+    if (t->hot[header] < 0) return;
+    if (++t->hot[header] >= TRACE_HOT_LOOP) {
+        trace_start(vm, header);
+    }
+}
+
+VMTracer* vm_trace_create(VM *vm) {
+    if (!vm || vm->code_size <= 0) return NULL;
+
+    VMTracer *t = (VMTracer*)calloc(1, sizeof(VMTracer));
+    if (!t) return NULL;
+    t->code_size = vm->code_size;
+    t->hot = (int*)calloc(vm->code_size, sizeof(int));
+    t->attempts = (uint8_t*)calloc(vm->code_size, 1);
+    t->traces = (VMTrace**)calloc(vm->code_size, sizeof(VMTrace*));
+    if (!t->hot || !t->attempts || !t->traces) {
+        vm_trace_free(t);
+        return NULL;
+    }
+
+    vm->tracer = t;
+    vm->trace_recording = 0;
+    return t;
+}
+
+void vm_trace_free(VMTracer *tracer) {
+    if (!tracer) return;
+
+    if (tracer->rec) {
+        free(tracer->rec->slots);
+        free(tracer->rec->entry);
+        free(tracer->rec->written);
+        free(tracer->rec);
+    }
+    if (tracer->traces) {
+        for (int i = 0; i < tracer->code_size; i++) {
+            free_trace(tracer->traces[i]);
+        }
+    }
+    free(tracer->traces);
+    free(tracer->hot);
+    free(tracer->attempts);
+    free(tracer->live);
+    free(tracer);
+}
+
+#else /* No code generator for this host */
+
+VMTracer* vm_trace_create(VM *vm) {
+    (void)vm;
+    return NULL;
+}
+
+void vm_trace_loop_edge(VM *vm, int header) {
+    (void)vm;
+    (void)header;
+}
+
+void vm_trace_record(VM *vm, Instruction instr, int pc) {
+    (void)instr;
+    (void)pc;
+    vm->trace_recording = 0;
+}
+
+void vm_trace_free(VMTracer *tracer) {
+    (void)tracer;
+}
+
+#endif
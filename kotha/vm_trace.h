@@ -0,0 +1,77 @@
+/*
+ * Kotha VM Tracing JIT Header
+ * Records hot loops as linear traces and compiles them to x86-64
+ */
+
+#ifndef VM_TRACE_H
+#define VM_TRACE_H
+
+#include "vm.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRACE_HOT_LOOP      50    // Backward jumps to a header before recording
+#define TRACE_MAX_ATTEMPTS  3     // Aborted recordings before a loop is blacklisted
+#define TRACE_MAX_IR        1024  // IR instructions per trace
+#define TRACE_MAX_STACK     64    // Operand stack depth inside a trace
+#define TRACE_MAX_EXITS     128
+#define TRACE_MAX_SNAP      4096  // Snapshot entries across all exits
+
+/* Native trace: runs the loop on the frame's slots, returns the exit taken */
+typedef int (*TraceFn)(Value *frame);
+
+/* Side exit: where the interpreter resumes and which slots to restore */
+typedef struct {
+    int pc;
+    int line;                // current_line at the exit (0 = unchanged)
+    int stack_depth;         // Operands left above the trace's base depth
+    int hits;
+} TraceExit;
+
+typedef struct {
+    int header;              // Loop header pc
+    int depth;               // Frame-relative sp at the header
+    int max_stack;           // Largest stack_depth of any exit
+    int *entry_locals;       // Locals the trace reads (must be VAL_INT on entry)
+    int entry_count;
+    TraceExit *exits;
+    int exit_count;
+    uint8_t *code;
+    size_t mapping;
+    TraceFn fn;
+    int runs;
+} VMTrace;
+
+typedef struct TraceRecorder TraceRecorder;
+
+typedef struct VMTracer {
+    int code_size;
+    int *hot;                // Backward-jump counts per header (-1 = blacklisted)
+    uint8_t *attempts;
+    VMTrace **traces;        // Compiled trace per header pc
+
+    // Local liveness over the bytecode (snapshots only restore live locals)
+    uint64_t *live;          // (code_size + 1) * live_words bits
+    int live_words;
+    int local_limit;
+
+    TraceRecorder *rec;      // Active recording, if any
+
+    // Statistics
+    int trace_count;
+    int abort_count;
+    int exit_count;
+} VMTracer;
+
+/* Enable tracing on a VM after codegen. Returns NULL where unsupported. */
+VMTracer* vm_trace_create(VM *vm);
+
+/* Interpreter hook: a backward OP_JMP to 'header' was taken */
+void vm_trace_loop_edge(VM *vm, int header);
+
+/* Interpreter hook while vm->trace_recording: 'instr' at 'pc' is about to run */
+void vm_trace_record(VM *vm, Instruction instr, int pc);
+
+void vm_trace_free(VMTracer *tracer);
+
+#endif /* VM_TRACE_H */
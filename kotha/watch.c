@@ -0,0 +1,462 @@
+/*
+ * Kotha Watch Mode
+ * kotha run --watch keeps the compiler resident and re-runs the script on
+ * every save.
+ *
+ * The file is cut into the same top-level regions as for the language
+ * server (lsp_split): the globals, then each 'kaj' and the main function.
+ * Each region is parsed on its own (kotha_parse_region), seeded with the
+ * symbols the regions before it declared, since the symbol table is flat,
+ * and the result is cached under a hash of its text and of those symbols.
+ * The main function's body is the only code that becomes bytecode in VM
+ * mode, so its unit also keeps the IR-to-bytecode result; each run starts
+ * a fresh VM on that program (vm_share_program). A save therefore costs
+ * the regions whose text changed: editing a function re-parses only that
+ * function, and the main function is recompiled only if it, or a symbol
+ * declared before it, changed. A region that merely moved is reused and
+ * its line numbers (diagnostics, bytecode) are shifted.
+ */
+
+#define _GNU_SOURCE
+#include "watch.h"
+#include "lsp.h"
+#include "ast.h"
+#include "symtab.h"
+#include "ir.h"
+#include "vm.h"
+#include "vm_jit.h"
+#include "vm_trace.h"
+#include "parser.tab.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#define WATCH_SETTLE_MS 50      // Quiet time after a save before rebuilding
+#define WATCH_EVENT_BUFFER 4096
+#define WATCH_KEEP_BUILDS 2     // Builds a unit survives unused (a save undone comes back free)
+
+typedef struct {
+    int line;                // In the file (0 = no line)
+    char *message;
+} WatchDiagnostic;
+
+typedef struct {
+    char *name;
+    SymbolType kind;
+    VarType type;
+    int line;
+} WatchSymbol;
+
+/* One region's parse (and for the main function, its bytecode) */
+typedef struct {
+    unsigned long long key;
+    int line;                // File line the region started on
+    WatchDiagnostic *diagnostics;
+    int diagnostic_count;
+    WatchSymbol *symbols;    // In declaration order
+    int symbol_count;
+    int failed;              // Stopped at a syntax error
+    int used;                // Part of the current version
+    int idle;                // Builds since it was last used
+    VM *program;             // Main function only (NULL if it did not compile)
+} WatchUnit;
+
+typedef struct {
+    const WatchConfig *config;
+    const char *path;
+    WatchUnit **units;
+    int unit_count;
+    // The last build
+    int parsed;
+    int reused;
+    int compiled;            // The main function was recompiled
+    double read_ms, split_ms, parse_ms, ir_ms, codegen_ms;
+} Watcher;
+
+static double watch_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static unsigned long long watch_hash(unsigned long long h, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char*)data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static void watch_free_unit(WatchUnit *unit) {
+    if (!unit) return;
+    for (int i = 0; i < unit->diagnostic_count; i++) free(unit->diagnostics[i].message);
+    for (int i = 0; i < unit->symbol_count; i++) free(unit->symbols[i].name);
+    free(unit->diagnostics);
+    free(unit->symbols);
+    if (unit->program) {
+        vm_free(unit->program);
+        free(unit->program);
+    }
+    free(unit);
+}
+
+static void watch_add_diagnostic(WatchUnit *unit, int line, const char *message) {
+    WatchDiagnostic *list = (WatchDiagnostic*)realloc(unit->diagnostics, sizeof(WatchDiagnostic) * (unit->diagnostic_count + 1));
+    if (!list) return;
+    unit->diagnostics = list;
+    list[unit->diagnostic_count].line = line;
+    list[unit->diagnostic_count].message = strdup(message);
+    unit->diagnostic_count++;
+}
+
+/* Parsing a region */
+
+typedef struct {
+    WatchUnit *unit;
+    WatchUnit **scope;       // The regions before it
+    int scope_count;
+} WatchJob;
+
+static void watch_seed(void *user) {
+    WatchJob *job = (WatchJob*)user;
+    for (int r = 0; r < job->scope_count; r++) {
+        const WatchUnit *unit = job->scope[r];
+        for (int i = 0; i < unit->symbol_count; i++) {
+            insert_symbol_typed(unit->symbols[i].name, unit->symbols[i].kind, unit->symbols[i].type);
+        }
+    }
+}
+
+static void watch_diagnostic(void *user, int line, int syntax, const char *message) {
+    watch_add_diagnostic(((WatchJob*)user)->unit, line, message);
+}
+
+static void watch_symbol(void *user, const Symbol *sym) {
+    WatchUnit *unit = ((WatchJob*)user)->unit;
+    WatchSymbol *list = (WatchSymbol*)realloc(unit->symbols, sizeof(WatchSymbol) * (unit->symbol_count + 1));
+    if (!list) return;
+    unit->symbols = list;
+    list[unit->symbol_count].name = strdup(sym->name);
+    list[unit->symbol_count].kind = sym->type;
+    list[unit->symbol_count].type = sym->value_type;
+    list[unit->symbol_count].line = sym->line_declared;
+    unit->symbol_count++;
+}
+
+static int watch_symbol_compare(const void *a, const void *b) {
+    const WatchSymbol *x = (const WatchSymbol*)a, *y = (const WatchSymbol*)b;
+    if (x->line != y->line) return x->line - y->line;
+    return strcmp(x->name, y->name);
+}
+
+/* The main function's body as bytecode */
+static void watch_compile(Watcher *w, WatchUnit *unit, ASTNode *body) {
+    double start = watch_now_ms();
+    ir_init();
+    ir_generate(body);
+    double generated = watch_now_ms();
+    unit->program = ir_head ? codegen_vm(ir_head) : NULL;
+    ir_free(ir_head);
+    ir_init();
+    w->ir_ms += generated - start;
+    w->codegen_ms += watch_now_ms() - generated;
+    w->compiled = 1;
+    if (!unit->program) watch_add_diagnostic(unit, 0, "Bytecode generation failed");
+}
+
+static WatchUnit* watch_parse(Watcher *w, const char *text, const LspRegion *region,
+                              WatchUnit **scope, int scope_count, unsigned long long key) {
+    WatchUnit *unit = (WatchUnit*)calloc(1, sizeof(WatchUnit));
+    if (!unit) return NULL;
+    unit->key = key;
+    unit->line = region->first_line + 1;
+    if (region->end == region->start) return unit;
+
+    FILE *in = fmemopen((void*)(text + region->start), region->end - region->start, "r");
+    if (!in) {
+        watch_free_unit(unit);
+        return NULL;
+    }
+    WatchJob job = {unit, scope, scope_count};
+    KothaParseHooks hooks = {&job, watch_seed, watch_diagnostic, watch_symbol, unit->line};
+    ASTNode *body = NULL;
+    double start = watch_now_ms();
+    unit->failed = !kotha_parse_region(in, &hooks, region->kind == REGION_MAIN ? &body : NULL);
+    w->parse_ms += watch_now_ms() - start;
+    fclose(in);
+    if (unit->symbol_count > 1) qsort(unit->symbols, unit->symbol_count, sizeof(WatchSymbol), watch_symbol_compare);
+
+    if (region->kind == REGION_MAIN && !unit->failed) watch_compile(w, unit, body);
+    free_ast(body);
+    return unit;
+}
+
+/* A cached unit for a region that now starts on 'line' */
+static void watch_move(WatchUnit *unit, int line) {
+    int delta = line - unit->line;
+    if (delta == 0) return;
+    for (int i = 0; i < unit->diagnostic_count; i++) {
+        if (unit->diagnostics[i].line > 0) unit->diagnostics[i].line += delta;
+    }
+    for (int i = 0; i < unit->symbol_count; i++) unit->symbols[i].line += delta;
+    VM *program = unit->program;
+    for (int pc = 0; program && pc < program->code_size; pc++) {
+        if (program->code[pc].line > 0) program->code[pc].line += delta;
+        if (program->code[pc].code == OP_LINE) program->code[pc].arg += delta;
+    }
+    unit->line = line;
+}
+
+/* Cached unit for 'key' not yet taken by another region, or a new one */
+static WatchUnit* watch_unit(Watcher *w, const char *text, const LspRegion *region,
+                             WatchUnit **scope, int scope_count, unsigned long long key) {
+    for (int i = 0; i < w->unit_count; i++) {
+        WatchUnit *unit = w->units[i];
+        if (unit->key == key && !unit->used) {
+            watch_move(unit, region->first_line + 1);
+            unit->used = 1;
+            w->reused++;
+            return unit;
+        }
+    }
+    WatchUnit **units = (WatchUnit**)realloc(w->units, sizeof(WatchUnit*) * (w->unit_count + 1));
+    if (!units) return NULL;
+    w->units = units;
+    WatchUnit *unit = watch_parse(w, text, region, scope, scope_count, key);
+    if (!unit) return NULL;
+    w->units[w->unit_count++] = unit;
+    unit->used = 1;
+    w->parsed++;
+    if (w->config->debug) {
+        fprintf(stderr, "  parsed %s (line %d)\n", region->name ? region->name : "globals", unit->line);
+    }
+    return unit;
+}
+
+static char* watch_read(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    size_t cap = 4096;
+    char *text = (char*)malloc(cap);
+    *len = 0;
+    while (text) {
+        *len += fread(text + *len, 1, cap - *len, f);
+        if (*len < cap) break;
+        char *grown = (char*)realloc(text, cap * 2);
+        if (!grown) {
+            free(text);
+            text = NULL;
+            break;
+        }
+        text = grown;
+        cap *= 2;
+    }
+    fclose(f);
+    return text;
+}
+
+/* Bring every region up to date and print their diagnostics. Returns the
+ * program to run, or NULL if the file does not compile. */
+static VM* watch_build(Watcher *w) {
+    w->parsed = w->reused = w->compiled = 0;
+    w->parse_ms = w->ir_ms = w->codegen_ms = 0;
+
+    double start = watch_now_ms();
+    size_t len;
+    char *text = watch_read(w->path, &len);
+    w->read_ms = watch_now_ms() - start;
+    if (!text) {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", w->path);
+        return NULL;
+    }
+
+    start = watch_now_ms();
+    LspRegion *regions;
+    int count = lsp_split(text, len, &regions);
+    w->split_ms = watch_now_ms() - start;
+    WatchUnit **scope = count > 0 ? (WatchUnit**)calloc(count, sizeof(WatchUnit*)) : NULL;
+    if (!scope) {
+        fprintf(stderr, "Error: Out of memory\n");
+        if (count > 0) lsp_free_regions(regions, count);
+        free(text);
+        return NULL;
+    }
+
+    for (int i = 0; i < w->unit_count; i++) w->units[i]->used = 0;
+
+    // A region's key covers its text and every symbol declared before it
+    int ok = 1, scope_count = 0;
+    unsigned long long symbols = watch_hash(14695981039346656037ULL, "S", 1);
+    WatchUnit *main_unit = NULL;
+    for (int r = 0; r < count && ok; r++) {
+        const LspRegion *region = &regions[r];
+        unsigned long long key = watch_hash(symbols, text + region->start, region->end - region->start);
+        WatchUnit *unit = watch_unit(w, text, region, scope, scope_count, key);
+        if (!unit) {
+            fprintf(stderr, "Error: Out of memory\n");
+            ok = 0;
+            break;
+        }
+        scope[scope_count++] = unit;
+        for (int i = 0; i < unit->symbol_count; i++) {
+            const WatchSymbol *s = &unit->symbols[i];
+            symbols = watch_hash(symbols, s->name, strlen(s->name) + 1);
+            symbols = watch_hash(symbols, &s->kind, sizeof(s->kind));
+            symbols = watch_hash(symbols, &s->type, sizeof(s->type));
+        }
+        if (region->kind == REGION_MAIN) main_unit = unit;
+    }
+
+    for (int r = 0; r < scope_count; r++) {
+        const WatchUnit *unit = scope[r];
+        for (int i = 0; i < unit->diagnostic_count; i++) {
+            const WatchDiagnostic *d = &unit->diagnostics[i];
+            if (d->line > 0) {
+                fprintf(stderr, "%s:%d: %s\n", w->path, d->line, d->message);
+            } else {
+                fprintf(stderr, "%s: %s\n", w->path, d->message);
+            }
+        }
+        if (unit->failed) ok = 0;
+    }
+    if (ok && !main_unit) {
+        fprintf(stderr, "%s: No main function\n", w->path);
+        ok = 0;
+    }
+
+    // Drop the units of text that has been gone for a while
+    int kept = 0;
+    for (int i = 0; i < w->unit_count; i++) {
+        WatchUnit *unit = w->units[i];
+        unit->idle = unit->used ? 0 : unit->idle + 1;
+        if (unit->idle < WATCH_KEEP_BUILDS) {
+            w->units[kept++] = unit;
+        } else {
+            watch_free_unit(unit);
+        }
+    }
+    w->unit_count = kept;
+
+    free(scope);
+    lsp_free_regions(regions, count);
+    free(text);
+    return ok ? main_unit->program : NULL;
+}
+
+/* One run on a fresh VM sharing the cached bytecode */
+static void watch_execute(Watcher *w, const VM *program) {
+    const WatchConfig *config = w->config;
+    VM *vm = (VM*)malloc(sizeof(VM));
+    if (!vm) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return;
+    }
+    vm_init(vm);
+    vm_share_program(vm, program);
+    vm->gc_max_pause_us = config->gc_max_pause_us;
+    vm->gc_slice_objects = config->gc_slice_objects;
+    vm->gc_threads = config->gc_threads;
+    vm->par_threads = config->par_threads;
+
+    if (config->trace_jit && !vm_trace_create(vm)) {
+        fprintf(stderr, "Warning: Tracing JIT unavailable on this platform, using the interpreter\n");
+    }
+    VMJit *jit = NULL;
+    if (config->jit) {
+        jit = vm_jit_compile(vm);
+        if (!jit) fprintf(stderr, "Warning: JIT unavailable on this platform, using the interpreter\n");
+    }
+    if (jit) {
+        vm_jit_run(jit, vm);
+    } else {
+        vm_run(vm);
+    }
+    vm_jit_free(jit);
+    vm_free(vm);   // Joins isolates, which may still print
+    free(vm);
+    fflush(stdout);
+}
+
+static void watch_once(Watcher *w) {
+    fprintf(stderr, "▶️  Running %s...\n", w->path);
+    VM *program = watch_build(w);
+    double run_ms = 0;
+    if (program) {
+        double start = watch_now_ms();
+        watch_execute(w, program);
+        run_ms = watch_now_ms() - start;
+    }
+
+    fprintf(stderr, "⏱  read %.2f ms, split %.2f ms, parse %.2f ms (%d of %d regions)",
+            w->read_ms, w->split_ms, w->parse_ms, w->parsed, w->parsed + w->reused);
+    if (w->compiled) {
+        fprintf(stderr, ", ir %.2f ms, codegen %.2f ms", w->ir_ms, w->codegen_ms);
+    } else if (program) {
+        fprintf(stderr, ", bytecode reused");
+    }
+    if (program) {
+        fprintf(stderr, ", run %.2f ms\n", run_ms);
+    } else {
+        fprintf(stderr, ", not run\n");
+    }
+}
+
+/* Block until 'name' is written or renamed into place, then until the
+ * directory has been quiet for WATCH_SETTLE_MS. Returns 0 on error. */
+static int watch_wait(int fd, const char *name) {
+    char buffer[WATCH_EVENT_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+    while (!changed) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        for (char *p = buffer; p < buffer + n; ) {
+            const struct inotify_event *event = (const struct inotify_event*)p;
+            if (event->len > 0 && strcmp(event->name, name) == 0) changed = 1;
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    // Editors often write a file in several steps
+    struct pollfd pfd = {fd, POLLIN, 0};
+    while (poll(&pfd, 1, WATCH_SETTLE_MS) > 0) {
+        if (read(fd, buffer, sizeof(buffer)) < 0 && errno != EINTR) return 0;
+    }
+    return 1;
+}
+
+int watch_run(const char *path, const WatchConfig *config) {
+    // Watch the directory: saving by rename replaces the file's inode
+    const char *slash = strrchr(path, '/');
+    const char *name = slash ? slash + 1 : path;
+    char *dir = slash ? strndup(path, slash > path ? (size_t)(slash - path) : 1) : strdup(".");
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (!dir || fd < 0 || inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        fprintf(stderr, "Error: Cannot watch '%s': %s\n", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        free(dir);
+        return 1;
+    }
+
+    Watcher w;
+    memset(&w, 0, sizeof(w));
+    w.config = config;
+    w.path = path;
+    do {
+        watch_once(&w);
+        fprintf(stderr, "👀 Watching %s for changes (Ctrl-C to stop)\n", path);
+    } while (watch_wait(fd, name));
+
+    fprintf(stderr, "Error: Stopped watching '%s': %s\n", path, strerror(errno));
+    for (int i = 0; i < w.unit_count; i++) watch_free_unit(w.units[i]);
+    free(w.units);
+    close(fd);
+    free(dir);
+    return 1;
+}
@@ -0,0 +1,24 @@
+/*
+ * Kotha Watch Mode Header
+ * kotha run --watch: run a script on the VM and again each time it is saved
+ */
+
+#ifndef WATCH_H
+#define WATCH_H
+
+typedef struct {
+    int jit;                // Run bytecode as native code
+    int trace_jit;          // Compile hot loops to native traces
+    int gc_max_pause_us;
+    int gc_slice_objects;
+    int gc_threads;
+    int par_threads;        // Threads for somantorale loops (0 = one per core)
+    int debug;              // Say which regions were rebuilt
+} WatchConfig;
+
+/* Run 'path', then wait for it to change (inotify) and run it again, with
+ * per-phase timings after each run. Returns only if the file cannot be
+ * watched (exit status 1). */
+int watch_run(const char *path, const WatchConfig *config);
+
+#endif /* WATCH_H */